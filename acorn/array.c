@@ -23,7 +23,7 @@ newarray(u32 n, size_t size)
         return NULL;
     }
 
-    array = malloc(sizeof(Array) + n * size);
+    array = memalloc(sizeof(Array) + n * size);
     if (slow(array == NULL)) {
         return NULL;
     }
@@ -44,10 +44,10 @@ freearray(Array *array)
 
     p = offset(array, sizeof(Array));
     if (array->items != p) {
-        free(array->items);
+        memfree(array->items);
     }
 
-    free(array);
+    memfree(array);
 }
 
 
@@ -87,7 +87,7 @@ grow(Array *array)
 
     p = array->items;
 
-    array->items = malloc(array->size * newalloc);
+    array->items = memalloc(array->size * newalloc);
     if (slow(array->items == NULL)) {
         return ERR;
     }
@@ -98,7 +98,7 @@ grow(Array *array)
     p2 = offset(array, sizeof(Array));
     if (p != p2) {
         /* old items are from different bucket than *array */
-        free(p);
+        memfree(p);
     }
 
     return OK;
@@ -0,0 +1,665 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+
+
+/*
+ * ns and allocations per call of the acorn functions, over input sizes
+ * that are bytes for strings and formats, items for arrays and causes for
+ * errors.  A case runs its function iters times, growing iters until the
+ * run takes MINNS, so setup is spread thin, and the allocations of the
+ * setup are taken out by a run of no calls.  Allocations are counted by
+ * memstats().  Where the result has to be freed, the free is part of the
+ * call.  With -json, each case is a line
+ * of JSON with the fields of the text columns.
+ */
+
+
+#define MINNS       20000000
+#define MAXITERS    (1 << 26)
+
+#define MAXSIZE     4096
+
+
+typedef struct {
+    const char  *name;
+    void        (*run)(u32 size, u64 iters);
+    u8          sized;      /* or run once with size 0 */
+} Case;
+
+
+static void measure(const Case *c, u32 size, u8 json);
+static void benchzmalloc(u32 size, u64 iters);
+static void benchcopy(u32 size, u64 iters);
+static void benchnewstring(u32 size, u64 iters);
+static void benchallocstring(u32 size, u64 iters);
+static void benchstrset(u32 size, u64 iters);
+static void benchappendc(u32 size, u64 iters);
+static void benchappendcstr(u32 size, u64 iters);
+static void benchappend(u32 size, u64 iters);
+static void benchnewarray(u32 size, u64 iters);
+static void bencharrayadd(u32 size, u64 iters);
+static void bencharrayget(u32 size, u64 iters);
+static void bencharrayset(u32 size, u64 iters);
+static void bencharraydel(u32 size, u64 iters);
+static void benchshrinkarray(u32 size, u64 iters);
+static void benchnewerror(u32 size, u64 iters);
+static void bencherror(u32 size, u64 iters);
+static void benchiserror(u32 size, u64 iters);
+static void benchcfmtint(u32 size, u64 iters);
+static void benchcfmtcstr(u32 size, u64 iters);
+static void benchcfmtstring(u32 size, u64 iters);
+static void benchcfmterror(u32 size, u64 iters);
+static void benchcfmtbuf(u32 size, u64 iters);
+static void benchpcfmt(u32 size, u64 iters);
+static void benchfmtint(u32 size, u64 iters);
+static Array *filled(u32 n, u32 nalloc);
+static Error *chain(u32 n);
+static u64 now();
+
+
+static const Case  cases[] = {
+    { "zmalloc",        benchzmalloc,       1 },
+    { "copy",           benchcopy,          1 },
+    { "newstring",      benchnewstring,     1 },
+    { "allocstring",    benchallocstring,   1 },
+    { "strset",         benchstrset,        1 },
+    { "appendc",        benchappendc,       1 },
+    { "appendcstr",     benchappendcstr,    1 },
+    { "append",         benchappend,        1 },
+    { "newarray",       benchnewarray,      1 },
+    { "arrayadd",       bencharrayadd,      1 },
+    { "arrayget",       bencharrayget,      1 },
+    { "arrayset",       bencharrayset,      1 },
+    { "arraydel",       bencharraydel,      1 },
+    { "shrinkarray",    benchshrinkarray,   1 },
+    { "newerror",       benchnewerror,      1 },
+    { "error",          bencherror,         1 },
+    { "iserror",        benchiserror,       1 },
+    { "cfmt %d",        benchcfmtint,       0 },
+    { "cfmt %s",        benchcfmtcstr,      1 },
+    { "cfmt %S",        benchcfmtstring,    1 },
+    { "cfmt %e",        benchcfmterror,     1 },
+    { "cfmtbuf",        benchcfmtbuf,       1 },
+    { "pcfmt",          benchpcfmt,         1 },
+    { "fmtint",         benchfmtint,        0 },
+};
+
+
+static const u32  sizes[] = { 16, 256, MAXSIZE };
+
+
+static u8           data[MAXSIZE + 1];
+static char         cstrs[nitems(sizes)][MAXSIZE + 1];
+static volatile u64 sink;
+
+
+int
+main(int argc, char **argv)
+{
+    u8   json;
+    u32  i, j;
+
+    fmtadd('e', errorfmt);
+
+    memtrack(1);
+
+    json = (argc > 1 && strcmp(argv[1], "-json") == 0);
+
+    memset(data, 'a', sizeof(data));
+
+    for (i = 0; i < nitems(sizes); i++) {
+        memset(cstrs[i], 'a', sizes[i]);
+    }
+
+    if (!json) {
+        printf("%-16s %6s %12s %10s %12s %10s\n", "function", "size",
+               "ns/op", "allocs/op", "bytes/op", "iters");
+    }
+
+    for (i = 0; i < nitems(cases); i++) {
+        if (!cases[i].sized) {
+            measure(&cases[i], 0, json);
+            continue;
+        }
+
+        for (j = 0; j < nitems(sizes); j++) {
+            measure(&cases[i], sizes[j], json);
+        }
+    }
+
+    return 0;
+}
+
+
+static void
+measure(const Case *c, u32 size, u8 json)
+{
+    u64       iters, ns, start, allocs, bytes;
+    double    nsop, allocsop, bytesop;
+    MemStats  before, after;
+
+    for (iters = 1; ; iters *= (ns < MINNS / 16) ? 16 : 2) {
+        memstats(&before);
+        start = now();
+
+        c->run(size, iters);
+
+        ns = now() - start;
+
+        memstats(&after);
+
+        if (ns >= MINNS || iters >= MAXITERS) {
+            break;
+        }
+    }
+
+    allocs = after.allocs - before.allocs;
+    bytes = after.bytes - before.bytes;
+
+    /* less those of the setup, by a run of no calls */
+
+    memstats(&before);
+
+    c->run(size, 0);
+
+    memstats(&after);
+
+    allocs -= after.allocs - before.allocs;
+    bytes -= after.bytes - before.bytes;
+
+    nsop = (double) ns / iters;
+    allocsop = (double) allocs / iters;
+    bytesop = (double) bytes / iters;
+
+    if (json) {
+        printf("{\"function\":\"%s\",\"size\":%u,\"ns_op\":%.2f,"
+               "\"allocs_op\":%.3f,\"bytes_op\":%.1f,\"iters\":%llu}\n",
+               c->name, size, nsop, allocsop, bytesop,
+               (unsigned long long) iters);
+        return;
+    }
+
+    printf("%-16s %6u %12.2f %10.3f %12.1f %10llu\n", c->name, size, nsop,
+           allocsop, bytesop, (unsigned long long) iters);
+}
+
+
+static void
+benchzmalloc(u32 size, u64 iters)
+{
+    u64   i;
+    void  *p;
+
+    for (i = 0; i < iters; i++) {
+        p = zmalloc(size);
+        sink += (uintptr_t) p;
+        memfree(p);
+    }
+}
+
+
+static void
+benchcopy(u32 size, u64 iters)
+{
+    u64  i;
+    u8   dst[MAXSIZE];
+
+    for (i = 0; i < iters; i++) {
+        data[0] = i;
+        copy(dst, data, size);
+        sink += dst[size - 1];
+    }
+}
+
+
+static void
+benchnewstring(u32 size, u64 iters)
+{
+    u64     i;
+    String  *s;
+
+    for (i = 0; i < iters; i++) {
+        s = newstring(data, size);
+        sink += s->len;
+        memfree(s);
+    }
+}
+
+
+static void
+benchallocstring(u32 size, u64 iters)
+{
+    u64     i;
+    String  *s;
+
+    for (i = 0; i < iters; i++) {
+        s = allocstring(size);
+        sink += s->nalloc;
+        memfree(s);
+    }
+}
+
+
+/*
+ * Into a string that grows on the first call only.
+ */
+static void
+benchstrset(u32 size, u64 iters)
+{
+    u64     i;
+    String  *s;
+
+    s = allocstring(16);
+
+    for (i = 0; i < iters; i++) {
+        s = strset(s, data, size);
+    }
+
+    sink += s->len;
+    memfree(s);
+}
+
+
+/*
+ * One char at a time to a string started anew every size calls, for the
+ * growth to be in the cost.
+ */
+static void
+benchappendc(u32 size, u64 iters)
+{
+    u64     i;
+    String  *s;
+
+    s = allocstring(16);
+
+    for (i = 0; i < iters; i++) {
+        if (i % size == 0) {
+            memfree(s);
+            s = allocstring(16);
+        }
+
+        s = appendc(s, 1, 'a');
+    }
+
+    sink += s->len;
+    memfree(s);
+}
+
+
+/*
+ * Of size chars, to a string emptied after each call.
+ */
+static void
+benchappendcstr(u32 size, u64 iters)
+{
+    u64     i;
+    String  *s;
+
+    s = allocstring(16);
+
+    for (i = 0; i < iters; i++) {
+        s = appendcstr(s, cstrs[(size > 16) + (size > 256)]);
+        s->len = 0;
+    }
+
+    memfree(s);
+}
+
+
+static void
+benchappend(u32 size, u64 iters)
+{
+    u64     i;
+    String  *s, other;
+
+    other.start = data;
+    other.len = size;
+
+    s = allocstring(16);
+
+    for (i = 0; i < iters; i++) {
+        s = append(s, &other);
+        s->len = 0;
+    }
+
+    memfree(s);
+}
+
+
+static void
+benchnewarray(u32 size, u64 iters)
+{
+    u64    i;
+    Array  *a;
+
+    for (i = 0; i < iters; i++) {
+        a = newarray(size, sizeof(u64));
+        sink += a->nalloc;
+        freearray(a);
+    }
+}
+
+
+/*
+ * To an array started anew every size calls, as benchappendc().
+ */
+static void
+bencharrayadd(u32 size, u64 iters)
+{
+    u64    i;
+    Array  *a;
+
+    a = newarray(1, sizeof(u64));
+
+    for (i = 0; i < iters; i++) {
+        if (i % size == 0) {
+            freearray(a);
+            a = newarray(1, sizeof(u64));
+        }
+
+        arrayadd(a, &i);
+    }
+
+    sink += a->len;
+    freearray(a);
+}
+
+
+static void
+bencharrayget(u32 size, u64 iters)
+{
+    u64    i;
+    Array  *a;
+
+    a = filled(size, size);
+
+    for (i = 0; i < iters; i++) {
+        sink += *(u64 *) arrayget(a, i % size);
+    }
+
+    freearray(a);
+}
+
+
+static void
+bencharrayset(u32 size, u64 iters)
+{
+    u64    i;
+    Array  *a;
+
+    a = filled(size, size);
+
+    for (i = 0; i < iters; i++) {
+        arrayset(a, i % size, &i);
+    }
+
+    freearray(a);
+}
+
+
+/*
+ * Of the first item, which moves all the others, put back at the end.
+ */
+static void
+bencharraydel(u32 size, u64 iters)
+{
+    u64    i;
+    Array  *a;
+
+    a = filled(size, size + 1);
+
+    for (i = 0; i < iters; i++) {
+        arraydel(a, 0);
+        arrayadd(a, &i);
+    }
+
+    freearray(a);
+}
+
+
+/*
+ * Of an array at half its room, filled with size items.
+ */
+static void
+benchshrinkarray(u32 size, u64 iters)
+{
+    u64    i;
+    Array  *a;
+
+    for (i = 0; i < iters; i++) {
+        a = newarray(size * 2, sizeof(u64));
+        a->len = size;
+        a = shrinkarray(a);
+        sink += a->nalloc;
+        freearray(a);
+    }
+}
+
+
+static void
+benchnewerror(u32 size, u64 iters)
+{
+    u64    i;
+    Error  *err;
+
+    for (i = 0; i < iters; i++) {
+        err = newerror("%s", cstrs[(size > 16) + (size > 256)]);
+        errorfree(err);
+    }
+}
+
+
+/*
+ * Wrapping a chain started anew every size calls.
+ */
+static void
+bencherror(u32 size, u64 iters)
+{
+    u64    i;
+    Error  *err;
+
+    err = NULL;
+
+    for (i = 0; i < iters; i++) {
+        if (i % size == 0 && err != NULL) {
+            errorfree(err);
+            err = NULL;
+        }
+
+        err = error(err, "wrapped");
+    }
+
+    if (err != NULL) {
+        errorfree(err);
+    }
+}
+
+
+/*
+ * A miss, which walks all size causes.
+ */
+static void
+benchiserror(u32 size, u64 iters)
+{
+    u64    i;
+    Error  *err;
+
+    err = chain(size);
+
+    for (i = 0; i < iters; i++) {
+        sink += iserror(err, "not in the chain");
+    }
+
+    errorfree(err);
+}
+
+
+static void
+benchcfmtint(u32 unused(size), u64 iters)
+{
+    u64     i;
+    String  *s;
+
+    for (i = 0; i < iters; i++) {
+        s = cfmt("value %d", (u32) i);
+        sink += s->len;
+        memfree(s);
+    }
+}
+
+
+static void
+benchcfmtcstr(u32 size, u64 iters)
+{
+    u64     i;
+    String  *s;
+
+    for (i = 0; i < iters; i++) {
+        s = cfmt("%s", cstrs[(size > 16) + (size > 256)]);
+        sink += s->len;
+        memfree(s);
+    }
+}
+
+
+static void
+benchcfmtstring(u32 size, u64 iters)
+{
+    u64     i;
+    String  *s, str;
+
+    str.start = data;
+    str.len = size;
+
+    for (i = 0; i < iters; i++) {
+        s = cfmt("%S", &str);
+        sink += s->len;
+        memfree(s);
+    }
+}
+
+
+/*
+ * Of an error of size causes.
+ */
+static void
+benchcfmterror(u32 size, u64 iters)
+{
+    u64     i;
+    Error   *err;
+    String  *s;
+
+    err = chain(size);
+
+    for (i = 0; i < iters; i++) {
+        s = cfmt("%e", err);
+        sink += s->len;
+        memfree(s);
+    }
+
+    errorfree(err);
+}
+
+
+/*
+ * Into a buffer emptied after each call.
+ */
+static void
+benchcfmtbuf(u32 size, u64 iters)
+{
+    u64     i;
+    String  *buf;
+
+    buf = allocstring(16);
+
+    for (i = 0; i < iters; i++) {
+        buf = cfmtbuf(buf, "%s", cstrs[(size > 16) + (size > 256)]);
+        buf->len = 0;
+    }
+
+    memfree(buf);
+}
+
+
+static void
+benchpcfmt(u32 size, u64 iters)
+{
+    u64      i;
+    String   *s;
+    Printer  *printer;
+
+    printer = newprinter();
+
+    for (i = 0; i < iters; i++) {
+        s = pcfmt(printer, "%s", cstrs[(size > 16) + (size > 256)]);
+        sink += s->len;
+        memfree(s);
+    }
+
+    memfree(printer);
+}
+
+
+static void
+benchfmtint(u32 unused(size), u64 iters)
+{
+    u64     i;
+    String  *s;
+
+    for (i = 0; i < iters; i++) {
+        s = fmtint(i * 2654435761u, 10);
+        sink += s->len;
+        memfree(s);
+    }
+}
+
+
+static Array *
+filled(u32 n, u32 nalloc)
+{
+    u64    i;
+    Array  *a;
+
+    a = newarray(nalloc, sizeof(u64));
+
+    for (i = 0; i < n; i++) {
+        arrayadd(a, &i);
+    }
+
+    return a;
+}
+
+
+static Error *
+chain(u32 n)
+{
+    u32    i;
+    Error  *err;
+
+    err = NULL;
+
+    for (i = 0; i < n; i++) {
+        err = error(err, "cause %d", i);
+    }
+
+    return err;
+}
+
+
+static u64
+now()
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -71,14 +71,14 @@ errorfree(Error *err)
     }
 
     if (err->msg) {
-        free(err->msg);
+        memfree(err->msg);
     }
 
     if (err->cause) {
         errorfree(err->cause);
     }
 
-    free(err);
+    memfree(err);
 }
 
 
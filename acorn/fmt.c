@@ -118,7 +118,7 @@ newprinter()
 {
     Printer  *printer;
 
-    printer = malloc(sizeof(Printer) + sizeof(Formatter) * MAXFMT);
+    printer = memalloc(sizeof(Printer) + sizeof(Formatter) * MAXFMT);
     if (slow(printer == NULL)) {
         return NULL;
     }
@@ -176,7 +176,7 @@ pcfmt(Printer *printer, const char *format, ...)
     s = vpfmt(printer, sfmt, args);
     va_end(args);
 
-    free(sfmt);
+    memfree(sfmt);
 
     return s;
 }
@@ -232,7 +232,7 @@ cfmtbuf(String *buf, const char *format, ...)
     s = vpfmtbuf(&defaultprinter, buf, sfmt, args);
     va_end(args);
 
-    free(sfmt);
+    memfree(sfmt);
 
     return s;
 }
@@ -257,7 +257,7 @@ cfmt(const char *format, ...)
     s = vfmt(sfmt, args);
     va_end(args);
 
-    free(sfmt);
+    memfree(sfmt);
 
     return s;
 }
@@ -274,7 +274,7 @@ cvfmt(const char *format, va_list args)
     }
 
     s = vfmt(sfmt, args);
-    free(sfmt);
+    memfree(sfmt);
     return s;
 }
 
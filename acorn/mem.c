@@ -6,6 +6,22 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#define usable(p)   malloc_size(p)
+#else
+#include <malloc.h>
+#define usable(p)   malloc_usable_size(p)
+#endif
+
+
+static void counted(void *p, size_t size);
+static void uncounted(void *p);
+
+
+static u8        tracking;
+static MemStats  stats;
+
 
 void *
 copy(void *dst, const void *src, size_t n)
@@ -23,7 +39,7 @@ zmalloc(size_t size)
 {
     void  *ptr;
 
-    ptr = malloc(size);
+    ptr = memalloc(size);
     if (slow(ptr == NULL)) {
         return NULL;
     }
@@ -32,3 +48,127 @@ zmalloc(size_t size)
 
     return ptr;
 }
+
+
+void *
+memalloc(size_t size)
+{
+    void  *ptr;
+
+    ptr = malloc(size);
+
+    if (slow(__atomic_load_n(&tracking, __ATOMIC_RELAXED))
+        && fast(ptr != NULL))
+    {
+        counted(ptr, size);
+    }
+
+    return ptr;
+}
+
+
+/*
+ * As a free of the old block and an alloc of the new one.  The old block
+ * is taken out of live before it is handed to realloc(), which may free
+ * it, and put back if realloc() fails.
+ */
+void *
+memrealloc(void *p, size_t size)
+{
+    u8      track;
+    void    *ptr;
+    size_t  old;
+
+    track = __atomic_load_n(&tracking, __ATOMIC_RELAXED);
+
+    old = 0;
+
+    if (slow(track) && p != NULL) {
+        old = usable(p);
+        __atomic_sub_fetch(&stats.live, old, __ATOMIC_RELAXED);
+    }
+
+    ptr = realloc(p, size);
+
+    if (fast(!track)) {
+        return ptr;
+    }
+
+    if (slow(ptr == NULL)) {
+        __atomic_add_fetch(&stats.live, old, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    if (old != 0) {
+        __atomic_add_fetch(&stats.frees, 1, __ATOMIC_RELAXED);
+    }
+
+    counted(ptr, size);
+
+    return ptr;
+}
+
+
+void
+memfree(void *p)
+{
+    if (slow(__atomic_load_n(&tracking, __ATOMIC_RELAXED)) && p != NULL) {
+        uncounted(p);
+    }
+
+    free(p);
+}
+
+
+/*
+ * Blocks allocated before tracking began and freed after take live below
+ * zero, so it is to be turned on before what is to be measured.
+ */
+void
+memtrack(u8 on)
+{
+    if (on) {
+        memset(&stats, 0, sizeof(MemStats));
+    }
+
+    __atomic_store_n(&tracking, on, __ATOMIC_SEQ_CST);
+}
+
+
+void
+memstats(MemStats *s)
+{
+    s->allocs = __atomic_load_n(&stats.allocs, __ATOMIC_RELAXED);
+    s->frees = __atomic_load_n(&stats.frees, __ATOMIC_RELAXED);
+    s->bytes = __atomic_load_n(&stats.bytes, __ATOMIC_RELAXED);
+    s->live = __atomic_load_n(&stats.live, __ATOMIC_RELAXED);
+    s->peak = __atomic_load_n(&stats.peak, __ATOMIC_RELAXED);
+}
+
+
+static void
+counted(void *p, size_t size)
+{
+    i64  live, peak;
+
+    __atomic_add_fetch(&stats.allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats.bytes, size, __ATOMIC_RELAXED);
+
+    live = __atomic_add_fetch(&stats.live, usable(p), __ATOMIC_RELAXED);
+    peak = __atomic_load_n(&stats.peak, __ATOMIC_RELAXED);
+
+    while (live > peak
+           && !__atomic_compare_exchange_n(&stats.peak, &peak, live, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+        /* peak was reloaded */
+    }
+}
+
+
+static void
+uncounted(void *p)
+{
+    __atomic_add_fetch(&stats.frees, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&stats.live, usable(p), __ATOMIC_RELAXED);
+}
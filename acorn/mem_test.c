@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <acorn/array.h>
+
+
+static Error *test_counts();
+static Error *test_untracked();
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_counts();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_untracked();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e", err);
+    return 1;
+}
+
+
+static Error *
+test_counts()
+{
+    u32       i;
+    i64       peak;
+    void      *p;
+    Array     *a;
+    String    *s;
+    MemStats  st;
+
+    memtrack(1);
+
+    s = newstring((const u8 *) "hello", 5);
+    a = newarray(1, sizeof(u32));
+    p = memalloc(16);
+    p = memrealloc(p, 4096);
+
+    /* the items outgrow the Array, into blocks of their own */
+
+    for (i = 0; i < 100; i++) {
+        arrayadd(a, &i);
+    }
+
+    memstats(&st);
+
+    peak = st.peak;
+
+    if (slow(st.allocs < 5 || st.bytes < 4096 + 100 * sizeof(u32)
+             || st.live < 4096 || st.peak < st.live))
+    {
+        memfree(s);
+        memfree(p);
+        freearray(a);
+        memtrack(0);
+        return newerror("%d allocs of %d bytes, %d live, %d at peak",
+                        (u32) st.allocs, (u32) st.bytes, (u32) st.live,
+                        (u32) st.peak);
+    }
+
+    memfree(s);
+    memfree(p);
+    freearray(a);
+
+    memstats(&st);
+    memtrack(0);
+
+    if (slow(st.frees != st.allocs || st.live != 0 || st.peak != peak)) {
+        return newerror("%d allocs, %d frees, %d live after freeing all",
+                        (u32) st.allocs, (u32) st.frees, (u32) st.live);
+    }
+
+    return NULL;
+}
+
+
+static Error *
+test_untracked()
+{
+    void      *p;
+    MemStats  st;
+
+    memtrack(1);
+    memtrack(0);
+
+    p = memalloc(64);
+    p = memrealloc(p, 128);
+    memfree(p);
+
+    memstats(&st);
+
+    if (slow(st.allocs != 0 || st.frees != 0 || st.bytes != 0)) {
+        return newerror("counted %d allocs with tracking off",
+                        (u32) st.allocs);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <acorn.h>
+#include <acorn/perf.h>
+
+
+/*
+ * Cycles and instructions are opened as a group, cycles leading, so that
+ * they are always on the PMU together and IPC compares counts of the same
+ * stretch of time.  Cache and branch misses are opened on their own, so
+ * that one the CPU lacks does not take the others with it, and without
+ * cycles, instructions are counted alone.  When there are more counters
+ * than the PMU has room for, the kernel takes turns with them, and the
+ * counts are scaled by the time each was enabled over the time it ran.
+ */
+
+
+#if defined(__linux__)
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+
+static int perfevent(u64 config, int group);
+
+
+static const u64  configs[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+
+/*
+ * Fails only if no counter opens, with the reason of the first, and then
+ * perf can still be started, stopped and closed, reading nothing.
+ */
+Error *
+perfopen(Perf *perf)
+{
+    int  errnum;
+    u32  i;
+
+    errnum = 0;
+    perf->avail = 0;
+
+    for (i = 0; i < PerfMax; i++) {
+        perf->fds[i] = perfevent(configs[i], (i == PerfInstructions)
+                                             ? perf->fds[PerfCycles] : -1);
+
+        if (fast(perf->fds[i] != -1)) {
+            perf->avail |= 1 << i;
+
+        } else if (errnum == 0) {
+            errnum = errno;
+        }
+    }
+
+    if (slow(perf->avail == 0)) {
+        return newerror("no performance counters: %s", strerror(errnum));
+    }
+
+    return NULL;
+}
+
+
+/*
+ * The group goes on and off through its leader, all at once.
+ */
+void
+perfstart(Perf *perf)
+{
+    u32  i;
+
+    for (i = 0; i < PerfMax; i++) {
+        if (perf->fds[i] == -1
+            || (i == PerfInstructions && perf->fds[PerfCycles] != -1))
+        {
+            continue;
+        }
+
+        ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+
+void
+perfstop(Perf *perf, PerfCounts *counts)
+{
+    u32  i;
+    u64  val[3];    /* value, time enabled, time running */
+
+    for (i = 0; i < PerfMax; i++) {
+        if (perf->fds[i] == -1
+            || (i == PerfInstructions && perf->fds[PerfCycles] != -1))
+        {
+            continue;
+        }
+
+        ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    counts->avail = 0;
+
+    for (i = 0; i < PerfMax; i++) {
+        counts->counts[i] = 0;
+
+        if (perf->fds[i] == -1
+            || read(perf->fds[i], val, sizeof(val)) != sizeof(val))
+        {
+            continue;
+        }
+
+        if (val[2] != 0 && val[2] < val[1]) {
+            val[0] = (double) val[0] * val[1] / val[2];
+        }
+
+        counts->counts[i] = val[0];
+        counts->avail |= 1 << i;
+    }
+}
+
+
+void
+perfclose(Perf *perf)
+{
+    u32  i;
+
+    for (i = 0; i < PerfMax; i++) {
+        if (perf->fds[i] != -1) {
+            close(perf->fds[i]);
+            perf->fds[i] = -1;
+        }
+    }
+
+    perf->avail = 0;
+}
+
+
+/*
+ * A member of the group of `group`, disabled only through its leader, or a
+ * leader or a counter of its own if group is -1.
+ */
+static int
+perfevent(u64 config, int group)
+{
+    struct perf_event_attr  attr;
+
+    memset(&attr, 0, sizeof(struct perf_event_attr));
+
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(struct perf_event_attr);
+    attr.config = config;
+    attr.disabled = (group == -1);
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                       | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+
+#else
+
+
+Error *
+perfopen(Perf *perf)
+{
+    u32  i;
+
+    for (i = 0; i < PerfMax; i++) {
+        perf->fds[i] = -1;
+    }
+
+    perf->avail = 0;
+
+    return newerror("no performance counters on this platform");
+}
+
+
+void
+perfstart(Perf * unused(perf))
+{
+}
+
+
+void
+perfstop(Perf * unused(perf), PerfCounts *counts)
+{
+    memset(counts, 0, sizeof(PerfCounts));
+}
+
+
+void
+perfclose(Perf * unused(perf))
+{
+}
+
+
+#endif
+
+
+const char *
+perfname(PerfCounter counter)
+{
+    switch (counter) {
+    case PerfCycles:
+        return "cycles";
+
+    case PerfInstructions:
+        return "instructions";
+
+    case PerfCacheMisses:
+        return "cache-misses";
+
+    case PerfBranchMisses:
+        return "branch-misses";
+
+    default:
+        return "unknown";
+    }
+}
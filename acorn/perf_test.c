@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <acorn/perf.h>
+
+
+static Error *test_region();
+static Error *test_closed();
+
+
+static volatile u64  sink;
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_region();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_closed();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e", err);
+    return 1;
+}
+
+
+/*
+ * Counters may well be missing here, as in containers and VMs, and then
+ * the region must still read, as nothing.
+ */
+static Error *
+test_region()
+{
+    u32         i;
+    Perf        perf;
+    Error       *err;
+    PerfCounts  counts;
+
+    err = perfopen(&perf);
+    if (err != NULL) {
+        cprint("perf_test: %e, counting nothing\n", err);
+        errorfree(err);
+        err = NULL;
+    }
+
+    perfstart(&perf);
+
+    for (i = 0; i < 1000000; i++) {
+        sink += i;
+    }
+
+    perfstop(&perf, &counts);
+
+    if (slow(counts.avail != perf.avail)) {
+        err = newerror("read %d of the %d counters open", counts.avail,
+                       perf.avail);
+        goto done;
+    }
+
+    for (i = 0; i < PerfMax; i++) {
+        if (slow(!(counts.avail & (1 << i)) && counts.counts[i] != 0)) {
+            err = newerror("%s unavailable but read %d", perfname(i),
+                           (u32) counts.counts[i]);
+            goto done;
+        }
+    }
+
+    /* a million adds take at least a million instructions */
+
+    if (slow((counts.avail & (1 << PerfInstructions))
+             && counts.counts[PerfInstructions] < 1000000))
+    {
+        err = newerror("%d instructions in the region",
+                       (u32) counts.counts[PerfInstructions]);
+    }
+
+done:
+
+    perfclose(&perf);
+
+    return err;
+}
+
+
+static Error *
+test_closed()
+{
+    Perf        perf;
+    Error       *err;
+    PerfCounts  counts;
+
+    err = perfopen(&perf);
+    if (err != NULL) {
+        errorfree(err);
+    }
+
+    perfclose(&perf);
+    perfstart(&perf);
+    perfstop(&perf, &counts);
+
+    if (slow(counts.avail != 0 || perf.avail != 0)) {
+        return newerror("closed counters still read");
+    }
+
+    return NULL;
+}
@@ -33,7 +33,7 @@ cprint(const char *format, ...)
 
     if (fast(s != NULL)) {
         print(s);
-        free(s);
+        memfree(s);
     }
 }
 
@@ -55,5 +55,5 @@ vprint(String *format, va_list args)
      */
     (void)(write(1, res->start, res->len) + 1);
 
-    free(res);
+    memfree(res);
 }
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/sha256.h>
+
+
+static Error *test_vectors();
+static Error *test_million();
+static Error *check(const u8 *data, size_t size, const char *want);
+
+
+/* FIPS 180-4 examples, and lengths either side of the padding boundary */
+
+static const struct {
+    const char  *data;
+    const char  *digest;
+} vectors[] = {
+    { "",
+      "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+    { "abc",
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+      "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+    { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+      "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+      "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+};
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_vectors();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_million();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e", err);
+    return 1;
+}
+
+
+static Error *
+test_vectors()
+{
+    u32    i;
+    Error  *err;
+
+    for (i = 0; i < nitems(vectors); i++) {
+        err = check((const u8 *) vectors[i].data, strlen(vectors[i].data),
+                    vectors[i].digest);
+        if (slow(err != NULL)) {
+            return error(err, "vector %d", i);
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * A million "a", so that most of it goes through whole blocks.
+ */
+static Error *
+test_million()
+{
+    u8     *data;
+    Error  *err;
+
+    data = malloc(1000000);
+    if (slow(data == NULL)) {
+        return newerror("failed to allocate");
+    }
+
+    memset(data, 'a', 1000000);
+
+    err = check(data, 1000000, "cdc76e5c9914fb9281a1c7e284d73e67"
+                               "f1809a48a497200e046d39ccc7112cd0");
+
+    free(data);
+
+    return err;
+}
+
+
+static Error *
+check(const u8 *data, size_t size, const char *want)
+{
+    u8    digest[SHA256_SIZE];
+    u32   i;
+    char  hex[SHA256_SIZE * 2 + 1];
+
+    sha256(data, size, digest);
+
+    for (i = 0; i < SHA256_SIZE; i++) {
+        snprintf(hex + i * 2, 3, "%02x", digest[i]);
+    }
+
+    if (slow(strcmp(hex, want) != 0)) {
+        return newerror("%d bytes hashed to %s", (u32) size, hex);
+    }
+
+    return NULL;
+}
@@ -40,7 +40,7 @@ allocstring(size_t size)
 {
     String  *s;
 
-    s = malloc(sizeof(String) + size);
+    s = memalloc(sizeof(String) + size);
     if (slow(s == NULL)) {
         return NULL;
     }
@@ -160,6 +160,6 @@ grow(String *s, size_t newsize)
     new->nalloc = newsize;
 
     memcpy(new->start, s->start, s->len);
-    free(s);
+    memfree(s);
     return new;
 }
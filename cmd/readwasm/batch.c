@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include "readwasm.h"
+
+
+/*
+ * Files the workers may get ahead of the one being written out, which
+ * bounds the output held in memory.
+ */
+#define WINDOW  256
+
+#define RESULTSIZE  4096
+
+
+typedef struct {
+    Out             out;
+    Error           *err;
+    u8              done;
+} Result;
+
+
+typedef struct {
+    char            **paths;
+    u32             npaths;
+    Options         opts;
+    Result          *results;
+    u32             next;       /* next file to take */
+    u32             written;    /* files written out so far */
+    Error           *err;       /* of adding up stats */
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} Batch;
+
+
+static void *work(void *arg);
+
+
+/*
+ * Runs the options on every path on a pool of opts->nthreads threads and
+ * writes the results in the order of the paths, each after a line with the
+ * path.  A file that fails does not stop the others, but the batch fails.
+ */
+Error *
+batch(char **paths, u32 npaths, const Options *opts, Out *out)
+{
+    u32        i, n, nthreads, nfailed;
+    Batch      b;
+    Result     *r;
+    pthread_t  tids[MAXTHREADS];
+
+    memset(&b, 0, sizeof(Batch));
+
+    b.paths = paths;
+    b.npaths = npaths;
+    b.opts = *opts;
+    b.opts.nthreads = 1;        /* files, not functions, are split */
+
+    b.results = calloc(npaths + 1, sizeof(Result));
+    if (slow(b.results == NULL)) {
+        return newerror("failed to allocate results: %s", strerror(errno));
+    }
+
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.cond, NULL);
+
+    nthreads = (opts->nthreads > MAXTHREADS) ? MAXTHREADS : opts->nthreads;
+
+    if (nthreads > npaths) {
+        nthreads = npaths;
+    }
+
+    for (n = 0; n < nthreads; n++) {
+        errno = pthread_create(&tids[n], NULL, work, &b);
+        if (slow(errno != 0)) {
+            break;
+        }
+    }
+
+    /* with no thread, this one does the work, window aside */
+
+    if (n == 0) {
+        b.written = npaths;
+        work(&b);
+        b.written = 0;
+    }
+
+    nfailed = 0;
+
+    for (i = 0; i < npaths; i++) {
+        r = &b.results[i];
+
+        pthread_mutex_lock(&b.lock);
+
+        while (!r->done) {
+            pthread_cond_wait(&b.cond, &b.lock);
+        }
+
+        pthread_mutex_unlock(&b.lock);
+
+        /* records carry the path themselves, and stats come at the end */
+
+        if (opts->format == FormatText
+            && (opts->stats == NULL || r->err != NULL))
+        {
+            outcstr(out, paths[i]);
+            outcstr(out, ":\n");
+        }
+
+        if (r->out.buf != NULL) {
+            outbytes(out, r->out.buf, r->out.len);
+            outfree(&r->out);
+        }
+
+        if (r->err != NULL) {
+            if (opts->format == FormatText) {
+                outfmt(out, "error: %e\n", r->err);
+
+            } else {
+                emiterror(opts, out, paths[i], r->err);
+            }
+
+            errorfree(r->err);
+            nfailed++;
+        }
+
+        pthread_mutex_lock(&b.lock);
+        b.written = i + 1;
+        pthread_cond_broadcast(&b.cond);
+        pthread_mutex_unlock(&b.lock);
+    }
+
+    for (i = 0; i < n; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    pthread_mutex_destroy(&b.lock);
+    pthread_cond_destroy(&b.cond);
+
+    free(b.results);
+
+    if (slow(b.err != NULL)) {
+        return b.err;
+    }
+
+    if (slow(nfailed > 0)) {
+        return newerror("%d of %d files failed", nfailed, npaths);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Reads a list of paths, one per line, skipping empty ones.  The paths
+ * point into buf, to be freed with them.
+ */
+Error *
+readlist(const char *filename, char **buf, char ***paths, u32 *npaths)
+{
+    u8     *p, *end, *line, *data;
+    u32    n;
+    char   **list;
+    File   file;
+    Error  *err;
+
+    err = openfile(&file, filename);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    data = malloc(file.size + 1);
+    list = malloc(sizeof(char *) * (file.size / 2 + 1));
+
+    if (slow(data == NULL || list == NULL)) {
+        free(data);
+        free(list);
+        closefile(&file);
+        return newerror("failed to allocate list: %s", strerror(errno));
+    }
+
+    memcpy(data, file.data, file.size);
+    data[file.size] = '\n';
+
+    end = data + file.size + 1;
+
+    closefile(&file);
+
+    n = 0;
+
+    for (line = p = data; p < end; p++) {
+        if (*p != '\n') {
+            continue;
+        }
+
+        *p = '\0';
+
+        if (p > line && p[-1] == '\r') {
+            p[-1] = '\0';
+        }
+
+        if (*line != '\0') {
+            list[n++] = (char *) line;
+        }
+
+        line = p + 1;
+    }
+
+    if (slow(n == 0)) {
+        free(data);
+        free(list);
+        return newerror("no paths in %s", filename);
+    }
+
+    *buf = (char *) data;
+    *paths = list;
+    *npaths = n;
+
+    return NULL;
+}
+
+
+/*
+ * With stats, each worker counts on its own and adds up to the batch ones
+ * when there are no files left.
+ */
+static void *
+work(void *arg)
+{
+    u32      i;
+    Batch    *b;
+    Error    *err;
+    Result   *r;
+    Options  opts;
+
+    b = arg;
+    opts = b->opts;
+
+    if (opts.stats != NULL) {
+        opts.stats = newstats();
+    }
+
+    for ( ;; ) {
+        i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED);
+        if (i >= b->npaths) {
+            break;
+        }
+
+        pthread_mutex_lock(&b->lock);
+
+        while (i >= b->written + WINDOW) {
+            pthread_cond_wait(&b->cond, &b->lock);
+        }
+
+        pthread_mutex_unlock(&b->lock);
+
+        r = &b->results[i];
+
+        r->err = outinit(&r->out, -1, RESULTSIZE);
+
+        if (r->err == NULL && b->opts.stats != NULL && opts.stats == NULL) {
+            r->err = newerror("failed to allocate stats");
+        }
+
+        if (r->err == NULL) {
+            r->err = run(b->paths[i], &opts, &r->out);
+
+            if (r->err == NULL) {
+                r->err = outflush(&r->out);
+            }
+        }
+
+        pthread_mutex_lock(&b->lock);
+        r->done = 1;
+        pthread_cond_broadcast(&b->cond);
+        pthread_mutex_unlock(&b->lock);
+    }
+
+    if (opts.stats != NULL) {
+        pthread_mutex_lock(&b->lock);
+        err = mergestats(b->opts.stats, opts.stats);
+        pthread_mutex_unlock(&b->lock);
+
+        freestats(opts.stats);
+
+        if (slow(err != NULL)) {
+            pthread_mutex_lock(&b->lock);
+
+            if (b->err == NULL) {
+                b->err = err;
+
+            } else {
+                errorfree(err);
+            }
+
+            pthread_mutex_unlock(&b->lock);
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,471 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/insn.h>
+#include "../../oak/opcodes.h"
+#include "readwasm.h"
+
+
+/*
+ * Functions a worker takes at a time, and chunks the workers may get ahead
+ * of the one being written out, which bounds the output held in memory.
+ */
+#define CHUNK       64
+#define WINDOW      256
+
+#define CHUNKSIZE   4096
+
+
+typedef struct {
+    Out             out;
+    Error           *err;
+    u8              done;
+} Chunk;
+
+
+typedef struct {
+    Module          *m;
+    const String    **names;
+    const u32       *funcs;
+    u32             n;
+    Chunk           *chunks;
+    u32             nchunks;
+    u32             next;       /* next chunk to take */
+    u32             written;    /* chunks written out so far */
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} Disasm;
+
+
+static Error *parallel(Disasm *d, u32 nthreads, Out *out);
+static void *work(void *arg);
+static Error *disasmfunc(Out *o, Module *m, const String **names, u32 index);
+static void imm(Out *o, const Insn *insn);
+static void types(Out *o, const Array *types);
+
+
+/*
+ * Prints the instructions of funcs, indexes in the function space, or of
+ * all the module defines if funcs is NULL.  On more than one thread, the
+ * functions are split in chunks printed in parallel to memory and written
+ * out in order, so the output is the same.
+ */
+Error *
+disassemble(Module *m, const u32 *funcs, u32 n, u32 nthreads, Out *out)
+{
+    u32           i, nfuncs, *all;
+    Error         *err;
+    Disasm        d;
+    ExportDecl    *export;
+    const String  **names;
+
+    nfuncs = m->nimportfuncs + len(m->funcs);
+
+    for (i = 0; funcs != NULL && i < n; i++) {
+        if (slow(funcs[i] >= nfuncs)) {
+            return newerror("unknown function %d", funcs[i]);
+        }
+
+        if (slow(funcs[i] < m->nimportfuncs)) {
+            return newerror("function %d is imported", funcs[i]);
+        }
+    }
+
+    all = NULL;
+
+    if (funcs == NULL) {
+        n = len(m->funcs);
+
+        all = malloc(sizeof(u32) * (n + 1));
+        if (slow(all == NULL)) {
+            return newerror("failed to allocate: %s", strerror(errno));
+        }
+
+        for (i = 0; i < n; i++) {
+            all[i] = m->nimportfuncs + i;
+        }
+
+        funcs = all;
+    }
+
+    names = calloc(nfuncs + 1, sizeof(String *));
+    if (slow(names == NULL)) {
+        free(all);
+        return newerror("failed to allocate: %s", strerror(errno));
+    }
+
+    for (i = 0; i < len(m->exports); i++) {
+        export = arrayget(m->exports, i);
+
+        if (export->kind == Function && export->index < nfuncs) {
+            names[export->index] = export->field;
+        }
+    }
+
+    if (nthreads > MAXTHREADS) {
+        nthreads = MAXTHREADS;
+    }
+
+    if (nthreads > (n + CHUNK - 1) / CHUNK) {
+        nthreads = (n + CHUNK - 1) / CHUNK;
+    }
+
+    err = NULL;
+
+    if (nthreads > 1) {
+        memset(&d, 0, sizeof(Disasm));
+
+        d.m = m;
+        d.names = names;
+        d.funcs = funcs;
+        d.n = n;
+        d.nchunks = (n + CHUNK - 1) / CHUNK;
+
+        err = parallel(&d, nthreads, out);
+
+    } else {
+        for (i = 0; i < n && err == NULL; i++) {
+            err = disasmfunc(out, m, names, funcs[i]);
+        }
+    }
+
+    free(names);
+    free(all);
+
+    return err;
+}
+
+
+/*
+ * Starts the workers once, which take chunks off an atomic cursor, and
+ * writes the chunks out in order as they are done.  After an error, the
+ * remaining chunks are left to no one and the workers are let go.
+ */
+static Error *
+parallel(Disasm *d, u32 nthreads, Out *out)
+{
+    u32        i, t;
+    Chunk      *c;
+    Error      *err;
+    pthread_t  tids[MAXTHREADS];
+
+    d->chunks = calloc(d->nchunks + 1, sizeof(Chunk));
+    if (slow(d->chunks == NULL)) {
+        return newerror("failed to allocate: %s", strerror(errno));
+    }
+
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->cond, NULL);
+
+    for (t = 0; t < nthreads; t++) {
+        errno = pthread_create(&tids[t], NULL, work, d);
+        if (slow(errno != 0)) {
+            break;
+        }
+    }
+
+    /* with no thread, this one does the work, window aside */
+
+    if (t == 0) {
+        d->written = d->nchunks;
+        work(d);
+        d->written = 0;
+    }
+
+    err = NULL;
+
+    for (i = 0; i < d->nchunks && err == NULL; i++) {
+        c = &d->chunks[i];
+
+        pthread_mutex_lock(&d->lock);
+
+        while (!c->done) {
+            pthread_cond_wait(&d->cond, &d->lock);
+        }
+
+        pthread_mutex_unlock(&d->lock);
+
+        if (c->out.buf != NULL) {
+            outbytes(out, c->out.buf, c->out.len);
+            outfree(&c->out);
+        }
+
+        err = c->err;
+        c->err = NULL;
+
+        pthread_mutex_lock(&d->lock);
+
+        d->written = i + 1;
+
+        if (slow(err != NULL)) {
+            __atomic_store_n(&d->next, d->nchunks, __ATOMIC_RELAXED);
+            d->written = d->nchunks;
+        }
+
+        pthread_cond_broadcast(&d->cond);
+        pthread_mutex_unlock(&d->lock);
+    }
+
+    while (t > 0) {
+        pthread_join(tids[--t], NULL);
+    }
+
+    /* what was done past an error */
+
+    for (i = 0; i < d->nchunks; i++) {
+        outfree(&d->chunks[i].out);
+
+        if (d->chunks[i].err != NULL) {
+            errorfree(d->chunks[i].err);
+        }
+    }
+
+    pthread_mutex_destroy(&d->lock);
+    pthread_cond_destroy(&d->cond);
+
+    free(d->chunks);
+
+    return err;
+}
+
+
+static void *
+work(void *arg)
+{
+    u32     i, j, end;
+    Chunk   *c;
+    Disasm  *d;
+
+    d = arg;
+
+    for ( ;; ) {
+        i = __atomic_fetch_add(&d->next, 1, __ATOMIC_RELAXED);
+        if (i >= d->nchunks) {
+            break;
+        }
+
+        pthread_mutex_lock(&d->lock);
+
+        while (i >= d->written + WINDOW) {
+            pthread_cond_wait(&d->cond, &d->lock);
+        }
+
+        pthread_mutex_unlock(&d->lock);
+
+        c = &d->chunks[i];
+
+        end = (d->n - i * CHUNK > CHUNK) ? (i + 1) * CHUNK : d->n;
+
+        c->err = outinit(&c->out, -1, CHUNKSIZE);
+
+        for (j = i * CHUNK; j < end && c->err == NULL; j++) {
+            c->err = disasmfunc(&c->out, d->m, d->names, d->funcs[j]);
+        }
+
+        if (c->err == NULL) {
+            c->err = outflush(&c->out);
+        }
+
+        pthread_mutex_lock(&d->lock);
+        c->done = 1;
+        pthread_cond_broadcast(&d->cond);
+        pthread_mutex_unlock(&d->lock);
+    }
+
+    return NULL;
+}
+
+
+static Error *
+disasmfunc(Out *o, Module *m, const String **names, u32 index)
+{
+    u32         i, depth;
+    Insn        insn;
+    Error       *err;
+    FuncDecl    *func;
+    CodeDecl    *code;
+    InsnIter    it;
+    LocalEntry  *local;
+
+    func = arrayget(m->funcs, index - m->nimportfuncs);
+    code = arrayget(m->codes, index - m->nimportfuncs);
+
+    outcstr(o, "func ");
+    outu64(o, index);
+
+    if (names[index] != NULL) {
+        outcstr(o, " \"");
+        outstr(o, names[index]);
+        outchar(o, '"');
+    }
+
+    outcstr(o, " (");
+    types(o, func->type.params);
+    outcstr(o, ") ");
+
+    if (len(func->type.rets) == 0) {
+        outcstr(o, "nil");
+
+    } else {
+        outchar(o, '(');
+        types(o, func->type.rets);
+        outchar(o, ')');
+    }
+
+    outcstr(o, ":\n");
+
+    for (i = 0; i < len(code->locals); i++) {
+        local = arrayget(code->locals, i);
+
+        outcstr(o, (i == 0) ? " locals: " : ", ");
+        outu64(o, local->count);
+        outchar(o, ' ');
+        outcstr(o, valtype(local->type));
+    }
+
+    if (len(code->locals) > 0) {
+        outchar(o, '\n');
+    }
+
+    depth = 1;
+
+    insniter(&it, code);
+
+    while (!insndone(&it)) {
+        err = insnnext(&it, &insn);
+        if (slow(err != NULL)) {
+            return error(err, "function %d", index);
+        }
+
+        if ((insn.op == OpEnd || insn.op == OpElse) && depth > 0) {
+            depth--;
+        }
+
+        outchar(o, ' ');
+        outhex(o, code->start - m->file.data + insn.offset, 6);
+        outchar(o, ':');
+
+        for (i = 0; i <= depth; i++) {
+            outchar(o, ' ');
+        }
+
+        outcstr(o, opinfo[insn.op].name);
+        imm(o, &insn);
+        outchar(o, '\n');
+
+        if (opinfo[insn.op].imm == ImmBlock || insn.op == OpElse) {
+            depth++;
+        }
+    }
+
+    outchar(o, '\n');
+
+    return NULL;
+}
+
+
+static void
+imm(Out *o, const Insn *insn)
+{
+    u32         i;
+    char        buf[32];
+    float       f32val;
+    double      f64val;
+    const u8    *labels;
+
+    switch (opinfo[insn->op].imm) {
+    case ImmBlock:
+        if (insn->imm.block != Emptyblock) {
+            outcstr(o, " (result ");
+            outcstr(o, valtype(0x80 - insn->imm.block));
+            outchar(o, ')');
+        }
+
+        return;
+
+    case ImmIndex:
+        outchar(o, ' ');
+        outu64(o, insn->imm.index);
+        return;
+
+    case ImmTable:
+        labels = insn->imm.targets;
+
+        for (i = 0; i < insn->imm.ntargets; i++) {
+            outchar(o, ' ');
+            outu64(o, nextlabel(&labels));
+        }
+
+        outchar(o, ' ');
+        outu64(o, insn->imm.index);
+        return;
+
+    case ImmIndirect:
+        outcstr(o, " (type ");
+        outu64(o, insn->imm.index);
+        outchar(o, ')');
+        return;
+
+    case ImmMem8:
+    case ImmMem16:
+    case ImmMem32:
+    case ImmMem64:
+        if (insn->imm.offset != 0) {
+            outcstr(o, " offset=");
+            outu64(o, insn->imm.offset);
+        }
+
+        if (insn->imm.align != (u32) (opinfo[insn->op].imm - ImmMem8)) {
+            outcstr(o, " align=");
+            outu64(o, (u64) 1 << (insn->imm.align & 63));
+        }
+
+        return;
+
+    case ImmI32:
+    case ImmI64:
+        outchar(o, ' ');
+        outi64(o, (i64) insn->imm.value);
+        return;
+
+    case ImmF32:
+        memcpy(&f32val, &insn->imm.value, sizeof(f32val));
+        snprintf(buf, sizeof(buf), " %.9g", f32val);
+        outcstr(o, buf);
+        return;
+
+    case ImmF64:
+        memcpy(&f64val, &insn->imm.value, sizeof(f64val));
+        snprintf(buf, sizeof(buf), " %.17g", f64val);
+        outcstr(o, buf);
+        return;
+    }
+}
+
+
+/*
+ * Comma separated, as in %o(typedecl).
+ */
+static void
+types(Out *o, const Array *types)
+{
+    u32  i;
+
+    for (i = 0; i < len(types); i++) {
+        if (i > 0) {
+            outchar(o, ',');
+        }
+
+        outcstr(o, valtype(*(Type *) arrayget((Array *) types, i)));
+    }
+}
@@ -0,0 +1,499 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include "../../oak/bin.h"
+#include "readwasm.h"
+
+
+/*
+ * Module information as records, one per module, section, type, import,
+ * function and export, in that order.
+ *
+ * As JSON lines, a record is an object on a line of its own, with its kind
+ * in "type" and its fields by name.  Section ids, kinds and value types
+ * are strings there.
+ *
+ * As TLV, a record is its tag byte, the uleb128 size of its fields and the
+ * fields, each a key byte and a value: a uleb128 for numbers, section ids,
+ * kinds and mutability, or a uleb128 size and as many bytes for strings and
+ * lists of value types, these being the binary format type codes.
+ */
+
+
+enum {
+    RecModule = 1,
+    RecSection,
+    RecType,
+    RecImport,
+    RecFunction,
+    RecExport,
+    RecError,
+};
+
+
+enum {
+    KeyFile = 1,
+    KeyVersion,
+    KeyIndex,
+    KeyId,
+    KeyOffset,
+    KeySize,
+    KeyParams,
+    KeyResults,
+    KeyModule,
+    KeyField,
+    KeyKind,
+    KeyTypeIndex,
+    KeyValType,
+    KeyMutable,
+    KeyTarget,
+    KeyMessage,
+    KeySections,
+    KeyTypes,
+    KeyImports,
+    KeyFunctions,
+    KeyExports,
+    KeyCodes,
+    KeyGlobals,
+    KeyStart,
+};
+
+
+typedef struct {
+    Out             *out;
+    u8              format;
+    u8              tag;
+    Out             rec;        /* fields of a TLV record, reused */
+} Writer;
+
+
+static Error *newwriter(Writer *w, u8 format, Out *out);
+static void begin(Writer *w, u8 tag);
+static void end(Writer *w);
+static void putint(Writer *w, u8 key, u64 v);
+static void putstr(Writer *w, u8 key, const u8 *s, size_t n);
+static void putname(Writer *w, u8 key, u32 code, const char *name);
+static void puttypes(Writer *w, u8 key, const Array *types);
+static void putkey(Writer *w, u8 key);
+static void putuleb(Out *o, u64 v);
+static void escape(Out *o, const u8 *s, size_t n);
+static u32 utf8len(const u8 *s, size_t n);
+
+
+static const char  *recnames[] = {
+    NULL, "module", "section", "type", "import", "function", "export",
+    "error",
+};
+
+
+static const char  *keynames[] = {
+    NULL, "file", "version", "index", "id", "offset", "size", "params",
+    "results", "module", "field", "kind", "typeindex", "valtype",
+    "mutable", "target", "message", "sections", "types", "imports",
+    "functions", "exports", "codes", "globals", "start",
+};
+
+
+Error *
+showrecords(const char *filename, const Options *opts, Out *out)
+{
+    u32         i;
+    Error       *err;
+    Module      *m;
+    Writer      w;
+    Section     *s;
+    FuncDecl    *f;
+    ImportDecl  *import;
+    ExportDecl  *export;
+
+    err = loadmodule(&m, filename);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = newwriter(&w, opts->format, out);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        return err;
+    }
+
+    begin(&w, RecModule);
+    putstr(&w, KeyFile, (const u8 *) filename, strlen(filename));
+    putint(&w, KeyVersion, m->version);
+    putint(&w, KeySections, len(m->sects));
+    putint(&w, KeyTypes, len(m->types));
+    putint(&w, KeyImports, len(m->imports));
+    putint(&w, KeyFunctions, len(m->funcs));
+    putint(&w, KeyExports, len(m->exports));
+    putint(&w, KeyCodes, len(m->codes));
+    putint(&w, KeyGlobals, len(m->globals));
+    putint(&w, KeyStart, m->start);
+    end(&w);
+
+    for (i = 0; i < len(m->sects); i++) {
+        s = arrayget(m->sects, i);
+
+        begin(&w, RecSection);
+        putint(&w, KeyIndex, i);
+        putname(&w, KeyId, s->id,
+                (s->id < nitems(sectnames)) ? sectnames[s->id] : "unknown");
+        putint(&w, KeyOffset, s->data - m->file.data);
+        putint(&w, KeySize, s->len);
+        end(&w);
+    }
+
+    for (i = 0; i < len(m->types); i++) {
+        f = arrayget(m->types, i);
+
+        begin(&w, RecType);
+        putint(&w, KeyIndex, i);
+        puttypes(&w, KeyParams, f->type.params);
+        puttypes(&w, KeyResults, f->type.rets);
+        end(&w);
+    }
+
+    for (i = 0; i < len(m->imports); i++) {
+        import = arrayget(m->imports, i);
+
+        begin(&w, RecImport);
+        putint(&w, KeyIndex, i);
+        putstr(&w, KeyModule, import->module->start, import->module->len);
+        putstr(&w, KeyField, import->field->start, import->field->len);
+        putname(&w, KeyKind, import->kind, kindnames[import->kind & 3]);
+
+        if (import->kind == Function) {
+            putint(&w, KeyTypeIndex, import->u.type.index);
+
+        } else if (import->kind == Global) {
+            putname(&w, KeyValType, import->u.global.type,
+                    valtype(import->u.global.type));
+            putint(&w, KeyMutable, import->u.global.mut);
+        }
+
+        end(&w);
+    }
+
+    for (i = 0; i < len(m->funcs); i++) {
+        f = arrayget(m->funcs, i);
+
+        begin(&w, RecFunction);
+        putint(&w, KeyIndex, m->nimportfuncs + i);
+        putint(&w, KeyTypeIndex, f->type.index);
+        end(&w);
+    }
+
+    for (i = 0; i < len(m->exports); i++) {
+        export = arrayget(m->exports, i);
+
+        begin(&w, RecExport);
+        putint(&w, KeyIndex, i);
+        putstr(&w, KeyField, export->field->start, export->field->len);
+        putname(&w, KeyKind, export->kind, kindnames[export->kind & 3]);
+        putint(&w, KeyTarget, export->index);
+        end(&w);
+    }
+
+    outfree(&w.rec);
+    closemodule(m);
+
+    return NULL;
+}
+
+
+/*
+ * An error record in place of the module ones, for those reading the
+ * output not to have to parse text.
+ */
+void
+emiterror(const Options *opts, Out *out, const char *filename, Error *err)
+{
+    Writer  w;
+    String  *msg;
+
+    if (slow(newwriter(&w, opts->format, out) != NULL)) {
+        return;
+    }
+
+    begin(&w, RecError);
+    putstr(&w, KeyFile, (const u8 *) filename, strlen(filename));
+
+    msg = cfmt("%e", err);
+    if (fast(msg != NULL)) {
+        putstr(&w, KeyMessage, msg->start, msg->len);
+        memfree(msg);
+    }
+
+    end(&w);
+
+    outfree(&w.rec);
+}
+
+
+static Error *
+newwriter(Writer *w, u8 format, Out *out)
+{
+    w->out = out;
+    w->format = format;
+    w->rec.buf = NULL;
+    w->rec.err = NULL;
+
+    if (format == FormatTlv) {
+        return outinit(&w->rec, -1, 256);
+    }
+
+    return NULL;
+}
+
+
+static void
+begin(Writer *w, u8 tag)
+{
+    w->tag = tag;
+
+    if (w->format == FormatTlv) {
+        w->rec.len = 0;
+        return;
+    }
+
+    outcstr(w->out, "{\"type\":\"");
+    outcstr(w->out, recnames[tag]);
+    outchar(w->out, '"');
+}
+
+
+static void
+end(Writer *w)
+{
+    if (w->format == FormatTlv) {
+        outchar(w->out, w->tag);
+        putuleb(w->out, w->rec.len);
+        outbytes(w->out, w->rec.buf, w->rec.len);
+        return;
+    }
+
+    outcstr(w->out, "}\n");
+}
+
+
+static void
+putint(Writer *w, u8 key, u64 v)
+{
+    putkey(w, key);
+
+    if (w->format == FormatTlv) {
+        putuleb(&w->rec, v);
+        return;
+    }
+
+    outu64(w->out, v);
+}
+
+
+static void
+putstr(Writer *w, u8 key, const u8 *s, size_t n)
+{
+    putkey(w, key);
+
+    if (w->format == FormatTlv) {
+        putuleb(&w->rec, n);
+        outbytes(&w->rec, s, n);
+        return;
+    }
+
+    outchar(w->out, '"');
+    escape(w->out, s, n);
+    outchar(w->out, '"');
+}
+
+
+/*
+ * Enumerations go by code in TLV and by name in JSON.
+ */
+static void
+putname(Writer *w, u8 key, u32 code, const char *name)
+{
+    if (w->format == FormatTlv) {
+        putint(w, key, code);
+        return;
+    }
+
+    putstr(w, key, (const u8 *) name, strlen(name));
+}
+
+
+static void
+puttypes(Writer *w, u8 key, const Array *types)
+{
+    u32  i;
+    u8   type;
+
+    putkey(w, key);
+
+    if (w->format == FormatTlv) {
+        putuleb(&w->rec, len(types));
+    }
+
+    if (w->format == FormatJson) {
+        outchar(w->out, '[');
+    }
+
+    for (i = 0; i < len(types); i++) {
+        type = *(Type *) arrayget((Array *) types, i);
+
+        if (w->format == FormatTlv) {
+            outchar(&w->rec, type);
+            continue;
+        }
+
+        outcstr(w->out, (i == 0) ? "\"" : ",\"");
+        outcstr(w->out, valtype(type));
+        outchar(w->out, '"');
+    }
+
+    if (w->format == FormatJson) {
+        outchar(w->out, ']');
+    }
+}
+
+
+static void
+putkey(Writer *w, u8 key)
+{
+    if (w->format == FormatTlv) {
+        outchar(&w->rec, key);
+        return;
+    }
+
+    outcstr(w->out, ",\"");
+    outcstr(w->out, keynames[key]);
+    outcstr(w->out, "\":");
+}
+
+
+static void
+putuleb(Out *o, u64 v)
+{
+    u8  buf[10];
+
+    outbytes(o, buf, uleb128encode(v, buf, buf + sizeof(buf)));
+}
+
+
+/*
+ * Names are bytes the spec wants to be UTF-8, which passes through.  Only
+ * what JSON cannot hold in a string is escaped, and bytes that are not
+ * UTF-8, as in a module that is not valid, become U+FFFD each, so the line
+ * stays JSON.
+ */
+static void
+escape(Out *o, const u8 *s, size_t n)
+{
+    u32     len;
+    size_t  i, start;
+
+    static const char  hex[] = "0123456789abcdef";
+
+    for (start = i = 0; i < n; i += len) {
+        len = 1;
+
+        if (fast(s[i] >= 0x20 && s[i] < 0x80 && s[i] != '"'
+                 && s[i] != '\\'))
+        {
+            continue;
+        }
+
+        if (s[i] >= 0x80) {
+            len = utf8len(s + i, n - i);
+            if (fast(len != 0)) {
+                continue;
+            }
+
+            len = 1;
+        }
+
+        outbytes(o, s + start, i - start);
+        start = i + 1;
+
+        if (s[i] >= 0x80) {
+            outcstr(o, "\\ufffd");
+            continue;
+        }
+
+        switch (s[i]) {
+        case '"':
+            outcstr(o, "\\\"");
+            break;
+
+        case '\\':
+            outcstr(o, "\\\\");
+            break;
+
+        case '\n':
+            outcstr(o, "\\n");
+            break;
+
+        case '\t':
+            outcstr(o, "\\t");
+            break;
+
+        default:
+            outcstr(o, "\\u00");
+            outchar(o, hex[s[i] >> 4]);
+            outchar(o, hex[s[i] & 0xf]);
+        }
+    }
+
+    outbytes(o, s + start, n - start);
+}
+
+
+/*
+ * The length of the UTF-8 sequence at s, or 0 if it is not well formed,
+ * which overlong forms, surrogates and code points past U+10FFFF are not.
+ */
+static u32
+utf8len(const u8 *s, size_t n)
+{
+    u8   lo, hi;
+    u32  i, len;
+
+    lo = 0x80;
+    hi = 0xbf;
+
+    if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+        len = 2;
+
+    } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+        len = 3;
+        lo = (s[0] == 0xe0) ? 0xa0 : lo;
+        hi = (s[0] == 0xed) ? 0x9f : hi;
+
+    } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+        len = 4;
+        lo = (s[0] == 0xf0) ? 0x90 : lo;
+        hi = (s[0] == 0xf4) ? 0x8f : hi;
+
+    } else {
+        return 0;
+    }
+
+    if (n < len || s[1] < lo || s[1] > hi) {
+        return 0;
+    }
+
+    for (i = 2; i < len; i++) {
+        if ((s[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+    }
+
+    return len;
+}
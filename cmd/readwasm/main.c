@@ -8,71 +8,287 @@
 #include <acorn.h>
 #include <acorn/array.h>
 #include <oak/module.h>
+#include "readwasm.h"
 
 
 #define fileoffset(m, s)                                                      \
     (s->data - (m)->file.data)
 
 
-static Error *show(const char *filename);
-static Error *showexport(const char *filename, char *fn);
-static ExportDecl *searchexport(Module *m, String *field);
+static Error *show(const char *filename, Out *out);
+static Error *showexport(const char *filename, const char *fn, Out *out);
+static Error *showcode(const char *filename, const Options *opts, Out *out);
+static Error *parsefuncs(const char *list, Options *opts);
+static Error *parseformat(const char *name, Options *opts);
+static char *optvalue(int *argc, char ***argv, char **s);
+static void printmem(void);
 
 
 int
 main(int argc, char **argv)
 {
-    u8     export;
-    char   *s;
-    Error  *err;
+    u8       stats, mem;
+    int      ret;
+    u32      npaths;
+    char     *s, *arg, *buf, **paths;
+    Out      out;
+    Error    *err, *werr;
+    Options  opts;
 
     fmtadd('e', errorfmt);
     fmtadd('o', oakfmt);
 
-    export = 0;
+    memset(&opts, 0, sizeof(Options));
+
+    opts.nthreads = 1;
+
+    stats = 0;
+    mem = 0;
+    err = NULL;
 
     while (--argc > 0 && (++argv)[0][0] == '-') {
         for (s = argv[0] + 1; *s != '\0'; s++) {
             switch (*s) {
             case 'e':
-                export = 1;
+                opts.export = optvalue(&argc, &argv, &s);
+                break;
+
+            case 'd':
+                opts.disasm = 1;
+                break;
+
+            case 'f':
+                arg = optvalue(&argc, &argv, &s);
+                if (arg != NULL) {
+                    err = parsefuncs(arg, &opts);
+                    opts.disasm = 1;
+                }
+
+                break;
+
+            case 'j':
+                arg = optvalue(&argc, &argv, &s);
+                if (arg != NULL) {
+                    opts.nthreads = strtoul(arg, NULL, 10);
+                }
+
+                break;
+
+            case 'b':
+                opts.batch = 1;
+                break;
+
+            case 'l':
+                opts.list = optvalue(&argc, &argv, &s);
+                opts.batch = 1;
                 break;
+
+            case 's':
+                stats = 1;
+                break;
+
+            case 'm':
+                /* from here, as the options may allocate */
+                memtrack(1);
+                mem = 1;
+                break;
+
+            case 'o':
+                arg = optvalue(&argc, &argv, &s);
+                if (arg != NULL) {
+                    err = parseformat(arg, &opts);
+                }
+
+                break;
+
             default:
                 cprint("Illegal option %c\n", *s);
                 argc = 0;
                 break;
             }
+
+            if (s == NULL || err != NULL) {
+                break;
+            }
+        }
+
+        if (s == NULL || err != NULL) {
+            argc = 0;
+            break;
         }
     }
 
-    if (slow(argc < 1)) {
-        cprint("usage: readwasm [-e exportname] <filename>\n");
+    if (slow(err == NULL
+             && ((argc < 1 && opts.list == NULL) || opts.nthreads == 0
+                 || ((opts.disasm || stats) && opts.format != FormatText)
+                 || (opts.disasm && stats))))
+    {
+        cprint("usage: readwasm [-e exportname] [-d] [-s] [-m] [-f funcs] "
+               "[-j threads] "
+               "<filename>\n"
+               "       readwasm -b [options] <filename>...\n"
+               "       readwasm -l listfile [options]\n"
+               "  -d        disassemble all functions, or the export\n"
+               "  -f funcs  disassemble functions by index, as 1,4,10-20\n"
+               "  -s        count opcodes, opcode pairs, LEB128 widths, body "
+               "sizes\n"
+               "            and section bytes over all the files\n"
+               "  -m        print the allocations of acorn and oak to stderr\n"
+               "  -j n      run on n threads\n"
+               "  -b        read all files given, in parallel with -j\n"
+               "  -l file   read the files listed in file, one per line\n"
+               "  -o fmt    print module information as text, json (JSON "
+               "lines) or tlv\n");
+        free(opts.funcs);
         return 1;
     }
 
-    if (export) {
-        err = showexport(argv[1], argv[0]);
+    if (err == NULL && stats) {
+        opts.stats = newstats();
+        if (slow(opts.stats == NULL)) {
+            err = newerror("failed to allocate stats");
+        }
+    }
 
-    } else {
-        err = show(argv[0]);
+    if (err == NULL) {
+        err = outinit(&out, 1, OUTSIZE);
+    }
+
+    if (err == NULL) {
+        if (opts.list != NULL) {
+            err = readlist(opts.list, &buf, &paths, &npaths);
+            if (err == NULL) {
+                err = batch(paths, npaths, &opts, &out);
+                free(paths);
+                free(buf);
+            }
+
+        } else if (opts.batch) {
+            err = batch(argv, argc, &opts, &out);
+
+        } else {
+            err = run(argv[0], &opts, &out);
+
+            if (err != NULL && opts.format != FormatText) {
+                emiterror(&opts, &out, argv[0], err);
+            }
+        }
+
+        /* in a batch, the files that did load count all the same */
+
+        if (opts.stats != NULL && (err == NULL || opts.batch)) {
+            printstats(opts.stats, &out);
+        }
+
+        /* what was printed before an error goes out too */
+
+        werr = outflush(&out);
+
+        if (err == NULL) {
+            err = werr;
+
+        } else if (werr != NULL) {
+            errorfree(werr);
+        }
+
+        outfree(&out);
     }
 
+    free(opts.funcs);
+    freestats(opts.stats);
+
+    ret = 0;
+
     if (slow(err != NULL)) {
-        cprint("error: %e\n", err);
+        /* structured output has its errors in records */
+
+        if (opts.format == FormatText) {
+            cprint("error: %e\n", err);
+        }
+
         errorfree(err);
-        return 1;
+        ret = 1;
     }
 
-    return 0;
+    if (mem) {
+        printmem();
+    }
+
+    return ret;
+}
+
+
+/*
+ * After all is freed, so live is what leaked.
+ */
+static void
+printmem(void)
+{
+    Out       o;
+    Error     *err;
+    MemStats  st;
+
+    memstats(&st);
+
+    err = outinit(&o, 2, 256);
+    if (slow(err != NULL)) {
+        errorfree(err);
+        return;
+    }
+
+    outcstr(&o, "allocs: ");
+    outu64(&o, st.allocs);
+    outcstr(&o, ", frees: ");
+    outu64(&o, st.frees);
+    outcstr(&o, ", bytes: ");
+    outu64(&o, st.bytes);
+    outcstr(&o, ", peak live: ");
+    outi64(&o, st.peak);
+    outcstr(&o, ", live: ");
+    outi64(&o, st.live);
+    outchar(&o, '\n');
+
+    err = outflush(&o);
+    if (err != NULL) {
+        errorfree(err);
+    }
+
+    outfree(&o);
+}
+
+
+/*
+ * Prints what the options ask for about one file.
+ */
+Error *
+run(const char *filename, const Options *opts, Out *out)
+{
+    if (opts->stats != NULL) {
+        return gatherstats(opts->stats, filename);
+    }
+
+    if (opts->disasm) {
+        return showcode(filename, opts, out);
+    }
+
+    if (opts->format != FormatText) {
+        return showrecords(filename, opts, out);
+    }
+
+    if (opts->export != NULL) {
+        return showexport(filename, opts->export, out);
+    }
+
+    return show(filename, out);
 }
 
 
 static Error *
-show(const char *filename)
+show(const char *filename, Out *out)
 {
     u32         i;
     Error       *err;
-    Module      m;
+    Module      *m;
     Section     *s;
     FuncDecl    *f;
     ImportDecl  *import;
@@ -83,61 +299,59 @@ show(const char *filename)
         return err;
     }
 
-    cprint("WASM Binary Information\n\n"
-           "%o\n\n"
-           "Sections (%d):\n", &m, len(m.sects));
-
-    for (i = 0; i < len(m.sects); i++) {
-        s = arrayget(m.sects, i);
-        cprint("\tSection %d\n"
-               "\tId: %o(sectid)\n"
-               "\tOffset: %d\n"
-               "\tLength: %d\n\n",
-               i, s->id, fileoffset(&m, s), len(s));
+    outfmt(out, "WASM Binary Information\n\n"
+                "%o\n\n"
+                "Sections (%d):\n", m, len(m->sects));
+
+    for (i = 0; i < len(m->sects); i++) {
+        s = arrayget(m->sects, i);
+        outfmt(out, "\tSection %d\n"
+                    "\tId: %o(sectid)\n"
+                    "\tOffset: %d\n"
+                    "\tLength: %d\n\n",
+                    i, s->id, fileoffset(m, s), len(s));
     }
 
-    cprint("Types (%d):\n", len(m.types));
+    outfmt(out, "Types (%d):\n", len(m->types));
 
-    for (i = 0; i < len(m.types); i++) {
-        f = arrayget(m.types, i);
-        cprint("\t%d -> func%o(func)\n", i, f);
+    for (i = 0; i < len(m->types); i++) {
+        f = arrayget(m->types, i);
+        outfmt(out, "\t%d -> func%o(func)\n", i, f);
     }
 
-    cprint("\nImports (%d):\n", len(m.imports));
+    outfmt(out, "\nImports (%d):\n", len(m->imports));
 
-    for (i = 0; i < len(m.imports); i++) {
-        import = arrayget(m.imports, i);
-        cprint("\t%d -> %o(import)\n", i, import);
+    for (i = 0; i < len(m->imports); i++) {
+        import = arrayget(m->imports, i);
+        outfmt(out, "\t%d -> %o(import)\n", i, import);
     }
 
-    cprint("\nFunctions (%d):\n", len(m.funcs));
+    outfmt(out, "\nFunctions (%d):\n", len(m->funcs));
 
-    for (i = 0; i < len(m.funcs); i++) {
-        f = arrayget(m.funcs, i);
-        cprint("\t%d -> %o(func)\n", i, f);
+    for (i = 0; i < len(m->funcs); i++) {
+        f = arrayget(m->funcs, i);
+        outfmt(out, "\t%d -> %o(func)\n", i, f);
     }
 
-    cprint("\nExports (%d):\n", len(m.exports));
+    outfmt(out, "\nExports (%d):\n", len(m->exports));
 
-    for (i = 0; i < len(m.exports); i++) {
-        export = arrayget(m.exports, i);
-        cprint("\t%d -> %o(export)\n", i, export);
+    for (i = 0; i < len(m->exports); i++) {
+        export = arrayget(m->exports, i);
+        outfmt(out, "\t%d -> %o(export)\n", i, export);
     }
 
-    closemodule(&m);
+    closemodule(m);
 
     return NULL;
 }
 
 
 static Error *
-showexport(const char *filename, char *funcname)
+showexport(const char *filename, const char *funcname, Out *out)
 {
-    u32         i;
     Error       *err;
     String      field;
-    Module      m;
-    FuncDecl    *fn;
+    Module      *m;
     CodeDecl    *code;
     ExportDecl  *export;
 
@@ -148,28 +362,24 @@ showexport(const char *filename, char *funcname)
         return err;
     }
 
-    export = searchexport(&m, &field);
+    export = findexport(m, &field);
     if (slow(export == NULL)) {
         err = newerror("no export named \"%S\"", &field);
         goto fail;
     }
 
     if (slow(export->kind != Function)) {
-        err = newerror("export is not a function but %o(extkind)", export->kind);
+        err = newerror("export is not a function but %o(extkind)",
+                       export->kind);
         goto fail;
     }
 
-    for (i = 0; i < len(m.funcs); i++) {
-        fn = arrayget(m.funcs, i);
-
-        if (fn->type.index == export->u.type.index) {
-            cprint("found func: %o(func)\n", fn);
+    outfmt(out, "found func: func%o(typedecl)\n", &export->u.type);
 
-            code = arrayget(m.codes, i);
-            if (fast(code != NULL)) {
-                cprint("found code %d\n", i);
-                break;
-            }
+    if (export->index >= m->nimportfuncs) {
+        code = arrayget(m->codes, export->index - m->nimportfuncs);
+        if (fast(code != NULL)) {
+            outfmt(out, "found code %d\n", export->index - m->nimportfuncs);
         }
     }
 
@@ -177,23 +387,140 @@ showexport(const char *filename, char *funcname)
 
 fail:
 
-    closemodule(&m);
+    closemodule(m);
     return err;
 }
 
 
-static ExportDecl *
-searchexport(Module *m, String *field)
+static Error *
+showcode(const char *filename, const Options *opts, Out *out)
 {
-    u32         i;
+    u32         index;
+    Error       *err;
+    String      field;
+    Module      *m;
     ExportDecl  *export;
 
-    for (i = 0; i < len(m->exports); i++) {
-        export = arrayget(m->exports, i);
-        if (stringcmp(export->field, field)) {
-            return export;
+    err = loadmodule(&m, filename);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    if (opts->export == NULL) {
+        err = disassemble(m, opts->funcs, opts->nfuncs, opts->nthreads,
+                          out);
+        goto done;
+    }
+
+    cstr(&field, (u8 *) opts->export);
+
+    export = findexport(m, &field);
+    if (slow(export == NULL || export->kind != Function)) {
+        err = newerror("no function export named \"%S\"", &field);
+        goto done;
+    }
+
+    index = export->index;
+
+    err = disassemble(m, &index, 1, 1, out);
+
+done:
+
+    closemodule(m);
+
+    return err;
+}
+
+
+/*
+ * Comma separated indexes and ranges of them, as 1,4,10-20.
+ */
+static Error *
+parsefuncs(const char *list, Options *opts)
+{
+    u32         n, *funcs;
+    u64         first, last;
+    char        *end;
+    const char  *p;
+
+    n = 0;
+
+    for (p = list; *p != '\0'; p = (*end == ',') ? end + 1 : end) {
+        first = strtoull(p, &end, 10);
+        last = first;
+
+        if (*end == '-') {
+            last = strtoull(end + 1, &end, 10);
+        }
+
+        if (slow(end == p || (*end != ',' && *end != '\0') || last < first
+                 || last > 0xffffffff || n + (last - first) >= (1 << 24)))
+        {
+            return newerror("bad function list \"%s\"", list);
+        }
+
+        funcs = realloc(opts->funcs, sizeof(u32) * (n + last - first + 1));
+        if (slow(funcs == NULL)) {
+            return newerror("failed to allocate function list");
         }
+
+        opts->funcs = funcs;
+
+        while (first <= last) {
+            funcs[n++] = first++;
+        }
+    }
+
+    opts->nfuncs = n;
+
+    return NULL;
+}
+
+
+static Error *
+parseformat(const char *name, Options *opts)
+{
+    if (strcmp(name, "text") == 0) {
+        opts->format = FormatText;
+
+    } else if (strcmp(name, "json") == 0) {
+        opts->format = FormatJson;
+
+    } else if (strcmp(name, "tlv") == 0) {
+        opts->format = FormatTlv;
+
+    } else {
+        return newerror("unknown output format \"%s\"", name);
     }
 
     return NULL;
 }
+
+
+/*
+ * The value of the option at *s, attached as in -j4 or the next argument.
+ * Leaves *s on the last char of the option, or NULL if the value is
+ * missing.
+ */
+static char *
+optvalue(int *argc, char ***argv, char **s)
+{
+    char  *value;
+
+    if ((*s)[1] != '\0') {
+        value = *s + 1;
+        *s = strchr(*s, '\0') - 1;
+        return value;
+    }
+
+    if (slow(*argc <= 1)) {
+        cprint("option -%c needs a value\n", **s);
+        *s = NULL;
+        return NULL;
+    }
+
+    (*argc)--;
+    (*argv)++;
+
+    return (*argv)[0];
+}
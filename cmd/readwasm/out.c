@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include "readwasm.h"
+
+
+static u8 reserve(Out *o, size_t n);
+
+
+/* names shared by the text, JSON and stats output */
+
+const char  *sectnames[NSECTS] = {
+    "custom", "type", "import", "function", "table", "memory", "global",
+    "export", "start", "element", "code", "data",
+};
+
+
+const char  *kindnames[4] = {
+    "function", "table", "memory", "global",
+};
+
+
+Error *
+outinit(Out *o, int fd, size_t size)
+{
+    o->fd = fd;
+    o->len = 0;
+    o->size = size;
+    o->err = NULL;
+
+    o->buf = malloc(size);
+    if (slow(o->buf == NULL)) {
+        return newerror("failed to allocate output buffer: %s",
+                        strerror(errno));
+    }
+
+    return NULL;
+}
+
+
+void
+outfree(Out *o)
+{
+    free(o->buf);
+
+    if (o->err != NULL) {
+        errorfree(o->err);
+    }
+
+    o->buf = NULL;
+    o->err = NULL;
+}
+
+
+void
+outbytes(Out *o, const void *data, size_t n)
+{
+    if (slow(!reserve(o, n))) {
+        return;
+    }
+
+    /* too big to buffer, it goes straight out */
+
+    if (slow(n > o->size)) {
+        if (slow(write(o->fd, data, n) != (ssize_t) n)) {
+            o->err = newerror("failed to write output: %s", strerror(errno));
+        }
+
+        return;
+    }
+
+    memcpy(o->buf + o->len, data, n);
+    o->len += n;
+}
+
+
+void
+outcstr(Out *o, const char *s)
+{
+    outbytes(o, s, strlen(s));
+}
+
+
+void
+outstr(Out *o, const String *s)
+{
+    outbytes(o, s->start, s->len);
+}
+
+
+void
+outchar(Out *o, u8 c)
+{
+    if (fast(o->len < o->size) || reserve(o, 1)) {
+        o->buf[o->len++] = c;
+    }
+}
+
+
+void
+outu64(Out *o, u64 v)
+{
+    u8  digits[20], *p;
+
+    p = digits + sizeof(digits);
+
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+
+    outbytes(o, p, digits + sizeof(digits) - p);
+}
+
+
+void
+outi64(Out *o, i64 v)
+{
+    if (v < 0) {
+        outchar(o, '-');
+        outu64(o, -(u64) v);
+        return;
+    }
+
+    outu64(o, v);
+}
+
+
+/*
+ * Zero padded to width digits, at most 16.
+ */
+void
+outhex(Out *o, u64 v, u32 width)
+{
+    u8  digits[16], *p;
+
+    static const char  hex[] = "0123456789abcdef";
+
+    p = digits + sizeof(digits);
+
+    do {
+        *--p = hex[v & 0xf];
+        v >>= 4;
+    } while (v != 0 || digits + sizeof(digits) - p < width);
+
+    outbytes(o, p, digits + sizeof(digits) - p);
+}
+
+
+/*
+ * Through the acorn formatters, for the %o verbs.  It allocates, so it is
+ * not for what is printed per instruction.
+ */
+void
+outfmt(Out *o, const char *format, ...)
+{
+    String   *s;
+    va_list  args;
+
+    va_start(args, format);
+    s = cvfmt(format, args);
+    va_end(args);
+
+    if (slow(s == NULL)) {
+        if (o->err == NULL) {
+            o->err = newerror("failed to format output");
+        }
+
+        return;
+    }
+
+    outstr(o, s);
+    memfree(s);
+}
+
+
+/*
+ * Writes what is buffered, if there is a file, and hands over the first
+ * error of the writes so far.
+ */
+Error *
+outflush(Out *o)
+{
+    Error  *err;
+
+    if (o->err == NULL && o->fd >= 0 && o->len > 0) {
+        if (slow(write(o->fd, o->buf, o->len) != (ssize_t) o->len)) {
+            o->err = newerror("failed to write output: %s", strerror(errno));
+        }
+
+        o->len = 0;
+    }
+
+    err = o->err;
+    o->err = NULL;
+
+    return err;
+}
+
+
+/*
+ * Makes room for n more bytes, flushing or growing the buffer.  Room for
+ * more than the buffer size is only made when growing.
+ */
+static u8
+reserve(Out *o, size_t n)
+{
+    u8      *buf;
+    size_t  size;
+
+    if (slow(o->err != NULL)) {
+        return 0;
+    }
+
+    if (fast(o->size - o->len >= n)) {
+        return 1;
+    }
+
+    if (o->fd >= 0) {
+        o->err = outflush(o);
+        return o->err == NULL;
+    }
+
+    for (size = o->size * 2; size - o->len < n; size *= 2) {
+        /* void */
+    }
+
+    buf = realloc(o->buf, size);
+    if (slow(buf == NULL)) {
+        o->err = newerror("failed to grow output buffer: %s",
+                          strerror(errno));
+        return 0;
+    }
+
+    o->buf = buf;
+    o->size = size;
+
+    return 1;
+}
+
+
+const char *
+valtype(u8 type)
+{
+    switch (type) {
+    case I32:
+        return "i32";
+
+    case I64:
+        return "i64";
+
+    case F32:
+        return "f32";
+
+    case F64:
+        return "f64";
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _READWASM_H_
+#define _READWASM_H_
+
+
+#include <oak/module.h>
+
+
+#define OUTSIZE         (1 << 16)
+
+#define MAXTHREADS      64
+
+#define NSECTS          12      /* section ids known, custom to data */
+
+
+typedef enum {
+    FormatText = 0,
+    FormatJson,         /* JSON lines */
+    FormatTlv,          /* tag, length and value records */
+} Format;
+
+
+typedef struct Stats  Stats;
+
+
+typedef struct {
+    const char      *export;
+    u8              disasm;
+    u32             nthreads;
+    u32             *funcs;     /* NULL for all */
+    u32             nfuncs;
+    u8              batch;
+    const char      *list;      /* file of paths, one per line */
+    u8              format;
+    Stats           *stats;     /* where -s counts, NULL without it */
+} Options;
+
+
+/*
+ * Output is gathered in one buffer and written with a single write(2) when
+ * it fills up, instead of formatting and writing each line.  With fd < 0
+ * the buffer grows instead, to be copied to another Out later.  The first
+ * failure is kept in err and later writes are dropped.
+ */
+typedef struct {
+    int             fd;
+    u8              *buf;
+    size_t          len;
+    size_t          size;
+    Error           *err;
+} Out;
+
+
+Error   *outinit(Out *o, int fd, size_t size);
+void    outfree(Out *o);
+void    outbytes(Out *o, const void *data, size_t n);
+void    outcstr(Out *o, const char *s);
+void    outstr(Out *o, const String *s);
+void    outchar(Out *o, u8 c);
+void    outu64(Out *o, u64 v);
+void    outi64(Out *o, i64 v);
+void    outhex(Out *o, u64 v, u32 width);
+void    outfmt(Out *o, const char *format, ...);
+Error   *outflush(Out *o);
+
+Error   *run(const char *filename, const Options *opts, Out *out);
+Error   *batch(char **paths, u32 npaths, const Options *opts, Out *out);
+Error   *readlist(const char *filename, char **buf, char ***paths,
+    u32 *npaths);
+
+Error   *showrecords(const char *filename, const Options *opts, Out *out);
+void    emiterror(const Options *opts, Out *out, const char *filename,
+    Error *err);
+
+Stats   *newstats(void);
+void    freestats(Stats *st);
+Error   *gatherstats(Stats *st, const char *filename);
+Error   *mergestats(Stats *dst, const Stats *src);
+void    printstats(Stats *st, Out *o);
+
+Error   *disassemble(Module *m, const u32 *funcs, u32 n, u32 nthreads,
+    Out *out);
+
+const char  *valtype(u8 type);
+
+extern const char  *sectnames[NSECTS];
+extern const char  *kindnames[4];   /* by ExternalKind */
+
+#endif /* _READWASM_H_ */
@@ -0,0 +1,577 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/insn.h>
+#include "../../oak/opcodes.h"
+#include "readwasm.h"
+
+
+#define TOPPAIRS    50
+
+
+/*
+ * Counts over every body of every file read.  Each thread of a batch has
+ * its own, merged at the end, so the counting takes no lock.
+ */
+struct Stats {
+    u64             nfiles;
+    u64             nbytes;
+    u64             ninsns;
+    u64             sects[NSECTS];
+    u64             ops[256];
+    u64             pairs[256 * 256];  /* by first opcode << 8 | second */
+    u64             widths[ImmF64 + 1][11];  /* by kind and bytes, 1-10 */
+    u32             *sizes;     /* of bodies, in code bytes */
+    u64             nsizes;
+    u64             maxsizes;
+};
+
+
+typedef struct {
+    u64             count;
+    u32             key;
+} Count;
+
+
+static Error *bodystats(Stats *st, const CodeDecl *code, u32 index);
+static void widths(Stats *st, u8 kind, const u8 *p, const u8 *end);
+static Error *addsizes(Stats *st, const u32 *sizes, u64 n);
+static void printsects(Stats *st, Out *o);
+static void printsizes(Stats *st, Out *o);
+static void printops(Stats *st, Out *o);
+static void printpairs(Stats *st, Out *o);
+static void printwidths(Stats *st, Out *o);
+static void row(Out *o, const char *name, u32 width, u64 n, u64 total);
+static void count(Out *o, const char *name, u32 width, u64 n);
+static void percent(Out *o, u64 part, u64 whole);
+static int bycount(const void *a, const void *b);
+static int bysize(const void *a, const void *b);
+
+
+/* kinds with uleb128 or sleb128 immediates */
+
+static const char  *immnames[ImmF64 + 1] = {
+    [ImmIndex] = "index",
+    [ImmTable] = "br_table",
+    [ImmIndirect] = "call_indirect",
+    [ImmMem8] = "memarg",
+    [ImmI32] = "i32.const",
+    [ImmI64] = "i64.const",
+};
+
+
+Stats *
+newstats(void)
+{
+    Stats  *st;
+
+    st = calloc(1, sizeof(Stats));
+    if (slow(st == NULL)) {
+        return NULL;
+    }
+
+    st->maxsizes = 1024;
+
+    st->sizes = malloc(sizeof(u32) * st->maxsizes);
+    if (slow(st->sizes == NULL)) {
+        free(st);
+        return NULL;
+    }
+
+    return st;
+}
+
+
+void
+freestats(Stats *st)
+{
+    if (st != NULL) {
+        free(st->sizes);
+        free(st);
+    }
+}
+
+
+/*
+ * Adds the sections and function bodies of a file to st.  Bodies were
+ * validated on load, so walking them does not fail but for a loader bug.
+ */
+Error *
+gatherstats(Stats *st, const char *filename)
+{
+    u32      i;
+    Error    *err;
+    Module   *m;
+    Section  *s;
+
+    err = loadmodule(&m, filename);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    st->nfiles++;
+    st->nbytes += m->file.size;
+
+    for (i = 0; i < len(m->sects); i++) {
+        s = arrayget(m->sects, i);
+
+        if (fast(s->id < NSECTS)) {
+            st->sects[s->id] += s->len;
+        }
+    }
+
+    for (i = 0; i < len(m->codes) && err == NULL; i++) {
+        err = bodystats(st, arrayget(m->codes, i), m->nimportfuncs + i);
+    }
+
+    closemodule(m);
+
+    return err;
+}
+
+
+Error *
+mergestats(Stats *dst, const Stats *src)
+{
+    u32    i, j;
+    Error  *err;
+
+    err = addsizes(dst, src->sizes, src->nsizes);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    dst->nfiles += src->nfiles;
+    dst->nbytes += src->nbytes;
+    dst->ninsns += src->ninsns;
+
+    for (i = 0; i < NSECTS; i++) {
+        dst->sects[i] += src->sects[i];
+    }
+
+    for (i = 0; i < 256; i++) {
+        dst->ops[i] += src->ops[i];
+    }
+
+    for (i = 0; i < 256 * 256; i++) {
+        dst->pairs[i] += src->pairs[i];
+    }
+
+    for (i = 0; i <= ImmF64; i++) {
+        for (j = 0; j < 11; j++) {
+            dst->widths[i][j] += src->widths[i][j];
+        }
+    }
+
+    return NULL;
+}
+
+
+void
+printstats(Stats *st, Out *o)
+{
+    outcstr(o, "Files: ");
+    outu64(o, st->nfiles);
+    outcstr(o, "\nBytes: ");
+    outu64(o, st->nbytes);
+    outcstr(o, "\nBodies: ");
+    outu64(o, st->nsizes);
+    outcstr(o, "\nInstructions: ");
+    outu64(o, st->ninsns);
+    outcstr(o, "\n\n");
+
+    printsects(st, o);
+    printsizes(st, o);
+    printops(st, o);
+    printpairs(st, o);
+    printwidths(st, o);
+}
+
+
+static Error *
+bodystats(Stats *st, const CodeDecl *code, u32 index)
+{
+    u8        kind;
+    u32       prev, size;
+    Insn      insn;
+    Error     *err;
+    const u8  *p;
+    InsnIter  it;
+
+    size = code->end - code->start + 1;
+
+    err = addsizes(st, &size, 1);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    prev = 0x100;       /* no instruction before the first */
+
+    insniter(&it, code);
+
+    while (!insndone(&it)) {
+        err = insnnext(&it, &insn);
+        if (slow(err != NULL)) {
+            return error(err, "function %d", index);
+        }
+
+        st->ninsns++;
+        st->ops[insn.op]++;
+
+        if (prev < 0x100) {
+            st->pairs[prev << 8 | insn.op]++;
+        }
+
+        prev = insn.op;
+
+        /* the immediate runs from past the opcode to the next one */
+
+        kind = opinfo[insn.op].imm;
+        p = it.start + insn.offset + 1;
+
+        if (kind >= ImmMem8 && kind <= ImmMem64) {
+            widths(st, ImmMem8, p, it.p);
+
+        } else if (kind == ImmIndirect) {
+            widths(st, kind, p, it.p - 1);  /* the reserved byte aside */
+
+        } else if (immnames[kind] != NULL) {
+            widths(st, kind, p, it.p);
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Counts the widths of the LEB128s in [p, end), each ending at a byte with
+ * the high bit clear.
+ */
+static void
+widths(Stats *st, u8 kind, const u8 *p, const u8 *end)
+{
+    const u8  *leb;
+
+    for (leb = p; p < end; p++) {
+        if ((*p & 0x80) == 0) {
+            st->widths[kind][(p - leb < 10) ? p - leb + 1 : 10]++;
+            leb = p + 1;
+        }
+    }
+}
+
+
+static Error *
+addsizes(Stats *st, const u32 *sizes, u64 n)
+{
+    u32  *p;
+    u64  max;
+
+    if (slow(st->maxsizes - st->nsizes < n)) {
+        for (max = st->maxsizes * 2; max - st->nsizes < n; max *= 2) {
+            /* void */
+        }
+
+        p = realloc(st->sizes, sizeof(u32) * max);
+        if (slow(p == NULL)) {
+            return newerror("failed to allocate stats: %s", strerror(errno));
+        }
+
+        st->sizes = p;
+        st->maxsizes = max;
+    }
+
+    memcpy(st->sizes + st->nsizes, sizes, sizeof(u32) * n);
+    st->nsizes += n;
+
+    return NULL;
+}
+
+
+/*
+ * What is not in section contents is the preamble and the id and size of
+ * each section.
+ */
+static void
+printsects(Stats *st, Out *o)
+{
+    u32  i;
+    u64  n;
+
+    outcstr(o, "Sections:\n");
+
+    n = 0;
+
+    for (i = 0; i < NSECTS; i++) {
+        n += st->sects[i];
+
+        if (st->sects[i] > 0) {
+            row(o, sectnames[i], 16, st->sects[i], st->nbytes);
+        }
+    }
+
+    row(o, "(headers)", 16, st->nbytes - n, st->nbytes);
+
+    outchar(o, '\n');
+}
+
+
+/*
+ * Nearest rank percentiles of the body sizes.
+ */
+static void
+printsizes(Stats *st, Out *o)
+{
+    u32  i;
+    u64  n, sum;
+
+    static const u32  ranks[] = { 50, 90, 99 };
+
+    outcstr(o, "Body sizes:\n");
+
+    n = st->nsizes;
+
+    if (n == 0) {
+        outcstr(o, "    (none)\n\n");
+        return;
+    }
+
+    qsort(st->sizes, n, sizeof(u32), bysize);
+
+    sum = 0;
+
+    for (i = 0; i < n; i++) {
+        sum += st->sizes[i];
+    }
+
+    outcstr(o, "    min ");
+    outu64(o, st->sizes[0]);
+
+    for (i = 0; i < nitems(ranks); i++) {
+        outcstr(o, "  p");
+        outu64(o, ranks[i]);
+        outchar(o, ' ');
+        outu64(o, st->sizes[(ranks[i] * n + 99) / 100 - 1]);
+    }
+
+    outcstr(o, "  max ");
+    outu64(o, st->sizes[n - 1]);
+    outcstr(o, "  mean ");
+    outu64(o, sum / n);
+    outcstr(o, "\n\n");
+}
+
+
+static void
+printops(Stats *st, Out *o)
+{
+    u32    i, n;
+    Count  counts[256];
+
+    for (n = i = 0; i < 256; i++) {
+        if (st->ops[i] > 0) {
+            counts[n].count = st->ops[i];
+            counts[n++].key = i;
+        }
+    }
+
+    qsort(counts, n, sizeof(Count), bycount);
+
+    outcstr(o, "Opcodes (");
+    outu64(o, n);
+    outcstr(o, "):\n");
+
+    for (i = 0; i < n; i++) {
+        row(o, opinfo[counts[i].key].name, 24, counts[i].count, st->ninsns);
+    }
+
+    outchar(o, '\n');
+}
+
+
+/*
+ * Only the top pairs are kept, in order, as they are found.
+ */
+static void
+printpairs(Stats *st, Out *o)
+{
+    u32    i, j, n, ntop;
+    u64    total;
+    char   name[64];
+    Count  c, top[TOPPAIRS];
+
+    total = 0;
+    ntop = 0;
+
+    for (n = i = 0; i < 256 * 256; i++) {
+        if (st->pairs[i] == 0) {
+            continue;
+        }
+
+        n++;
+        total += st->pairs[i];
+
+        c.count = st->pairs[i];
+        c.key = i;
+
+        for (j = ntop; j > 0 && bycount(&c, &top[j - 1]) < 0; j--) {
+            if (j < TOPPAIRS) {
+                top[j] = top[j - 1];
+            }
+        }
+
+        if (j < TOPPAIRS) {
+            top[j] = c;
+            ntop += (ntop < TOPPAIRS);
+        }
+    }
+
+    outcstr(o, "Opcode pairs (");
+    outu64(o, n);
+    outcstr(o, ", top ");
+    outu64(o, ntop);
+    outcstr(o, "):\n");
+
+    for (i = 0; i < ntop; i++) {
+        snprintf(name, sizeof(name), "%s %s", opinfo[top[i].key >> 8].name,
+                 opinfo[top[i].key & 0xff].name);
+        row(o, name, 40, top[i].count, total);
+    }
+
+    outchar(o, '\n');
+}
+
+
+static void
+printwidths(Stats *st, Out *o)
+{
+    u32  i, j;
+    u64  total;
+
+    outcstr(o, "LEB128 widths:\n");
+
+    for (i = 0; i <= ImmF64; i++) {
+        if (immnames[i] == NULL) {
+            continue;
+        }
+
+        total = 0;
+
+        for (j = 1; j <= 10; j++) {
+            total += st->widths[i][j];
+        }
+
+        if (total == 0) {
+            continue;
+        }
+
+        count(o, immnames[i], 16, total);
+
+        for (j = 1; j <= 10; j++) {
+            if (st->widths[i][j] > 0) {
+                outcstr(o, "  ");
+                outu64(o, j);
+                outcstr(o, ": ");
+                percent(o, st->widths[i][j], total);
+            }
+        }
+
+        outchar(o, '\n');
+    }
+}
+
+
+static void
+row(Out *o, const char *name, u32 width, u64 n, u64 total)
+{
+    count(o, name, width, n);
+    outcstr(o, "  ");
+    percent(o, n, total);
+    outchar(o, '\n');
+}
+
+
+/*
+ * A name padded to width and the count right aligned after it.
+ */
+static void
+count(Out *o, const char *name, u32 width, u64 n)
+{
+    u32  i;
+    u64  v;
+
+    outcstr(o, "    ");
+    outcstr(o, name);
+
+    for (i = strlen(name); i < width; i++) {
+        outchar(o, ' ');
+    }
+
+    for (i = 1, v = n; v >= 10; v /= 10) {
+        i++;
+    }
+
+    for ( ; i < 14; i++) {
+        outchar(o, ' ');
+    }
+
+    outu64(o, n);
+}
+
+
+/*
+ * In tenths of a percent, with no floating point.
+ */
+static void
+percent(Out *o, u64 part, u64 whole)
+{
+    u64  tenths;
+
+    tenths = (whole == 0) ? 0 : (part * 1000 + whole / 2) / whole;
+
+    outu64(o, tenths / 10);
+    outchar(o, '.');
+    outu64(o, tenths % 10);
+    outchar(o, '%');
+}
+
+
+/*
+ * Most first, and by key on a tie, for the same output on any -j.
+ */
+static int
+bycount(const void *a, const void *b)
+{
+    const Count  *x, *y;
+
+    x = a;
+    y = b;
+
+    if (x->count != y->count) {
+        return (x->count < y->count) ? 1 : -1;
+    }
+
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+
+static int
+bysize(const void *a, const void *b)
+{
+    u32  x, y;
+
+    x = *(const u32 *) a;
+    y = *(const u32 *) b;
+
+    return (x > y) - (x < y);
+}
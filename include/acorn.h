@@ -55,8 +55,31 @@
     } while (0)
 
 
+/*
+ * All acorn and oak heap memory comes from memalloc(), zmalloc() and
+ * memrealloc(), and goes back with memfree(), so that it can be counted.
+ * Counting is off until memtrack(1), which starts it from zero, and then
+ * costs a few atomic adds per call.  bytes is what was asked for, while
+ * live and peak are in the bytes malloc() handed out, net of what was
+ * freed since tracking began.  What acorn and oak hand out, as the
+ * Strings of cfmt(), is to be freed with memfree() for live to drop.
+ */
+typedef struct {
+    u64     allocs;
+    u64     frees;      /* a realloc() is a free and an alloc */
+    u64     bytes;
+    i64     live;
+    i64     peak;
+} MemStats;
+
+
 void    *copy(void *dst, const void *src, size_t n);
 void    *zmalloc(size_t size);
+void    *memalloc(size_t size);
+void    *memrealloc(void *p, size_t size);
+void    memfree(void *p);
+void    memtrack(u8 on);
+void    memstats(MemStats *stats);
 
 
 #include <acorn/string.h>
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+
+#ifndef _ACORN_PERF_H_
+#define _ACORN_PERF_H_
+
+
+/*
+ * Hardware counters of the calling thread, and of the threads it starts
+ * while they count, in user space only.  Counters the kernel or the CPU
+ * do not provide are left out of avail and read as 0, so a region can be
+ * measured the same way everywhere, with as much as there is.
+ */
+
+typedef enum {
+    PerfCycles = 0,
+    PerfInstructions,
+    PerfCacheMisses,
+    PerfBranchMisses,
+    PerfMax,
+} PerfCounter;
+
+
+typedef struct {
+    int     fds[PerfMax];       /* -1 if unavailable */
+    u8      avail;              /* 1 << PerfCounter */
+} Perf;
+
+
+typedef struct {
+    u64     counts[PerfMax];
+    u8      avail;
+} PerfCounts;
+
+
+Error       *perfopen(Perf *perf);
+void        perfstart(Perf *perf);
+void        perfstop(Perf *perf, PerfCounts *counts);
+void        perfclose(Perf *perf);
+const char  *perfname(PerfCounter counter);
+
+
+#endif /* _ACORN_PERF_H_ */
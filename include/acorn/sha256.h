@@ -0,0 +1,20 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+
+#ifndef _ACORN_SHA256_H_
+#define _ACORN_SHA256_H_
+
+
+#define SHA256_SIZE     32
+
+
+/*
+ * SHA-256 of FIPS 180-4, in one call, for keying content where a collision
+ * must not be something anyone can produce on purpose.
+ */
+void    sha256(const u8 *data, size_t size, u8 digest[SHA256_SIZE]);
+
+
+#endif /* _ACORN_SHA256_H_ */
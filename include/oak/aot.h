@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _OAK_AOT_H_
+#define _OAK_AOT_H_
+
+
+#include <stdio.h>
+
+#include "module.h"
+#include "memory.h"
+#include "jit.h"
+
+
+/*
+ * Bumped whenever the generated code or AotEnv change, so objects built by
+ * an older translator are never loaded from the cache.
+ */
+#define AOT_ABI         2
+
+#define AOT_CACHE_NAME  "oak-aot"     /* under the user cache directory */
+
+
+/*
+ * The part of an Aot the generated code sees.  The translator emits the
+ * same struct at the top of every C file, so both must change together.
+ */
+typedef struct {
+    u8              *membase;
+    HostCall        *hosts;     /* of imported functions */
+    u8              *stacklimit; /* see jitstacklimit() */
+    void            (*trap)(void *env, u32 trap) __attribute__((noreturn));
+    u64             (*grow)(void *env, u64 delta);
+    u64             (*size)(void *env);
+} AotEnv;
+
+
+typedef u64 (*AotFunc)(AotEnv *env, u64 *args);
+
+
+/*
+ * Ahead-of-time compiled module.  The module is translated to C, with one C
+ * function per CodeDecl following the jit calling convention:
+ *
+ *     u64 fn(AotEnv *env, u64 *args);
+ *
+ * and linear memory accessed through `membase` without bounds checks, so
+ * `memory` must be a guarded LinearMemory as for the jit.  The C file is
+ * built with the configured compiler into a shared object and loaded with
+ * dlopen().
+ *
+ * Objects are kept in a private cache directory of the user, keyed by the
+ * SHA-256 of the module, and aotmodule() loads a cached object without
+ * translating or compiling.
+ * Imports are bound by aotbind(), see host.h.
+ */
+typedef struct {
+    AotEnv          env;        /* must be first */
+    Module          *module;
+    void            *handle;    /* of the shared object */
+    const AotFunc   *table;     /* of defined functions, from the object */
+    u32             nimports;   /* imported functions in the index space */
+    u32             nfuncs;     /* size of the function index space */
+    u32             nbound;     /* imports bound so far */
+    u8              cached;     /* loaded without compiling */
+    LinearMemory    *memory;    /* set by the embedder */
+    Trap            trap;
+    void            *jmp;       /* jmp_buf of the active aotcall() */
+} Aot;
+
+
+Error   *aotmodule(Aot *aot, Module *m, const char *cachedir);
+Error   *aotcall(Aot *aot, u32 index, u64 *args, u64 *ret);
+void    aotclose(Aot *aot);
+Error   *aottranslate(const Module *m, FILE *out);
+
+#endif /* _OAK_AOT_H_ */
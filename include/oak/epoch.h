@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _OAK_EPOCH_H_
+#define _OAK_EPOCH_H_
+
+
+/*
+ * Process-wide epoch counter for JitEpoch code.  It only ever increases,
+ * either from epochtick() or from the timer thread of epochstart(), and is
+ * read by guest code without synchronization, so a bump is noticed at the
+ * next check rather than instantly.
+ */
+extern u64  globalepoch;
+
+
+u64     epochnow(void);
+void    epochtick(void);
+Error   *epochstart(u32 ms);
+void    epochstop(void);
+
+#endif /* _OAK_EPOCH_H_ */
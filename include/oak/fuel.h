@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _OAK_FUEL_H_
+#define _OAK_FUEL_H_
+
+
+#include "module.h"
+
+
+/*
+ * Straight-line run of a function body.  A block ends after any instruction
+ * that may branch (if, br, br_if, br_table, return, unreachable) and a new
+ * one starts at any that may be branched to (loop, else, end), so once
+ * entered all of it executes.  The final end belongs to the last block.
+ * Offsets are from CodeDecl.start and the cost is the number of instructions.
+ */
+typedef struct {
+    u32             start;
+    u32             end;
+    u32             cost;
+} BasicBlock;
+
+
+Error   *basicblocks(const CodeDecl *code, Array *blocks);
+
+#endif /* _OAK_FUEL_H_ */
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _OAK_HOST_H_
+#define _OAK_HOST_H_
+
+
+#include "jit.h"
+#include "aot.h"
+
+
+/*
+ * Host functions bound to the function imports of a jitted or ahead-of-time
+ * compiled module.
+ *
+ * Each import is called through a trampoline specialized for its signature
+ * that unpacks the argument slots straight into a C call, so a host function
+ * for (i32, i32) -> i32 is simply:
+ *
+ *     i32 fn(void *data, i32 a, i32 b);
+ *
+ * HOST_SHAPES lists the specialized signatures as
+ *
+ *     X(name, params, rets, C return type, C params, C args)
+ *
+ * where params and rets spell the wasm types with 'i' for i32 and 'I' for
+ * i64.  Other signatures must be bound to a HostRaw function, which gets the
+ * argument slots as they are.
+ */
+#define HOST_SHAPES(X)                                                        \
+    X(v_v,      "",     "",  void, (void *),                                  \
+      (h->data))                                                              \
+    X(v_i,      "",     "i", i32,  (void *),                                  \
+      (h->data))                                                              \
+    X(i_v,      "i",    "",  void, (void *, i32),                             \
+      (h->data, args[0]))                                                     \
+    X(i_i,      "i",    "i", i32,  (void *, i32),                             \
+      (h->data, args[0]))                                                     \
+    X(ii_v,     "ii",   "",  void, (void *, i32, i32),                        \
+      (h->data, args[0], args[1]))                                            \
+    X(ii_i,     "ii",   "i", i32,  (void *, i32, i32),                        \
+      (h->data, args[0], args[1]))                                            \
+    X(iii_i,    "iii",  "i", i32,  (void *, i32, i32, i32),                   \
+      (h->data, args[0], args[1], args[2]))                                   \
+    X(iiii_i,   "iiii", "i", i32,  (void *, i32, i32, i32, i32),              \
+      (h->data, args[0], args[1], args[2], args[3]))                          \
+    X(v_I,      "",     "I", i64,  (void *),                                  \
+      (h->data))                                                              \
+    X(I_I,      "I",    "I", i64,  (void *, i64),                             \
+      (h->data, args[0]))                                                     \
+    X(II_I,     "II",   "I", i64,  (void *, i64, i64),                        \
+      (h->data, args[0], args[1]))
+
+
+typedef u64 (*HostRaw)(void *data, u64 *args);
+
+
+typedef struct {
+    const char      *module;
+    const char      *field;
+    void            *fn;        /* of the import's shape, or a HostRaw */
+    void            *data;      /* passed as first argument */
+    u8              raw;
+} HostFunc;
+
+
+Error   *jitbind(Jit *jit, const HostFunc *funcs, u32 nfuncs);
+Error   *aotbind(Aot *aot, const HostFunc *funcs, u32 nfuncs);
+
+#endif /* _OAK_HOST_H_ */
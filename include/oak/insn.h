@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _OAK_INSN_H_
+#define _OAK_INSN_H_
+
+
+#include "module.h"
+
+
+typedef enum {
+    ImmNone         = 0,
+    ImmBlock,           /* block type */
+    ImmIndex,           /* label, function, local or global index */
+    ImmTable,           /* br_table labels and default */
+    ImmIndirect,        /* type index and reserved byte */
+    ImmMem8,            /* alignment and offset, by natural alignment */
+    ImmMem16,
+    ImmMem32,
+    ImmMem64,
+    ImmReserved,        /* memory index, always 0 */
+    ImmI32,
+    ImmI64,
+    ImmF32,
+    ImmF64,
+} ImmKind;
+
+
+/*
+ * Decoded immediates, in the fields their kind uses:
+ *
+ *   ImmBlock       block: Emptyblock or a value type byte, 0x7f to 0x7c
+ *   ImmIndex       index
+ *   ImmTable       index is the default label, and targets points to the
+ *                  ntargets other labels, read with nextlabel()
+ *   ImmIndirect    index is the type index
+ *   ImmMem*        align, as log2, and offset
+ *   ImmI32/ImmI64  value, sign extended
+ *   ImmF32/ImmF64  value, holding the bits of the float
+ */
+typedef struct {
+    u32             index;
+    u32             align;
+    u32             offset;
+    u32             ntargets;
+    const u8        *targets;
+    u64             value;
+    u8              block;
+} Imm;
+
+
+typedef struct {
+    u8              op;
+    u32             offset;     /* from CodeDecl.start */
+    Imm             imm;
+} Insn;
+
+
+/*
+ * Walks a function body one instruction at a time, decoding in place.  It
+ * holds no memory of its own, so it may live on the stack and be dropped at
+ * any point.  The final end of the body is the last instruction.
+ */
+typedef struct {
+    const u8        *start;
+    u8              *p;
+    const u8        *end;
+} InsnIter;
+
+
+#define insndone(it)    ((it)->p >= (it)->end)
+
+
+void        insniter(InsnIter *it, const CodeDecl *code);
+Error       *insnnext(InsnIter *it, Insn *insn);
+u32         nextlabel(const u8 **p);
+const char  *opname(u8 op);
+
+#endif /* _OAK_INSN_H_ */
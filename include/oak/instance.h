@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _OAK_INSTANCE_H_
+#define _OAK_INSTANCE_H_
+
+
+#include "module.h"
+#include "memory.h"
+
+
+/*
+ * Runtime state of a module: its linear memory, table and globals.
+ *
+ * Data segments whose file offset and memory offset agree modulo the page
+ * size have their whole pages mapped copy-on-write from the module file
+ * instead of being copied.  Table entries hold a function index plus one,
+ * 0 being the null entry, so zeroed pages are an empty table.
+ *
+ * Globals are laid out flat in the order of the global index space, imported
+ * ones first, each in a u64 slot holding its raw bits: global i is always at
+ * offset 8 * i of `globals`.  Their init expressions were folded at load
+ * time, so initializing one is a store of a constant or a copy of an
+ * imported slot.
+ */
+typedef struct {
+    Module          *module;
+    u8              hasmemory;
+    LinearMemory    memory;
+    u32             *table;
+    u32             tablesize;
+    u64             *globals;   /* raw bits of each global */
+    u32             nglobals;
+    void            *pool;      /* owning pool, if any */
+    u32             slot;
+    u32             nmapped;    /* data pages mapped from the file */
+    u32             ncopied;    /* data bytes copied */
+} Instance;
+
+
+Error   *instantiate(Instance *inst, Module *m);
+Error   *instantiateimports(Instance *inst, Module *m, const u64 *globals,
+                            u32 nglobals);
+Error   *initinstance(Instance *inst);
+void    closeinstance(Instance *inst);
+
+#endif /* _OAK_INSTANCE_H_ */
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _OAK_JIT_H_
+#define _OAK_JIT_H_
+
+
+#include "module.h"
+#include "memory.h"
+
+
+/*
+ * Guest calls trap once their frames would take more than JIT_STACK_MAX bytes
+ * of native stack below the outermost jitcall() or aotcall(), or would come
+ * closer than JIT_STACK_RESERVE bytes to the end of the thread's stack.  The
+ * reserve is left for host functions, the trap path and signal handlers.
+ */
+#define JIT_STACK_MAX       (4 << 20)
+#define JIT_STACK_RESERVE   (64 << 10)
+
+/*
+ * Reserved code region: JIT_CODE_MIN plus JIT_CODE_RATIO bytes per byte of
+ * function bodies.  It is virtual space only, pages are committed on install.
+ */
+#define JIT_CODE_MIN    (1 << 20)
+#define JIT_CODE_RATIO  64
+
+
+typedef enum {
+    TrapNone = 0,
+    TrapUnreachable,
+    TrapDivZero,
+    TrapOverflow,
+    TrapCallStack,
+    TrapOutOfBounds,
+    TrapFuel,
+    TrapEpoch,
+    TrapPrepare,
+} Trap;
+
+
+/*
+ * Flags.  JitMetered code charges `fuel` on entry to each basic block and
+ * traps when there is not enough left for the whole block.  JitEpoch code
+ * compares `*epoch` against `deadline` on function entry and loop headers,
+ * and traps once the deadline is reached.
+ */
+typedef enum {
+    JitEager = 0,       /* compile every function in jitmodule() */
+    JitLazy = 1 << 0,   /* compile each function on its first call */
+    JitMetered = 1 << 1,
+    JitEpoch = 1 << 2,
+} JitMode;
+
+
+/*
+ * How guest code reaches an imported function: `call` is the trampoline for
+ * the import's signature and gets the entry itself plus the argument slots.
+ * Bound by jitbind(), see host.h.
+ */
+typedef struct HostCall  HostCall;
+
+struct HostCall {
+    u64             (*call)(const HostCall *h, u64 *args);
+    void            *fn;
+    void            *data;
+};
+
+
+/*
+ * Native code for the functions of a module, compiled by a single pass over
+ * each CodeDecl body.  Every compiled function follows the SysV convention:
+ *
+ *     u64 fn(Jit *jit, u64 *args);
+ *
+ * Arguments are passed as an array of 64-bit slots and the result, if any,
+ * is returned in rax.  i32 values are always kept zero-extended.
+ *
+ * Loads and stores are not bounds checked: `memory` must be a guarded
+ * LinearMemory, and out of bounds accesses trap from its fault handler.
+ *
+ * Calls go through `table`, indexed by the function index space.  In lazy
+ * mode every entry starts pointing to a stub that prepares the function on
+ * its first call and patches the entry, so setup does not depend on the
+ * number or size of functions.  Imported functions are called through
+ * `hosts` instead, and every import must be bound before calling into the
+ * module.
+ */
+typedef struct {
+    Module          *module;
+    JitMode         mode;
+    u8              *code;      /* reserved executable region */
+    size_t          size;
+    size_t          used;
+    u8              *lazystub;
+    u32             nimports;   /* imported functions in the index space */
+    u32             nfuncs;     /* size of the function index space */
+    u32             nprepared;  /* functions compiled so far */
+    void            **table;    /* of native entry points */
+    HostCall        *hosts;     /* of imported functions */
+    u32             nbound;     /* imports bound so far */
+    void            *compiler;
+    LinearMemory    *memory;    /* set by the embedder */
+    u8              *membase;
+
+    /* runtime state */
+    u64             fuel;       /* set by the embedder if metered */
+    const u64       *epoch;     /* &globalepoch unless set by the embedder */
+    u64             deadline;   /* epoch at which JitEpoch code traps */
+    u8              *stacklimit; /* lowest rsp a frame may reach */
+    Trap            trap;
+    Error           *err;       /* why a lazy preparation failed */
+    void            *env;       /* jmp_buf of the active jitcall() */
+} Jit;
+
+
+Error   *jitmodule(Jit *jit, Module *m, JitMode mode);
+Error   *jitcall(Jit *jit, u32 index, u64 *args, u64 *ret);
+void    jitclose(Jit *jit);
+u8      *jitstacklimit(void);
+
+const char  *trapstr(Trap trap);
+
+#endif /* _OAK_JIT_H_ */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _OAK_MEMORY_H_
+#define _OAK_MEMORY_H_
+
+
+#include "module.h"
+
+
+#define WASM_PAGE_SIZE      65536
+#define WASM_MAX_PAGES      65536
+
+/*
+ * Every memory reserves the whole 32-bit address space plus a guard region
+ * of the same size, so any u32 address plus u32 offset lands inside the
+ * reservation.  Accesses past the committed pages fault instead of needing
+ * an explicit bounds check.
+ */
+#define MEMORY_RESERVE      (8ULL << 30)
+
+
+typedef struct {
+    u8              *base;
+    u64             reserved;   /* bytes of address space */
+    u32             pages;      /* committed (accessible) pages */
+    u32             maximum;    /* in pages */
+    u8              mapped;     /* has pages mapped from a file */
+} LinearMemory;
+
+
+/*
+ * Guards are pushed per thread while guest code runs.  A fault inside the
+ * reservation of a guarded memory calls trap(data), which must not return.
+ */
+typedef struct MemoryGuard  MemoryGuard;
+
+struct MemoryGuard {
+    LinearMemory    *mem;
+    void            (*trap)(void *data);
+    void            *data;
+    MemoryGuard     *prev;
+};
+
+
+Error   *newmemory(LinearMemory *mem, const ResizableLimit *limit);
+Error   *limitmemory(LinearMemory *mem, const ResizableLimit *limit);
+u32     growmemory(LinearMemory *mem, u32 delta);
+Error   *mapmemory(LinearMemory *mem, int fd, u32 pages);
+Error   *resetmemory(LinearMemory *mem);
+void    closememory(LinearMemory *mem);
+
+Error   *memorysignals(void);
+void    guardmemory(MemoryGuard *guard);
+void    unguardmemory(MemoryGuard *guard);
+
+#endif /* _OAK_MEMORY_H_ */
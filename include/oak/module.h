@@ -78,6 +78,12 @@ typedef struct {
 } FuncDecl;
 
 
+typedef struct {
+    Type            type;
+    u8              mut;        /* 1-bit - mutability */
+} GlobalType;
+
+
 typedef struct {
     String          *module;
     String          *field;
@@ -85,6 +91,7 @@ typedef struct {
 
     union {
         TypeDecl    type;
+        GlobalType  global;
     } u;
 } ImportDecl;
 
@@ -100,14 +107,15 @@ typedef struct {
 } MemoryDecl;
 
 
-typedef struct {
-    Type            type;
-    u8              mut;        /* 1-bit - mutability */
-} GlobalType;
-
-
+/*
+ * Init expressions are evaluated at load time: get_global chains are folded
+ * down to the constant at their end, so `init` is the opcode of a constant,
+ * or OpgetGlobal of an imported global, whose value is only known when
+ * instantiating.
+ */
 typedef struct {
     GlobalType      type;
+    u8              init;
     union {
         u32         globalindex;
         i32         i32val;
@@ -121,6 +129,7 @@ typedef struct {
 typedef struct {
     String          *field;
     ExternalKind    kind;
+    u32             index;
     union {
         TypeDecl    type;
         GlobalDecl  global;
@@ -134,28 +143,49 @@ typedef struct {
 } LocalEntry;
 
 
+/*
+ * nlocals counts params too, and with maxstack, the most values on the
+ * operand stack, gives the slots of a frame.  Both are set by validation.
+ */
 typedef struct {
     Array           *locals;     /* of LocalEntry */
     const u8        *start;      /* pointer to file offset */
     const u8        *end;
+    u32             nlocals;
+    u32             maxstack;
 } CodeDecl;
 
 
 typedef struct {
     u32             index;
+    u8              init;       /* as for GlobalDecl */
     i32             offset;
+    u32             globalindex;
     u32             size;
     const u8        *data;
 } DataDecl;
 
 
+/*
+ * A loaded module is immutable: nothing in it changes after loadmodule(), so
+ * any number of threads can read it at once.  It is only ever allocated by
+ * loadmodule(), never on the stack of a caller.  Per-user state lives in the
+ * Instance, Jit and Snapshot built from it, each holding a reference that
+ * keeps the module alive.  closemodule() drops the caller's reference and the
+ * module is freed with the last one.
+ */
 typedef struct {
+    u32             refs;       /* updated atomically */
     File            file;
     u32             version;
     u32             start;      /* function index */
+    u32             nimportfuncs;
+    u32             nimportglobals;
     Array           *sects;     /* of Section */
     Array           *types;     /* of FuncDecl */
     Array           *imports;   /* of ImportDecl */
+    Array           *importfuncs;   /* of TypeDecl, by function index */
+    Array           *importglobals; /* of GlobalType, by global index */
     Array           *funcs;     /* of FuncDecl */
     Array           *tables;    /* of TableDecl */
     Array           *memories;  /* of MemoryDecl */
@@ -166,9 +196,14 @@ typedef struct {
 } Module;
 
 
-Error   *loadmodule(Module *, const char *filename);
+Error   *loadmodule(Module **m, const char *filename);
+Module  *acquiremodule(Module *m);
 void    closemodule(Module *m);
 
+TypeDecl    *functype(const Module *m, u32 index);
+GlobalType  *globaltype(const Module *m, u32 index);
+ExportDecl  *findexport(const Module *m, const String *field);
+
 u8      oakfmt(String **buf, u8 **format, void *val);
 
 #endif /* _OAK_MODULE_H_ */
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _OAK_POOL_H_
+#define _OAK_POOL_H_
+
+
+#include "module.h"
+#include "memory.h"
+#include "instance.h"
+#include "snapshot.h"
+
+
+/*
+ * Pre-reserved instance state.  Each slot owns a linear memory reservation
+ * and room for a table of `maxtable` entries and `maxglobals` globals.
+ * Releasing an instance resets its slot with MADV_DONTNEED, so the next
+ * instance gets zeroed pages without any mmap/munmap of its own.
+ *
+ * Pools are not thread safe.
+ */
+typedef struct {
+    u32             nslots;
+    u32             maxtable;
+    u32             maxglobals;
+    u64             stride;     /* bytes of table and globals per slot */
+    u8              *state;     /* nslots * stride */
+    LinearMemory    *memories;  /* of each slot */
+    u32             *free;      /* stack of free slots */
+    u32             nfree;
+    u32             ndropped;   /* slots lost to failed resets */
+} Pool;
+
+
+Error   *newpool(Pool *pool, u32 nslots, u32 maxtable, u32 maxglobals);
+Error   *poolinstantiate(Pool *pool, Instance *inst, Module *m);
+Error   *poolclone(Pool *pool, Instance *inst, const Snapshot *snap);
+void    poolrelease(Pool *pool, Instance *inst);
+void    closepool(Pool *pool);
+
+#endif /* _OAK_POOL_H_ */
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _OAK_SNAPSHOT_H_
+#define _OAK_SNAPSHOT_H_
+
+
+#include "module.h"
+#include "memory.h"
+#include "instance.h"
+
+
+/*
+ * Frozen state of an initialized instance.  The linear memory image lives
+ * in a memfd, so a clone maps it MAP_PRIVATE in a single mmap and starts
+ * with copy-on-write pages instead of re-applying data segments.  Table
+ * and globals are small and copied: mapping them would take a page and an
+ * mmap per clone for what a memcpy of a few words does.
+ */
+typedef struct {
+    Module          *module;
+    int             fd;         /* memfd with the memory image, or -1 */
+    u32             pages;
+    u32             maximum;
+    u32             *table;
+    u32             tablesize;
+    u64             *globals;
+    u32             nglobals;
+} Snapshot;
+
+
+Error   *takesnapshot(Snapshot *snap, const Instance *inst);
+Error   *clonesnapshot(const Snapshot *snap, Instance *inst);
+void    closesnapshot(Snapshot *snap);
+
+#endif /* _OAK_SNAPSHOT_H_ */
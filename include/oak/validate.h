@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#ifndef _OAK_VALIDATE_H_
+#define _OAK_VALIDATE_H_
+
+
+#include "module.h"
+
+
+/*
+ * loadmodule() validates on a single thread unless the code section has at
+ * least VALIDATE_PARALLEL_MIN bytes, where spawning threads pays off.
+ */
+#define VALIDATE_PARALLEL_MIN   (1 << 20)
+#define VALIDATE_MAX_THREADS    8
+
+
+/*
+ * Type checks every function body in a single streaming pass, following the
+ * validation algorithm of the spec appendix, and records the frame size of
+ * each CodeDecl on the way.  Each thread allocates its value and control
+ * stacks once, sized for the largest body, so nothing is allocated per
+ * instruction.
+ *
+ * With nthreads > 1 the bodies are split among threads, and the error
+ * reported is always the one of the lowest failing function index, as on a
+ * single thread.  nthreads = 0 picks a count from the code size.
+ */
+Error   *validatemodule(Module *m, u32 nthreads);
+
+#endif /* _OAK_VALIDATE_H_ */
@@ -0,0 +1,1540 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <acorn/sha256.h>
+#include <oak/module.h>
+#include <oak/jit.h>
+#include <oak/aot.h>
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "bin.h"
+#include "opcodes.h"
+
+
+/*
+ * Wasm to C translator.
+ *
+ * Like the jit, the operand stack is mapped statically: slot `d` is the C
+ * variable s<d> and local i is l<i>, all u64 with i32 values kept
+ * zero-extended.  Structured control flow becomes gotos: every control
+ * frame gets a label number n, with L<n> at the end of blocks and ifs or at
+ * the header of loops, and E<n> at the else arm of an if.  Branches carrying
+ * a value copy it to the slot at the target height first, so each frame
+ * leaves its result in a fixed variable.
+ *
+ * Everything else is left to the C compiler.
+ */
+
+
+/* the compiler configured by auto/cc */
+#ifndef OAK_CC
+#define OAK_CC      "cc"
+#endif
+
+#define CC_MAXARGS  32
+
+
+extern char  **environ;
+
+
+typedef enum {
+    CtrlBlock = 0,
+    CtrlLoop,
+    CtrlIf,
+    CtrlElse,
+} CtrlKind;
+
+
+typedef struct {
+    CtrlKind        kind;
+    u8              arity;
+    u8              unreachable;    /* rest of the current arm is dead */
+    u8              dead;           /* whole construct is dead */
+    u32             height;
+    u32             label;
+} Ctrl;
+
+
+typedef struct {
+    const Module    *m;
+    FILE            *out;       /* of the function body */
+    Array           *ctrls;     /* of Ctrl */
+
+    const u8        *p;
+    const u8        *end;
+
+    u32             nimports;
+    u32             nlocals;
+    u32             depth;
+    u32             maxdepth;
+    u32             nlabels;
+    u32             indent;     /* extra, inside ifs and switches */
+} Translator;
+
+
+typedef struct {
+    u8              nargs;
+    const char      *c;         /* s%1$u is the result and first operand */
+} COp;
+
+
+typedef struct {
+    u8              bits;       /* 0 if not supported */
+    const char      *conv;      /* applied to loaded values */
+} CMemOp;
+
+
+static Error *translatefunc(Translator *t, FILE *out, u32 index,
+    const CodeDecl *code);
+static Error *translateop(Translator *t, u8 op);
+static Error *branch(Translator *t, u32 label, u8 cond);
+static Error *brtable(Translator *t);
+static Error *callfunc(Translator *t, u32 index);
+static Error *endctrl(Translator *t);
+static Error *pushctrl(Translator *t, CtrlKind kind, u8 dead);
+static Error *blocktype(Translator *t, u8 *arity);
+static Error *memop(Translator *t, u8 op);
+static void move(Translator *t, u32 dst, u32 src);
+static void emit(Translator *t, const char *fmt, ...);
+
+static Error *cachedirectory(const char *cachedir, char *dir, size_t size);
+static Error *build(const Module *m, const char *path);
+static Error *compile(const char *src, const char *obj);
+static Error *load(Aot *aot, const char *path);
+
+static void aottrap(void *env, u32 trap) __attribute__((noreturn));
+static void aotmemtrap(void *data) __attribute__((noreturn));
+static u64 aotgrow(void *env, u64 delta);
+static u64 aotsize(void *env);
+
+
+/*
+ * Emitted at the top of every C file.  The types must match jit.h and
+ * aot.h.
+ */
+static const char  prelude[] =
+    "#include <stdint.h>\n"
+    "#include <string.h>\n"
+    "\n"
+    "typedef uint8_t   u8;\n"
+    "typedef uint16_t  u16;\n"
+    "typedef uint32_t  u32;\n"
+    "typedef uint64_t  u64;\n"
+    "typedef int8_t    i8;\n"
+    "typedef int16_t   i16;\n"
+    "typedef int32_t   i32;\n"
+    "typedef int64_t   i64;\n"
+    "\n"
+    "typedef struct HostCall  HostCall;\n"
+    "\n"
+    "struct HostCall {\n"
+    "    u64   (*call)(const HostCall *h, u64 *args);\n"
+    "    void  *fn;\n"
+    "    void  *data;\n"
+    "};\n"
+    "\n"
+    "typedef struct {\n"
+    "    u8        *membase;\n"
+    "    HostCall  *hosts;\n"
+    "    u8        *stacklimit;\n"
+    "    void      (*trap)(void *env, u32 trap) __attribute__((noreturn));\n"
+    "    u64       (*grow)(void *env, u64 delta);\n"
+    "    u64       (*size)(void *env);\n"
+    "} AotEnv;\n"
+    "\n"
+    "#define LD(n)                                                         \\\n"
+    "    static inline u##n ld##n(const u8 *p)                             \\\n"
+    "    { u##n v; memcpy(&v, p, sizeof(v)); return v; }\n"
+    "#define ST(n)                                                         \\\n"
+    "    static inline void st##n(u8 *p, u##n v)                           \\\n"
+    "    { memcpy(p, &v, sizeof(v)); }\n"
+    "\n"
+    "LD(8) LD(16) LD(32) LD(64)\n"
+    "ST(8) ST(16) ST(32) ST(64)\n"
+    "\n"
+    "#define DIVS(name, u, i, min)                                         \\\n"
+    "    static inline u64 name(AotEnv *env, u64 a, u64 b)                 \\\n"
+    "    {                                                                 \\\n"
+    "        if ((u) b == 0) {                                             \\\n"
+    "            env->trap(env, TRAP_DIVZERO);                             \\\n"
+    "        }                                                             \\\n"
+    "        if ((u) b == (u) -1 && (u) a == (min)) {                      \\\n"
+    "            env->trap(env, TRAP_OVERFLOW);                            \\\n"
+    "        }                                                             \\\n"
+    "        return (u) ((i) a / (i) b);                                   \\\n"
+    "    }\n"
+    "\n"
+    "#define REMS(name, u, i)                                              \\\n"
+    "    static inline u64 name(AotEnv *env, u64 a, u64 b)                 \\\n"
+    "    {                                                                 \\\n"
+    "        if ((u) b == 0) {                                             \\\n"
+    "            env->trap(env, TRAP_DIVZERO);                             \\\n"
+    "        }                                                             \\\n"
+    "        if ((u) b == (u) -1) {                                        \\\n"
+    "            return 0;                                                 \\\n"
+    "        }                                                             \\\n"
+    "        return (u) ((i) a % (i) b);                                   \\\n"
+    "    }\n"
+    "\n"
+    "#define DIVU(name, u, op)                                             \\\n"
+    "    static inline u64 name(AotEnv *env, u64 a, u64 b)                 \\\n"
+    "    {                                                                 \\\n"
+    "        if ((u) b == 0) {                                             \\\n"
+    "            env->trap(env, TRAP_DIVZERO);                             \\\n"
+    "        }                                                             \\\n"
+    "        return (u) a op (u) b;                                        \\\n"
+    "    }\n"
+    "\n"
+    "DIVS(divs32, u32, i32, 0x80000000)\n"
+    "DIVU(divu32, u32, /)\n"
+    "REMS(rems32, u32, i32)\n"
+    "DIVU(remu32, u32, %)\n"
+    "DIVS(divs64, u64, i64, 0x8000000000000000)\n"
+    "DIVU(divu64, u64, /)\n"
+    "REMS(rems64, u64, i64)\n"
+    "DIVU(remu64, u64, %)\n"
+    "\n"
+    "#define ROT(name, u, bits, l, r)                                      \\\n"
+    "    static inline u64 name(u64 a, u64 b)                              \\\n"
+    "    {                                                                 \\\n"
+    "        u n = b & (bits - 1);                                         \\\n"
+    "        return (u) (((u) a l n) | ((u) a r ((bits - n) & (bits - 1))));\\\n"
+    "    }\n"
+    "\n"
+    "ROT(rotl32, u32, 32, <<, >>)\n"
+    "ROT(rotr32, u32, 32, >>, <<)\n"
+    "ROT(rotl64, u64, 64, <<, >>)\n"
+    "ROT(rotr64, u64, 64, >>, <<)\n";
+
+
+static const COp  cops[256] = {
+    [Opi32eqz] =   {1, "s%1$u = (u32) s%1$u == 0;"},
+    [Opi32eq] =    {2, "s%1$u = (u32) s%1$u == (u32) s%2$u;"},
+    [Opi32ne] =    {2, "s%1$u = (u32) s%1$u != (u32) s%2$u;"},
+    [Opi32lts] =   {2, "s%1$u = (i32) s%1$u < (i32) s%2$u;"},
+    [Opi32ltu] =   {2, "s%1$u = (u32) s%1$u < (u32) s%2$u;"},
+    [Opi32gts] =   {2, "s%1$u = (i32) s%1$u > (i32) s%2$u;"},
+    [Opi32gtu] =   {2, "s%1$u = (u32) s%1$u > (u32) s%2$u;"},
+    [Opi32les] =   {2, "s%1$u = (i32) s%1$u <= (i32) s%2$u;"},
+    [Opi32leu] =   {2, "s%1$u = (u32) s%1$u <= (u32) s%2$u;"},
+    [Opi32ges] =   {2, "s%1$u = (i32) s%1$u >= (i32) s%2$u;"},
+    [Opi32geu] =   {2, "s%1$u = (u32) s%1$u >= (u32) s%2$u;"},
+
+    [Opi64eqz] =   {1, "s%1$u = s%1$u == 0;"},
+    [Opi64eq] =    {2, "s%1$u = s%1$u == s%2$u;"},
+    [Opi64ne] =    {2, "s%1$u = s%1$u != s%2$u;"},
+    [Opi64lts] =   {2, "s%1$u = (i64) s%1$u < (i64) s%2$u;"},
+    [Opi64ltu] =   {2, "s%1$u = s%1$u < s%2$u;"},
+    [Opi64gts] =   {2, "s%1$u = (i64) s%1$u > (i64) s%2$u;"},
+    [Opi64gtu] =   {2, "s%1$u = s%1$u > s%2$u;"},
+    [Opi64les] =   {2, "s%1$u = (i64) s%1$u <= (i64) s%2$u;"},
+    [Opi64leu] =   {2, "s%1$u = s%1$u <= s%2$u;"},
+    [Opi64ges] =   {2, "s%1$u = (i64) s%1$u >= (i64) s%2$u;"},
+    [Opi64geu] =   {2, "s%1$u = s%1$u >= s%2$u;"},
+
+    [Opi32clz] =   {1, "s%1$u = s%1$u ? __builtin_clz(s%1$u) : 32;"},
+    [Opi32ctz] =   {1, "s%1$u = s%1$u ? __builtin_ctz(s%1$u) : 32;"},
+    [Opi32popcnt] = {1, "s%1$u = __builtin_popcount(s%1$u);"},
+    [Opi32add] =   {2, "s%1$u = (u32) (s%1$u + s%2$u);"},
+    [Opi32sub] =   {2, "s%1$u = (u32) (s%1$u - s%2$u);"},
+    [Opi32mul] =   {2, "s%1$u = (u32) (s%1$u * s%2$u);"},
+    [Opi32divs] =  {2, "s%1$u = divs32(env, s%1$u, s%2$u);"},
+    [Opi32divu] =  {2, "s%1$u = divu32(env, s%1$u, s%2$u);"},
+    [Opi32rems] =  {2, "s%1$u = rems32(env, s%1$u, s%2$u);"},
+    [Opi32remu] =  {2, "s%1$u = remu32(env, s%1$u, s%2$u);"},
+    [Opi32and] =   {2, "s%1$u &= s%2$u;"},
+    [Opi32or] =    {2, "s%1$u |= s%2$u;"},
+    [Opi32xor] =   {2, "s%1$u ^= s%2$u;"},
+    [Opi32shl] =   {2, "s%1$u = (u32) (s%1$u << (s%2$u & 31));"},
+    [Opi32shrs] =  {2, "s%1$u = (u32) ((i32) s%1$u >> (s%2$u & 31));"},
+    [Opi32shru] =  {2, "s%1$u >>= s%2$u & 31;"},
+    [Opi32rotl] =  {2, "s%1$u = rotl32(s%1$u, s%2$u);"},
+    [Opi32rotr] =  {2, "s%1$u = rotr32(s%1$u, s%2$u);"},
+
+    [Opi64clz] =   {1, "s%1$u = s%1$u ? __builtin_clzll(s%1$u) : 64;"},
+    [Opi64ctz] =   {1, "s%1$u = s%1$u ? __builtin_ctzll(s%1$u) : 64;"},
+    [Opi64popcnt] = {1, "s%1$u = __builtin_popcountll(s%1$u);"},
+    [Opi64add] =   {2, "s%1$u += s%2$u;"},
+    [Opi64sub] =   {2, "s%1$u -= s%2$u;"},
+    [Opi64mul] =   {2, "s%1$u *= s%2$u;"},
+    [Opi64divs] =  {2, "s%1$u = divs64(env, s%1$u, s%2$u);"},
+    [Opi64divu] =  {2, "s%1$u = divu64(env, s%1$u, s%2$u);"},
+    [Opi64rems] =  {2, "s%1$u = rems64(env, s%1$u, s%2$u);"},
+    [Opi64remu] =  {2, "s%1$u = remu64(env, s%1$u, s%2$u);"},
+    [Opi64and] =   {2, "s%1$u &= s%2$u;"},
+    [Opi64or] =    {2, "s%1$u |= s%2$u;"},
+    [Opi64xor] =   {2, "s%1$u ^= s%2$u;"},
+    [Opi64shl] =   {2, "s%1$u <<= s%2$u & 63;"},
+    [Opi64shrs] =  {2, "s%1$u = (u64) ((i64) s%1$u >> (s%2$u & 63));"},
+    [Opi64shru] =  {2, "s%1$u >>= s%2$u & 63;"},
+    [Opi64rotl] =  {2, "s%1$u = rotl64(s%1$u, s%2$u);"},
+    [Opi64rotr] =  {2, "s%1$u = rotr64(s%1$u, s%2$u);"},
+
+    [Opi32wrapi64] =    {1, "s%1$u = (u32) s%1$u;"},
+    [Opi64extendsi32] = {1, "s%1$u = (u64) (i64) (i32) s%1$u;"},
+    [Opi64extendui32] = {1, "s%1$u = (u32) s%1$u;"},
+};
+
+
+/*
+ * Indexed by opcode - OpLoadi32, as memops in jit.c.
+ */
+static const CMemOp  cmemops[] = {
+    {32, ""},                       /* i32.load */
+    {64, ""},                       /* i64.load */
+    {0, NULL},                      /* f32.load */
+    {0, NULL},                      /* f64.load */
+    {8, "(u32) (i32) (i8) "},       /* i32.load8_s */
+    {8, ""},                        /* i32.load8_u */
+    {16, "(u32) (i32) (i16) "},     /* i32.load16_s */
+    {16, ""},                       /* i32.load16_u */
+    {8, "(u64) (i64) (i8) "},       /* i64.load8_s */
+    {8, ""},                        /* i64.load8_u */
+    {16, "(u64) (i64) (i16) "},     /* i64.load16_s */
+    {16, ""},                       /* i64.load16_u */
+    {32, "(u64) (i64) (i32) "},     /* i64.load32_s */
+    {32, ""},                       /* i64.load32_u */
+    {32, NULL},                     /* i32.store */
+    {64, NULL},                     /* i64.store */
+    {0, NULL},                      /* f32.store */
+    {0, NULL},                      /* f64.store */
+    {8, NULL},                      /* i32.store8 */
+    {16, NULL},                     /* i32.store16 */
+    {8, NULL},                      /* i64.store8 */
+    {16, NULL},                     /* i64.store16 */
+    {32, NULL},                     /* i64.store32 */
+};
+
+
+static const char  *Eunsupported = "opcode 0x%x not supported";
+static const char  *Enomemory = "module has no linear memory";
+
+static u32  nbuilds;
+
+
+Error *
+aotmodule(Aot *aot, Module *m, const char *cachedir)
+{
+    u8     digest[SHA256_SIZE];
+    u32    i;
+    int    n;
+    char   dir[1024], path[1024], key[SHA256_SIZE * 2 + 1];
+    Error  *err;
+
+    memset(aot, 0, sizeof(Aot));
+
+    aot->module = acquiremodule(m);
+    aot->nimports = m->nimportfuncs;
+    aot->nfuncs = m->nimportfuncs + len(m->codes);
+
+    aot->env.trap = aottrap;
+    aot->env.grow = aotgrow;
+    aot->env.size = aotsize;
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    err = newerror("aot not supported on this platform");
+    goto fail;
+#endif
+
+    aot->env.hosts = zmalloc(sizeof(HostCall) * (aot->nimports + 1));
+    if (slow(aot->env.hosts == NULL)) {
+        err = newerror("failed to allocate imports: %s", strerror(errno));
+        goto fail;
+    }
+
+    if (m->memories != NULL && len(m->memories) > 0) {
+        err = memorysignals();
+        if (slow(err != NULL)) {
+            goto fail;
+        }
+    }
+
+    err = cachedirectory(cachedir, dir, sizeof(dir));
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    sha256(m->file.data, m->file.size, digest);
+
+    for (i = 0; i < SHA256_SIZE; i++) {
+        snprintf(key + i * 2, 3, "%02x", digest[i]);
+    }
+
+    n = snprintf(path, sizeof(path), "%s/%s-%d.so", dir, key, AOT_ABI);
+    if (slow(n < 0 || (size_t) n >= sizeof(path))) {
+        err = newerror("cache directory path too long");
+        goto fail;
+    }
+
+    /* an unusable object is simply built again */
+
+    if (access(path, R_OK) == 0) {
+        err = load(aot, path);
+        if (err == NULL) {
+            aot->cached = 1;
+            return NULL;
+        }
+
+        errorfree(err);
+    }
+
+    err = build(m, path);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = load(aot, path);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return NULL;
+
+fail:
+
+    aotclose(aot);
+    return err;
+}
+
+
+Error *
+aotcall(Aot *aot, u32 index, u64 *args, u64 *ret)
+{
+    u64          val;
+    void         *prev;
+    jmp_buf      env;
+    MemoryGuard  guard;
+
+    if (slow(index < aot->nimports)) {
+        return newerror("function %d is an import", index);
+    }
+
+    if (slow(index >= aot->nfuncs)) {
+        return newerror("function %d not found", index);
+    }
+
+    if (slow(aot->nbound < aot->nimports)) {
+        return newerror("%d of %d imported functions not bound",
+                        aot->nimports - aot->nbound, aot->nimports);
+    }
+
+    if (slow(aot->memory == NULL && aot->module->memories != NULL
+             && len(aot->module->memories) > 0))
+    {
+        return newerror(Enomemory);
+    }
+
+    prev = aot->jmp;
+
+    if (prev == NULL) {
+        aot->env.stacklimit = jitstacklimit();
+    }
+
+    aot->trap = TrapNone;
+    aot->jmp = &env;
+
+    if (aot->memory != NULL) {
+        aot->env.membase = aot->memory->base;
+
+        guard.mem = aot->memory;
+        guard.trap = aotmemtrap;
+        guard.data = aot;
+        guardmemory(&guard);
+    }
+
+    if (setjmp(env) != 0) {
+        aot->jmp = prev;
+
+        if (aot->memory != NULL) {
+            unguardmemory(&guard);
+        }
+
+        return newerror("trap: %s", trapstr(aot->trap));
+    }
+
+    val = aot->table[index - aot->nimports](&aot->env, args);
+
+    aot->jmp = prev;
+
+    if (aot->memory != NULL) {
+        unguardmemory(&guard);
+    }
+
+    if (ret != NULL) {
+        *ret = val;
+    }
+
+    return NULL;
+}
+
+
+void
+aotclose(Aot *aot)
+{
+    if (aot->handle != NULL) {
+        dlclose(aot->handle);
+        aot->handle = NULL;
+        aot->table = NULL;
+    }
+
+    memfree(aot->env.hosts);
+    aot->env.hosts = NULL;
+
+    if (aot->module != NULL) {
+        closemodule(aot->module);
+        aot->module = NULL;
+    }
+}
+
+
+/*
+ * Writes the C translation of every function of `m` to `out`.  The object
+ * built from it exports the defined functions in oak_funcs, indexed by
+ * function index minus the number of imported functions.
+ */
+Error *
+aottranslate(const Module *m, FILE *out)
+{
+    u32         i;
+    Error       *err;
+    CodeDecl    *code;
+    Translator  t;
+
+    memset(&t, 0, sizeof(Translator));
+
+    t.m = m;
+    t.nimports = m->nimportfuncs;
+    t.ctrls = newarray(16, sizeof(Ctrl));
+    if (slow(t.ctrls == NULL)) {
+        return newerror("failed to allocate translator: %s", strerror(errno));
+    }
+
+    fprintf(out, "/* generated by oak, do not edit */\n\n");
+    fprintf(out, "#define TRAP_UNREACHABLE  %d\n", TrapUnreachable);
+    fprintf(out, "#define TRAP_DIVZERO      %d\n", TrapDivZero);
+    fprintf(out, "#define TRAP_OVERFLOW     %d\n", TrapOverflow);
+    fprintf(out, "#define TRAP_CALLSTACK    %d\n\n", TrapCallStack);
+    fputs(prelude, out);
+    fputc('\n', out);
+
+    for (i = 0; i < len(m->codes); i++) {
+        fprintf(out, "static u64 f%u(AotEnv *env, u64 *args);\n",
+                t.nimports + i);
+    }
+
+    err = NULL;
+
+    for (i = 0; i < len(m->codes); i++) {
+        code = arrayget(m->codes, i);
+
+        err = translatefunc(&t, out, t.nimports + i, code);
+        if (slow(err != NULL)) {
+            err = error(err, "translating function %d", t.nimports + i);
+            goto done;
+        }
+    }
+
+    fprintf(out, "\nconst u32  oak_abi = %d;\n", AOT_ABI);
+    fprintf(out, "const u32  oak_envsize = sizeof(AotEnv);\n");
+    fprintf(out, "const u32  oak_nfuncs = %u;\n\n", len(m->codes));
+    fprintf(out, "u64  (*const oak_funcs[])(AotEnv *, u64 *) = {\n");
+
+    for (i = 0; i < len(m->codes); i++) {
+        fprintf(out, "    f%u,\n", t.nimports + i);
+    }
+
+    fprintf(out, "    0\n};\n");
+
+    if (slow(ferror(out))) {
+        err = newerror("failed to write translation");
+    }
+
+done:
+
+    freearray(t.ctrls);
+
+    return err;
+}
+
+
+/*
+ * The body is translated to a buffer first, as the slot variables it needs
+ * are only known at the end.  It goes to b<index>, called by f<index> once
+ * there is room for a frame twice the size of its locals and slots, so the
+ * check runs before the body's frame is touched.
+ */
+static Error *
+translatefunc(Translator *t, FILE *out, u32 index, const CodeDecl *code)
+{
+    u8          op;
+    u32         i, j, at, nparams;
+    u64         frame;
+    char        *buf;
+    size_t      size;
+    Type        *type;
+    Error       *err;
+    TypeDecl    *ftype;
+    LocalEntry  *local;
+
+    ftype = functype(t->m, index);
+    if (slow(ftype == NULL)) {
+        return newerror("function type not found");
+    }
+
+    if (slow(len(ftype->rets) > 1)) {
+        return newerror("multiple return values not supported");
+    }
+
+    for (i = 0; i < len(ftype->params); i++) {
+        type = arrayget(ftype->params, i);
+        if (slow(*type != I32 && *type != I64)) {
+            return newerror("param of type 0x%x not supported", *type);
+        }
+    }
+
+    nparams = len(ftype->params);
+    t->nlocals = nparams;
+
+    for (i = 0; i < len(code->locals); i++) {
+        local = arrayget(code->locals, i);
+        if (slow(local->type != I32 && local->type != I64)) {
+            return newerror("local of type 0x%x not supported", local->type);
+        }
+
+        if (slow(local->count > (1 << 24) - t->nlocals)) {
+            return newerror("too many locals");
+        }
+
+        t->nlocals += local->count;
+    }
+
+    buf = NULL;
+    size = 0;
+
+    t->out = open_memstream(&buf, &size);
+    if (slow(t->out == NULL)) {
+        return newerror("failed to open buffer: %s", strerror(errno));
+    }
+
+    t->p = code->start;
+    t->end = code->end + 1;     /* includes the final 0x0b */
+    t->depth = 0;
+    t->maxdepth = 0;
+    t->nlabels = 0;
+    t->indent = 0;
+    t->ctrls->len = 0;
+
+    err = pushctrl(t, CtrlBlock, 0);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    ((Ctrl *) arraylast(t->ctrls))->arity = len(ftype->rets);
+
+    while (len(t->ctrls) > 0) {
+        if (slow(t->p >= t->end)) {
+            err = newerror("unexpected end of function body");
+            goto done;
+        }
+
+        at = t->p - code->start;
+        op = *t->p++;
+
+        err = translateop(t, op);
+        if (slow(err != NULL)) {
+            err = error(err, "at offset %d", at);
+            goto done;
+        }
+
+        if (t->depth > t->maxdepth) {
+            t->maxdepth = t->depth;
+        }
+    }
+
+    if (slow(t->p != t->end)) {
+        err = newerror("surplus bytes after function end");
+        goto done;
+    }
+
+done:
+
+    fclose(t->out);
+    t->out = NULL;
+
+    if (slow(buf == NULL)) {
+        return (err != NULL) ? err : newerror("failed to write buffer");
+    }
+
+    if (err == NULL) {
+        fprintf(out, "\nstatic u64 __attribute__((noinline))\n"
+                     "b%u(AotEnv *env, u64 *args)\n{\n", index);
+        fprintf(out, "    u8   *m = env->membase;\n");
+
+        for (i = 0; i < nparams; i++) {
+            fprintf(out, "    u64  l%u = args[%u];\n", i, i);
+        }
+
+        for (j = nparams; j < t->nlocals; j++) {
+            fprintf(out, "    u64  l%u = 0;\n", j);
+        }
+
+        for (i = 0; i < t->maxdepth; i++) {
+            fprintf(out, "    u64  s%u;\n", i);
+        }
+
+        fputc('\n', out);
+        fwrite(buf, 1, size, out);
+        fprintf(out, "}\n");
+
+        frame = 16 * ((u64) t->nlocals + t->maxdepth) + 256;
+
+        fprintf(out, "\nstatic u64\nf%u(AotEnv *env, u64 *args)\n{\n"
+                     "    if ((uintptr_t) __builtin_frame_address(0)\n"
+                     "        < (uintptr_t) env->stacklimit + %lluull)\n"
+                     "    {\n"
+                     "        env->trap(env, TRAP_CALLSTACK);\n"
+                     "    }\n\n"
+                     "    return b%u(env, args);\n}\n",
+                index, (unsigned long long) frame, index);
+    }
+
+    free(buf);
+
+    return err;
+}
+
+
+static Error *
+translateop(Translator *t, u8 op)
+{
+    u8         arity;
+    u32        idx;
+    i32        i32val;
+    i64        i64val;
+    Ctrl       *ctrl;
+    Error      *err;
+    const COp  *cop;
+
+    ctrl = arraylast(t->ctrls);
+
+    if (ctrl->dead || ctrl->unreachable) {
+        switch (op) {
+        case OpBlock:
+        case OpLoop:
+        case OpIf:
+            if (slow(blocktype(t, &arity) != NULL)) {
+                return newerror("malformed block type");
+            }
+
+            return pushctrl(t, op == OpLoop ? CtrlLoop : CtrlBlock, 1);
+
+        case OpElse:
+        case OpEnd:
+            if (ctrl->dead) {
+                if (op == OpEnd) {
+                    t->ctrls->len--;
+                }
+
+                return NULL;
+            }
+
+            break;
+
+        default:
+            return skipimm((u8 **) &t->p, t->end, op);
+        }
+    }
+
+    switch (op) {
+    case OpUnreachable:
+        emit(t, "env->trap(env, TRAP_UNREACHABLE);");
+        ctrl->unreachable = 1;
+        t->depth = ctrl->height;
+        return NULL;
+
+    case OpNop:
+        return NULL;
+
+    case OpBlock:
+    case OpLoop:
+        err = blocktype(t, &arity);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        err = pushctrl(t, op == OpBlock ? CtrlBlock : CtrlLoop, 0);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        ctrl = arraylast(t->ctrls);
+        ctrl->arity = arity;
+
+        if (op == OpLoop) {
+            emit(t, "L%u:;", ctrl->label);
+        }
+
+        return NULL;
+
+    case OpIf:
+        err = blocktype(t, &arity);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        if (slow(t->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        t->depth--;
+
+        err = pushctrl(t, CtrlIf, 0);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        ctrl = arraylast(t->ctrls);
+        ctrl->arity = arity;
+
+        emit(t, "if ((u32) s%u == 0) goto E%u;", t->depth, ctrl->label);
+        return NULL;
+
+    case OpElse:
+        if (slow(ctrl->kind != CtrlIf)) {
+            return newerror("else without if");
+        }
+
+        if (!ctrl->unreachable && ctrl->arity > 0) {
+            move(t, ctrl->height, t->depth - 1);
+        }
+
+        emit(t, "goto L%u;", ctrl->label);
+        emit(t, "E%u:;", ctrl->label);
+
+        ctrl->kind = CtrlElse;
+        ctrl->unreachable = 0;
+        t->depth = ctrl->height;
+        return NULL;
+
+    case OpEnd:
+        return endctrl(t);
+
+    case OpBr:
+    case OpBrIf:
+        if (slow(u32vdecode((u8 **) &t->p, t->end, &idx) != OK)) {
+            return newerror("malformed branch depth");
+        }
+
+        return branch(t, idx, op == OpBrIf);
+
+    case OpBrTable:
+        return brtable(t);
+
+    case OpReturn:
+        return branch(t, len(t->ctrls) - 1, 0);
+
+    case OpCall:
+        if (slow(u32vdecode((u8 **) &t->p, t->end, &idx) != OK)) {
+            return newerror("malformed call index");
+        }
+
+        return callfunc(t, idx);
+
+    case OpDrop:
+        if (slow(t->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        t->depth--;
+        return NULL;
+
+    case OpSelect:
+        if (slow(t->depth < ctrl->height + 3)) {
+            return newerror("stack underflow");
+        }
+
+        emit(t, "s%u = (u32) s%u ? s%u : s%u;", t->depth - 3, t->depth - 1,
+             t->depth - 3, t->depth - 2);
+        t->depth -= 2;
+        return NULL;
+
+    case OpGetLocal:
+    case OpSetLocal:
+    case OpTeeLocal:
+        if (slow(u32vdecode((u8 **) &t->p, t->end, &idx) != OK
+                 || idx >= t->nlocals))
+        {
+            return newerror("invalid local index");
+        }
+
+        if (op == OpGetLocal) {
+            emit(t, "s%u = l%u;", t->depth, idx);
+            t->depth++;
+            return NULL;
+        }
+
+        if (slow(t->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        emit(t, "l%u = s%u;", idx, t->depth - 1);
+
+        if (op == OpSetLocal) {
+            t->depth--;
+        }
+
+        return NULL;
+
+    case Opi32const:
+        if (slow(s32vdecode((u8 **) &t->p, t->end, &i32val) != OK)) {
+            return newerror("malformed i32.const");
+        }
+
+        emit(t, "s%u = %uu;", t->depth, (u32) i32val);
+        t->depth++;
+        return NULL;
+
+    case Opi64const:
+        if (slow(s64vdecode((u8 **) &t->p, t->end, &i64val) != OK)) {
+            return newerror("malformed i64.const");
+        }
+
+        emit(t, "s%u = %lluull;", t->depth, (unsigned long long) i64val);
+        t->depth++;
+        return NULL;
+
+    case OpCurrentMemory:
+    case OpGrowMemory:
+        if (slow(t->m->memories == NULL || len(t->m->memories) == 0)) {
+            return newerror(Enomemory);
+        }
+
+        if (slow(t->p >= t->end || *t->p++ != 0)) {
+            return newerror("malformed memory reserved byte");
+        }
+
+        if (op == OpCurrentMemory) {
+            emit(t, "s%u = env->size(env);", t->depth);
+            t->depth++;
+            return NULL;
+        }
+
+        if (slow(t->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        emit(t, "s%u = env->grow(env, s%u);", t->depth - 1, t->depth - 1);
+        return NULL;
+    }
+
+    if (op >= OpLoadi32 && op <= OpStorei64x32) {
+        if (slow(t->depth < ctrl->height + (op >= OpStorei32 ? 2 : 1))) {
+            return newerror("stack underflow");
+        }
+
+        return memop(t, op);
+    }
+
+    cop = &cops[op];
+    if (slow(cop->c == NULL)) {
+        return newerror(Eunsupported, op);
+    }
+
+    if (slow(t->depth < ctrl->height + cop->nargs)) {
+        return newerror("stack underflow");
+    }
+
+    emit(t, cop->c, t->depth - cop->nargs, t->depth - 1);
+    t->depth -= cop->nargs - 1;
+
+    return NULL;
+}
+
+
+/*
+ * Branch to the control frame `label` levels up.  Conditional branches pop
+ * the condition first and keep the carried value on the stack.
+ */
+static Error *
+branch(Translator *t, u32 label, u8 cond)
+{
+    u8    arity;
+    Ctrl  *ctrl, *target;
+
+    ctrl = arraylast(t->ctrls);
+
+    if (slow(label >= len(t->ctrls))) {
+        return newerror("invalid branch depth %d", label);
+    }
+
+    target = arrayget(t->ctrls, len(t->ctrls) - 1 - label);
+    arity = (target->kind == CtrlLoop) ? 0 : target->arity;
+
+    if (cond) {
+        if (slow(t->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        t->depth--;
+        emit(t, "if ((u32) s%u != 0) {", t->depth);
+        t->indent++;
+    }
+
+    if (slow(t->depth < ctrl->height + arity)) {
+        return newerror("stack underflow");
+    }
+
+    if (arity > 0) {
+        move(t, target->height, t->depth - 1);
+    }
+
+    emit(t, "goto L%u;", target->label);
+
+    if (cond) {
+        t->indent--;
+        emit(t, "}");
+        return NULL;
+    }
+
+    ctrl->unreachable = 1;
+    t->depth = ctrl->height;
+
+    return NULL;
+}
+
+
+static Error *
+brtable(Translator *t)
+{
+    u32    i, n, label, depth;
+    Ctrl   *ctrl;
+    Error  *err;
+
+    ctrl = arraylast(t->ctrls);
+
+    if (slow(u32vdecode((u8 **) &t->p, t->end, &n) != OK)) {
+        return newerror("malformed br_table");
+    }
+
+    if (slow(t->depth < ctrl->height + 1)) {
+        return newerror("stack underflow");
+    }
+
+    t->depth--;
+    depth = t->depth;
+
+    emit(t, "switch ((u32) s%u) {", depth);
+
+    for (i = 0; i <= n; i++) {
+        if (slow(u32vdecode((u8 **) &t->p, t->end, &label) != OK)) {
+            return newerror("malformed br_table");
+        }
+
+        if (i < n) {
+            emit(t, "case %u:", i);
+
+        } else {
+            emit(t, "default:");
+        }
+
+        t->indent++;
+        err = branch(t, label, 0);
+        t->indent--;
+
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        if (i < n) {
+            ctrl->unreachable = 0;
+            t->depth = depth;
+        }
+    }
+
+    emit(t, "}");
+
+    return NULL;
+}
+
+
+static Error *
+callfunc(Translator *t, u32 index)
+{
+    u32       i, base, nargs;
+    Ctrl      *ctrl;
+    TypeDecl  *type;
+
+    ctrl = arraylast(t->ctrls);
+
+    type = functype(t->m, index);
+    if (slow(type == NULL)) {
+        return newerror("call to unknown function %d", index);
+    }
+
+    nargs = len(type->params);
+
+    if (slow(t->depth < ctrl->height + nargs)) {
+        return newerror("stack underflow");
+    }
+
+    base = t->depth - nargs;
+
+    emit(t, "{");
+    t->indent++;
+
+    emit(t, "u64  a[%u];", (nargs > 0) ? nargs : 1);
+
+    for (i = 0; i < nargs; i++) {
+        emit(t, "a[%u] = s%u;", i, base + i);
+    }
+
+    if (len(type->rets) > 0) {
+        emit(t, (index < t->nimports)
+                ? "s%1$u = env->hosts[%2$u].call(&env->hosts[%2$u], a);"
+                : "s%u = f%u(env, a);", base, index);
+
+    } else {
+        emit(t, (index < t->nimports)
+                ? "env->hosts[%1$u].call(&env->hosts[%1$u], a);"
+                : "f%u(env, a);", index);
+    }
+
+    t->indent--;
+    emit(t, "}");
+
+    t->depth = base + len(type->rets);
+
+    return NULL;
+}
+
+
+static Error *
+endctrl(Translator *t)
+{
+    Ctrl  *ctrl;
+
+    ctrl = arraylast(t->ctrls);
+
+    if (!ctrl->unreachable && ctrl->arity > 0) {
+        if (slow(t->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        move(t, ctrl->height, t->depth - 1);
+    }
+
+    t->depth = ctrl->height + ctrl->arity;
+    t->ctrls->len--;
+
+    /* labels go one level out, the popped frame is still in place */
+
+    if (ctrl->kind == CtrlIf) {
+        emit(t, "E%u:;", ctrl->label);
+    }
+
+    if (ctrl->kind != CtrlLoop) {
+        emit(t, "L%u:;", ctrl->label);
+    }
+
+    if (len(t->ctrls) == 0) {
+        t->indent++;
+        emit(t, (t->depth > 0) ? "return s0;" : "return 0;");
+        t->indent--;
+    }
+
+    return NULL;
+}
+
+
+static Error *
+pushctrl(Translator *t, CtrlKind kind, u8 dead)
+{
+    Ctrl  ctrl;
+
+    memset(&ctrl, 0, sizeof(Ctrl));
+
+    ctrl.kind = kind;
+    ctrl.dead = dead;
+    ctrl.height = t->depth;
+    ctrl.label = t->nlabels++;
+
+    if (slow(arrayadd(t->ctrls, &ctrl) != OK)) {
+        return newerror("failed to push control frame: %s", strerror(errno));
+    }
+
+    return NULL;
+}
+
+
+static Error *
+blocktype(Translator *t, u8 *arity)
+{
+    u8  type;
+
+    *arity = 0;
+
+    if (slow(t->p >= t->end)) {
+        return newerror("malformed block type");
+    }
+
+    type = *t->p++;
+
+    switch (type) {
+    case 0x40:
+        *arity = 0;
+        return NULL;
+
+    case 0x7f:
+    case 0x7e:
+        *arity = 1;
+        return NULL;
+    }
+
+    return newerror("block type 0x%x not supported", type);
+}
+
+
+/*
+ * As in the jit, the guard region covers any u32 address plus u32 offset,
+ * so nothing is checked here.
+ */
+static Error *
+memop(Translator *t, u8 op)
+{
+    u32           align, offset;
+    const CMemOp  *mop;
+
+    if (slow(t->m->memories == NULL || len(t->m->memories) == 0)) {
+        return newerror(Enomemory);
+    }
+
+    mop = &cmemops[op - OpLoadi32];
+    if (slow(mop->bits == 0)) {
+        return newerror(Eunsupported, op);
+    }
+
+    if (slow(u32vdecode((u8 **) &t->p, t->end, &align) != OK
+             || u32vdecode((u8 **) &t->p, t->end, &offset) != OK))
+    {
+        return newerror("malformed memory immediate");
+    }
+
+    if (op < OpStorei32) {
+        emit(t, "s%u = %sld%u(m + (u64) (u32) s%u + %uu);", t->depth - 1,
+             mop->conv, mop->bits, t->depth - 1, offset);
+        return NULL;
+    }
+
+    emit(t, "st%u(m + (u64) (u32) s%u + %uu, s%u);", mop->bits, t->depth - 2,
+         offset, t->depth - 1);
+
+    t->depth -= 2;
+
+    return NULL;
+}
+
+
+static void
+move(Translator *t, u32 dst, u32 src)
+{
+    if (dst != src) {
+        emit(t, "s%u = s%u;", dst, src);
+    }
+}
+
+
+static void
+emit(Translator *t, const char *fmt, ...)
+{
+    u32      i;
+    va_list  args;
+
+    for (i = 0; i < len(t->ctrls) + t->indent; i++) {
+        fputs("    ", t->out);
+    }
+
+    va_start(args, fmt);
+    vfprintf(t->out, fmt, args);
+    va_end(args);
+
+    fputc('\n', t->out);
+}
+
+
+/*
+ * The cache directory is `cachedir`, or else $XDG_CACHE_HOME/oak-aot or
+ * ~/.cache/oak-aot.  What is in it gets dlopen()ed, so it is only used if it
+ * is a directory, not a link to one, of the effective user and closed to
+ * everyone else.
+ */
+static Error *
+cachedirectory(const char *cachedir, char *dir, size_t size)
+{
+    int          n;
+    const char   *base;
+    struct stat  st;
+
+    if (cachedir != NULL) {
+        n = snprintf(dir, size, "%s", cachedir);
+
+    } else {
+        base = getenv("XDG_CACHE_HOME");
+
+        if (base != NULL && base[0] == '/') {
+            n = snprintf(dir, size, "%s", base);
+
+        } else {
+            base = getenv("HOME");
+            if (slow(base == NULL || base[0] != '/')) {
+                return newerror("no cache directory, as neither "
+                                "XDG_CACHE_HOME nor HOME is set");
+            }
+
+            n = snprintf(dir, size, "%s/.cache", base);
+        }
+
+        /* the base directory may be missing, as on a fresh account */
+
+        if (n >= 0 && (size_t) n < size) {
+            (void) mkdir(dir, 0700);
+            n += snprintf(dir + n, size - n, "/" AOT_CACHE_NAME);
+        }
+    }
+
+    if (slow(n < 0 || (size_t) n >= size)) {
+        return newerror("cache directory path too long");
+    }
+
+    if (slow(mkdir(dir, 0700) != 0 && errno != EEXIST)) {
+        return newerror("failed to create %s: %s", dir, strerror(errno));
+    }
+
+    if (slow(lstat(dir, &st) != 0)) {
+        return newerror("failed to stat %s: %s", dir, strerror(errno));
+    }
+
+    if (slow(!S_ISDIR(st.st_mode) || st.st_uid != geteuid()
+             || (st.st_mode & (S_IRWXG | S_IRWXO)) != 0))
+    {
+        return newerror("%s is not a directory only this user can access",
+                        dir);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Translates to a temporary C file and compiles it next to `path`, renaming
+ * the object in place at the end so concurrent builds of the same module
+ * never load a partial object.  Both temporaries are created exclusively,
+ * so nothing already at their names is followed or written through.
+ */
+static Error *
+build(const Module *m, const char *path)
+{
+    u32    id;
+    int    fd;
+    char   src[1100], obj[1100];
+    FILE   *out;
+    Error  *err;
+
+    id = __atomic_add_fetch(&nbuilds, 1, __ATOMIC_RELAXED);
+
+    snprintf(src, sizeof(src), "%s.%d.%d.c", path, (int) getpid(), id);
+    snprintf(obj, sizeof(obj), "%s.%d.%d", path, (int) getpid(), id);
+
+    fd = open(obj, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+              0600);
+    if (slow(fd == -1)) {
+        return newerror("failed to create %s: %s", obj, strerror(errno));
+    }
+
+    close(fd);
+
+    fd = open(src, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+              0600);
+    if (slow(fd == -1)) {
+        unlink(obj);
+        return newerror("failed to create %s: %s", src, strerror(errno));
+    }
+
+    out = fdopen(fd, "w");
+    if (slow(out == NULL)) {
+        close(fd);
+        unlink(src);
+        unlink(obj);
+        return newerror("failed to open %s: %s", src, strerror(errno));
+    }
+
+    err = aottranslate(m, out);
+
+    if (slow(fclose(out) != 0 && err == NULL)) {
+        err = newerror("failed to write %s: %s", src, strerror(errno));
+    }
+
+    if (err == NULL) {
+        err = compile(src, obj);
+    }
+
+    if (err == NULL && slow(rename(obj, path) != 0)) {
+        err = newerror("failed to rename %s: %s", obj, strerror(errno));
+    }
+
+    if (err != NULL) {
+        unlink(obj);
+    }
+
+    unlink(src);
+
+    return err;
+}
+
+
+static Error *
+compile(const char *src, const char *obj)
+{
+    int    status;
+    u32    n;
+    char   cc[] = OAK_CC, *argv[CC_MAXARGS + 8], *save, *word;
+    pid_t  pid;
+
+    n = 0;
+
+    for (word = strtok_r(cc, " \t", &save);
+         word != NULL && n < CC_MAXARGS;
+         word = strtok_r(NULL, " \t", &save))
+    {
+        argv[n++] = word;
+    }
+
+    if (slow(n == 0)) {
+        return newerror("no C compiler configured");
+    }
+
+    argv[n++] = "-O2";
+    argv[n++] = "-shared";
+    argv[n++] = "-fPIC";
+    argv[n++] = "-w";
+    argv[n++] = "-o";
+    argv[n++] = (char *) obj;
+    argv[n++] = (char *) src;
+    argv[n] = NULL;
+
+    errno = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    if (slow(errno != 0)) {
+        return newerror("failed to run %s: %s", argv[0], strerror(errno));
+    }
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (slow(errno != EINTR)) {
+            return newerror("failed to wait for %s: %s", argv[0],
+                            strerror(errno));
+        }
+    }
+
+    if (slow(!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+        return newerror("%s failed with status 0x%x", argv[0], status);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Only objects of the effective user that no one else can write are
+ * loaded, even in a directory that passed cachedirectory().
+ */
+static Error *
+load(Aot *aot, const char *path)
+{
+    void           *handle;
+    const u32      *abi, *envsize, *nfuncs;
+    struct stat    st;
+    const AotFunc  *table;
+
+    if (slow(lstat(path, &st) != 0)) {
+        return newerror("failed to stat %s: %s", path, strerror(errno));
+    }
+
+    if (slow(!S_ISREG(st.st_mode) || st.st_uid != geteuid()
+             || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0))
+    {
+        return newerror("%s is not a file only this user can write", path);
+    }
+
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (slow(handle == NULL)) {
+        return newerror("failed to load %s: %s", path, dlerror());
+    }
+
+    abi = dlsym(handle, "oak_abi");
+    envsize = dlsym(handle, "oak_envsize");
+    nfuncs = dlsym(handle, "oak_nfuncs");
+    table = dlsym(handle, "oak_funcs");
+
+    if (slow(abi == NULL || envsize == NULL || nfuncs == NULL
+             || table == NULL || *abi != AOT_ABI
+             || *envsize != sizeof(AotEnv)
+             || *nfuncs != aot->nfuncs - aot->nimports))
+    {
+        dlclose(handle);
+        return newerror("%s was not built for this module", path);
+    }
+
+    aot->handle = handle;
+    aot->table = table;
+
+    return NULL;
+}
+
+
+static void
+aottrap(void *env, u32 trap)
+{
+    Aot  *aot;
+
+    aot = env;
+    aot->trap = trap;
+    longjmp(*(jmp_buf *) aot->jmp, 1);
+}
+
+
+/*
+ * Called from the SIGSEGV handler for faults inside the guarded memory.
+ */
+static void
+aotmemtrap(void *data)
+{
+    aottrap(data, TrapOutOfBounds);
+}
+
+
+static u64
+aotgrow(void *env, u64 delta)
+{
+    return growmemory(((Aot *) env)->memory, (u32) delta);
+}
+
+
+static u64
+aotsize(void *env)
+{
+    return ((Aot *) env)->memory->pages;
+}
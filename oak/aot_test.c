@@ -0,0 +1,450 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/jit.h>
+#include <oak/aot.h>
+#include <oak/host.h>
+#include "test.h"
+
+
+typedef struct {
+    const char  *func;
+    u64         args[4];
+    u64         want;
+    const char  *err;
+} Testcase;
+
+
+static Error *test_kernels(const char *dir);
+static Error *test_memory(const char *dir);
+static Error *test_host(const char *dir);
+static Error *test_unsupported(const char *dir);
+static Error *callexport(Aot *aot, const Testcase *tc);
+static void cleanup(const char *dir);
+
+static i32 hostadd(void *data, i32 a, i32 b);
+static u64 hostadd64(void *data, u64 *args);
+static u64 hostnop(void *data, u64 *args);
+static u64 hostmix(void *data, u64 *args);
+
+
+#define I32MIN  0x80000000
+#define I64MIN  0x8000000000000000
+#define NEG32   0xffffffff      /* -1 as i32 */
+#define NEG64   0xffffffffffffffff
+
+
+static const Testcase  kernels[] = {
+    {"i32.add", {NEG32, 1}, 0, NULL},
+    {"i32.mul", {NEG32, 7}, 0xfffffff9, NULL},
+    {"i32.div_s", {NEG32 - 9, 3}, NEG32 - 2, NULL},
+    {"i32.div_s", {7, 0}, 0, "trap: integer divide by zero"},
+    {"i32.div_s", {I32MIN, NEG32}, 0, "trap: integer overflow"},
+    {"i32.div_u", {NEG32, 2}, 0x7fffffff, NULL},
+    {"i32.rem_s", {NEG32 - 9, 3}, NEG32, NULL},
+    {"i32.rem_s", {I32MIN, NEG32}, 0, NULL},
+    {"i32.shl", {1, 33}, 2, NULL},
+    {"i32.shr_s", {I32MIN, 31}, NEG32, NULL},
+    {"i32.shr_u", {I32MIN, 31}, 1, NULL},
+    {"i32.rotl", {I32MIN | 1, 1}, 3, NULL},
+    {"i32.rotr", {3, 1}, I32MIN | 1, NULL},
+    {"i32.lt_s", {NEG32, 0}, 1, NULL},
+    {"i32.gt_u", {NEG32, 0}, 1, NULL},
+
+    {"i64.add", {NEG64, 2}, 1, NULL},
+    {"i64.mul", {0x100000000, 0x10}, 0x1000000000, NULL},
+    {"i64.div_s", {I64MIN, NEG64}, 0, "trap: integer overflow"},
+    {"i64.div_u", {1, 0}, 0, "trap: integer divide by zero"},
+    {"i64.rem_s", {I64MIN, NEG64}, 0, NULL},
+    {"i64.rem_u", {0x100000001, 0x100000000}, 1, NULL},
+    {"i64.shl", {1, 63}, I64MIN, NULL},
+    {"i64.shr_s", {I64MIN, 63}, NEG64, NULL},
+    {"i64.rotl", {I64MIN, 1}, 1, NULL},
+    {"i64.rotr", {1, 1}, I64MIN, NULL},
+    {"i64.lt_s", {NEG64, 0}, 1, NULL},
+    {"i64.ge_u", {0, NEG64}, 0, NULL},
+
+    {"i32.eqz", {I32MIN}, 0, NULL},
+    {"i64.eqz", {0x100000000}, 0, NULL},
+    {"i32.wrap", {0x1ffffffff}, NEG32, NULL},
+    {"i64.extend_s", {NEG32}, NEG64, NULL},
+    {"i64.extend_u", {NEG32}, NEG32, NULL},
+    {"select", {1, 2, 0}, 2, NULL},
+    {"select", {1, 2, 7}, 1, NULL},
+
+    {"fac", {20}, 2432902008176640000, NULL},
+    {"fibrec", {20}, 6765, NULL},
+    {"fib", {40}, 102334155, NULL},
+    {"sum", {100000}, 4999950000, NULL},
+    {"brif", {1}, 7, NULL},
+    {"brif", {0}, 9, NULL},
+    {"abs", {NEG32 - 4}, 5, NULL},
+    {"abs", {5}, 5, NULL},
+    {"deep", {1}, 137, NULL},
+    {"spill", {3}, 42, NULL},
+    {"dead", {0}, 3, NULL},
+    {"zero", {0}, 0, NULL},
+    {"unreachable", {0}, 0, "trap: unreachable executed"},
+    {"recurse", {0}, 0, "trap: call stack exhausted"},
+    {"bigrecurse", {0}, 0, "trap: call stack exhausted"},
+};
+
+
+/* run in order against the same memory */
+static const Testcase  memcases[] = {
+    {"size", {0}, 1, NULL},
+    {"rw32", {65532, 0xdeadbeef}, 0xdeadbeef, NULL},
+    {"rw8", {7, 0x180}, NEG32 - 127, NULL},
+    {"rw16", {9, 0x12345}, 0x2345, NULL},
+    {"rw64", {16, NEG64 - 1}, NEG64 - 1, NULL},
+    {"rw32s", {24, 0x80000000}, 0xffffffff80000000, NULL},
+    {"spill", {32, 42}, 42, NULL},
+    {"load", {65533}, 0, "trap: out of bounds memory access"},
+    {"offset", {0}, 0, "trap: out of bounds memory access"},
+    {"grow", {1}, 36, NULL},
+    {"size", {0}, 2, NULL},
+    {"load", {65533}, 0xdeadbe, NULL},
+    {"grow", {1}, 34, NULL},
+    {"load", {131069}, 0, "trap: out of bounds memory access"},
+};
+
+
+int
+main()
+{
+    char   dir[] = "/tmp/oak-aot-test.XXXXXX";
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    if (slow(mkdtemp(dir) == NULL)) {
+        cprint("[error] failed to create cache directory\n");
+        return 1;
+    }
+
+    err = test_kernels(dir);
+
+    if (err == NULL) {
+        err = test_memory(dir);
+    }
+
+    if (err == NULL) {
+        err = test_host(dir);
+    }
+
+    if (err == NULL) {
+        err = test_unsupported(dir);
+    }
+
+    cleanup(dir);
+
+    if (slow(err != NULL)) {
+        cprint("[error] %e\n", err);
+        errorfree(err);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static Error *
+test_kernels(const char *dir)
+{
+    u32     i, run;
+    Aot     aot;
+    Error   *err;
+    Module  *m;
+
+    err = loadmodule(&m, "testdata/ok/kernels.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    /* the second run must load the object built by the first */
+
+    for (run = 0; run < 2; run++) {
+        err = aotmodule(&aot, m, dir);
+        if (slow(err != NULL)) {
+            err = error(err, "compiling kernels.wasm");
+            break;
+        }
+
+        if (slow(aot.cached != run)) {
+            err = newerror("run %d: cached is %d", run, aot.cached);
+            aotclose(&aot);
+            break;
+        }
+
+        for (i = 0; i < nitems(kernels); i++) {
+            err = callexport(&aot, &kernels[i]);
+            if (slow(err != NULL)) {
+                break;
+            }
+        }
+
+        aotclose(&aot);
+
+        if (slow(err != NULL)) {
+            break;
+        }
+    }
+
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+test_memory(const char *dir)
+{
+    u32           i;
+    Aot           aot;
+    Error         *err;
+    Module        *m;
+    MemoryDecl    *decl;
+    LinearMemory  mem;
+
+    err = loadmodule(&m, "testdata/ok/memory.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = aotmodule(&aot, m, dir);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        return error(err, "compiling memory.wasm");
+    }
+
+    err = callexport(&aot, &memcases[0]);
+    if (slow(err == NULL || !iserror(err, "module has no linear memory"))) {
+        err = error(err, "aotcall must require a memory");
+        goto done;
+    }
+
+    errorfree(err);
+
+    decl = arrayget(m->memories, 0);
+
+    err = newmemory(&mem, &decl->limit);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    aot.memory = &mem;
+
+    for (i = 0; i < nitems(memcases); i++) {
+        err = callexport(&aot, &memcases[i]);
+        if (slow(err != NULL)) {
+            break;
+        }
+    }
+
+    closememory(&mem);
+
+done:
+
+    aotclose(&aot);
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+test_host(const char *dir)
+{
+    Aot       aot;
+    Error     *err;
+    Module    *m;
+    Testcase  add = {"add", {2, 3}, 1005, NULL};
+    Testcase  mix = {"mix", {5, 0x10000000000, 7}, 0x70000000005, NULL};
+    Testcase  sum = {"sum", {100}, 4950, NULL};
+    HostFunc  funcs[] = {
+        {"env", "add", (void *) hostadd, NULL, 0},
+        {"env", "add64", (void *) hostadd64, NULL, 1},
+        {"env", "nop", (void *) hostnop, NULL, 1},
+        {"env", "mix", (void *) hostmix, NULL, 1},
+    };
+
+    err = loadmodule(&m, "testdata/ok/host.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = aotmodule(&aot, m, dir);
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        return error(err, "compiling host.wasm");
+    }
+
+    err = callexport(&aot, &add);
+    if (slow(err == NULL
+             || !iserror(err, "4 of 4 imported functions not bound")))
+    {
+        err = error(err, "call with unbound imports must fail");
+        goto done;
+    }
+
+    errorfree(err);
+
+    err = aotbind(&aot, funcs, nitems(funcs));
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    err = callexport(&aot, &add);
+    if (err == NULL) {
+        err = callexport(&aot, &mix);
+    }
+
+    if (err == NULL) {
+        err = callexport(&aot, &sum);
+    }
+
+done:
+
+    aotclose(&aot);
+
+    return err;
+}
+
+
+static Error *
+test_unsupported(const char *dir)
+{
+    Aot     aot;
+    Error   *err;
+    Module  *m;
+
+    err = loadmodule(&m, "testdata/ok/floats.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = aotmodule(&aot, m, dir);
+    closemodule(m);
+
+    if (slow(err == NULL)) {
+        aotclose(&aot);
+        return newerror("floats.wasm must not compile");
+    }
+
+    if (slow(!iserror(err, "opcode 0x43 not supported"))) {
+        return error(err, "unexpected error");
+    }
+
+    errorfree(err);
+
+    return NULL;
+}
+
+
+static Error *
+callexport(Aot *aot, const Testcase *tc)
+{
+    u64         args[4], got;
+    Error       *err;
+    String      field;
+    ExportDecl  *export;
+
+    cstr(&field, (u8 *) tc->func);
+
+    export = findexport(aot->module, &field);
+    if (slow(export == NULL)) {
+        return newerror("export %s not found", tc->func);
+    }
+
+    memcpy(args, tc->args, sizeof(args));
+
+    got = 0;
+
+    err = aotcall(aot, export->index, args, &got);
+    if (err != NULL) {
+        if (tc->err == NULL) {
+            return error(err, "%s must not fail", tc->func);
+        }
+
+        if (slow(!iserror(err, tc->err))) {
+            return error(err, "%s: expected error \"%s\"", tc->func, tc->err);
+        }
+
+        errorfree(err);
+        return NULL;
+    }
+
+    if (slow(tc->err != NULL)) {
+        return newerror("%s: expected error \"%s\"", tc->func, tc->err);
+    }
+
+    if (slow(got != tc->want)) {
+        return newerror("%s: result mismatch (%x(u64) != %x(u64))", tc->func,
+                        got, tc->want);
+    }
+
+    return NULL;
+}
+
+
+static void
+cleanup(const char *dir)
+{
+    DIR            *d;
+    char           path[512];
+    struct dirent  *entry;
+
+    d = opendir(dir);
+    if (d == NULL) {
+        return;
+    }
+
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            unlink(path);
+        }
+    }
+
+    closedir(d);
+    rmdir(dir);
+}
+
+
+static i32
+hostadd(void * unused(data), i32 a, i32 b)
+{
+    return a + b;
+}
+
+
+static u64
+hostadd64(void * unused(data), u64 *args)
+{
+    return args[0] + args[1];
+}
+
+
+static u64
+hostnop(void * unused(data), u64 * unused(args))
+{
+    return 0;
+}
+
+
+static u64
+hostmix(void * unused(data), u64 *args)
+{
+    return (u32) args[0] + args[1] * (u32) args[2];
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/jit.h>
+
+
+/*
+ * Overhead of fuel metering and of epoch checks on the kernels of
+ * testdata/ok/kernels.wasm: the same kernels jitted plain, metered and with
+ * epoch interruption, and the fuel each call takes.
+ */
+
+
+typedef struct {
+    const char  *func;
+    u64         arg;
+    u32         iters;
+} Kernel;
+
+
+static Error *bench(Jit *jits, const Kernel *k);
+static Error *run(Jit *jit, u32 index, const Kernel *k, u64 *ns, u64 *ret);
+static u64 now();
+
+
+static const Kernel  kernels[] = {
+    {"fibrec", 27, 10},
+    {"fib", 1000000, 100},
+    {"sum", 1000000, 100},
+    {"fac", 20, 1000000},
+};
+
+
+int
+main(int argc, char **argv)
+{
+    u32         i;
+    Jit         jits[3];
+    Error       *err;
+    Module      *m;
+    const char  *filename;
+    JitMode     modes[] = {JitEager, JitMetered, JitEpoch};
+
+    fmtadd('e', errorfmt);
+
+    filename = (argc > 1) ? argv[1] : "testdata/ok/kernels.wasm";
+
+    err = loadmodule(&m, filename);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    for (i = 0; i < nitems(modes); i++) {
+        err = jitmodule(&jits[i], m, modes[i]);
+        if (slow(err != NULL)) {
+            break;
+        }
+    }
+
+    if (slow(err != NULL)) {
+        while (i > 0) {
+            jitclose(&jits[--i]);
+        }
+
+        closemodule(m);
+        goto fail;
+    }
+
+    printf("%-10s %14s %14s %8s %14s %8s %12s\n", "kernel", "plain ns/call",
+           "metered ns", "ratio", "epoch ns", "ratio", "fuel/call");
+
+    for (i = 0; i < nitems(kernels); i++) {
+        err = bench(jits, &kernels[i]);
+        if (slow(err != NULL)) {
+            break;
+        }
+    }
+
+    for (i = 0; i < nitems(modes); i++) {
+        jitclose(&jits[i]);
+    }
+
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+bench(Jit *jits, const Kernel *k)
+{
+    u32         i;
+    u64         ns[3], got[3], fuel;
+    Error       *err;
+    String      field;
+    ExportDecl  *export;
+
+    cstr(&field, (u8 *) k->func);
+
+    export = findexport(jits[0].module, &field);
+    if (slow(export == NULL)) {
+        return newerror("export %s not found", k->func);
+    }
+
+    jits[1].fuel = 0xffffffffffffffff;
+
+    for (i = 0; i < 3; i++) {
+        err = run(&jits[i], export->index, k, &ns[i], &got[i]);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        if (slow(got[i] != got[0])) {
+            return newerror("%s: result mismatch (%d(u64) != %d(u64))",
+                            k->func, got[i], got[0]);
+        }
+    }
+
+    fuel = (0xffffffffffffffff - jits[1].fuel) / k->iters;
+
+    printf("%-10s %14.1f %14.1f %8.2f %14.1f %8.2f %12llu\n", k->func,
+           (double) ns[0] / k->iters, (double) ns[1] / k->iters,
+           (double) ns[1] / ns[0], (double) ns[2] / k->iters,
+           (double) ns[2] / ns[0], (unsigned long long) fuel);
+
+    return NULL;
+}
+
+
+static Error *
+run(Jit *jit, u32 index, const Kernel *k, u64 *ns, u64 *ret)
+{
+    u32    i;
+    u64    arg, start;
+    Error  *err;
+
+    start = now();
+
+    for (i = 0; i < k->iters; i++) {
+        arg = k->arg;
+
+        err = jitcall(jit, index, &arg, ret);
+        if (slow(err != NULL)) {
+            return err;
+        }
+    }
+
+    *ns = now() - start;
+
+    return NULL;
+}
+
+
+static u64
+now()
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
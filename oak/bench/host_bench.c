@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/jit.h>
+#include <oak/host.h>
+
+
+/*
+ * Cost of a guest to host call: the "sum" loop of testdata/ok/host.wasm calls
+ * the env.add import once per iteration, bound through its typed trampoline
+ * and as a raw function, against a C loop calling the same host function
+ * through a pointer.
+ */
+
+
+#define NCALLS  10000000
+
+
+static Error *bench(const char *name, Module *m, const HostFunc *add);
+static void report(const char *name, u64 ns, u64 sum);
+static i32 hostadd(void *data, i32 a, i32 b);
+static u64 hostaddraw(void *data, u64 *args);
+static u64 now();
+
+
+static i32  (*volatile nativeadd)(void *, i32, i32) = hostadd;
+
+
+int
+main()
+{
+    u32       i;
+    u64       start, sum;
+    Error     *err;
+    Module    *m;
+    HostFunc  typed = {"env", "add", (void *) hostadd, NULL, 0};
+    HostFunc  raw = {"env", "add", (void *) hostaddraw, NULL, 1};
+
+    fmtadd('e', errorfmt);
+
+    err = loadmodule(&m, "testdata/ok/host.wasm");
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    printf("%-12s %10s\n", "host call", "ns/call");
+
+    err = bench("typed", m, &typed);
+    if (err == NULL) {
+        err = bench("raw", m, &raw);
+    }
+
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    start = now();
+    sum = 0;
+
+    for (i = 0; i < NCALLS; i++) {
+        sum = (u32) nativeadd(NULL, sum, i);
+    }
+
+    report("native", now() - start, sum);
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+bench(const char *name, Module *m, const HostFunc *add)
+{
+    u64         args[1], start, sum;
+    Jit         jit;
+    Error       *err;
+    String      field = str("sum");
+    ExportDecl  *export;
+
+    export = findexport(m, &field);
+    if (slow(export == NULL)) {
+        return newerror("export sum not found");
+    }
+
+    err = jitmodule(&jit, m, JitEager);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    /* the other imports are not called by "sum" */
+
+    err = jitbind(&jit, (HostFunc[]) {
+                      *add,
+                      {"env", "add64", (void *) hostaddraw, NULL, 1},
+                      {"env", "nop", (void *) hostaddraw, NULL, 1},
+                      {"env", "mix", (void *) hostaddraw, NULL, 1},
+                  }, 4);
+    if (slow(err != NULL)) {
+        jitclose(&jit);
+        return err;
+    }
+
+    args[0] = NCALLS;
+
+    start = now();
+
+    err = jitcall(&jit, export->index, args, &sum);
+
+    if (err == NULL) {
+        report(name, now() - start, sum);
+    }
+
+    jitclose(&jit);
+
+    return err;
+}
+
+
+static void
+report(const char *name, u64 ns, u64 sum)
+{
+    printf("%-12s %10.2f   (sum %x)\n", name, (double) ns / NCALLS,
+           (u32) sum);
+}
+
+
+static i32
+hostadd(void * unused(data), i32 a, i32 b)
+{
+    return (u32) a + (u32) b;
+}
+
+
+static u64
+hostaddraw(void * unused(data), u64 *args)
+{
+    return (u32) (args[0] + args[1]);
+}
+
+
+static u64
+now()
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/jit.h>
+
+
+/*
+ * Compares jitted compute kernels from testdata/ok/kernels.wasm against the
+ * same kernels compiled by the C compiler.
+ */
+
+
+typedef u64 (*Native)(u64 arg);
+
+
+typedef struct {
+    const char  *func;
+    u64         arg;
+    u32         iters;
+    Native      native;
+} Kernel;
+
+
+static u64 nativefibrec(u64 n);
+static u64 nativefib(u64 n);
+static u64 nativesum(u64 n);
+static u64 nativefac(u64 n);
+
+static Error *bench(Jit *jit, const Kernel *k);
+static Error *setup(Module *m);
+static u64 now();
+
+
+static const Kernel  kernels[] = {
+    {"fibrec", 27, 10, nativefibrec},
+    {"fib", 1000000, 100, nativefib},
+    {"sum", 1000000, 100, nativesum},
+    {"fac", 20, 1000000, nativefac},
+};
+
+
+int
+main(int argc, char **argv)
+{
+    u32         i;
+    Jit         jit;
+    Error       *err;
+    Module      *m;
+    const char  *filename;
+
+    fmtadd('e', errorfmt);
+
+    filename = (argc > 1) ? argv[1] : "testdata/ok/kernels.wasm";
+
+    err = loadmodule(&m, filename);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = setup(m);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        goto fail;
+    }
+
+    err = jitmodule(&jit, m, JitEager);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        goto fail;
+    }
+
+    printf("%-10s %14s %14s %8s\n", "kernel", "jit ns/call", "cc ns/call",
+           "ratio");
+
+    for (i = 0; i < nitems(kernels); i++) {
+        err = bench(&jit, &kernels[i]);
+        if (slow(err != NULL)) {
+            break;
+        }
+    }
+
+    jitclose(&jit);
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+/*
+ * Time to get a callable module with every function compiled up front versus
+ * compiled on first call.
+ */
+static Error *
+setup(Module *m)
+{
+    u32      i, iters;
+    u64      start, eagerns, lazyns;
+    Jit      jit;
+    Error    *err;
+
+    iters = 1000;
+
+    start = now();
+
+    for (i = 0; i < iters; i++) {
+        err = jitmodule(&jit, m, JitEager);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        jitclose(&jit);
+    }
+
+    eagerns = now() - start;
+
+    start = now();
+
+    for (i = 0; i < iters; i++) {
+        err = jitmodule(&jit, m, JitLazy);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        jitclose(&jit);
+    }
+
+    lazyns = now() - start;
+
+    printf("%-10s %14s %14s\n", "setup", "eager ns", "lazy ns");
+    printf("%-10s %14.1f %14.1f\n\n", "kernels",
+           (double) eagerns / iters, (double) lazyns / iters);
+
+    return NULL;
+}
+
+
+static Error *
+bench(Jit *jit, const Kernel *k)
+{
+    u32         i;
+    u64         arg, got, want, start, jitns, ccns;
+    Error       *err;
+    String      field;
+    ExportDecl  *export;
+
+    cstr(&field, (u8 *) k->func);
+
+    export = findexport(jit->module, &field);
+    if (slow(export == NULL)) {
+        return newerror("export %s not found", k->func);
+    }
+
+    got = 0;
+    want = 0;
+
+    start = now();
+
+    for (i = 0; i < k->iters; i++) {
+        arg = k->arg;
+
+        err = jitcall(jit, export->index, &arg, &got);
+        if (slow(err != NULL)) {
+            return err;
+        }
+    }
+
+    jitns = now() - start;
+
+    start = now();
+
+    for (i = 0; i < k->iters; i++) {
+        want = k->native(k->arg);
+    }
+
+    ccns = now() - start;
+
+    if (slow(got != want)) {
+        return newerror("%s: result mismatch (%d(u64) != %d(u64))", k->func,
+                        got, want);
+    }
+
+    printf("%-10s %14.1f %14.1f %8.2f\n", k->func,
+           (double) jitns / k->iters, (double) ccns / k->iters,
+           (double) jitns / (ccns ? ccns : 1));
+
+    return NULL;
+}
+
+
+static u64
+now()
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/*
+ * Native kernels take a volatile copy of the argument so the compiler can't
+ * fold them into constants.
+ */
+
+
+static u64
+nativefibrec(u64 n)
+{
+    volatile u32  v;
+
+    v = (u32) n;
+
+    if (v < 2) {
+        return v;
+    }
+
+    return (u32) (nativefibrec(v - 1) + nativefibrec(v - 2));
+}
+
+
+static u64
+nativefib(u64 n)
+{
+    u32           a, b, t;
+    volatile u32  v;
+
+    v = (u32) n;
+    a = 0;
+    b = 1;
+
+    while (v != 0) {
+        t = a + b;
+        a = b;
+        b = t;
+        v = v - 1;
+    }
+
+    return a;
+}
+
+
+static u64
+nativesum(u64 n)
+{
+    u32           i;
+    u64           acc;
+    volatile u32  v;
+
+    v = (u32) n;
+    acc = 0;
+
+    for (i = 0; i < v; i++) {
+        acc += i;
+    }
+
+    return acc;
+}
+
+
+static u64
+nativefac(u64 n)
+{
+    volatile i64  v;
+
+    v = (i64) n;
+
+    if (v < 2) {
+        return 1;
+    }
+
+    return v * nativefac(v - 1);
+}
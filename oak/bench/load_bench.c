@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include "../gen.h"
+#include "../test.h"
+
+
+/*
+ * loadmodule() and closemodule() latency, as p50 and p99 of single runs,
+ * load throughput over the file size, and the allocations and bytes each
+ * load asks for, from memstats().  Without file arguments, it runs on testdata/ok and on modules
+ * of genfuncs[i] exported functions written to /tmp.  With -sweep MB, it
+ * runs on generated modules instead, from 64 KB up to MB, doubling.
+ *
+ * Each module is loaded until MINNS have gone by, at least MINITERS and at
+ * most MAXITERS times, after a first load to warm up.  With -json, each
+ * module is a line of JSON with the fields in the same order as the text
+ * columns, to compare builds.
+ */
+
+
+#define MINITERS    5
+#define MAXITERS    20000
+#define MINNS       200000000
+
+#define SWEEPMIN    (64 * 1024)
+
+#define GENERATED   "/tmp/oak-load-bench.wasm"
+
+
+typedef struct {
+    const char  *name;
+    u64         size;
+    u32         iters;
+    u64         loadp50;
+    u64         loadp99;
+    u64         closep50;
+    u64         allocs;     /* per load */
+    u64         bytes;      /* per load */
+} Result;
+
+
+static Error *bench(const char *filename, Result *r);
+static Error *generated(u8 json);
+static Error *sweep(u64 maxsize, u8 json);
+static void report(const Result *r, u8 json);
+static int byns(const void *a, const void *b);
+static u64 now();
+
+
+static const u32  genfuncs[] = { 1000, 16000, 128000 };
+
+
+int
+main(int argc, char **argv)
+{
+    u8      json;
+    u32     i, n;
+    u64     maxsize;
+    char    **names;
+    Error   *err;
+    Result  r;
+
+    fmtadd('e', errorfmt);
+
+    memtrack(1);
+
+    json = 0;
+    maxsize = 0;
+
+    while (argc > 1 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-json") == 0) {
+            json = 1;
+
+        } else if (strcmp(argv[1], "-sweep") == 0 && argc > 2) {
+            maxsize = strtoull(argv[2], NULL, 10) * 1024 * 1024;
+            argc--;
+            argv++;
+
+        } else {
+            cprint("usage: load_bench [-json] [-sweep MB] [file...]\n");
+            return 1;
+        }
+
+        argc--;
+        argv++;
+    }
+
+    if (!json) {
+        printf("%-36s %10s %7s %10s %10s %10s %9s %8s %10s\n", "module",
+               "bytes", "iters", "p50 us", "p99 us", "close us", "MB/s",
+               "allocs", "alloc KB");
+    }
+
+    if (maxsize > 0) {
+        err = sweep(maxsize, json);
+        if (slow(err != NULL)) {
+            goto fail;
+        }
+
+        return 0;
+    }
+
+    if (argc > 1) {
+        for (i = 1; i < (u32) argc; i++) {
+            err = bench(argv[i], &r);
+            if (slow(err != NULL)) {
+                goto fail;
+            }
+
+            report(&r, json);
+        }
+
+        return 0;
+    }
+
+    err = testdata(&names, &n);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    for (i = 0; i < n && err == NULL; i++) {
+        err = bench(names[i], &r);
+        if (fast(err == NULL)) {
+            report(&r, json);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        free(names[i]);
+    }
+
+    free(names);
+
+    if (fast(err == NULL)) {
+        err = generated(json);
+    }
+
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+bench(const char *filename, Result *r)
+{
+    u32       i;
+    u64       start, mid, total, *loadns, *closens;
+    Error     *err;
+    Module    *m;
+    MemStats  before, after;
+
+    loadns = malloc(sizeof(u64) * MAXITERS);
+    closens = malloc(sizeof(u64) * MAXITERS);
+
+    if (slow(loadns == NULL || closens == NULL)) {
+        free(loadns);
+        free(closens);
+        return newerror("failed to allocate timings");
+    }
+
+    err = loadmodule(&m, filename);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    r->name = filename;
+    r->size = m->file.size;
+
+    closemodule(m);
+
+    /* what the program allocates outside of oak is not counted */
+
+    memstats(&before);
+
+    total = 0;
+
+    for (i = 0; i < MAXITERS && (i < MINITERS || total < MINNS); i++) {
+        start = now();
+
+        err = loadmodule(&m, filename);
+        if (slow(err != NULL)) {
+            goto done;
+        }
+
+        mid = now();
+
+        closemodule(m);
+
+        loadns[i] = mid - start;
+        closens[i] = now() - mid;
+
+        total += loadns[i] + closens[i];
+    }
+
+    memstats(&after);
+
+    r->iters = i;
+    r->allocs = (after.allocs - before.allocs) / i;
+    r->bytes = (after.bytes - before.bytes) / i;
+
+    qsort(loadns, i, sizeof(u64), byns);
+    qsort(closens, i, sizeof(u64), byns);
+
+    /* nearest rank */
+
+    r->loadp50 = loadns[(50 * i + 99) / 100 - 1];
+    r->loadp99 = loadns[(99 * i + 99) / 100 - 1];
+    r->closep50 = closens[(50 * i + 99) / 100 - 1];
+
+done:
+
+    free(loadns);
+    free(closens);
+
+    return err;
+}
+
+
+static Error *
+generated(u8 json)
+{
+    u32      i;
+    char     name[64];
+    Error    *err;
+    Result   r;
+    GenSpec  spec;
+
+    memset(&spec, 0, sizeof(GenSpec));
+
+    spec.ntypes = 8;
+    spec.nglobals = 16;
+    spec.bodysize = 32;
+    spec.seed = 1;
+
+    for (i = 0; i < nitems(genfuncs); i++) {
+        spec.nfuncs = genfuncs[i];
+        spec.nexports = genfuncs[i];
+
+        err = genfile(&spec, GENERATED);
+        if (fast(err == NULL)) {
+            err = bench(GENERATED, &r);
+        }
+
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        snprintf(name, sizeof(name), "generated %u funcs", genfuncs[i]);
+
+        r.name = name;
+        report(&r, json);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Modules from size KB up to maxsize, doubling, with a quarter of them in
+ * data and the rest in code, exports and the rest.  Loading time is to
+ * grow with the size, and MB/s is to hold on.
+ */
+static Error *
+sweep(u64 maxsize, u8 json)
+{
+    u64      size;
+    char     name[64];
+    Error    *err;
+    Result   r;
+    GenSpec  spec;
+
+    memset(&spec, 0, sizeof(GenSpec));
+
+    spec.ntypes = 32;
+    spec.nglobals = 64;
+    spec.ndatas = 16;
+    spec.bodysize = 96;
+    spec.seed = 1;
+
+    for (size = SWEEPMIN; size <= maxsize; size *= 2) {
+        spec.nfuncs = size * 3 / 4 / (spec.bodysize + 8);
+        spec.nimports = spec.nfuncs / 32;
+        spec.nexports = spec.nfuncs / 2;
+        spec.datasize = size / 4 / spec.ndatas;
+
+        err = genfile(&spec, GENERATED);
+        if (fast(err == NULL)) {
+            err = bench(GENERATED, &r);
+        }
+
+        if (slow(err != NULL)) {
+            return error(err, "sweep at %d KB", (u32) (size / 1024));
+        }
+
+        snprintf(name, sizeof(name), "generated %llu KB",
+                 (unsigned long long) size / 1024);
+
+        r.name = name;
+        report(&r, json);
+    }
+
+    return NULL;
+}
+
+
+static void
+report(const Result *r, u8 json)
+{
+    double  mbps;
+
+    mbps = (r->size / 1e6) / (r->loadp50 / 1e9);
+
+    if (json) {
+        printf("{\"module\":\"%s\",\"bytes\":%llu,\"iters\":%u,"
+               "\"load_p50_ns\":%llu,\"load_p99_ns\":%llu,"
+               "\"close_p50_ns\":%llu,\"mbps\":%.1f,\"allocs\":%llu,"
+               "\"alloc_bytes\":%llu}\n",
+               r->name, (unsigned long long) r->size, r->iters,
+               (unsigned long long) r->loadp50,
+               (unsigned long long) r->loadp99,
+               (unsigned long long) r->closep50, mbps,
+               (unsigned long long) r->allocs,
+               (unsigned long long) r->bytes);
+        return;
+    }
+
+    printf("%-36s %10llu %7u %10.1f %10.1f %10.1f %9.1f %8llu %10.1f\n",
+           r->name, (unsigned long long) r->size, r->iters,
+           r->loadp50 / 1e3, r->loadp99 / 1e3, r->closep50 / 1e3, mbps,
+           (unsigned long long) r->allocs, r->bytes / 1024.0);
+}
+
+
+static int
+byns(const void *a, const void *b)
+{
+    u64  x, y;
+
+    x = *(const u64 *) a;
+    y = *(const u64 *) b;
+
+    return (x > y) - (x < y);
+}
+
+
+static u64
+now()
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
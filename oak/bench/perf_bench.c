@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <acorn/perf.h>
+#include <oak/module.h>
+#include "../gen.h"
+#include "../test.h"
+
+
+/*
+ * What loadmodule() does with the CPU, from the hardware counters: cycles
+ * and instructions per load, IPC, and cache and branch misses per KB of
+ * module.  closemodule() is left out of the counted region.  Without file
+ * arguments, it runs on testdata/ok and on a module of GENFUNCS exported
+ * functions written to /tmp.
+ *
+ * Each module is loaded until MINNS have gone by, at least MINITERS times,
+ * after a first load to warm up.  Where a counter is unavailable, as in
+ * most VMs and containers, its columns read "-", and in JSON its fields
+ * are null.
+ */
+
+
+#define MINITERS    5
+#define MAXITERS    20000
+#define MINNS       100000000
+
+#define GENFUNCS    16000
+
+#define GENERATED   "/tmp/oak-perf-bench.wasm"
+
+
+typedef struct {
+    const char  *name;
+    u64         size;
+    u32         iters;
+    PerfCounts  counts;     /* over all iters */
+} Result;
+
+
+static Error *bench(Perf *perf, const char *filename, Result *r);
+static Error *generated(Perf *perf, u8 json);
+static void report(const Result *r, u8 json);
+static void field(char *buf, size_t size, const Result *r, PerfCounter c,
+    double div, const char *fmt, u8 json);
+static u64 now();
+
+
+int
+main(int argc, char **argv)
+{
+    u8      json;
+    u32     i, n;
+    char    **names;
+    Perf    perf;
+    Error   *err;
+    Result  r;
+
+    fmtadd('e', errorfmt);
+
+    json = 0;
+
+    while (argc > 1 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-json") == 0) {
+            json = 1;
+
+        } else {
+            cprint("usage: perf_bench [-json] [file...]\n");
+            return 1;
+        }
+
+        argc--;
+        argv++;
+    }
+
+    /* without counters, it still runs, with "-" for what is missing */
+
+    err = perfopen(&perf);
+    if (err != NULL) {
+        if (!json) {
+            cprint("perf_bench: %e\n", err);
+        }
+
+        errorfree(err);
+    }
+
+    if (!json) {
+        printf("%-36s %10s %7s %12s %12s %6s %10s %10s\n", "module",
+               "bytes", "iters", "cycles", "insns", "IPC", "cmiss/KB",
+               "bmiss/KB");
+    }
+
+    if (argc > 1) {
+        for (i = 1; i < (u32) argc; i++) {
+            err = bench(&perf, argv[i], &r);
+            if (slow(err != NULL)) {
+                goto fail;
+            }
+
+            report(&r, json);
+        }
+
+        perfclose(&perf);
+        return 0;
+    }
+
+    err = testdata(&names, &n);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    for (i = 0; i < n && err == NULL; i++) {
+        err = bench(&perf, names[i], &r);
+        if (fast(err == NULL)) {
+            report(&r, json);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        free(names[i]);
+    }
+
+    free(names);
+
+    if (fast(err == NULL)) {
+        err = generated(&perf, json);
+    }
+
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    perfclose(&perf);
+    return 0;
+
+fail:
+
+    perfclose(&perf);
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+bench(Perf *perf, const char *filename, Result *r)
+{
+    u32         i, c;
+    u64         total, start;
+    Error       *err;
+    Module      *m;
+    PerfCounts  counts;
+
+    err = loadmodule(&m, filename);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    r->name = filename;
+    r->size = m->file.size;
+
+    closemodule(m);
+
+    memset(&r->counts, 0, sizeof(PerfCounts));
+    r->counts.avail = perf->avail;
+
+    total = 0;
+
+    for (i = 0; i < MAXITERS && (i < MINITERS || total < MINNS); i++) {
+        start = now();
+
+        perfstart(perf);
+
+        err = loadmodule(&m, filename);
+
+        perfstop(perf, &counts);
+
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        closemodule(m);
+
+        total += now() - start;
+
+        for (c = 0; c < PerfMax; c++) {
+            r->counts.counts[c] += counts.counts[c];
+        }
+
+        r->counts.avail &= counts.avail;
+    }
+
+    r->iters = i;
+
+    return NULL;
+}
+
+
+static Error *
+generated(Perf *perf, u8 json)
+{
+    char     name[64];
+    Error    *err;
+    Result   r;
+    GenSpec  spec;
+
+    memset(&spec, 0, sizeof(GenSpec));
+
+    spec.ntypes = 8;
+    spec.nfuncs = GENFUNCS;
+    spec.nexports = GENFUNCS;
+    spec.nglobals = 16;
+    spec.bodysize = 32;
+    spec.seed = 1;
+
+    err = genfile(&spec, GENERATED);
+    if (fast(err == NULL)) {
+        err = bench(perf, GENERATED, &r);
+    }
+
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    snprintf(name, sizeof(name), "generated %u funcs", GENFUNCS);
+
+    r.name = name;
+    report(&r, json);
+
+    return NULL;
+}
+
+
+static void
+report(const Result *r, u8 json)
+{
+    u8      ipc;
+    char    cycles[32], insns[32], cmiss[32], bmiss[32], ipcs[32];
+    double  kb;
+
+    kb = r->size * (double) r->iters / 1024;
+    ipc = (r->counts.avail & (1 << PerfCycles))
+          && (r->counts.avail & (1 << PerfInstructions))
+          && r->counts.counts[PerfCycles] != 0;
+
+    field(cycles, sizeof(cycles), r, PerfCycles, r->iters, "%.0f", json);
+    field(insns, sizeof(insns), r, PerfInstructions, r->iters, "%.0f", json);
+    field(cmiss, sizeof(cmiss), r, PerfCacheMisses, kb, "%.2f", json);
+    field(bmiss, sizeof(bmiss), r, PerfBranchMisses, kb, "%.2f", json);
+
+    if (ipc) {
+        snprintf(ipcs, sizeof(ipcs), "%.2f",
+                 (double) r->counts.counts[PerfInstructions]
+                 / r->counts.counts[PerfCycles]);
+
+    } else {
+        snprintf(ipcs, sizeof(ipcs), "%s", json ? "null" : "-");
+    }
+
+    if (json) {
+        printf("{\"module\":\"%s\",\"bytes\":%llu,\"iters\":%u,"
+               "\"cycles\":%s,\"instructions\":%s,\"ipc\":%s,"
+               "\"cache_misses_per_kb\":%s,\"branch_misses_per_kb\":%s}\n",
+               r->name, (unsigned long long) r->size, r->iters, cycles,
+               insns, ipcs, cmiss, bmiss);
+        return;
+    }
+
+    printf("%-36s %10llu %7u %12s %12s %6s %10s %10s\n", r->name,
+           (unsigned long long) r->size, r->iters, cycles, insns, ipcs,
+           cmiss, bmiss);
+}
+
+
+/*
+ * Counter c over div, or a placeholder if it was not read, which is null
+ * for JSON lines and "-" for the text columns.
+ */
+static void
+field(char *buf, size_t size, const Result *r, PerfCounter c, double div,
+    const char *fmt, u8 json)
+{
+    if (!(r->counts.avail & (1 << c))) {
+        snprintf(buf, size, "%s", json ? "null" : "-");
+        return;
+    }
+
+    snprintf(buf, size, fmt, r->counts.counts[c] / div);
+}
+
+
+static u64
+now()
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
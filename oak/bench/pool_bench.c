@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/instance.h>
+#include <oak/snapshot.h>
+#include <oak/pool.h>
+
+
+/*
+ * Instance setup and teardown of testdata/ok/small.wasm, from scratch versus
+ * from a pool of pre-reserved slots, and both again cloning a snapshot
+ * instead of applying data segments.
+ */
+
+
+#define ITERS   10000
+#define NSLOTS  64
+
+
+static Error *fresh(Module *m, u64 *ns);
+static Error *pooled(Module *m, u64 *ns);
+static Error *clone(Snapshot *snap, u64 *ns);
+static Error *poolclonebench(Snapshot *snap, u64 *ns);
+static void report(const char *name, u64 ns);
+static u64 now();
+
+
+int
+main(int argc, char **argv)
+{
+    u64         freshns, poolns, clonens, poolclonens;
+    Error       *err;
+    Module      *m;
+    Instance    inst;
+    Snapshot    snap;
+    const char  *filename;
+
+    fmtadd('e', errorfmt);
+
+    filename = (argc > 1) ? argv[1] : "testdata/ok/small.wasm";
+
+    err = loadmodule(&m, filename);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = instantiate(&inst, m);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        goto fail;
+    }
+
+    err = takesnapshot(&snap, &inst);
+    closeinstance(&inst);
+
+    if (slow(err != NULL)) {
+        closemodule(m);
+        goto fail;
+    }
+
+    err = fresh(m, &freshns);
+
+    if (err == NULL) {
+        err = pooled(m, &poolns);
+    }
+
+    if (err == NULL) {
+        err = clone(&snap, &clonens);
+    }
+
+    if (err == NULL) {
+        err = poolclonebench(&snap, &poolclonens);
+    }
+
+    closesnapshot(&snap);
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    printf("%-12s %14s\n", "setup", "us/instance");
+
+    report("fresh", freshns);
+    report("pooled", poolns);
+    report("clone", clonens);
+    report("poolclone", poolclonens);
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+fresh(Module *m, u64 *ns)
+{
+    u32       i;
+    u64       start;
+    Error     *err;
+    Instance  inst;
+
+    start = now();
+
+    for (i = 0; i < ITERS; i++) {
+        err = instantiate(&inst, m);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        inst.memory.base[0] = 1;
+
+        closeinstance(&inst);
+    }
+
+    *ns = now() - start;
+
+    return NULL;
+}
+
+
+static Error *
+pooled(Module *m, u64 *ns)
+{
+    u32       i;
+    u64       start;
+    Pool      pool;
+    Error     *err;
+    Instance  inst;
+
+    err = newpool(&pool, NSLOTS, 1024, 64);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    start = now();
+
+    for (i = 0; i < ITERS; i++) {
+        err = poolinstantiate(&pool, &inst, m);
+        if (slow(err != NULL)) {
+            closepool(&pool);
+            return err;
+        }
+
+        inst.memory.base[0] = 1;
+
+        closeinstance(&inst);
+    }
+
+    *ns = now() - start;
+
+    closepool(&pool);
+
+    return NULL;
+}
+
+
+static Error *
+clone(Snapshot *snap, u64 *ns)
+{
+    u32       i;
+    u64       start;
+    Error     *err;
+    Instance  inst;
+
+    start = now();
+
+    for (i = 0; i < ITERS; i++) {
+        err = clonesnapshot(snap, &inst);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        inst.memory.base[0] = 1;
+
+        closeinstance(&inst);
+    }
+
+    *ns = now() - start;
+
+    return NULL;
+}
+
+
+static Error *
+poolclonebench(Snapshot *snap, u64 *ns)
+{
+    u32       i;
+    u64       start;
+    Pool      pool;
+    Error     *err;
+    Instance  inst;
+
+    err = newpool(&pool, NSLOTS, 1024, 64);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    start = now();
+
+    for (i = 0; i < ITERS; i++) {
+        err = poolclone(&pool, &inst, snap);
+        if (slow(err != NULL)) {
+            closepool(&pool);
+            return err;
+        }
+
+        inst.memory.base[0] = 1;
+
+        closeinstance(&inst);
+    }
+
+    *ns = now() - start;
+
+    closepool(&pool);
+
+    return NULL;
+}
+
+
+static void
+report(const char *name, u64 ns)
+{
+    printf("%-12s %14.2f\n", name, (double) ns / ITERS / 1000);
+}
+
+
+static u64
+now()
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/validate.h>
+#include "../bin.h"
+
+
+/*
+ * Validation throughput, in MB/s of code section, on one thread and fanned
+ * out on up to VALIDATE_MAX_THREADS.  Without a file argument, a module of
+ * NFUNCS functions of mixed control flow, locals, loads and arithmetic is
+ * written to /tmp and used instead.
+ */
+
+
+#define NFUNCS      4096
+#define NREPEATS    64      /* of the body pattern */
+#define ITERS       10
+
+#define SYNTHETIC   "/tmp/oak-validate-bench.wasm"
+
+
+static Error *synthesize(const char *filename);
+static u8 *put(u8 *p, const u8 *bytes, u32 size);
+static u8 *putu(u8 *p, u64 v);
+static u64 now();
+
+
+/* (param i32) (result i32) (local i32 i64), see synthesize() */
+static const u8  pattern[] = {
+    0x02, 0x40,                     /* block */
+    0x03, 0x40,                     /* loop */
+    0x20, 0x00, 0x20, 0x01,         /* get_local 0, get_local 1 */
+    0x6a, 0x22, 0x01,               /* i32.add, tee_local 1 */
+    0x41, 0xe4, 0x00,               /* i32.const 100 */
+    0x49, 0x0d, 0x00,               /* i32.lt_u, br_if 0 */
+    0x0b, 0x0b,                     /* end, end */
+    0x20, 0x00, 0x28, 0x02, 0x08,   /* get_local 0, i32.load offset=8 */
+    0x20, 0x01, 0x46,               /* get_local 1, i32.eq */
+    0x04, 0x7f,                     /* if (result i32) */
+    0x41, 0x01,                     /* i32.const 1 */
+    0x05,                           /* else */
+    0x20, 0x00, 0x45,               /* get_local 0, i32.eqz */
+    0x0b,                           /* end */
+    0x21, 0x01,                     /* set_local 1 */
+    0x20, 0x02, 0x42, 0x03,         /* get_local 2, i64.const 3 */
+    0x7e, 0x21, 0x02,               /* i64.mul, set_local 2 */
+};
+
+
+int
+main(int argc, char **argv)
+{
+    u32          i, nthreads;
+    u64          start, ns, base, codesize;
+    Error        *err;
+    Module       *m;
+    CodeDecl     *code;
+    const char   *filename;
+
+    fmtadd('e', errorfmt);
+
+    filename = (argc > 1) ? argv[1] : SYNTHETIC;
+
+    if (argc <= 1) {
+        err = synthesize(filename);
+        if (slow(err != NULL)) {
+            goto fail;
+        }
+    }
+
+    err = loadmodule(&m, filename);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    codesize = 0;
+
+    for (i = 0; i < len(m->codes); i++) {
+        code = arrayget(m->codes, i);
+        codesize += code->end - code->start + 1;
+    }
+
+    printf("%u bodies, %llu bytes of code\n", len(m->codes),
+           (unsigned long long) codesize);
+    printf("%-8s %12s %10s %8s\n", "threads", "ms/module", "MB/s", "speedup");
+
+    base = 0;
+
+    for (nthreads = 1; nthreads <= VALIDATE_MAX_THREADS; nthreads *= 2) {
+        start = now();
+
+        for (i = 0; i < ITERS; i++) {
+            err = validatemodule(m, nthreads);
+            if (slow(err != NULL)) {
+                closemodule(m);
+                goto fail;
+            }
+        }
+
+        ns = (now() - start) / ITERS;
+
+        if (base == 0) {
+            base = ns;
+        }
+
+        printf("%-8u %12.3f %10.1f %8.2f\n", nthreads, ns / 1e6,
+               (codesize / 1e6) / (ns / 1e9), (double) base / ns);
+    }
+
+    closemodule(m);
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+synthesize(const char *filename)
+{
+    u8     *buf, *p, *body, *sect;
+    u32    i, bodysize;
+    FILE   *f;
+    Error  *err;
+
+    static const u8  header[] = {
+        0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+        0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,     /* types */
+        0x05, 0x03, 0x01, 0x00, 0x01,                       /* memory 1 */
+    };
+
+    static const u8  locals[] = {0x02, 0x01, 0x7f, 0x01, 0x7e};
+    static const u8  tail[] = {0x20, 0x01, 0x0b};
+
+    bodysize = sizeof(locals) + NREPEATS * sizeof(pattern) + sizeof(tail);
+
+    buf = malloc(sizeof(header) + 2 * NFUNCS + 64
+                 + NFUNCS * (bodysize + 8));
+    if (slow(buf == NULL)) {
+        return newerror("failed to allocate module");
+    }
+
+    p = put(buf, header, sizeof(header));
+
+    *p++ = FunctionId;
+    p = putu(p, NFUNCS + 2);        /* count in 2 bytes, 1 per index */
+    p = putu(p, NFUNCS);
+
+    for (i = 0; i < NFUNCS; i++) {
+        *p++ = 0x00;
+    }
+
+    /* the section size is patched in after the bodies */
+
+    *p++ = CodeId;
+    sect = p;
+    p += 5;
+    p = putu(p, NFUNCS);
+
+    for (i = 0; i < NFUNCS; i++) {
+        p = putu(p, bodysize);
+        body = put(p, locals, sizeof(locals));
+
+        for (p = body; p < body + NREPEATS * sizeof(pattern);
+             p += sizeof(pattern))
+        {
+            memcpy(p, pattern, sizeof(pattern));
+        }
+
+        p = put(p, tail, sizeof(tail));
+    }
+
+    /* padded to 5 bytes to fit the room left for it */
+
+    for (i = 0; i < 5; i++) {
+        sect[i] = (((p - sect - 5) >> (7 * i)) & 0x7f) | ((i < 4) ? 0x80 : 0);
+    }
+
+    err = NULL;
+
+    f = fopen(filename, "w");
+    if (slow(f == NULL || fwrite(buf, 1, p - buf, f) != (size_t) (p - buf))) {
+        err = newerror("failed to write %s", filename);
+    }
+
+    if (f != NULL) {
+        fclose(f);
+    }
+
+    free(buf);
+
+    return err;
+}
+
+
+static u8 *
+put(u8 *p, const u8 *bytes, u32 size)
+{
+    memcpy(p, bytes, size);
+
+    return p + size;
+}
+
+
+static u8 *
+putu(u8 *p, u64 v)
+{
+    return p + uleb128encode(v, p, p + 10);
+}
+
+
+static u64
+now()
+{
+    struct timespec  ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -141,7 +141,13 @@ u32vdecode(u8 **begin, const u8 *end, u32 *val)
     ssize_t  read;
 
     read = uvdecode(*begin, end, &uval);
-    if (slow(read <= 0 || read > 4)) {
+    if (slow(read <= 0 || read > 5)) {
+        return ERR;
+    }
+
+    /* the unused bits of a 5th byte must be zero */
+
+    if (slow(uval > UINT32_MAX)) {
         return ERR;
     }
 
@@ -206,7 +212,13 @@ s32vdecode(u8 **begin, const u8 *end, i32 *val)
     ssize_t  read;
 
     read = svdecode(*begin, end, &ival);
-    if (slow(read <= 0 || read > 4)) {
+    if (slow(read <= 0 || read > 5)) {
+        return ERR;
+    }
+
+    /* the unused bits of a 5th byte must extend the sign */
+
+    if (slow(ival < INT32_MIN || ival > INT32_MAX)) {
         return ERR;
     }
 
@@ -222,7 +234,7 @@ s64vdecode(u8 **begin, const u8 *end, i64 *val)
     ssize_t  read;
 
     read = svdecode(*begin, end, val);
-    if (slow(read <= 0 || read > 8)) {
+    if (slow(read <= 0 || read > 10)) {
         return ERR;
     }
 
@@ -30,6 +30,7 @@ Error *test_svencode(i64 v, const u8 *want, u8 size);
 Error *test_svdecode(const u8 *encoded, u8 size, i64 want);
 Error *test_encodeoverflow();
 Error *test_decodemalformed();
+Error *test_decodeunused();
 
 
 static const UTestcase  utestcases[] = {
@@ -164,6 +165,11 @@ int main() {
         goto fail;
     }
 
+    err = test_decodeunused();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
     for (i = 0; i < OAK_ULEB128_NTESTS; i++) {
         utc = &utestcases[i];
         err = test_uvencode(utc->val, utc->want, utc->size);
@@ -266,6 +272,52 @@ test_decodemalformed()
 }
 
 
+/*
+ * The 5th byte of a 32-bit LEB128 has 4 bits of the value, and the rest
+ * must be zero, or a copy of the sign bit if signed.
+ */
+Error *
+test_decodeunused()
+{
+    u8   *p;
+    i32  ival;
+    u32  uval;
+
+    u8  umax[] = {0xff, 0xff, 0xff, 0xff, 0x0f};
+    u8  uover[] = {0xff, 0xff, 0xff, 0xff, 0x1f};
+    u8  smin[] = {0x80, 0x80, 0x80, 0x80, 0x78};
+    u8  sover[] = {0xff, 0xff, 0xff, 0xff, 0x0f};
+    u8  sunder[] = {0x80, 0x80, 0x80, 0x80, 0x70};
+
+    p = umax;
+    if (slow(u32vdecode(&p, umax + 5, &uval) != OK || uval != UINT32_MAX)) {
+        return newerror("failed to decode UINT32_MAX");
+    }
+
+    p = uover;
+    if (slow(u32vdecode(&p, uover + 5, &uval) != ERR)) {
+        return newerror("u32 with unused bits set decoded as %d", uval);
+    }
+
+    p = smin;
+    if (slow(s32vdecode(&p, smin + 5, &ival) != OK || ival != INT32_MIN)) {
+        return newerror("failed to decode INT32_MIN");
+    }
+
+    p = sover;
+    if (slow(s32vdecode(&p, sover + 5, &ival) != ERR)) {
+        return newerror("i32 over INT32_MAX decoded as %d", ival);
+    }
+
+    p = sunder;
+    if (slow(s32vdecode(&p, sunder + 5, &ival) != ERR)) {
+        return newerror("i32 under INT32_MIN decoded as %d", ival);
+    }
+
+    return NULL;
+}
+
+
 Error *
 test_uvencode(u64 v, const u8 *want, u8 size)
 {
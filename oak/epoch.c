@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <oak/epoch.h>
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+
+static void *ticker(void *arg);
+
+
+u64  globalepoch;
+
+static u8         running;
+static u8         stopping;
+static pthread_t  thread;
+
+
+u64
+epochnow(void)
+{
+    return __atomic_load_n(&globalepoch, __ATOMIC_RELAXED);
+}
+
+
+void
+epochtick(void)
+{
+    __atomic_add_fetch(&globalepoch, 1, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Starts a thread bumping the epoch every `ms` milliseconds.  Not meant to be
+ * called concurrently with itself or epochstop().
+ */
+Error *
+epochstart(u32 ms)
+{
+    int  rc;
+
+    if (slow(running)) {
+        return newerror("epoch timer already running");
+    }
+
+    if (slow(ms == 0)) {
+        return newerror("epoch period must be at least 1ms");
+    }
+
+    __atomic_store_n(&stopping, 0, __ATOMIC_RELAXED);
+
+    rc = pthread_create(&thread, NULL, ticker, (void *) (ptr) ms);
+    if (slow(rc != 0)) {
+        return newerror("failed to start epoch timer: %s", strerror(rc));
+    }
+
+    running = 1;
+
+    return NULL;
+}
+
+
+void
+epochstop(void)
+{
+    if (!running) {
+        return;
+    }
+
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELAXED);
+    pthread_join(thread, NULL);
+
+    running = 0;
+}
+
+
+static void *
+ticker(void *arg)
+{
+    u32              ms;
+    struct timespec  ts;
+
+    ms = (u32) (ptr) arg;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+
+    while (!__atomic_load_n(&stopping, __ATOMIC_RELAXED)) {
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+            /* resume the remaining time */
+        }
+
+        ts.tv_sec = ms / 1000;
+        ts.tv_nsec = (ms % 1000) * 1000000;
+
+        epochtick();
+    }
+
+    return NULL;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/jit.h>
+#include <oak/epoch.h>
+#include "test.h"
+
+
+static Error *test_entry();
+static Error *test_timer(JitMode mode);
+static Error *setup(Jit *jit, JitMode mode);
+static Error *call(Jit *jit, const char *func);
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_entry();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_timer(JitEpoch);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_timer(JitLazy | JitMetered | JitEpoch);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+/*
+ * Function entries check the deadline, here against a counter of our own.
+ */
+static Error *
+test_entry()
+{
+    u64    epoch;
+    Jit    jit;
+    Error  *err;
+
+    err = setup(&jit, JitEpoch);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    epoch = 0;
+
+    jit.epoch = &epoch;
+    jit.deadline = 1;
+
+    err = call(&jit, "leaf");
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    epoch = 1;
+
+    err = call(&jit, "leaf");
+    if (slow(err == NULL || !iserror(err, "trap: epoch deadline reached"))) {
+        err = error(err, "call past the deadline must trap");
+        goto done;
+    }
+
+    errorfree(err);
+
+    jit.deadline = 2;
+
+    err = call(&jit, "leaf");
+
+done:
+
+    jitclose(&jit);
+
+    return err;
+}
+
+
+/*
+ * A loop that never ends is interrupted through its back-edge.
+ */
+static Error *
+test_timer(JitMode mode)
+{
+    Jit    jit;
+    Error  *err;
+
+    err = setup(&jit, mode);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = epochstart(1);
+    if (slow(err != NULL)) {
+        jitclose(&jit);
+        return err;
+    }
+
+    jit.fuel = 0xffffffffffffffff;
+    jit.deadline = epochnow() + 5;
+
+    err = call(&jit, "spin");
+
+    epochstop();
+    jitclose(&jit);
+
+    if (slow(err == NULL || !iserror(err, "trap: epoch deadline reached"))) {
+        return error(err, "spin must be interrupted");
+    }
+
+    errorfree(err);
+
+    return NULL;
+}
+
+
+static Error *
+setup(Jit *jit, JitMode mode)
+{
+    Error   *err;
+    Module  *m;
+
+    err = loadmodule(&m, "testdata/ok/spin.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = jitmodule(jit, m, mode);
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+call(Jit *jit, const char *func)
+{
+    u64         got;
+    String      field;
+    ExportDecl  *export;
+
+    cstr(&field, (u8 *) func);
+
+    export = findexport(jit->module, &field);
+    if (slow(export == NULL)) {
+        return newerror("export %s not found", func);
+    }
+
+    return jitcall(jit, export->index, NULL, &got);
+}
@@ -122,7 +122,7 @@ modulefmt(String **buf, u8 ** unused(format), void *val)
 
     *buf = append(*buf, out);
 
-    free(out);
+    memfree(out);
 
     if (slow(*buf == NULL)) {
         return ERR;
@@ -315,6 +315,13 @@ importfmt(String **buf, u8 ** format, void *val)
         }
 
         break;
+    case Global:
+        check(*buf, append(*buf, import->module));
+        check(*buf, appendc(*buf, 1, '.'));
+        check(*buf, append(*buf, import->field));
+        check(*buf, appendcstr(*buf, import->u.global.mut ? " (global mut)"
+                                                          : " (global)"));
+        break;
     default:
         check(*buf, appendcstr(*buf, "(not implemented)"));
     }
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/fuel.h>
+#include <oak/insn.h>
+
+#include <string.h>
+#include <errno.h>
+
+#include "opcodes.h"
+
+
+static Error *addblock(Array *blocks, BasicBlock *block);
+
+
+/*
+ * Appends the basic blocks of `code`, in order, to `blocks`.
+ */
+Error *
+basicblocks(const CodeDecl *code, Array *blocks)
+{
+    Insn        insn;
+    Error       *err;
+    InsnIter    it;
+    BasicBlock  block;
+
+    insniter(&it, code);
+
+    block.start = 0;
+    block.cost = 0;
+
+    while (!insndone(&it)) {
+        err = insnnext(&it, &insn);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        if (istarget(insn.op) && block.cost > 0 && !insndone(&it)) {
+            block.end = insn.offset;
+
+            err = addblock(blocks, &block);
+            if (slow(err != NULL)) {
+                return err;
+            }
+        }
+
+        block.cost++;
+
+        if (isbranch(insn.op) || insndone(&it)) {
+            block.end = it.p - it.start;
+
+            err = addblock(blocks, &block);
+            if (slow(err != NULL)) {
+                return err;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+static Error *
+addblock(Array *blocks, BasicBlock *block)
+{
+    if (slow(arrayadd(blocks, block) != OK)) {
+        return newerror("failed to add block: %s", strerror(errno));
+    }
+
+    block->start = block->end;
+    block->cost = 0;
+
+    return NULL;
+}
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/jit.h>
+#include <oak/fuel.h>
+#include "test.h"
+
+
+/*
+ * Fuel taken by sum(n) of kernels.wasm: [block] once, [loop ... br_if] n + 1
+ * times, the loop body n times, then [end get_local end].
+ */
+#define SUMFUEL(n)  (1 + 5 * ((n) + 1) + 10 * (n) + 3)
+
+
+static Error *test_blocks();
+static Error *test_metered(JitMode mode);
+static Error *runsum(Jit *jit, u32 n, u64 fuel, u64 *left);
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_blocks();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_metered(JitMetered);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_metered(JitLazy | JitMetered);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+test_blocks()
+{
+    u32         i, size;
+    Array       *blocks;
+    Error       *err;
+    Module      *m;
+    String      field = str("sum");
+    CodeDecl    *code;
+    ExportDecl  *export;
+    BasicBlock  *block;
+    u32         want[][2] = {{1, 2}, {5, 9}, {10, 17}, {1, 1}, {3, 4}};
+
+    err = loadmodule(&m, "testdata/ok/kernels.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    blocks = newarray(8, sizeof(BasicBlock));
+    if (slow(blocks == NULL)) {
+        closemodule(m);
+        return newerror("failed to allocate blocks");
+    }
+
+    /* every body is covered by contiguous blocks */
+
+    for (i = 0; i < len(m->codes); i++) {
+        code = arrayget(m->codes, i);
+
+        blocks->len = 0;
+
+        err = basicblocks(code, blocks);
+        if (slow(err != NULL)) {
+            err = error(err, "function %d", i);
+            goto done;
+        }
+
+        err = NULL;
+        size = (code->end + 1) - code->start;
+
+        if (slow(len(blocks) == 0
+                 || ((BasicBlock *) arrayget(blocks, 0))->start != 0
+                 || ((BasicBlock *) arraylast(blocks))->end != size))
+        {
+            err = newerror("function %d: blocks don't cover the body", i);
+            goto done;
+        }
+    }
+
+    export = findexport(m, &field);
+    code = arrayget(m->codes, export->index - m->nimportfuncs);
+
+    blocks->len = 0;
+
+    err = basicblocks(code, blocks);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    if (slow(len(blocks) != nitems(want))) {
+        err = newerror("sum has %d blocks, expected %d", len(blocks),
+                       nitems(want));
+        goto done;
+    }
+
+    for (i = 0; i < nitems(want); i++) {
+        block = arrayget(blocks, i);
+
+        if (slow(block->cost != want[i][0]
+                 || block->end - block->start != want[i][1]))
+        {
+            err = newerror("sum block %d: cost %d and %d bytes, expected %d "
+                           "and %d", i, block->cost, block->end - block->start,
+                           want[i][0], want[i][1]);
+            goto done;
+        }
+    }
+
+done:
+
+    freearray(blocks);
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+test_metered(JitMode mode)
+{
+    u64     left;
+    Jit     jit;
+    Error   *err;
+    Module  *m;
+
+    err = loadmodule(&m, "testdata/ok/kernels.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = jitmodule(&jit, m, mode);
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = runsum(&jit, 10, 1000, &left);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    if (slow(left != 1000 - SUMFUEL(10))) {
+        err = newerror("sum(10) left %d fuel, expected %d", left,
+                       1000 - SUMFUEL(10));
+        goto done;
+    }
+
+    /* exactly enough */
+
+    err = runsum(&jit, 100, SUMFUEL(100), &left);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    if (slow(left != 0)) {
+        err = newerror("sum(100) left %d fuel, expected 0", left);
+        goto done;
+    }
+
+    err = runsum(&jit, 100, SUMFUEL(100) - 1, &left);
+    if (slow(err == NULL || !iserror(err, "trap: all fuel consumed"))) {
+        err = error(err, "sum(100) must run out of fuel");
+        goto done;
+    }
+
+    errorfree(err);
+    err = NULL;
+
+    if (slow(jit.fuel != 0)) {
+        err = newerror("%x(u64) fuel left after the trap", jit.fuel);
+    }
+
+done:
+
+    jitclose(&jit);
+
+    return err;
+}
+
+
+static Error *
+runsum(Jit *jit, u32 n, u64 fuel, u64 *left)
+{
+    u64         args[1], got;
+    Error       *err;
+    String      field = str("sum");
+    ExportDecl  *export;
+
+    export = findexport(jit->module, &field);
+    if (slow(export == NULL)) {
+        return newerror("export sum not found");
+    }
+
+    args[0] = n;
+    jit->fuel = fuel;
+
+    err = jitcall(jit, export->index, args, &got);
+    if (err != NULL) {
+        return err;
+    }
+
+    if (slow(got != (u64) n * (n - 1) / 2)) {
+        return newerror("sum(%d) = %d", n, got);
+    }
+
+    *left = jit->fuel;
+
+    return NULL;
+}
@@ -0,0 +1,614 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+
+#include "bin.h"
+#include "gen.h"
+#include "opcodes.h"
+
+
+#define PAGESIZE    65536
+#define MAXPAGES    32768       /* for data offsets to fit an i32 */
+
+
+typedef struct {
+    u8              *data;
+    size_t          len;
+    size_t          size;
+    u8              failed;
+} Buf;
+
+
+typedef struct {
+    const GenSpec   *spec;
+    u64             rand;
+    u8              memory;
+    Buf             body;
+} Gen;
+
+
+static void typesect(Gen *g, Buf *b);
+static void importsect(Gen *g, Buf *b);
+static void funcsect(Gen *g, Buf *b);
+static void memorysect(Gen *g, Buf *b);
+static void globalsect(Gen *g, Buf *b);
+static void exportsect(Gen *g, Buf *b);
+static void codesect(Gen *g, Buf *b);
+static void datasect(Gen *g, Buf *b);
+static void body(Gen *g, u32 type);
+static void section(Buf *out, Buf *sect, u8 id);
+static u8 reserve(Buf *b, size_t n);
+static void putbyte(Buf *b, u8 v);
+static void putbytes(Buf *b, const void *data, size_t n);
+static void putname(Buf *b, const char *prefix, u32 index);
+static void putuleb(Buf *b, u64 v);
+static void putsleb(Buf *b, i64 v);
+static u64 next(Gen *g);
+static i64 anywidth(Gen *g);
+
+
+static const u8  magic[] = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+
+
+/*
+ * Makes the module in a buffer of its own, to be freed by the caller.
+ */
+Error *
+genmodule(const GenSpec *spec, u8 **buf, size_t *size)
+{
+    Gen    g;
+    Buf    out, sect;
+    u32    i;
+    u64    datasize;
+
+    static void  (*sections[])(Gen *, Buf *) = {
+        typesect, importsect, funcsect, memorysect, globalsect, exportsect,
+        codesect, datasect,
+    };
+
+    static const u8  ids[] = {
+        TypeId, ImportId, FunctionId, MemoryId, GlobalId, ExportId, CodeId,
+        DataId,
+    };
+
+    if (slow(spec->ntypes == 0 && spec->nimports + spec->nfuncs > 0)) {
+        return newerror("functions need at least one type");
+    }
+
+    if (slow(spec->nexports > (u64) spec->nimports + spec->nfuncs)) {
+        return newerror("%d exports of %d functions", spec->nexports,
+                        spec->nimports + spec->nfuncs);
+    }
+
+    datasize = (u64) spec->ndatas * spec->datasize;
+
+    if (slow(datasize > (u64) MAXPAGES * PAGESIZE)) {
+        return newerror("%d segments of %d bytes do not fit in memory",
+                        spec->ndatas, spec->datasize);
+    }
+
+    memset(&g, 0, sizeof(Gen));
+    memset(&out, 0, sizeof(Buf));
+    memset(&sect, 0, sizeof(Buf));
+
+    g.spec = spec;
+    g.rand = spec->seed * 0x9e3779b97f4a7c15ULL + 1;
+    g.memory = (spec->ndatas > 0);
+
+    putbytes(&out, magic, sizeof(magic));
+
+    for (i = 0; i < nitems(sections); i++) {
+        sect.len = 0;
+        sections[i](&g, &sect);
+
+        if (sect.len > 0) {
+            section(&out, &sect, ids[i]);
+        }
+    }
+
+    memfree(sect.data);
+    memfree(g.body.data);
+
+    if (slow(out.failed || sect.failed || g.body.failed)) {
+        memfree(out.data);
+        return newerror("failed to allocate module: %s", strerror(errno));
+    }
+
+    *buf = out.data;
+    *size = out.len;
+
+    return NULL;
+}
+
+
+Error *
+genfile(const GenSpec *spec, const char *filename)
+{
+    u8       *buf, *p;
+    int      fd;
+    size_t   size;
+    ssize_t  n;
+    Error    *err;
+
+    err = genmodule(spec, &buf, &size);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (slow(fd < 0)) {
+        memfree(buf);
+        return newerror("failed to create %s: %s", filename, strerror(errno));
+    }
+
+    for (p = buf; p < buf + size; p += n) {
+        n = write(fd, p, buf + size - p);
+        if (slow(n < 0)) {
+            err = newerror("failed to write %s: %s", filename,
+                           strerror(errno));
+            break;
+        }
+    }
+
+    close(fd);
+    memfree(buf);
+
+    return err;
+}
+
+
+static void
+typesect(Gen *g, Buf *b)
+{
+    u32  i, j, nparams;
+
+    if (g->spec->ntypes == 0) {
+        return;
+    }
+
+    putuleb(b, g->spec->ntypes);
+
+    for (i = 0; i < g->spec->ntypes; i++) {
+        nparams = i % 4;
+
+        putbyte(b, 0x60);
+        putuleb(b, nparams);
+
+        for (j = 0; j < nparams; j++) {
+            putbyte(b, ((i / 4 + j) & 1) ? 0x7e : 0x7f);
+        }
+
+        putuleb(b, 1);
+        putbyte(b, 0x7f);
+    }
+}
+
+
+static void
+importsect(Gen *g, Buf *b)
+{
+    u32  i;
+
+    if (g->spec->nimports == 0) {
+        return;
+    }
+
+    putuleb(b, g->spec->nimports);
+
+    for (i = 0; i < g->spec->nimports; i++) {
+        putname(b, "env", (u32) -1);
+        putname(b, "import", i);
+        putbyte(b, Function);
+        putuleb(b, i % g->spec->ntypes);
+    }
+}
+
+
+static void
+funcsect(Gen *g, Buf *b)
+{
+    u32  i;
+
+    if (g->spec->nfuncs == 0) {
+        return;
+    }
+
+    putuleb(b, g->spec->nfuncs);
+
+    for (i = 0; i < g->spec->nfuncs; i++) {
+        putuleb(b, i % g->spec->ntypes);
+    }
+}
+
+
+static void
+memorysect(Gen *g, Buf *b)
+{
+    u64  pages;
+
+    if (!g->memory) {
+        return;
+    }
+
+    pages = ((u64) g->spec->ndatas * g->spec->datasize + PAGESIZE - 1)
+            / PAGESIZE;
+
+    putuleb(b, 1);
+    putbyte(b, 0);                          /* no maximum */
+    putuleb(b, (pages > 0) ? pages : 1);
+}
+
+
+static void
+globalsect(Gen *g, Buf *b)
+{
+    u32  i;
+
+    if (g->spec->nglobals == 0) {
+        return;
+    }
+
+    putuleb(b, g->spec->nglobals);
+
+    for (i = 0; i < g->spec->nglobals; i++) {
+        putbyte(b, (i & 1) ? 0x7e : 0x7f);
+        putbyte(b, (i % 3) == 0);
+        putbyte(b, (i & 1) ? Opi64const : Opi32const);
+        putsleb(b, (i & 1) ? anywidth(g) : (i32) anywidth(g));
+        putbyte(b, OpEnd);
+    }
+}
+
+
+static void
+exportsect(Gen *g, Buf *b)
+{
+    u32  i;
+
+    if (g->spec->nexports == 0) {
+        return;
+    }
+
+    putuleb(b, g->spec->nexports);
+
+    for (i = 0; i < g->spec->nexports; i++) {
+        putname(b, "f", i);
+        putbyte(b, Function);
+        putuleb(b, i);
+    }
+}
+
+
+static void
+codesect(Gen *g, Buf *b)
+{
+    u32  i;
+
+    if (g->spec->nfuncs == 0) {
+        return;
+    }
+
+    putuleb(b, g->spec->nfuncs);
+
+    for (i = 0; i < g->spec->nfuncs; i++) {
+        body(g, i % g->spec->ntypes);
+
+        putuleb(b, g->body.len);
+        putbytes(b, g->body.data, g->body.len);
+    }
+}
+
+
+static void
+datasect(Gen *g, Buf *b)
+{
+    u32  i;
+
+    if (g->spec->ndatas == 0) {
+        return;
+    }
+
+    putuleb(b, g->spec->ndatas);
+
+    for (i = 0; i < g->spec->ndatas; i++) {
+        putuleb(b, 0);
+        putbyte(b, Opi32const);
+        putsleb(b, (i64) i * g->spec->datasize);
+        putbyte(b, OpEnd);
+        putuleb(b, g->spec->datasize);
+
+        if (fast(reserve(b, g->spec->datasize))) {
+            memset(b->data + b->len, i & 0xff, g->spec->datasize);
+            b->len += g->spec->datasize;
+        }
+    }
+}
+
+
+/*
+ * One i32 and one i64 local, after the params, are the operands of each
+ * piece, which leaves the stack as it found it.  Calls go to the defined
+ * functions of type 0, which take nothing.
+ */
+static void
+body(Gen *g, u32 type)
+{
+    u8   local, wide;
+    u32  ncallees, nglobals32;
+    u64  r;
+    Buf  *b;
+
+    b = &g->body;
+    b->len = 0;
+
+    local = type % 4;
+    wide = local + 1;
+
+    ncallees = (g->spec->nfuncs + g->spec->ntypes - 1) / g->spec->ntypes;
+    nglobals32 = (g->spec->nglobals + 1) / 2;
+
+    putuleb(b, 2);
+    putuleb(b, 1);
+    putbyte(b, 0x7f);
+    putuleb(b, 1);
+    putbyte(b, 0x7e);
+
+    /* the get_local and end to come count in the size */
+
+    while (b->len + 3 < g->spec->bodysize && !b->failed) {
+        r = next(g);
+
+        switch (r % 9) {
+        case 0:
+            putbyte(b, OpGetLocal);
+            putuleb(b, local);
+            putbyte(b, Opi32const);
+            putsleb(b, (i32) anywidth(g));
+            putbyte(b, Opi32add);
+            putbyte(b, OpSetLocal);
+            putuleb(b, local);
+            break;
+
+        case 1:
+            putbyte(b, OpGetLocal);
+            putuleb(b, wide);
+            putbyte(b, Opi64const);
+            putsleb(b, anywidth(g));
+            putbyte(b, Opi64mul);
+            putbyte(b, OpSetLocal);
+            putuleb(b, wide);
+            break;
+
+        case 2:
+            putbyte(b, OpBlock);
+            putbyte(b, Emptyblock);
+            putbyte(b, OpGetLocal);
+            putuleb(b, local);
+            putbyte(b, OpBrIf);
+            putuleb(b, 0);
+            putbyte(b, OpEnd);
+            break;
+
+        case 3:
+            putbyte(b, OpBlock);
+            putbyte(b, 0x7f);
+            putbyte(b, OpGetLocal);
+            putuleb(b, local);
+            putbyte(b, OpEnd);
+            putbyte(b, OpTeeLocal);
+            putuleb(b, local);
+            putbyte(b, OpDrop);
+            break;
+
+        case 4:
+            if (ncallees == 0) {
+                break;
+            }
+
+            putbyte(b, OpCall);
+            putuleb(b, g->spec->nimports
+                       + (u64) (next(g) % ncallees) * g->spec->ntypes);
+            putbyte(b, OpSetLocal);
+            putuleb(b, local);
+            break;
+
+        case 5:
+            if (nglobals32 == 0) {
+                break;
+            }
+
+            putbyte(b, OpgetGlobal);
+            putuleb(b, (next(g) % nglobals32) * 2);
+            putbyte(b, OpSetLocal);
+            putuleb(b, local);
+            break;
+
+        case 6:
+            if (!g->memory) {
+                break;
+            }
+
+            putbyte(b, OpGetLocal);
+            putuleb(b, local);
+            putbyte(b, OpLoadi32);
+            putuleb(b, 2);
+            putuleb(b, (u32) anywidth(g) & 0xfffff);
+            putbyte(b, OpSetLocal);
+            putuleb(b, local);
+            break;
+
+        case 7:
+            putbyte(b, OpGetLocal);
+            putuleb(b, local);
+            putbyte(b, Opi64extendui32);
+            putbyte(b, OpGetLocal);
+            putuleb(b, wide);
+            putbyte(b, Opi64add);
+            putbyte(b, OpSetLocal);
+            putuleb(b, wide);
+            break;
+
+        case 8:
+            putbyte(b, OpGetLocal);
+            putuleb(b, wide);
+            putbyte(b, Opi32wrapi64);
+            putbyte(b, OpSetLocal);
+            putuleb(b, local);
+            break;
+        }
+    }
+
+    putbyte(b, OpGetLocal);
+    putuleb(b, local);
+    putbyte(b, OpEnd);
+}
+
+
+static void
+section(Buf *out, Buf *sect, u8 id)
+{
+    putbyte(out, id);
+    putuleb(out, sect->len);
+    putbytes(out, sect->data, sect->len);
+}
+
+
+/*
+ * Makes room for n more bytes.  A failure is kept in the buffer, and what
+ * is put after it is dropped.
+ */
+static u8
+reserve(Buf *b, size_t n)
+{
+    u8      *data;
+    size_t  size;
+
+    if (slow(b->failed)) {
+        return 0;
+    }
+
+    if (fast(b->size - b->len >= n)) {
+        return 1;
+    }
+
+    for (size = (b->size > 0) ? b->size * 2 : 4096; size - b->len < n;
+         size *= 2)
+    {
+        /* void */
+    }
+
+    data = memrealloc(b->data, size);
+    if (slow(data == NULL)) {
+        b->failed = 1;
+        return 0;
+    }
+
+    b->data = data;
+    b->size = size;
+
+    return 1;
+}
+
+
+static void
+putbyte(Buf *b, u8 v)
+{
+    if (fast(reserve(b, 1))) {
+        b->data[b->len++] = v;
+    }
+}
+
+
+static void
+putbytes(Buf *b, const void *data, size_t n)
+{
+    if (fast(reserve(b, n))) {
+        memcpy(b->data + b->len, data, n);
+        b->len += n;
+    }
+}
+
+
+/*
+ * A name as prefix and index, or prefix alone for index -1.
+ */
+static void
+putname(Buf *b, const char *prefix, u32 index)
+{
+    u8      digits[10], *p;
+    size_t  n;
+
+    p = digits + sizeof(digits);
+
+    while (index != (u32) -1) {
+        *--p = '0' + index % 10;
+        index /= 10;
+
+        if (index == 0) {
+            break;
+        }
+    }
+
+    n = strlen(prefix);
+
+    putuleb(b, n + (digits + sizeof(digits) - p));
+    putbytes(b, prefix, n);
+    putbytes(b, p, digits + sizeof(digits) - p);
+}
+
+
+static void
+putuleb(Buf *b, u64 v)
+{
+    if (fast(reserve(b, 10))) {
+        b->len += uleb128encode(v, b->data + b->len, b->data + b->len + 10);
+    }
+}
+
+
+static void
+putsleb(Buf *b, i64 v)
+{
+    if (fast(reserve(b, 10))) {
+        b->len += sleb128encode(v, b->data + b->len, b->data + b->len + 10);
+    }
+}
+
+
+/*
+ * xorshift64*, good enough to pick pieces and constants.
+ */
+static u64
+next(Gen *g)
+{
+    g->rand ^= g->rand >> 12;
+    g->rand ^= g->rand << 25;
+    g->rand ^= g->rand >> 27;
+
+    return g->rand * 0x2545f4914f6cdd1dULL;
+}
+
+
+/*
+ * A value of any magnitude, and so of any LEB128 width, either sign.
+ */
+static i64
+anywidth(Gen *g)
+{
+    u64  r;
+
+    r = next(g);
+
+    return (i64) r >> (r & 63);
+}
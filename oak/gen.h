@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+
+#ifndef _OAK_GEN_H_
+#define _OAK_GEN_H_
+
+
+/*
+ * Synthetic modules of any size, for tests and benchmarks of the loader.
+ * Type i takes i % 4 params, i32 and i64, and returns an i32.  Functions
+ * and imports take the types in turn, and bodies are instructions picked
+ * from seed until bodysize bytes: arithmetic on locals, constants of all
+ * LEB128 widths, blocks, calls, globals and, with data, loads.  The same
+ * spec always makes the same module, and every module validates.
+ */
+typedef struct {
+    u32             ntypes;     /* at least 1 with imports or functions */
+    u32             nimports;   /* functions, from "env" */
+    u32             nfuncs;
+    u32             nexports;   /* of the function space, from index 0 */
+    u32             nglobals;   /* i32 and i64 in turn, every third mutable */
+    u32             ndatas;     /* data segments, with a memory for them */
+    u32             datasize;   /* bytes per segment */
+    u32             bodysize;   /* code bytes per body, at least */
+    u64             seed;
+} GenSpec;
+
+
+Error *genmodule(const GenSpec *spec, u8 **buf, size_t *size);
+Error *genfile(const GenSpec *spec, const char *filename);
+
+
+#endif /* _OAK_GEN_H_ */
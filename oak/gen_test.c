@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/insn.h>
+#include "gen.h"
+#include "opcodes.h"
+#include "test.h"
+
+
+#define GENERATED   "/tmp/oak-gen-test.wasm"
+
+
+static Error *test_counts(void);
+static Error *test_widths(Module *m);
+static Error *test_same(void);
+static Error *test_empty(void);
+static Error *test_bad(void);
+
+
+static const GenSpec  spec = {
+    .ntypes = 7,
+    .nimports = 5,
+    .nfuncs = 300,
+    .nexports = 100,
+    .nglobals = 9,
+    .ndatas = 4,
+    .datasize = 100000,
+    .bodysize = 200,
+    .seed = 1,
+};
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_counts();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_same();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_empty();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_bad();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+test_counts(void)
+{
+    u32          i;
+    Error        *err;
+    Module       *m;
+    CodeDecl     *code;
+    TypeDecl     *type;
+    ExportDecl   *export;
+
+    err = genfile(&spec, GENERATED);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = loadmodule(&m, GENERATED);
+    if (slow(err != NULL)) {
+        return error(err, "loading the generated module");
+    }
+
+    if (slow(len(m->types) != spec.ntypes || len(m->imports) != spec.nimports
+             || len(m->funcs) != spec.nfuncs
+             || len(m->exports) != spec.nexports
+             || len(m->globals) != spec.nglobals
+             || len(m->datas) != spec.ndatas || len(m->memories) != 1
+             || len(m->codes) != spec.nfuncs))
+    {
+        err = newerror("%d types, %d imports, %d funcs, %d exports, "
+                       "%d globals, %d datas", len(m->types), len(m->imports),
+                       len(m->funcs), len(m->exports), len(m->globals),
+                       len(m->datas));
+        goto done;
+    }
+
+    for (i = 0; i < len(m->types); i++) {
+        type = &((FuncDecl *) arrayget(m->types, i))->type;
+
+        if (slow(len(type->params) != i % 4 || len(type->rets) != 1)) {
+            err = newerror("type %d: %d params, %d results", i,
+                           len(type->params), len(type->rets));
+            goto done;
+        }
+    }
+
+    /* locals take 5 bytes of the body */
+
+    for (i = 0; i < len(m->codes); i++) {
+        code = arrayget(m->codes, i);
+
+        if (slow(code->end - code->start + 1 + 5 < spec.bodysize)) {
+            err = newerror("body %d of %d bytes", i,
+                           (u32) (code->end - code->start + 1));
+            goto done;
+        }
+    }
+
+    export = arrayget(m->exports, 42);
+
+    if (slow(export->field->len != 3
+             || memcmp(export->field->start, "f42", 3) != 0
+             || export->index != 42))
+    {
+        err = newerror("export 42 is \"%S\" of function %d", export->field,
+                       export->index);
+        goto done;
+    }
+
+    err = test_widths(m);
+
+done:
+
+    closemodule(m);
+
+    return err;
+}
+
+
+/*
+ * Constants are to come in all widths, up to 5 and 10 bytes.
+ */
+static Error *
+test_widths(Module *m)
+{
+    u32       i, width, max32, max64;
+    Insn      insn;
+    Error     *err;
+    InsnIter  it;
+
+    max32 = 0;
+    max64 = 0;
+
+    for (i = 0; i < len(m->codes); i++) {
+        insniter(&it, arrayget(m->codes, i));
+
+        while (!insndone(&it)) {
+            err = insnnext(&it, &insn);
+            if (slow(err != NULL)) {
+                return err;
+            }
+
+            width = it.p - it.start - insn.offset - 1;
+
+            if (insn.op == Opi32const && width > max32) {
+                max32 = width;
+            }
+
+            if (insn.op == Opi64const && width > max64) {
+                max64 = width;
+            }
+        }
+    }
+
+    if (slow(max32 != 5 || max64 != 10)) {
+        return newerror("widest constants of %d and %d bytes", max32, max64);
+    }
+
+    return NULL;
+}
+
+
+static Error *
+test_same(void)
+{
+    u8       *a, *b;
+    size_t   asize, bsize;
+    Error    *err;
+    GenSpec  other;
+
+    err = genmodule(&spec, &a, &asize);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = genmodule(&spec, &b, &bsize);
+    if (slow(err != NULL)) {
+        free(a);
+        return err;
+    }
+
+    if (slow(asize != bsize || memcmp(a, b, asize) != 0)) {
+        err = newerror("the same spec made different modules");
+    }
+
+    free(b);
+
+    if (slow(err != NULL)) {
+        free(a);
+        return err;
+    }
+
+    other = spec;
+    other.seed = 2;
+
+    err = genmodule(&other, &b, &bsize);
+    if (slow(err != NULL)) {
+        free(a);
+        return err;
+    }
+
+    if (slow(asize == bsize && memcmp(a, b, asize) == 0)) {
+        err = newerror("another seed made the same module");
+    }
+
+    free(a);
+    free(b);
+
+    return err;
+}
+
+
+static Error *
+test_empty(void)
+{
+    Error    *err;
+    Module   *m;
+    GenSpec  empty;
+
+    memset(&empty, 0, sizeof(GenSpec));
+
+    err = genfile(&empty, GENERATED);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = loadmodule(&m, GENERATED);
+    if (slow(err != NULL)) {
+        return error(err, "loading the empty module");
+    }
+
+    if (slow(m->file.size != 8 || len(m->sects) != 0)) {
+        err = newerror("empty module of %d bytes, %d sections",
+                       (u32) m->file.size, len(m->sects));
+    }
+
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+test_bad(void)
+{
+    u8       *buf;
+    size_t   size;
+    Error    *err;
+    GenSpec  bad;
+
+    static const char  *notype = "functions need at least one type";
+    static const char  *exports = "101 exports of 100 functions";
+
+    memset(&bad, 0, sizeof(GenSpec));
+
+    bad.nfuncs = 100;
+
+    err = genmodule(&bad, &buf, &size);
+    if (slow(err == NULL || !iserror(err, notype))) {
+        return (err != NULL) ? error(err, "expected \"%s\"", notype)
+                             : newerror("no types passed");
+    }
+
+    errorfree(err);
+
+    bad.ntypes = 1;
+    bad.nexports = 101;
+
+    err = genmodule(&bad, &buf, &size);
+    if (slow(err == NULL || !iserror(err, exports))) {
+        return (err != NULL) ? error(err, "expected \"%s\"", exports)
+                             : newerror("too many exports passed");
+    }
+
+    errorfree(err);
+
+    return NULL;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/jit.h>
+#include <oak/aot.h>
+#include <oak/host.h>
+
+#include <string.h>
+
+
+typedef struct {
+    const char      *params;
+    const char      *rets;
+    u64             (*call)(const HostCall *h, u64 *args);
+} Shape;
+
+
+static Error *bind(const Module *m, HostCall *hosts, u32 *nbound,
+    const HostFunc *funcs, u32 nfuncs);
+static Error *signature(const TypeDecl *type, char *params, char *rets);
+static const HostFunc *findhost(const ImportDecl *import,
+    const HostFunc *funcs, u32 nfuncs);
+static u64 hostraw(const HostCall *h, u64 *args);
+
+
+/*
+ * Return values are zero-extended into the result slot like every i32.
+ */
+#define HOSTRET_void(call)  ((call), 0)
+#define HOSTRET_i32(call)   ((u64) (u32) (call))
+#define HOSTRET_i64(call)   ((u64) (call))
+
+
+#define TRAMPOLINE(name, params, rets, rtype, ctypes, cargs)                  \
+    static u64                                                                \
+    host_##name(const HostCall *h, u64 * unused(args))                        \
+    {                                                                         \
+        rtype  (*fn) ctypes;                                                  \
+                                                                              \
+        memcpy(&fn, &h->fn, sizeof(fn));                                      \
+        return HOSTRET_##rtype(fn cargs);                                     \
+    }
+
+HOST_SHAPES(TRAMPOLINE)
+
+
+#define SHAPE(name, params, rets, rtype, ctypes, cargs)                       \
+    {params, rets, host_##name},
+
+static const Shape  shapes[] = {
+    HOST_SHAPES(SHAPE)
+};
+
+
+/*
+ * Binds the function imports matching the module and field of an entry of
+ * `funcs`.  Imports left out keep their previous binding, if any, so a module
+ * can be bound in several calls.
+ */
+Error *
+jitbind(Jit *jit, const HostFunc *funcs, u32 nfuncs)
+{
+    if (slow(jit->nimports > 0 && jit->hosts == NULL)) {
+        return newerror("jit not supported on this platform");
+    }
+
+    return bind(jit->module, jit->hosts, &jit->nbound, funcs, nfuncs);
+}
+
+
+Error *
+aotbind(Aot *aot, const HostFunc *funcs, u32 nfuncs)
+{
+    return bind(aot->module, aot->env.hosts, &aot->nbound, funcs, nfuncs);
+}
+
+
+static Error *
+bind(const Module *m, HostCall *hosts, u32 *nbound, const HostFunc *funcs,
+    u32 nfuncs)
+{
+    u32             i, n, j;
+    char            params[8], rets[2];
+    Error           *err;
+    HostCall        *call;
+    ImportDecl      *import;
+    const HostFunc  *host;
+
+    n = 0;
+
+    for (i = 0; i < len(m->imports); i++) {
+        import = arrayget(m->imports, i);
+        if (import->kind != Function) {
+            continue;
+        }
+
+        call = &hosts[n++];
+
+        host = findhost(import, funcs, nfuncs);
+        if (host == NULL) {
+            continue;
+        }
+
+        if (host->raw) {
+            if (call->call == NULL) {
+                (*nbound)++;
+            }
+
+            call->call = hostraw;
+            call->fn = host->fn;
+            call->data = host->data;
+            continue;
+        }
+
+        err = signature(&import->u.type, params, rets);
+        if (slow(err != NULL)) {
+            return error(err, "binding %s.%s", host->module, host->field);
+        }
+
+        for (j = 0; j < nitems(shapes); j++) {
+            if (strcmp(shapes[j].params, params) == 0
+                && strcmp(shapes[j].rets, rets) == 0)
+            {
+                break;
+            }
+        }
+
+        if (slow(j == nitems(shapes))) {
+            return newerror("binding %s.%s: no trampoline for (%s) -> (%s), "
+                            "bind it raw", host->module, host->field, params,
+                            rets);
+        }
+
+        if (call->call == NULL) {
+            (*nbound)++;
+        }
+
+        call->call = shapes[j].call;
+        call->fn = host->fn;
+        call->data = host->data;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Spells a signature the way HOST_SHAPES does, failing for types or arities
+ * no shape has.
+ */
+static Error *
+signature(const TypeDecl *type, char *params, char *rets)
+{
+    u32   i;
+    Type  *t;
+
+    if (slow(len(type->params) > 7 || len(type->rets) > 1)) {
+        return newerror("no trampoline for %d params and %d results",
+                        len(type->params), len(type->rets));
+    }
+
+    for (i = 0; i < len(type->params); i++) {
+        t = arrayget(type->params, i);
+        if (slow(*t != I32 && *t != I64)) {
+            return newerror("param of type 0x%x not supported", *t);
+        }
+
+        params[i] = (*t == I32) ? 'i' : 'I';
+    }
+
+    params[i] = '\0';
+
+    rets[0] = '\0';
+
+    if (len(type->rets) == 1) {
+        t = arrayget(type->rets, 0);
+        if (slow(*t != I32 && *t != I64)) {
+            return newerror("result of type 0x%x not supported", *t);
+        }
+
+        rets[0] = (*t == I32) ? 'i' : 'I';
+        rets[1] = '\0';
+    }
+
+    return NULL;
+}
+
+
+static const HostFunc *
+findhost(const ImportDecl *import, const HostFunc *funcs, u32 nfuncs)
+{
+    u32  i;
+
+    for (i = 0; i < nfuncs; i++) {
+        if (cstringcmp(import->module, funcs[i].module)
+            && cstringcmp(import->field, funcs[i].field))
+        {
+            return &funcs[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+static u64
+hostraw(const HostCall *h, u64 *args)
+{
+    HostRaw  fn;
+
+    memcpy(&fn, &h->fn, sizeof(fn));
+
+    return fn(h->data, args);
+}
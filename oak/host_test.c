@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/jit.h>
+#include <oak/host.h>
+#include "test.h"
+
+
+static Error *test_bind(JitMode mode);
+static Error *test_noshape();
+static Error *test_void();
+static Error *call(Jit *jit, const char *func, u64 *args, u64 want);
+
+static i32 hostadd(void *data, i32 a, i32 b);
+static i64 hostadd64(void *data, i64 a, i64 b);
+static void hostnop(void *data);
+static u64 hostmix(void *data, u64 *args);
+static void hoststore(void *data, i32 v);
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_bind(JitEager);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_bind(JitLazy);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_noshape();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_void();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+test_bind(JitMode mode)
+{
+    u32       nops;
+    u64       args[3];
+    Jit       jit;
+    Error     *err;
+    Module    *m;
+    HostFunc  funcs[] = {
+        {"env", "add", (void *) hostadd, NULL, 0},
+        {"env", "add64", (void *) hostadd64, NULL, 0},
+        {"env", "nop", (void *) hostnop, &nops, 0},
+        {"env", "mix", (void *) hostmix, NULL, 1},
+    };
+
+    err = loadmodule(&m, "testdata/ok/host.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = jitmodule(&jit, m, mode);
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        return error(err, "compiling host.wasm");
+    }
+
+    args[0] = 1;
+    args[1] = 2;
+
+    err = jitcall(&jit, 4, args, NULL);
+    if (slow(err == NULL
+             || !iserror(err, "4 of 4 imported functions not bound")))
+    {
+        err = error(err, "call with unbound imports must fail");
+        goto done;
+    }
+
+    errorfree(err);
+
+    /* bound in two steps */
+
+    err = jitbind(&jit, funcs, 2);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    err = jitbind(&jit, funcs + 2, 2);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    if (slow(jit.nbound != 4)) {
+        err = newerror("%d imports bound, expected 4", jit.nbound);
+        goto done;
+    }
+
+    args[0] = 2;
+    args[1] = 3;
+
+    err = call(&jit, "add", args, 1005);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    /* i32 results come back zero-extended */
+
+    args[0] = 0xffffffff;
+    args[1] = 0xffffffff;
+
+    err = call(&jit, "add", args, 998);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    args[0] = 0x100000000;
+    args[1] = 0xffffffffffffffff;
+
+    err = call(&jit, "add64", args, 0xffffffff);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    nops = 0;
+
+    args[0] = 5;
+    args[1] = 0x10000000000;
+    args[2] = 7;
+
+    err = call(&jit, "mix", args, 0x70000000005);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    if (slow(nops != 1)) {
+        err = newerror("nop called %d times", nops);
+        goto done;
+    }
+
+    args[0] = 100;
+
+    err = call(&jit, "sum", args, 4950);
+
+done:
+
+    jitclose(&jit);
+
+    return err;
+}
+
+
+static Error *
+test_noshape()
+{
+    Jit       jit;
+    Error     *err;
+    Module    *m;
+    HostFunc  mix = {"env", "mix", (void *) hostmix, NULL, 0};
+
+    err = loadmodule(&m, "testdata/ok/host.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = jitmodule(&jit, m, JitLazy);
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = jitbind(&jit, &mix, 1);
+    jitclose(&jit);
+
+    if (slow(err == NULL)) {
+        return newerror("signature without a shape must not bind");
+    }
+
+    if (slow(!iserror(err, "binding env.mix: no trampoline for (iIi) -> (I), "
+                           "bind it raw")))
+    {
+        return error(err, "unexpected error");
+    }
+
+    errorfree(err);
+
+    return NULL;
+}
+
+
+static Error *
+test_void()
+{
+    i32       stored;
+    Jit       jit;
+    Error     *err;
+    Module    *m;
+    HostFunc  store = {
+        "imports", "imported_func", (void *) hoststore, &stored, 0
+    };
+
+    err = loadmodule(&m, "testdata/ok/call1.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = jitmodule(&jit, m, JitEager);
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = jitbind(&jit, &store, 1);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    stored = 0;
+
+    err = jitcall(&jit, 1, NULL, NULL);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    if (slow(stored != 42)) {
+        err = newerror("host function got %d, expected 42", stored);
+    }
+
+done:
+
+    jitclose(&jit);
+
+    return err;
+}
+
+
+static Error *
+call(Jit *jit, const char *func, u64 *args, u64 want)
+{
+    u64         got;
+    Error       *err;
+    String      field;
+    ExportDecl  *export;
+
+    cstr(&field, (u8 *) func);
+
+    export = findexport(jit->module, &field);
+    if (slow(export == NULL)) {
+        return newerror("export %s not found", func);
+    }
+
+    err = jitcall(jit, export->index, args, &got);
+    if (slow(err != NULL)) {
+        return error(err, "calling %s", func);
+    }
+
+    if (slow(got != want)) {
+        return newerror("%s: result mismatch (%x(u64) != %x(u64))", func, got,
+                        want);
+    }
+
+    return NULL;
+}
+
+
+static i32
+hostadd(void * unused(data), i32 a, i32 b)
+{
+    return a + b;
+}
+
+
+static i64
+hostadd64(void * unused(data), i64 a, i64 b)
+{
+    return a + b;
+}
+
+
+static void
+hostnop(void *data)
+{
+    (*(u32 *) data)++;
+}
+
+
+static u64
+hostmix(void * unused(data), u64 *args)
+{
+    return (u32) args[0] + args[1] * (u32) args[2];
+}
+
+
+static void
+hoststore(void *data, i32 v)
+{
+    *(i32 *) data = v;
+}
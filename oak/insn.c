@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/insn.h>
+
+#include <sys/types.h>
+
+#include "bin.h"
+#include "opcodes.h"
+
+
+void
+insniter(InsnIter *it, const CodeDecl *code)
+{
+    it->start = code->start;
+    it->p = (u8 *) code->start;
+    it->end = code->end + 1;        /* includes the final 0x0b */
+}
+
+
+/*
+ * Decodes the instruction at the iterator and moves past it.  A malformed
+ * one ends the walk.
+ */
+Error *
+insnnext(InsnIter *it, Insn *insn)
+{
+    Error  *err;
+
+    if (slow(it->p >= it->end)) {
+        return newerror("no instructions left");
+    }
+
+    insn->offset = it->p - it->start;
+    insn->op = *it->p++;
+
+    err = decodeimm(&it->p, it->end, insn->op, &insn->imm);
+    if (slow(err != NULL)) {
+        it->p = (u8 *) it->end;
+        return error(err, "at offset %d", insn->offset);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Reads a br_table label starting from Imm.targets.  The labels were
+ * checked by insnnext(), so this does not fail.
+ */
+u32
+nextlabel(const u8 **p)
+{
+    u32  label;
+
+    u32vdecode((u8 **) p, *p + 5, &label);
+
+    return label;
+}
+
+
+const char *
+opname(u8 op)
+{
+    return opinfo[op].name;
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/insn.h>
+#include "test.h"
+
+
+static Error *test_body(void);
+static Error *test_module(const char *filename);
+static Error *test_malformed(void);
+
+
+/*
+ * block (result i32)
+ *   i32.const 7
+ *   br_table 0 1 0
+ * end
+ * i64.load offset=16
+ * end
+ */
+static const u8  body[] = {
+    0x02, 0x7f,
+    0x41, 0x07,
+    0x0e, 0x02, 0x00, 0x01, 0x00,
+    0x0b,
+    0x29, 0x03, 0x10,
+    0x0b,
+};
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_body();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_module("testdata/ok/kernels.wasm");
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_module("testdata/ok/dead.wasm");
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_malformed();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+test_body(void)
+{
+    u32         i;
+    Insn        insn;
+    Error       *err;
+    InsnIter    it;
+    CodeDecl    code;
+    const u8    *labels;
+
+    static const u8   ops[] = {0x02, 0x41, 0x0e, 0x0b, 0x29, 0x0b};
+    static const u32  offsets[] = {0, 2, 4, 9, 10, 13};
+    static const u32  want[] = {0, 1};
+
+    memset(&code, 0, sizeof(CodeDecl));
+
+    code.start = body;
+    code.end = body + sizeof(body) - 1;
+
+    insniter(&it, &code);
+
+    for (i = 0; !insndone(&it); i++) {
+        if (slow(i == nitems(ops))) {
+            return newerror("more instructions than the %d expected", i);
+        }
+
+        err = insnnext(&it, &insn);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        if (slow(insn.op != ops[i] || insn.offset != offsets[i])) {
+            return newerror("instruction %d: %s at %d, expected %s at %d",
+                            i, opname(insn.op), insn.offset,
+                            opname(ops[i]), offsets[i]);
+        }
+
+        switch (insn.op) {
+        case 0x02:
+            if (slow(insn.imm.block != 0x7f)) {
+                return newerror("block type 0x%x", insn.imm.block);
+            }
+
+            break;
+
+        case 0x41:
+            if (slow(insn.imm.value != 7)) {
+                return newerror("i32.const %d", (i32) insn.imm.value);
+            }
+
+            break;
+
+        case 0x0e:
+            if (slow(insn.imm.ntargets != 2 || insn.imm.index != 0)) {
+                return newerror("br_table of %d labels, default %d",
+                                insn.imm.ntargets, insn.imm.index);
+            }
+
+            labels = insn.imm.targets;
+
+            for (i = 0; i < nitems(want); i++) {
+                if (slow(nextlabel(&labels) != want[i])) {
+                    return newerror("br_table label %d", i);
+                }
+            }
+
+            i = 2;
+            break;
+
+        case 0x29:
+            if (slow(insn.imm.align != 3 || insn.imm.offset != 16)) {
+                return newerror("i64.load align=%d offset=%d",
+                                insn.imm.align, insn.imm.offset);
+            }
+
+            break;
+        }
+    }
+
+    if (slow(i != nitems(ops))) {
+        return newerror("%d instructions, expected %d", i, nitems(ops));
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Every body of a valid module is walked to its last byte, and its last
+ * instruction is an end.
+ */
+static Error *
+test_module(const char *filename)
+{
+    u32         i;
+    Insn        insn;
+    Error       *err;
+    Module      *m;
+    InsnIter    it;
+    CodeDecl    *code;
+
+    err = loadmodule(&m, filename);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    for (i = 0; i < len(m->codes); i++) {
+        code = arrayget(m->codes, i);
+
+        insniter(&it, code);
+
+        while (!insndone(&it)) {
+            err = insnnext(&it, &insn);
+            if (slow(err != NULL)) {
+                err = error(err, "%s: function %d", filename, i);
+                goto done;
+            }
+        }
+
+        if (slow(it.p != code->end + 1 || insn.op != 0x0b
+                 || insn.offset != (u32) (code->end - code->start)))
+        {
+            err = newerror("%s: function %d ends with %s at %d", filename,
+                           i, opname(insn.op), insn.offset);
+            goto done;
+        }
+    }
+
+done:
+
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+test_malformed(void)
+{
+    Insn      insn;
+    Error     *err;
+    InsnIter  it;
+    CodeDecl  code;
+
+    /* f32.const with a truncated immediate */
+
+    static const u8  truncated[] = {0x01, 0x43, 0x00, 0x00};
+
+    memset(&code, 0, sizeof(CodeDecl));
+
+    code.start = truncated;
+    code.end = truncated + sizeof(truncated) - 1;
+
+    insniter(&it, &code);
+
+    err = insnnext(&it, &insn);
+    if (slow(err != NULL || insn.op != 0x01)) {
+        return error(err, "nop expected");
+    }
+
+    err = insnnext(&it, &insn);
+    if (slow(err == NULL || !iserror(err, "at offset 1")
+             || !iserror(err, "malformed float constant")))
+    {
+        return error(err, "expected a malformed f32.const at offset 1");
+    }
+
+    errorfree(err);
+
+    if (slow(!insndone(&it))) {
+        return newerror("the walk goes on after a malformed instruction");
+    }
+
+    return NULL;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/memory.h>
+#include <oak/instance.h>
+#include <oak/pool.h>
+#include "opcodes.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+static Error *initdata(Instance *inst, const DataDecl *data, u32 index);
+
+
+Error *
+instantiate(Instance *inst, Module *m)
+{
+    return instantiateimports(inst, m, NULL, 0);
+}
+
+
+/*
+ * Instantiates a module importing globals, given the raw bits of each, in
+ * import order.
+ */
+Error *
+instantiateimports(Instance *inst, Module *m, const u64 *globals, u32 nglobals)
+{
+    Error       *err;
+    TableDecl   *table;
+    MemoryDecl  *decl;
+
+    memset(inst, 0, sizeof(Instance));
+
+    if (slow(nglobals != m->nimportglobals)) {
+        return newerror("%d of %d imported globals supplied", nglobals,
+                        m->nimportglobals);
+    }
+
+    inst->module = acquiremodule(m);
+
+    if (m->memories != NULL && len(m->memories) > 0) {
+        decl = arrayget(m->memories, 0);
+
+        err = newmemory(&inst->memory, &decl->limit);
+        if (slow(err != NULL)) {
+            return error(err, "instantiating memory");
+        }
+
+        inst->hasmemory = 1;
+    }
+
+    if (m->tables != NULL && len(m->tables) > 0) {
+        table = arrayget(m->tables, 0);
+        inst->tablesize = table->limit.initial;
+    }
+
+    inst->nglobals = m->nimportglobals + len(m->globals);
+
+    if (inst->tablesize > 0) {
+        inst->table = zmalloc(sizeof(u32) * inst->tablesize);
+        if (slow(inst->table == NULL)) {
+            err = newerror("failed to allocate table: %s", strerror(errno));
+            goto fail;
+        }
+    }
+
+    if (inst->nglobals > 0) {
+        inst->globals = zmalloc(sizeof(u64) * inst->nglobals);
+        if (slow(inst->globals == NULL)) {
+            err = newerror("failed to allocate globals: %s", strerror(errno));
+            goto fail;
+        }
+
+        if (nglobals > 0) {
+            memcpy(inst->globals, globals, sizeof(u64) * nglobals);
+        }
+    }
+
+    err = initinstance(inst);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return NULL;
+
+fail:
+
+    closeinstance(inst);
+    return err;
+}
+
+
+/*
+ * Sets globals and applies data segments on storage that is already
+ * allocated and zeroed, be it fresh or from a pool, and with the imported
+ * globals set.
+ */
+Error *
+initinstance(Instance *inst)
+{
+    u32         i;
+    u64         *slot;
+    Error       *err;
+    Module      *m;
+    DataDecl    *data;
+    GlobalDecl  *global;
+
+    m = inst->module;
+
+    slot = inst->globals + m->nimportglobals;
+
+    for (i = 0; i < len(m->globals); i++, slot++) {
+        global = arrayget(m->globals, i);
+
+        if (global->init == OpgetGlobal) {
+            *slot = inst->globals[global->u.globalindex];
+            continue;
+        }
+
+        switch (global->type.type) {
+        case I32:
+            *slot = (u32) global->u.i32val;
+            break;
+
+        case I64:
+            *slot = (u64) global->u.i64val;
+            break;
+
+        case F32:
+            *slot = global->u.f32val;
+            break;
+
+        default:
+            *slot = global->u.f64val;
+        }
+    }
+
+    if (m->datas == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < len(m->datas); i++) {
+        data = arrayget(m->datas, i);
+
+        err = initdata(inst, data, i);
+        if (slow(err != NULL)) {
+            return err;
+        }
+    }
+
+    return NULL;
+}
+
+
+void
+closeinstance(Instance *inst)
+{
+    if (inst->pool != NULL) {
+        poolrelease(inst->pool, inst);
+        return;
+    }
+
+    if (inst->hasmemory) {
+        closememory(&inst->memory);
+        inst->hasmemory = 0;
+    }
+
+    memfree(inst->table);
+    memfree(inst->globals);
+
+    inst->table = NULL;
+    inst->globals = NULL;
+
+    if (inst->module != NULL) {
+        closemodule(inst->module);
+        inst->module = NULL;
+    }
+}
+
+
+/*
+ * Segments are applied in order, so a later segment overlapping an earlier
+ * one wins whether its pages are mapped or copied.
+ */
+static Error *
+initdata(Instance *inst, const DataDecl *data, u32 index)
+{
+    u8      *base, *p;
+    u64     off, end, first, last, fileoff, pagesize;
+    File    *file;
+
+    if (slow(!inst->hasmemory || data->index != 0)) {
+        return newerror("data segment %d: memory %d not found", index,
+                        data->index);
+    }
+
+    base = inst->memory.base;
+    file = &inst->module->file;
+
+    off = (data->init == OpgetGlobal) ? (u32) inst->globals[data->globalindex]
+                                       : (u32) data->offset;
+    end = off + data->size;
+
+    if (slow(end > (u64) inst->memory.pages * WASM_PAGE_SIZE)) {
+        return newerror("data segment %d does not fit in memory", index);
+    }
+
+    pagesize = getpagesize();
+    fileoff = data->data - file->data;
+
+    first = (off + pagesize - 1) & ~(pagesize - 1);
+    last = end & ~(pagesize - 1);
+
+    if ((fileoff & (pagesize - 1)) != (off & (pagesize - 1)) || first >= last)
+    {
+        memcpy(base + off, data->data, data->size);
+        inst->ncopied += data->size;
+        return NULL;
+    }
+
+    p = mmap(base + first, last - first, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, file->fd, fileoff + (first - off));
+    if (slow(p == MAP_FAILED)) {
+        return newerror("data segment %d: failed to map file: %s", index,
+                        strerror(errno));
+    }
+
+    memcpy(base + off, data->data, first - off);
+    memcpy(base + last, data->data + (last - off), end - last);
+
+    inst->memory.mapped = 1;
+    inst->nmapped += (last - first) / pagesize;
+    inst->ncopied += (first - off) + (end - last);
+
+    return NULL;
+}
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/memory.h>
+#include <oak/instance.h>
+#include "test.h"
+
+
+#define SEG0OFF     8192
+#define SEG0SIZE    (3 * 4096 + 10)
+
+#define NTHREADS    8
+#define NLIVE       32      /* instances alive at once on each thread */
+#define NROUNDS     4
+
+
+static Error *test_datas();
+static Error *test_dataoob();
+static Error *test_shared();
+static Error *test_outlive();
+static Error *test_imports();
+static Error *checkdatas(Instance *inst);
+static void *consumer(void *arg);
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_datas();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_dataoob();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_shared();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_outlive();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_imports();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+test_datas()
+{
+    u8        *filebyte;
+    Error     *err;
+    Module    *m;
+    Instance  a, b;
+    DataDecl  *data;
+
+    err = loadmodule(&m, "testdata/ok/datas.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = instantiate(&a, m);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        return err;
+    }
+
+    err = checkdatas(&a);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    if (getpagesize() == 4096 && slow(a.nmapped != 3)) {
+        err = newerror("expected 3 mapped pages, got %d", a.nmapped);
+        goto done;
+    }
+
+    /* writes must stay private to the instance */
+
+    data = arrayget(m->datas, 0);
+    filebyte = (u8 *) data->data + 4096;
+
+    a.memory.base[SEG0OFF + 4096] = 0xff;
+
+    if (slow(*filebyte != 4096 % 251)) {
+        err = newerror("write to instance memory reached the module file");
+        goto done;
+    }
+
+    err = instantiate(&b, m);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    err = checkdatas(&b);
+
+    closeinstance(&b);
+
+done:
+
+    closeinstance(&a);
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+checkdatas(Instance *inst)
+{
+    u8   *base;
+    u32  i;
+
+    base = inst->memory.base;
+
+    for (i = 0; i < 100; i++) {
+        if (slow(base[3 + i] != i)) {
+            return newerror("segment 1: byte %d is %d", i, base[3 + i]);
+        }
+    }
+
+    for (i = 0; i < SEG0SIZE; i++) {
+        if (i >= 4096 + 5 && i < 4096 + 15) {
+            if (slow(base[SEG0OFF + i] != 0xaa)) {
+                return newerror("segment 2: byte %d is %d", i,
+                                base[SEG0OFF + i]);
+            }
+
+            continue;
+        }
+
+        if (slow(base[SEG0OFF + i] != i % 251)) {
+            return newerror("segment 0: byte %d is %d", i, base[SEG0OFF + i]);
+        }
+    }
+
+    if (slow(base[SEG0OFF - 1] != 0 || base[SEG0OFF + SEG0SIZE] != 0)) {
+        return newerror("segment 0 leaked outside its range");
+    }
+
+    return NULL;
+}
+
+
+static Error *
+test_dataoob()
+{
+    Error     *err;
+    Module    *m;
+    Instance  inst;
+
+    err = loadmodule(&m, "testdata/ok/dataoob.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = instantiate(&inst, m);
+    closemodule(m);
+
+    if (slow(err == NULL)) {
+        closeinstance(&inst);
+        return newerror("out of bounds data segment must fail");
+    }
+
+    if (slow(!iserror(err, "data segment 0 does not fit in memory"))) {
+        return error(err, "unexpected error");
+    }
+
+    errorfree(err);
+
+    return NULL;
+}
+
+
+/*
+ * One load shared by NTHREADS * NLIVE instances alive at the same time.
+ */
+static Error *
+test_shared()
+{
+    u32        i, n;
+    void       *ret;
+    Error      *err, *e;
+    Module     *m;
+    pthread_t  threads[NTHREADS];
+
+    err = loadmodule(&m, "testdata/ok/small.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    for (n = 0; n < NTHREADS; n++) {
+        if (slow(pthread_create(&threads[n], NULL, consumer, m) != 0)) {
+            err = newerror("failed to create thread %d", n);
+            break;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        pthread_join(threads[i], &ret);
+
+        e = ret;
+        if (slow(e != NULL)) {
+            if (err == NULL) {
+                err = error(e, "thread %d", i);
+
+            } else {
+                errorfree(e);
+            }
+        }
+    }
+
+    if (slow(err == NULL && m->refs != 1)) {
+        err = newerror("%d references left after all consumers", m->refs);
+    }
+
+    closemodule(m);
+
+    return err;
+}
+
+
+static void *
+consumer(void *arg)
+{
+    u32       i, round;
+    Error     *err;
+    Module    *m;
+    Instance  insts[NLIVE];
+
+    m = arg;
+    err = NULL;
+
+    for (round = 0; round < NROUNDS && err == NULL; round++) {
+        for (i = 0; i < NLIVE; i++) {
+            err = instantiate(&insts[i], m);
+            if (slow(err != NULL)) {
+                break;
+            }
+
+            if (slow(memcmp(insts[i].memory.base + 16, "hello", 5) != 0)) {
+                err = newerror("instance %d: data segment not applied", i);
+                closeinstance(&insts[i]);
+                break;
+            }
+
+            insts[i].memory.base[16] = 'j';
+        }
+
+        while (i > 0) {
+            closeinstance(&insts[--i]);
+        }
+    }
+
+    return err;
+}
+
+
+/*
+ * Instances keep the module alive after the loader closed it.
+ */
+static Error *
+test_outlive()
+{
+    Error     *err;
+    Module    *m;
+    Instance  inst;
+
+    err = loadmodule(&m, "testdata/ok/small.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = instantiate(&inst, m);
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    if (slow(inst.module->refs != 1 || len(inst.module->globals) != 3)) {
+        err = newerror("module not kept alive by its instance");
+    }
+
+    closeinstance(&inst);
+
+    return err;
+}
+
+
+static Error *
+test_imports()
+{
+    u32       i;
+    Error     *err;
+    Module    *m;
+    Instance  inst;
+
+    static const u64  imports[] = {100, 0x100000000};
+    static const u64  want[] = {100, 0x100000000, 100, 100, 5, 5, 0x100000000};
+
+    err = loadmodule(&m, "testdata/ok/imports.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = instantiate(&inst, m);
+    if (slow(err == NULL || !iserror(err, "0 of 2 imported globals supplied")))
+    {
+        if (err == NULL) {
+            closeinstance(&inst);
+        }
+
+        closemodule(m);
+        return error(err, "imported globals must be supplied");
+    }
+
+    errorfree(err);
+
+    err = instantiateimports(&inst, m, imports, nitems(imports));
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    if (slow(inst.nglobals != nitems(want))) {
+        err = newerror("expected %d globals, got %d", nitems(want),
+                       inst.nglobals);
+        goto done;
+    }
+
+    for (i = 0; i < nitems(want); i++) {
+        if (slow(inst.globals[i] != want[i])) {
+            err = newerror("global %d is %x(u64), expected %x(u64)", i,
+                           inst.globals[i], want[i]);
+            goto done;
+        }
+    }
+
+    if (slow(memcmp(inst.memory.base + 100, "hi", 2) != 0
+             || inst.memory.base[5] != '!'))
+    {
+        err = newerror("data segments not at their global offsets");
+    }
+
+done:
+
+    closeinstance(&inst);
+
+    return err;
+}
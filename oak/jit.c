@@ -0,0 +1,2317 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#define _GNU_SOURCE     /* pthread_getattr_np() */
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/jit.h>
+#include <oak/fuel.h>
+#include <oak/epoch.h>
+
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "bin.h"
+#include "opcodes.h"
+
+
+/*
+ * Single-pass x86-64 compiler.
+ *
+ * The operand stack is mapped statically: slot `d` lives in stackregs[d] when
+ * d < NSTACKREGS and in its home slot in the native frame otherwise.  Every
+ * slot also has a home in the frame, used to pass arguments and to preserve
+ * caller-saved registers around calls.  The frame looks like:
+ *
+ *     rsp + 8 * i                 local i (params first)
+ *     rsp + 8 * (nlocals + d)     home of stack slot d
+ *
+ * rax, rcx and rdx are scratch, r15 holds the Jit pointer and r14 is reserved
+ * for the linear memory base.
+ */
+
+
+#if defined(__x86_64__) && defined(__linux__)
+
+
+#define NOFIX       0xffffffff
+#define NSTACKREGS  nitems(stackregs)
+
+
+typedef enum {
+    RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+} Reg;
+
+
+typedef enum {
+    CcO = 0x0, CcB = 0x2, CcAE = 0x3, CcE = 0x4, CcNE = 0x5, CcBE = 0x6,
+    CcA = 0x7, CcL = 0xc, CcGE = 0xd, CcLE = 0xe, CcG = 0xf,
+    CcAlways = 0x10,
+} Cond;
+
+
+typedef enum {
+    CtrlBlock = 0,
+    CtrlLoop,
+    CtrlIf,
+    CtrlElse,
+} CtrlKind;
+
+
+typedef struct {
+    u8              mem;
+    u8              reg;        /* register, or base register if mem */
+    u8              indexed;    /* [base + index + disp] */
+    u8              index;
+    i32             disp;
+} Operand;
+
+
+typedef struct {
+    u8              w;
+    u8              prefix;
+    u32             opcode;     /* 0 if not supported */
+} MemOp;
+
+
+typedef struct {
+    CtrlKind        kind;
+    u8              arity;
+    u8              unreachable;    /* rest of the current arm is dead */
+    u8              dead;           /* whole construct is dead */
+    u32             height;
+    u32             label;          /* loop header */
+    u32             fixups;         /* chain of jumps to the end */
+    u32             elsefix;        /* false branch of an if */
+} Ctrl;
+
+
+typedef struct {
+    Jit             *jit;
+    Module          *m;
+
+    u8              *code;
+    u32             len;
+    u32             nalloc;
+
+    Array           *ctrls;     /* of Ctrl */
+    Array           *blocks;    /* of BasicBlock, if metered */
+    u32             nextblock;
+
+    const u8        *p;
+    const u8        *end;
+
+    u32             nlocals;
+    u32             depth;
+    u32             maxdepth;
+    u32             traps[TrapPrepare];
+} Compiler;
+
+
+static Error *prepare(Jit *jit, u32 index);
+static void *jitlazy(Jit *jit, u32 index);
+static Error *install(Compiler *c, u8 **fn);
+static Error *emitlazystub(Compiler *c);
+static Error *compilefunc(Compiler *c, u32 index, CodeDecl *code);
+static Error *compileop(Compiler *c, u8 op);
+static void meter(Compiler *c, u32 at);
+static void epochcheck(Compiler *c);
+static Error *skipop(Compiler *c, u8 op);
+static Error *branch(Compiler *c, u32 label, Cond cc);
+static Error *brtable(Compiler *c);
+static Error *callfunc(Compiler *c, u32 index);
+static Error *endctrl(Compiler *c);
+static Error *pushctrl(Compiler *c, CtrlKind kind, u8 dead);
+static Error *blocktype(Compiler *c, u8 *arity);
+static Error *memarg(Compiler *c, u32 d, Operand *addr);
+static Error *loadop(Compiler *c, u8 op);
+static Error *storeop(Compiler *c, u8 op);
+static void growop(Compiler *c);
+static void sizeop(Compiler *c);
+
+static void binop(Compiler *c, u8 w, u32 opcode);
+static void shiftop(Compiler *c, u8 w, u8 ext);
+static void cmpop(Compiler *c, u8 w, Cond cc);
+static void eqzop(Compiler *c, u8 w);
+static void divop(Compiler *c, u8 w, u8 sign, u8 rem);
+static void selectop(Compiler *c);
+static void convop(Compiler *c, u8 op);
+static void constop(Compiler *c, u64 v, u8 w);
+
+static void prologue(Compiler *c, TypeDecl *type, CodeDecl *code);
+static void epilogue(Compiler *c);
+static void emittraps(Compiler *c);
+
+static Operand slot(Compiler *c, u32 d);
+static Operand home(Compiler *c, u32 d);
+static Operand local(u32 i);
+static Operand reg(Reg r);
+static Operand mem(Reg base, i32 disp);
+
+static void emit(Compiler *c, u8 b);
+static void emit32(Compiler *c, u32 v);
+static void emit64(Compiler *c, u64 v);
+static void emitrm(Compiler *c, u8 w, u32 opcode, u8 r, const Operand *rm);
+static void emitmov(Compiler *c, const Operand *dst, const Operand *src);
+static void emitimm(Compiler *c, Reg r, u64 v, u8 w);
+static u32 emitjump(Compiler *c, Cond cc, u32 *chain);
+static void emitjumpto(Compiler *c, Cond cc, u32 target);
+static void resolve(Compiler *c, u32 chain, u32 target);
+static void patch32(Compiler *c, u32 pos, u32 v);
+
+static void jittrap(Jit *jit, Trap trap) __attribute__((noreturn));
+static void jitmemtrap(void *data) __attribute__((noreturn));
+static u64 jitgrow(Jit *jit, u64 delta);
+static u8 calleesaved(Reg r);
+
+
+static const Reg  stackregs[] = {
+    RBX, R12, R13, RSI, RDI, R8, R9, R10, R11,
+};
+
+
+/*
+ * Indexed by opcode - OpLoadi32.  Float loads and stores are not supported
+ * yet.
+ */
+static const MemOp  memops[] = {
+    {0, 0, 0x8b},               /* i32.load */
+    {1, 0, 0x8b},               /* i64.load */
+    {0, 0, 0},                  /* f32.load */
+    {0, 0, 0},                  /* f64.load */
+    {0, 0, 0x0fbe},             /* i32.load8_s */
+    {0, 0, 0x0fb6},             /* i32.load8_u */
+    {0, 0, 0x0fbf},             /* i32.load16_s */
+    {0, 0, 0x0fb7},             /* i32.load16_u */
+    {1, 0, 0x0fbe},             /* i64.load8_s */
+    {0, 0, 0x0fb6},             /* i64.load8_u */
+    {1, 0, 0x0fbf},             /* i64.load16_s */
+    {0, 0, 0x0fb7},             /* i64.load16_u */
+    {1, 0, 0x63},               /* i64.load32_s */
+    {0, 0, 0x8b},               /* i64.load32_u */
+    {0, 0, 0x89},               /* i32.store */
+    {1, 0, 0x89},               /* i64.store */
+    {0, 0, 0},                  /* f32.store */
+    {0, 0, 0},                  /* f64.store */
+    {0, 0, 0x88},               /* i32.store8 */
+    {0, 0x66, 0x89},            /* i32.store16 */
+    {0, 0, 0x88},               /* i64.store8 */
+    {0, 0x66, 0x89},            /* i64.store16 */
+    {0, 0, 0x89},               /* i64.store32 */
+};
+
+
+static const char  *Eunsupported = "opcode 0x%x not supported";
+static const char  *Enomemory = "module has no linear memory";
+
+
+Error *
+jitmodule(Jit *jit, Module *m, JitMode mode)
+{
+    u32       i;
+    u64       nbytes;
+    Error     *err;
+    Compiler  *c;
+    CodeDecl  *code;
+
+    memset(jit, 0, sizeof(Jit));
+
+    jit->module = acquiremodule(m);
+    jit->mode = mode;
+    jit->epoch = &globalepoch;
+    jit->deadline = 0xffffffffffffffff;
+    jit->nimports = m->nimportfuncs;
+    jit->nfuncs = m->nimportfuncs + len(m->codes);
+
+    if (m->memories != NULL && len(m->memories) > 0) {
+        err = memorysignals();
+        if (slow(err != NULL)) {
+            goto fail;
+        }
+    }
+
+    c = zmalloc(sizeof(Compiler));
+    if (slow(c == NULL)) {
+        err = newerror("failed to allocate compiler: %s", strerror(errno));
+        goto fail;
+    }
+
+    jit->compiler = c;
+
+    c->jit = jit;
+    c->m = m;
+    c->ctrls = newarray(16, sizeof(Ctrl));
+    jit->table = zmalloc(sizeof(void *) * (jit->nfuncs + 1));
+    jit->hosts = zmalloc(sizeof(HostCall) * (jit->nimports + 1));
+
+    if (slow(c->ctrls == NULL || jit->table == NULL || jit->hosts == NULL)) {
+        err = newerror("failed to allocate compiler: %s", strerror(errno));
+        goto fail;
+    }
+
+    if (mode & JitMetered) {
+        c->blocks = newarray(64, sizeof(BasicBlock));
+        if (slow(c->blocks == NULL)) {
+            err = newerror("failed to allocate compiler: %s", strerror(errno));
+            goto fail;
+        }
+    }
+
+    /*
+     * The code region is reserved up front and committed as functions get
+     * installed, so lazily prepared functions are appended in place.
+     */
+    nbytes = 0;
+
+    for (i = 0; i < len(m->codes); i++) {
+        code = arrayget(m->codes, i);
+        nbytes += (code->end - code->start) + 1;
+    }
+
+    jit->size = JIT_CODE_MIN + JIT_CODE_RATIO * nbytes;
+
+    jit->code = mmap(NULL, jit->size, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (slow(jit->code == MAP_FAILED)) {
+        jit->code = NULL;
+        err = newerror("failed to reserve code region: %s", strerror(errno));
+        goto fail;
+    }
+
+    err = emitlazystub(c);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    for (i = jit->nimports; i < jit->nfuncs; i++) {
+        jit->table[i] = jit->lazystub;
+    }
+
+    if (mode & JitLazy) {
+        return NULL;
+    }
+
+    for (i = jit->nimports; i < jit->nfuncs; i++) {
+        err = prepare(jit, i);
+        if (slow(err != NULL)) {
+            goto fail;
+        }
+    }
+
+    return NULL;
+
+fail:
+
+    jitclose(jit);
+    return err;
+}
+
+
+Error *
+jitcall(Jit *jit, u32 index, u64 *args, u64 *ret)
+{
+    u64          val;
+    void         *prev;
+    Error        *err;
+    jmp_buf      env;
+    MemoryGuard  guard;
+    u64          (*fn)(Jit *, u64 *);
+
+    if (slow(index < jit->nimports)) {
+        return newerror("function %d is an import", index);
+    }
+
+    if (slow(index >= jit->nfuncs)) {
+        return newerror("function %d not found", index);
+    }
+
+    if (slow(jit->nbound < jit->nimports)) {
+        return newerror("%d of %d imported functions not bound",
+                        jit->nimports - jit->nbound, jit->nimports);
+    }
+
+    if (slow(jit->memory == NULL && jit->module->memories != NULL
+             && len(jit->module->memories) > 0))
+    {
+        return newerror(Enomemory);
+    }
+
+    if (jit->table[index] == jit->lazystub) {
+        err = prepare(jit, index);
+        if (slow(err != NULL)) {
+            return err;
+        }
+    }
+
+    memcpy(&fn, &jit->table[index], sizeof(fn));
+
+    prev = jit->env;
+
+    if (prev == NULL) {
+        jit->stacklimit = jitstacklimit();
+    }
+
+    jit->trap = TrapNone;
+    jit->env = &env;
+
+    if (jit->memory != NULL) {
+        jit->membase = jit->memory->base;
+
+        guard.mem = jit->memory;
+        guard.trap = jitmemtrap;
+        guard.data = jit;
+        guardmemory(&guard);
+    }
+
+    if (setjmp(env) != 0) {
+        jit->env = prev;
+
+        if (jit->memory != NULL) {
+            unguardmemory(&guard);
+        }
+
+        if (jit->trap == TrapFuel) {
+            jit->fuel = 0;
+        }
+
+        if (jit->trap == TrapPrepare) {
+            err = jit->err;
+            jit->err = NULL;
+            return error(err, "trap: %s", trapstr(jit->trap));
+        }
+
+        return newerror("trap: %s", trapstr(jit->trap));
+    }
+
+    val = fn(jit, args);
+
+    jit->env = prev;
+
+    if (jit->memory != NULL) {
+        unguardmemory(&guard);
+    }
+
+    if (ret != NULL) {
+        *ret = val;
+    }
+
+    return NULL;
+}
+
+
+void
+jitclose(Jit *jit)
+{
+    Compiler  *c;
+
+    c = jit->compiler;
+
+    if (c != NULL) {
+        memfree(c->code);
+
+        if (c->ctrls != NULL) {
+            freearray(c->ctrls);
+        }
+
+        if (c->blocks != NULL) {
+            freearray(c->blocks);
+        }
+
+        memfree(c);
+        jit->compiler = NULL;
+    }
+
+    if (jit->code != NULL) {
+        munmap(jit->code, jit->size);
+        jit->code = NULL;
+    }
+
+    memfree(jit->table);
+    memfree(jit->hosts);
+    jit->table = NULL;
+    jit->hosts = NULL;
+
+    if (jit->module != NULL) {
+        closemodule(jit->module);
+        jit->module = NULL;
+    }
+}
+
+
+/*
+ * Decodes, checks and compiles function `index`, then installs its code and
+ * patches its table entry.
+ */
+static Error *
+prepare(Jit *jit, u32 index)
+{
+    u8        *fn;
+    Error     *err;
+    Compiler  *c;
+    CodeDecl  *code;
+
+    c = jit->compiler;
+
+    code = arrayget(c->m->codes, index - jit->nimports);
+    if (slow(code == NULL)) {
+        return newerror("function %d has no code", index);
+    }
+
+    c->len = 0;
+
+    err = compilefunc(c, index, code);
+    if (slow(err != NULL)) {
+        return error(err, "compiling function %d", index);
+    }
+
+    err = install(c, &fn);
+    if (slow(err != NULL)) {
+        return error(err, "installing function %d", index);
+    }
+
+    jit->table[index] = fn;
+    jit->nprepared++;
+
+    return NULL;
+}
+
+
+/*
+ * Called by the lazy stub on the first call of a function.  It returns the
+ * native entry point, or traps if the function can't be prepared.
+ */
+static void *
+jitlazy(Jit *jit, u32 index)
+{
+    Error  *err;
+
+    err = prepare(jit, index);
+    if (slow(err != NULL)) {
+        jit->err = err;
+        jittrap(jit, TrapPrepare);
+    }
+
+    return jit->table[index];
+}
+
+
+/*
+ * Copies the code buffer into the code region.  Pages are only writable
+ * while being copied.
+ */
+static Error *
+install(Compiler *c, u8 **fn)
+{
+    u8      *start, *end, *p;
+    Jit     *jit;
+    size_t  pagesize;
+
+    jit = c->jit;
+
+    if (slow(c->code == NULL)) {
+        return newerror("failed to grow code buffer");
+    }
+
+    p = jit->code + ((jit->used + 15) & ~15);
+
+    if (slow(p + c->len > jit->code + jit->size)) {
+        return newerror("code region exhausted");
+    }
+
+    pagesize = getpagesize();
+    start = (u8 *) ((ptr) p & ~(pagesize - 1));
+    end = (u8 *) (((ptr) p + c->len + pagesize - 1) & ~(pagesize - 1));
+
+    if (slow(mprotect(start, end - start, PROT_READ | PROT_WRITE) != 0)) {
+        return newerror("failed to mprotect code: %s", strerror(errno));
+    }
+
+    memcpy(p, c->code, c->len);
+
+    if (slow(mprotect(start, end - start, PROT_READ | PROT_EXEC) != 0)) {
+        return newerror("failed to mprotect code: %s", strerror(errno));
+    }
+
+    jit->used = (p + c->len) - jit->code;
+    *fn = p;
+
+    return NULL;
+}
+
+
+static void
+jittrap(Jit *jit, Trap trap)
+{
+    jit->trap = trap;
+    longjmp(*(jmp_buf *) jit->env, 1);
+}
+
+
+/*
+ * Called from the SIGSEGV handler for faults inside the guarded memory.
+ */
+static void
+jitmemtrap(void *data)
+{
+    jittrap(data, TrapOutOfBounds);
+}
+
+
+static u64
+jitgrow(Jit *jit, u64 delta)
+{
+    return growmemory(jit->memory, (u32) delta);
+}
+
+
+static Error *
+compilefunc(Compiler *c, u32 index, CodeDecl *code)
+{
+    u8          op;
+    u32         i, at;
+    Type        *t;
+    Error       *err;
+    TypeDecl    *type;
+    LocalEntry  *local;
+
+    type = functype(c->m, index);
+    if (slow(type == NULL)) {
+        return newerror("function type not found");
+    }
+
+    if (slow(len(type->rets) > 1)) {
+        return newerror("multiple return values not supported");
+    }
+
+    for (i = 0; i < len(type->params); i++) {
+        t = arrayget(type->params, i);
+        if (slow(*t != I32 && *t != I64)) {
+            return newerror("param of type 0x%x not supported", *t);
+        }
+    }
+
+    for (i = 0; i < len(code->locals); i++) {
+        local = arrayget(code->locals, i);
+        if (slow(local->type != I32 && local->type != I64)) {
+            return newerror("local of type 0x%x not supported", local->type);
+        }
+    }
+
+    if (slow(code->nlocals > (1 << 24))) {
+        return newerror("too many locals");
+    }
+
+    /* with both capped, the frame size of prologue() fits in 32 bits */
+
+    if (slow(code->maxstack > (1 << 24))) {
+        return newerror("operand stack too deep");
+    }
+
+    c->nlocals = code->nlocals;
+
+    c->p = code->start;
+    c->end = code->end + 1;     /* includes the final 0x0b */
+    c->depth = 0;
+    c->maxdepth = 0;
+    c->ctrls->len = 0;
+
+    for (i = 0; i < nitems(c->traps); i++) {
+        c->traps[i] = NOFIX;
+    }
+
+    if (c->blocks != NULL) {
+        c->blocks->len = 0;
+        c->nextblock = 0;
+
+        err = basicblocks(code, c->blocks);
+        if (slow(err != NULL)) {
+            return err;
+        }
+    }
+
+    prologue(c, type, code);
+
+    if (c->jit->mode & JitEpoch) {
+        epochcheck(c);
+    }
+
+    err = pushctrl(c, CtrlBlock, 0);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    ((Ctrl *) arraylast(c->ctrls))->arity = len(type->rets);
+
+    while (len(c->ctrls) > 0) {
+        if (slow(c->p >= c->end)) {
+            return newerror("unexpected end of function body");
+        }
+
+        at = c->p - code->start;
+        op = *c->p++;
+
+        if (c->blocks != NULL && !istarget(op)) {
+            meter(c, at);
+        }
+
+        err = compileop(c, op);
+        if (slow(err != NULL)) {
+            return error(err, "at offset %d", at);
+        }
+
+        if (c->blocks != NULL && istarget(op)) {
+            meter(c, at);
+        }
+
+        if (c->depth > c->maxdepth) {
+            c->maxdepth = c->depth;
+        }
+    }
+
+    if (slow(c->p != c->end)) {
+        return newerror("surplus bytes after function end");
+    }
+
+    if (slow(c->maxdepth > code->maxstack)) {
+        return newerror("operand stack deeper than validated");
+    }
+
+    emittraps(c);
+
+    if (slow(c->code == NULL)) {
+        return newerror("failed to grow code buffer");
+    }
+
+    return NULL;
+}
+
+
+static Error *
+compileop(Compiler *c, u8 op)
+{
+    u8       arity;
+    u32      idx;
+    i32      i32val;
+    i64      i64val;
+    Ctrl     *ctrl;
+    Error    *err;
+    Operand  dst, src;
+
+    ctrl = arraylast(c->ctrls);
+
+    if (ctrl->dead || ctrl->unreachable) {
+        switch (op) {
+        case OpBlock:
+        case OpLoop:
+        case OpIf:
+            if (slow(blocktype(c, &arity) != NULL)) {
+                return newerror("malformed block type");
+            }
+
+            return pushctrl(c, op == OpLoop ? CtrlLoop : CtrlBlock, 1);
+
+        case OpElse:
+        case OpEnd:
+            if (ctrl->dead) {
+                if (op == OpEnd) {
+                    c->ctrls->len--;
+                }
+
+                return NULL;
+            }
+
+            break;
+
+        default:
+            return skipop(c, op);
+        }
+    }
+
+    switch (op) {
+    case OpUnreachable:
+        emitjump(c, CcAlways, &c->traps[TrapUnreachable]);
+        ctrl->unreachable = 1;
+        c->depth = ctrl->height;
+        break;
+
+    case OpNop:
+        break;
+
+    case OpBlock:
+    case OpLoop:
+        err = blocktype(c, &arity);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        err = pushctrl(c, op == OpBlock ? CtrlBlock : CtrlLoop, 0);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        ctrl = arraylast(c->ctrls);
+        ctrl->arity = arity;
+
+        /* at the loop header, so every back-edge checks */
+        if (op == OpLoop && (c->jit->mode & JitEpoch)) {
+            epochcheck(c);
+        }
+
+        break;
+
+    case OpIf:
+        err = blocktype(c, &arity);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        if (slow(c->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        c->depth--;
+        src = slot(c, c->depth);
+        emitmov(c, &(Operand) {.reg = RCX}, &src);
+        emitrm(c, 0, 0x85, RCX, &(Operand) {.reg = RCX});
+
+        err = pushctrl(c, CtrlIf, 0);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        ctrl = arraylast(c->ctrls);
+        ctrl->arity = arity;
+        emitjump(c, CcE, &ctrl->elsefix);
+        break;
+
+    case OpElse:
+        if (slow(ctrl->kind != CtrlIf)) {
+            return newerror("else without if");
+        }
+
+        if (!ctrl->unreachable && ctrl->arity > 0
+            && c->depth - 1 != ctrl->height)
+        {
+            dst = slot(c, ctrl->height);
+            src = slot(c, c->depth - 1);
+            emitmov(c, &dst, &src);
+        }
+
+        emitjump(c, CcAlways, &ctrl->fixups);
+        resolve(c, ctrl->elsefix, c->len);
+
+        ctrl->elsefix = NOFIX;
+        ctrl->kind = CtrlElse;
+        ctrl->unreachable = 0;
+        c->depth = ctrl->height;
+        break;
+
+    case OpEnd:
+        return endctrl(c);
+
+    case OpBr:
+    case OpBrIf:
+        if (slow(u32vdecode((u8 **) &c->p, c->end, &idx) != OK)) {
+            return newerror("malformed branch depth");
+        }
+
+        err = branch(c, idx, op == OpBr ? CcAlways : CcNE);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        break;
+
+    case OpBrTable:
+        return brtable(c);
+
+    case OpReturn:
+        return branch(c, len(c->ctrls) - 1, CcAlways);
+
+    case OpCall:
+        if (slow(u32vdecode((u8 **) &c->p, c->end, &idx) != OK)) {
+            return newerror("malformed call index");
+        }
+
+        return callfunc(c, idx);
+
+    case OpDrop:
+        if (slow(c->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        c->depth--;
+        break;
+
+    case OpSelect:
+        if (slow(c->depth < ctrl->height + 3)) {
+            return newerror("stack underflow");
+        }
+
+        selectop(c);
+        break;
+
+    case OpGetLocal:
+    case OpSetLocal:
+    case OpTeeLocal:
+        if (slow(u32vdecode((u8 **) &c->p, c->end, &idx) != OK
+                 || idx >= c->nlocals))
+        {
+            return newerror("invalid local index");
+        }
+
+        dst = local(idx);
+
+        if (op == OpGetLocal) {
+            src = slot(c, c->depth);
+            emitmov(c, &src, &dst);     /* local to the new slot */
+            c->depth++;
+            break;
+        }
+
+        if (slow(c->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        src = slot(c, c->depth - 1);
+        emitmov(c, &dst, &src);
+
+        if (op == OpSetLocal) {
+            c->depth--;
+        }
+
+        break;
+
+    case Opi32const:
+        if (slow(s32vdecode((u8 **) &c->p, c->end, &i32val) != OK)) {
+            return newerror("malformed i32.const");
+        }
+
+        constop(c, (u32) i32val, 0);
+        break;
+
+    case Opi64const:
+        if (slow(s64vdecode((u8 **) &c->p, c->end, &i64val) != OK)) {
+            return newerror("malformed i64.const");
+        }
+
+        constop(c, (u64) i64val, 1);
+        break;
+
+    case Opi32eqz:
+    case Opi64eqz:
+        if (slow(c->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        eqzop(c, op == Opi64eqz);
+        break;
+
+    case Opi32wrapi64:
+    case Opi64extendsi32:
+    case Opi64extendui32:
+        if (slow(c->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        convop(c, op);
+        break;
+
+    case OpCurrentMemory:
+    case OpGrowMemory:
+        if (slow(c->m->memories == NULL || len(c->m->memories) == 0)) {
+            return newerror(Enomemory);
+        }
+
+        if (slow(c->p >= c->end || *c->p++ != 0)) {
+            return newerror("malformed memory reserved byte");
+        }
+
+        if (op == OpCurrentMemory) {
+            sizeop(c);
+            break;
+        }
+
+        if (slow(c->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        growop(c);
+        break;
+
+    default:
+        if (op >= OpLoadi32 && op <= OpStorei64x32) {
+            if (slow(c->depth < ctrl->height + (op >= OpStorei32 ? 2 : 1))) {
+                return newerror("stack underflow");
+            }
+
+            return (op >= OpStorei32) ? storeop(c, op) : loadop(c, op);
+        }
+
+        if ((op >= Opi32eq && op <= Opi32geu)
+            || (op >= Opi64eq && op <= Opi64geu)
+            || (op >= Opi32add && op <= Opi32rotr)
+            || (op >= Opi64add && op <= Opi64rotr))
+        {
+            if (slow(c->depth < ctrl->height + 2)) {
+                return newerror("stack underflow");
+            }
+
+            break;
+        }
+
+        return newerror(Eunsupported, op);
+    }
+
+    switch (op) {
+    case Opi32eq: cmpop(c, 0, CcE); break;
+    case Opi32ne: cmpop(c, 0, CcNE); break;
+    case Opi32lts: cmpop(c, 0, CcL); break;
+    case Opi32ltu: cmpop(c, 0, CcB); break;
+    case Opi32gts: cmpop(c, 0, CcG); break;
+    case Opi32gtu: cmpop(c, 0, CcA); break;
+    case Opi32les: cmpop(c, 0, CcLE); break;
+    case Opi32leu: cmpop(c, 0, CcBE); break;
+    case Opi32ges: cmpop(c, 0, CcGE); break;
+    case Opi32geu: cmpop(c, 0, CcAE); break;
+
+    case Opi64eq: cmpop(c, 1, CcE); break;
+    case Opi64ne: cmpop(c, 1, CcNE); break;
+    case Opi64lts: cmpop(c, 1, CcL); break;
+    case Opi64ltu: cmpop(c, 1, CcB); break;
+    case Opi64gts: cmpop(c, 1, CcG); break;
+    case Opi64gtu: cmpop(c, 1, CcA); break;
+    case Opi64les: cmpop(c, 1, CcLE); break;
+    case Opi64leu: cmpop(c, 1, CcBE); break;
+    case Opi64ges: cmpop(c, 1, CcGE); break;
+    case Opi64geu: cmpop(c, 1, CcAE); break;
+
+    case Opi32add: binop(c, 0, 0x03); break;
+    case Opi32sub: binop(c, 0, 0x2b); break;
+    case Opi32mul: binop(c, 0, 0x0faf); break;
+    case Opi32divs: divop(c, 0, 1, 0); break;
+    case Opi32divu: divop(c, 0, 0, 0); break;
+    case Opi32rems: divop(c, 0, 1, 1); break;
+    case Opi32remu: divop(c, 0, 0, 1); break;
+    case Opi32and: binop(c, 0, 0x23); break;
+    case Opi32or: binop(c, 0, 0x0b); break;
+    case Opi32xor: binop(c, 0, 0x33); break;
+    case Opi32shl: shiftop(c, 0, 4); break;
+    case Opi32shrs: shiftop(c, 0, 7); break;
+    case Opi32shru: shiftop(c, 0, 5); break;
+    case Opi32rotl: shiftop(c, 0, 0); break;
+    case Opi32rotr: shiftop(c, 0, 1); break;
+
+    case Opi64add: binop(c, 1, 0x03); break;
+    case Opi64sub: binop(c, 1, 0x2b); break;
+    case Opi64mul: binop(c, 1, 0x0faf); break;
+    case Opi64divs: divop(c, 1, 1, 0); break;
+    case Opi64divu: divop(c, 1, 0, 0); break;
+    case Opi64rems: divop(c, 1, 1, 1); break;
+    case Opi64remu: divop(c, 1, 0, 1); break;
+    case Opi64and: binop(c, 1, 0x23); break;
+    case Opi64or: binop(c, 1, 0x0b); break;
+    case Opi64xor: binop(c, 1, 0x33); break;
+    case Opi64shl: shiftop(c, 1, 4); break;
+    case Opi64shrs: shiftop(c, 1, 7); break;
+    case Opi64shru: shiftop(c, 1, 5); break;
+    case Opi64rotl: shiftop(c, 1, 0); break;
+    case Opi64rotr: shiftop(c, 1, 1); break;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Charges a whole basic block on entry, if the instruction at `at` starts
+ * one.  Blocks starting at a branch target are charged after compiling it,
+ * as that binds its label, so every way into the block pays:
+ *
+ *     sub qword [r15 + fuel], cost; jb trap
+ */
+static void
+meter(Compiler *c, u32 at)
+{
+    Ctrl        *ctrl;
+    Operand     dst;
+    BasicBlock  *block;
+
+    if (c->nextblock >= len(c->blocks)) {
+        return;
+    }
+
+    block = arrayget(c->blocks, c->nextblock);
+    if (block->start != at) {
+        return;
+    }
+
+    c->nextblock++;
+
+    if (len(c->ctrls) == 0) {
+        return;                 /* after the final end */
+    }
+
+    ctrl = arraylast(c->ctrls);
+    if (ctrl->dead || ctrl->unreachable) {
+        return;
+    }
+
+    dst = mem(R15, offsetof(Jit, fuel));
+
+    if (block->cost < 128) {
+        emitrm(c, 1, 0x83, 5, &dst);
+        emit(c, block->cost);
+
+    } else {
+        emitrm(c, 1, 0x81, 5, &dst);
+        emit32(c, block->cost);
+    }
+
+    emitjump(c, CcB, &c->traps[TrapFuel]);
+}
+
+
+/*
+ *     mov rax, [r15 + epoch]; mov rax, [rax]
+ *     cmp rax, [r15 + deadline]; jae trap
+ */
+static void
+epochcheck(Compiler *c)
+{
+    Operand  src;
+
+    src = mem(R15, offsetof(Jit, epoch));
+    emitrm(c, 1, 0x8b, RAX, &src);
+
+    src = mem(RAX, 0);
+    emitrm(c, 1, 0x8b, RAX, &src);
+
+    src = mem(R15, offsetof(Jit, deadline));
+    emitrm(c, 1, 0x3b, RAX, &src);
+
+    emitjump(c, CcAE, &c->traps[TrapEpoch]);
+}
+
+
+/*
+ * Skips the immediates of an instruction in dead code.
+ */
+static Error *
+skipop(Compiler *c, u8 op)
+{
+    return skipimm((u8 **) &c->p, c->end, op);
+}
+
+
+static Error *
+blocktype(Compiler *c, u8 *arity)
+{
+    u8  t;
+
+    *arity = 0;
+
+    if (slow(c->p >= c->end)) {
+        return newerror("malformed block type");
+    }
+
+    t = *c->p++;
+
+    switch (t) {
+    case 0x40:
+        *arity = 0;
+        return NULL;
+
+    case 0x7f:
+    case 0x7e:
+        *arity = 1;
+        return NULL;
+    }
+
+    return newerror("block type 0x%x not supported", t);
+}
+
+
+static Error *
+pushctrl(Compiler *c, CtrlKind kind, u8 dead)
+{
+    Ctrl  ctrl;
+
+    memset(&ctrl, 0, sizeof(Ctrl));
+
+    ctrl.kind = kind;
+    ctrl.dead = dead;
+    ctrl.height = c->depth;
+    ctrl.label = c->len;
+    ctrl.fixups = NOFIX;
+    ctrl.elsefix = NOFIX;
+
+    if (slow(arrayadd(c->ctrls, &ctrl) != OK)) {
+        return newerror("failed to push control frame: %s", strerror(errno));
+    }
+
+    return NULL;
+}
+
+
+static Error *
+endctrl(Compiler *c)
+{
+    Ctrl     *ctrl;
+    Operand  dst, src;
+
+    ctrl = arraylast(c->ctrls);
+
+    if (!ctrl->unreachable && ctrl->arity > 0) {
+        if (slow(c->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        if (c->depth - 1 != ctrl->height) {
+            dst = slot(c, ctrl->height);
+            src = slot(c, c->depth - 1);
+            emitmov(c, &dst, &src);
+        }
+    }
+
+    resolve(c, ctrl->elsefix, c->len);
+    resolve(c, ctrl->fixups, c->len);
+
+    c->depth = ctrl->height + ctrl->arity;
+    c->ctrls->len--;
+
+    if (len(c->ctrls) == 0) {
+        if (c->depth > 0) {
+            src = slot(c, 0);
+            emitmov(c, &(Operand) {.reg = RAX}, &src);
+        }
+
+        epilogue(c);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Branch to the control frame `label` levels up.  Conditional branches pop
+ * the condition first and keep the carried value on the stack.
+ */
+static Error *
+branch(Compiler *c, u32 label, Cond cc)
+{
+    u8       arity;
+    u32      skip;
+    Ctrl     *ctrl, *target;
+    Operand  dst, src, cond;
+
+    ctrl = arraylast(c->ctrls);
+
+    if (slow(label >= len(c->ctrls))) {
+        return newerror("invalid branch depth %d", label);
+    }
+
+    target = arrayget(c->ctrls, len(c->ctrls) - 1 - label);
+    arity = (target->kind == CtrlLoop) ? 0 : target->arity;
+
+    if (cc != CcAlways) {
+        if (slow(c->depth < ctrl->height + 1)) {
+            return newerror("stack underflow");
+        }
+
+        c->depth--;
+        cond = slot(c, c->depth);
+        emitmov(c, &(Operand) {.reg = RCX}, &cond);
+        emitrm(c, 0, 0x85, RCX, &(Operand) {.reg = RCX});
+    }
+
+    if (slow(c->depth < ctrl->height + arity)) {
+        return newerror("stack underflow");
+    }
+
+    skip = NOFIX;
+
+    if (arity > 0 && c->depth - 1 != target->height) {
+        if (cc != CcAlways) {
+            emitjump(c, CcE, &skip);
+            cc = CcAlways;
+        }
+
+        dst = slot(c, target->height);
+        src = slot(c, c->depth - 1);
+        emitmov(c, &dst, &src);
+    }
+
+    if (target->kind == CtrlLoop) {
+        emitjumpto(c, cc, target->label);
+
+    } else {
+        emitjump(c, cc, &target->fixups);
+    }
+
+    resolve(c, skip, c->len);
+
+    if (cc == CcAlways && skip == NOFIX) {
+        ctrl->unreachable = 1;
+        c->depth = ctrl->height;
+    }
+
+    return NULL;
+}
+
+
+static Error *
+brtable(Compiler *c)
+{
+    u32      i, n, label, next, depth;
+    Ctrl     *ctrl;
+    Error    *err;
+    Operand  idx;
+
+    ctrl = arraylast(c->ctrls);
+
+    if (slow(u32vdecode((u8 **) &c->p, c->end, &n) != OK)) {
+        return newerror("malformed br_table");
+    }
+
+    if (slow(c->depth < ctrl->height + 1)) {
+        return newerror("stack underflow");
+    }
+
+    c->depth--;
+    depth = c->depth;
+    idx = slot(c, c->depth);
+
+    /* rdx is not touched by the value moves done in branch() */
+    emitmov(c, &(Operand) {.reg = RDX}, &idx);
+
+    for (i = 0; i < n; i++) {
+        if (slow(u32vdecode((u8 **) &c->p, c->end, &label) != OK)) {
+            return newerror("malformed br_table");
+        }
+
+        /* cmp edx, i */
+        emitrm(c, 0, 0x81, 7, &(Operand) {.reg = RDX});
+        emit32(c, i);
+
+        next = NOFIX;
+        emitjump(c, CcNE, &next);
+
+        err = branch(c, label, CcAlways);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        ctrl->unreachable = 0;
+        c->depth = depth;
+        resolve(c, next, c->len);
+    }
+
+    if (slow(u32vdecode((u8 **) &c->p, c->end, &label) != OK)) {
+        return newerror("malformed br_table");
+    }
+
+    return branch(c, label, CcAlways);
+}
+
+
+static Error *
+callfunc(Compiler *c, u32 index)
+{
+    u32        d, base, nargs;
+    Ctrl       *ctrl;
+    Operand    r, h;
+    TypeDecl   *type;
+
+    ctrl = arraylast(c->ctrls);
+
+    type = functype(c->m, index);
+    if (slow(type == NULL)) {
+        return newerror("call to unknown function %d", index);
+    }
+
+    if (slow(index < c->jit->nimports
+             && index > INT32_MAX / sizeof(HostCall)))
+    {
+        return newerror("too many imported functions");
+    }
+
+    if (slow(index > INT32_MAX / sizeof(void *))) {
+        return newerror("too many functions");
+    }
+
+    nargs = len(type->params);
+
+    if (slow(c->depth < ctrl->height + nargs)) {
+        return newerror("stack underflow");
+    }
+
+    base = c->depth - nargs;
+
+    /* arguments and live caller-saved registers go to their homes */
+    for (d = 0; d < c->depth && d < NSTACKREGS; d++) {
+        if (d >= base || !calleesaved(stackregs[d])) {
+            r = reg(stackregs[d]);
+            h = home(c, d);
+            emitmov(c, &h, &r);
+        }
+    }
+
+    h = home(c, base);
+    emitrm(c, 1, 0x8d, RSI, &h);                        /* lea rsi, args */
+
+    if (index < c->jit->nimports) {
+        h = mem(R15, offsetof(Jit, hosts));
+        emitrm(c, 1, 0x8b, RDI, &h);                    /* mov rdi, hosts */
+
+        h = mem(RDI, sizeof(HostCall) * index);
+        emitrm(c, 1, 0x8d, RDI, &h);                    /* lea rdi, [rdi+i] */
+
+        h = mem(RDI, offsetof(HostCall, call));
+        emitrm(c, 0, 0xff, 2, &h);                      /* call [rdi] */
+
+    } else {
+        emitrm(c, 1, 0x89, R15, &(Operand) {.reg = RDI});   /* mov rdi, r15 */
+
+        /* the lazy stub finds the callee index in eax */
+        emitimm(c, RAX, index, 0);
+
+        h = mem(R15, offsetof(Jit, table));
+        emitrm(c, 1, 0x8b, RCX, &h);                    /* mov rcx, table */
+
+        h = mem(RCX, 8 * index);
+        emitrm(c, 0, 0xff, 2, &h);                      /* call [rcx + i] */
+    }
+
+    for (d = 0; d < base && d < NSTACKREGS; d++) {
+        if (!calleesaved(stackregs[d])) {
+            r = reg(stackregs[d]);
+            h = home(c, d);
+            emitmov(c, &r, &h);
+        }
+    }
+
+    c->depth = base;
+
+    if (len(type->rets) > 0) {
+        r = slot(c, c->depth);
+        emitmov(c, &r, &(Operand) {.reg = RAX});
+        c->depth++;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Decodes a memory immediate and computes the effective address of the
+ * access whose address operand is in slot `d`.  The address goes to rax and
+ * the access uses [r14 + rax + offset]: the guard region covers any u32
+ * address plus u32 offset, so nothing is checked here.
+ */
+static Error *
+memarg(Compiler *c, u32 d, Operand *addr)
+{
+    u32      align, offset;
+    Operand  a;
+
+    if (slow(c->m->memories == NULL || len(c->m->memories) == 0)) {
+        return newerror(Enomemory);
+    }
+
+    if (slow(u32vdecode((u8 **) &c->p, c->end, &align) != OK
+             || u32vdecode((u8 **) &c->p, c->end, &offset) != OK))
+    {
+        return newerror("malformed memory immediate");
+    }
+
+    a = slot(c, d);
+    emitrm(c, 0, 0x8b, RAX, &a);                        /* mov eax, addr */
+
+    *addr = mem(R14, 0);
+    addr->indexed = 1;
+    addr->index = RAX;
+
+    if (offset <= INT32_MAX) {
+        addr->disp = offset;
+        return NULL;
+    }
+
+    emitimm(c, RCX, offset, 0);
+    emitrm(c, 1, 0x03, RAX, &(Operand) {.reg = RCX});   /* add rax, rcx */
+
+    return NULL;
+}
+
+
+static Error *
+loadop(Compiler *c, u8 op)
+{
+    Error        *err;
+    Operand      addr, dst;
+    const MemOp  *mop;
+
+    mop = &memops[op - OpLoadi32];
+    if (slow(mop->opcode == 0)) {
+        return newerror(Eunsupported, op);
+    }
+
+    err = memarg(c, c->depth - 1, &addr);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    dst = slot(c, c->depth - 1);
+
+    if (!dst.mem) {
+        emitrm(c, mop->w, mop->opcode, dst.reg, &addr);
+        return NULL;
+    }
+
+    emitrm(c, mop->w, mop->opcode, RAX, &addr);
+    emitmov(c, &dst, &(Operand) {.reg = RAX});
+
+    return NULL;
+}
+
+
+/*
+ * The value goes through rdx when it's not in a register or for byte
+ * stores, as sil and dil need a REX prefix emitrm() may leave out.
+ */
+static Error *
+storeop(Compiler *c, u8 op)
+{
+    Reg          r;
+    Error        *err;
+    Operand      addr, val;
+    const MemOp  *mop;
+
+    mop = &memops[op - OpLoadi32];
+    if (slow(mop->opcode == 0)) {
+        return newerror(Eunsupported, op);
+    }
+
+    err = memarg(c, c->depth - 2, &addr);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    val = slot(c, c->depth - 1);
+    r = val.reg;
+
+    if (val.mem || mop->opcode == 0x88) {
+        emitmov(c, &(Operand) {.reg = RDX}, &val);
+        r = RDX;
+    }
+
+    if (mop->prefix != 0) {
+        emit(c, mop->prefix);
+    }
+
+    emitrm(c, mop->w, mop->opcode, r, &addr);
+
+    c->depth -= 2;
+
+    return NULL;
+}
+
+
+static void
+sizeop(Compiler *c)
+{
+    Operand  src, dst;
+
+    src = mem(R15, offsetof(Jit, memory));
+    emitrm(c, 1, 0x8b, RAX, &src);                      /* mov rax, memory */
+
+    src = mem(RAX, offsetof(LinearMemory, pages));
+    dst = slot(c, c->depth);
+
+    if (dst.mem) {
+        emitrm(c, 0, 0x8b, RAX, &src);
+        emitmov(c, &dst, &(Operand) {.reg = RAX});
+
+    } else {
+        emitrm(c, 0, 0x8b, dst.reg, &src);
+    }
+
+    c->depth++;
+}
+
+
+/*
+ * grow_memory calls into C.  Live caller-saved registers are preserved in
+ * their homes as around calls; the memory base doesn't move.
+ */
+static void
+growop(Compiler *c)
+{
+    u32      d, n;
+    Operand  r, h;
+
+    n = c->depth - 1;
+
+    for (d = 0; d < n && d < NSTACKREGS; d++) {
+        if (!calleesaved(stackregs[d])) {
+            r = reg(stackregs[d]);
+            h = home(c, d);
+            emitmov(c, &h, &r);
+        }
+    }
+
+    r = slot(c, n);
+    emitmov(c, &(Operand) {.reg = RSI}, &r);
+    emitrm(c, 1, 0x89, R15, &(Operand) {.reg = RDI});   /* mov rdi, r15 */
+    emitimm(c, RAX, (u64) (ptr) jitgrow, 1);
+    emitrm(c, 0, 0xff, 2, &(Operand) {.reg = RAX});     /* call rax */
+
+    for (d = 0; d < n && d < NSTACKREGS; d++) {
+        if (!calleesaved(stackregs[d])) {
+            r = reg(stackregs[d]);
+            h = home(c, d);
+            emitmov(c, &r, &h);
+        }
+    }
+
+    r = slot(c, n);
+    emitmov(c, &r, &(Operand) {.reg = RAX});
+}
+
+
+/*
+ * Loads the left operand into a register: its own if it has one, rax
+ * otherwise.  storeleft() writes rax back when needed.
+ */
+static Reg
+loadleft(Compiler *c, const Operand *a)
+{
+    if (!a->mem) {
+        return a->reg;
+    }
+
+    emitmov(c, &(Operand) {.reg = RAX}, a);
+    return RAX;
+}
+
+
+static void
+storeleft(Compiler *c, const Operand *a)
+{
+    if (a->mem) {
+        emitmov(c, a, &(Operand) {.reg = RAX});
+    }
+}
+
+
+static void
+binop(Compiler *c, u8 w, u32 opcode)
+{
+    Reg      r;
+    Operand  a, b;
+
+    a = slot(c, c->depth - 2);
+    b = slot(c, c->depth - 1);
+    c->depth--;
+
+    r = loadleft(c, &a);
+    emitrm(c, w, opcode, r, &b);
+    storeleft(c, &a);
+}
+
+
+static void
+shiftop(Compiler *c, u8 w, u8 ext)
+{
+    Reg      r;
+    Operand  a, b;
+
+    a = slot(c, c->depth - 2);
+    b = slot(c, c->depth - 1);
+    c->depth--;
+
+    emitmov(c, &(Operand) {.reg = RCX}, &b);
+    r = loadleft(c, &a);
+    emitrm(c, w, 0xd3, ext, &(Operand) {.reg = r});
+    storeleft(c, &a);
+}
+
+
+static void
+setcc(Compiler *c, Cond cc, const Operand *dst)
+{
+    emitrm(c, 0, 0x0f90 | cc, 0, &(Operand) {.reg = RAX});  /* setcc al */
+    emitrm(c, 0, 0x0fb6, RAX, &(Operand) {.reg = RAX});     /* movzx */
+    emitmov(c, dst, &(Operand) {.reg = RAX});
+}
+
+
+static void
+cmpop(Compiler *c, u8 w, Cond cc)
+{
+    Reg      r;
+    Operand  a, b;
+
+    a = slot(c, c->depth - 2);
+    b = slot(c, c->depth - 1);
+    c->depth--;
+
+    r = loadleft(c, &a);
+    emitrm(c, w, 0x3b, r, &b);
+    setcc(c, cc, &a);
+}
+
+
+static void
+eqzop(Compiler *c, u8 w)
+{
+    Reg      r;
+    Operand  a;
+
+    a = slot(c, c->depth - 1);
+
+    r = loadleft(c, &a);
+    emitrm(c, w, 0x85, r, &(Operand) {.reg = r});
+    setcc(c, CcE, &a);
+}
+
+
+static void
+divop(Compiler *c, u8 w, u8 sign, u8 rem)
+{
+    u32      done, normal;
+    Operand  a, b;
+
+    a = slot(c, c->depth - 2);
+    b = slot(c, c->depth - 1);
+    c->depth--;
+
+    done = NOFIX;
+
+    emitmov(c, &(Operand) {.reg = RAX}, &a);
+    emitmov(c, &(Operand) {.reg = RCX}, &b);
+
+    emitrm(c, w, 0x85, RCX, &(Operand) {.reg = RCX});
+    emitjump(c, CcE, &c->traps[TrapDivZero]);
+
+    if (sign) {
+        normal = NOFIX;
+
+        /* cmp rcx, -1 */
+        emitrm(c, w, 0x83, 7, &(Operand) {.reg = RCX});
+        emit(c, 0xff);
+        emitjump(c, CcNE, &normal);
+
+        if (rem) {
+            /* x % -1 == 0, and INT_MIN % -1 must not fault */
+            emitrm(c, 0, 0x33, RDX, &(Operand) {.reg = RDX});
+            emitjump(c, CcAlways, &done);
+
+        } else {
+            /* INT_MIN / -1 overflows */
+            emitimm(c, RDX, w ? (u64) INT64_MIN : (u32) INT32_MIN, w);
+            emitrm(c, w, 0x3b, RAX, &(Operand) {.reg = RDX});
+            emitjump(c, CcE, &c->traps[TrapOverflow]);
+        }
+
+        resolve(c, normal, c->len);
+
+        if (w) {
+            emit(c, 0x48);
+        }
+
+        emit(c, 0x99);                                      /* cdq/cqo */
+        emitrm(c, w, 0xf7, 7, &(Operand) {.reg = RCX});     /* idiv */
+
+    } else {
+        emitrm(c, 0, 0x33, RDX, &(Operand) {.reg = RDX});
+        emitrm(c, w, 0xf7, 6, &(Operand) {.reg = RCX});     /* div */
+    }
+
+    resolve(c, done, c->len);
+
+    emitmov(c, &a, &(Operand) {.reg = rem ? RDX : RAX});
+}
+
+
+static void
+selectop(Compiler *c)
+{
+    Reg      r;
+    Operand  a, b, cond;
+
+    a = slot(c, c->depth - 3);
+    b = slot(c, c->depth - 2);
+    cond = slot(c, c->depth - 1);
+    c->depth -= 2;
+
+    emitmov(c, &(Operand) {.reg = RCX}, &cond);
+    emitrm(c, 0, 0x85, RCX, &(Operand) {.reg = RCX});
+
+    r = loadleft(c, &a);
+    emitrm(c, 1, 0x0f44, r, &b);                            /* cmovz */
+    storeleft(c, &a);
+}
+
+
+static void
+convop(Compiler *c, u8 op)
+{
+    Reg      r;
+    Operand  a;
+
+    a = slot(c, c->depth - 1);
+    r = loadleft(c, &a);
+
+    if (op == Opi64extendsi32) {
+        emitrm(c, 1, 0x63, r, &(Operand) {.reg = r});       /* movsxd */
+
+    } else {
+        emitrm(c, 0, 0x8b, r, &(Operand) {.reg = r});       /* zero-extend */
+    }
+
+    storeleft(c, &a);
+}
+
+
+static void
+constop(Compiler *c, u64 v, u8 w)
+{
+    Operand  dst;
+
+    dst = slot(c, c->depth);
+    c->depth++;
+
+    if (!dst.mem) {
+        emitimm(c, dst.reg, v, w);
+        return;
+    }
+
+    emitimm(c, RAX, v, w);
+    emitmov(c, &dst, &(Operand) {.reg = RAX});
+}
+
+
+static void
+prologue(Compiler *c, TypeDecl *type, CodeDecl *code)
+{
+    u32      i, nparams, frame;
+    Operand  src, dst;
+
+    nparams = len(type->params);
+
+    emit(c, 0x55);                                  /* push rbp */
+    emitrm(c, 1, 0x89, RSP, &(Operand) {.reg = RBP});
+
+    emit(c, 0x53);                                  /* push rbx */
+    emit(c, 0x41); emit(c, 0x54);                   /* push r12 */
+    emit(c, 0x41); emit(c, 0x55);                   /* push r13 */
+    emit(c, 0x41); emit(c, 0x56);                   /* push r14 */
+    emit(c, 0x41); emit(c, 0x57);                   /* push r15 */
+
+    emitrm(c, 1, 0x89, RDI, &(Operand) {.reg = R15});
+
+    /* the frame must keep rsp 16-byte aligned after the 6 pushes */
+
+    frame = ((8 * (c->nlocals + code->maxstack) + 8 + 15) & ~15) - 8;
+
+    /* lea rax, [rsp - frame]; cmp rax, [r15 + stacklimit]; jb trap */
+    src = mem(RSP, -(i32) frame);
+    emitrm(c, 1, 0x8d, RAX, &src);
+    src = mem(R15, offsetof(Jit, stacklimit));
+    emitrm(c, 1, 0x3b, RAX, &src);
+    emitjump(c, CcB, &c->traps[TrapCallStack]);
+
+    emitrm(c, 1, 0x81, 5, &(Operand) {.reg = RSP}); /* sub rsp, frame */
+    emit32(c, frame);
+
+    dst = mem(R15, offsetof(Jit, membase));
+    emitrm(c, 1, 0x8b, R14, &dst);                  /* mov r14, membase */
+
+    for (i = 0; i < nparams; i++) {
+        src = mem(RSI, 8 * i);
+        dst = local(i);
+        emitmov(c, &dst, &src);
+    }
+
+    if (c->nlocals == nparams) {
+        return;
+    }
+
+    emitrm(c, 0, 0x33, RAX, &(Operand) {.reg = RAX});   /* xor eax, eax */
+
+    if (c->nlocals - nparams <= 8) {
+        for (i = nparams; i < c->nlocals; i++) {
+            dst = local(i);
+            emitmov(c, &dst, &(Operand) {.reg = RAX});
+        }
+
+        return;
+    }
+
+    dst = local(nparams);
+    emitrm(c, 1, 0x8d, RDI, &dst);                  /* lea rdi, locals */
+    emitimm(c, RCX, c->nlocals - nparams, 0);
+    emit(c, 0xf3); emit(c, 0x48); emit(c, 0xab);    /* rep stosq */
+}
+
+
+static void
+epilogue(Compiler *c)
+{
+    Operand  dst;
+
+    dst = mem(RBP, -40);
+    emitrm(c, 1, 0x8d, RSP, &dst);                  /* lea rsp, [rbp-40] */
+
+    emit(c, 0x41); emit(c, 0x5f);                   /* pop r15 */
+    emit(c, 0x41); emit(c, 0x5e);                   /* pop r14 */
+    emit(c, 0x41); emit(c, 0x5d);                   /* pop r13 */
+    emit(c, 0x41); emit(c, 0x5c);                   /* pop r12 */
+    emit(c, 0x5b);                                  /* pop rbx */
+    emit(c, 0x5d);                                  /* pop rbp */
+    emit(c, 0xc3);                                  /* ret */
+}
+
+
+/*
+ * Every not yet prepared function points to this stub:
+ *
+ *     push rbp; mov rbp, rsp; push rdi; push rsi
+ *     mov esi, eax; mov rax, jitlazy; call rax
+ *     pop rsi; pop rdi; pop rbp; jmp rax
+ */
+static Error *
+emitlazystub(Compiler *c)
+{
+    Error  *err;
+
+    c->len = 0;
+
+    emit(c, 0x55);
+    emitrm(c, 1, 0x89, RSP, &(Operand) {.reg = RBP});
+    emit(c, 0x57);
+    emit(c, 0x56);
+    emitrm(c, 0, 0x89, RAX, &(Operand) {.reg = RSI});
+    emitimm(c, RAX, (u64) (ptr) jitlazy, 1);
+    emitrm(c, 0, 0xff, 2, &(Operand) {.reg = RAX});     /* call rax */
+    emit(c, 0x5e);
+    emit(c, 0x5f);
+    emit(c, 0x5d);
+    emitrm(c, 0, 0xff, 4, &(Operand) {.reg = RAX});     /* jmp rax */
+
+    err = install(c, &c->jit->lazystub);
+    if (slow(err != NULL)) {
+        return error(err, "installing lazy stub");
+    }
+
+    return NULL;
+}
+
+
+static void
+emittraps(Compiler *c)
+{
+    u32  i;
+
+    for (i = 0; i < nitems(c->traps); i++) {
+        if (c->traps[i] == NOFIX) {
+            continue;
+        }
+
+        resolve(c, c->traps[i], c->len);
+
+        /* the call stack trap fires before the frame aligns rsp */
+
+        emitrm(c, 1, 0x83, 4, &(Operand) {.reg = RSP}); /* and rsp, -16 */
+        emit(c, 0xf0);
+
+        emitimm(c, RSI, i, 0);
+        emitrm(c, 1, 0x89, R15, &(Operand) {.reg = RDI});
+        emitimm(c, RAX, (u64) (ptr) jittrap, 1);
+        emitrm(c, 0, 0xff, 2, &(Operand) {.reg = RAX}); /* call rax */
+    }
+}
+
+
+static Operand
+slot(Compiler *c, u32 d)
+{
+    if (d < NSTACKREGS) {
+        return reg(stackregs[d]);
+    }
+
+    return home(c, d);
+}
+
+
+static Operand
+home(Compiler *c, u32 d)
+{
+    return mem(RSP, 8 * (c->nlocals + d));
+}
+
+
+static Operand
+local(u32 i)
+{
+    return mem(RSP, 8 * i);
+}
+
+
+static Operand
+reg(Reg r)
+{
+    Operand  o;
+
+    o.mem = 0;
+    o.reg = r;
+    o.indexed = 0;
+    o.index = 0;
+    o.disp = 0;
+
+    return o;
+}
+
+
+static Operand
+mem(Reg base, i32 disp)
+{
+    Operand  o;
+
+    o.mem = 1;
+    o.reg = base;
+    o.indexed = 0;
+    o.index = 0;
+    o.disp = disp;
+
+    return o;
+}
+
+
+static u8
+calleesaved(Reg r)
+{
+    return r == RBX || r == RBP || r >= R12;
+}
+
+
+static void
+emit(Compiler *c, u8 b)
+{
+    u8   *p;
+    u32  nalloc;
+
+    if (slow(c->len == c->nalloc)) {
+        nalloc = (c->nalloc == 0) ? 4096 : c->nalloc * 2;
+
+        p = memrealloc(c->code, nalloc);
+        if (slow(p == NULL)) {
+            memfree(c->code);
+            c->code = NULL;
+            c->len = 0;
+            c->nalloc = 0;
+            return;
+        }
+
+        c->code = p;
+        c->nalloc = nalloc;
+    }
+
+    c->code[c->len++] = b;
+}
+
+
+static void
+emit32(Compiler *c, u32 v)
+{
+    emit(c, v & 0xff);
+    emit(c, (v >> 8) & 0xff);
+    emit(c, (v >> 16) & 0xff);
+    emit(c, (v >> 24) & 0xff);
+}
+
+
+static void
+emit64(Compiler *c, u64 v)
+{
+    emit32(c, (u32) v);
+    emit32(c, (u32) (v >> 32));
+}
+
+
+/*
+ * Emits REX prefix, opcode (one or two bytes) and ModRM for `r` and the
+ * register, [base + disp] or [base + index + disp] operand `rm`.
+ */
+static void
+emitrm(Compiler *c, u8 w, u32 opcode, u8 r, const Operand *rm)
+{
+    u8  rex, mod;
+
+    rex = 0x40 | (w << 3) | ((r & 8) >> 1) | ((rm->reg & 8) >> 3);
+
+    if (rm->mem && rm->indexed) {
+        rex |= (rm->index & 8) >> 2;
+    }
+
+    if (rex != 0x40) {
+        emit(c, rex);
+    }
+
+    if (opcode > 0xff) {
+        emit(c, opcode >> 8);
+    }
+
+    emit(c, opcode & 0xff);
+
+    if (!rm->mem) {
+        emit(c, 0xc0 | ((r & 7) << 3) | (rm->reg & 7));
+        return;
+    }
+
+    mod = (rm->disp >= -128 && rm->disp <= 127) ? 0x40 : 0x80;
+
+    if (rm->indexed) {
+        emit(c, mod | ((r & 7) << 3) | RSP);        /* SIB follows */
+        emit(c, ((rm->index & 7) << 3) | (rm->reg & 7));
+
+    } else {
+        emit(c, mod | ((r & 7) << 3) | (rm->reg & 7));
+
+        if ((rm->reg & 7) == RSP) {
+            emit(c, 0x24);                          /* SIB: base only */
+        }
+    }
+
+    if (mod == 0x40) {
+        emit(c, (u8) rm->disp);
+
+    } else {
+        emit32(c, (u32) rm->disp);
+    }
+}
+
+
+static void
+emitmov(Compiler *c, const Operand *dst, const Operand *src)
+{
+    if (!dst->mem && !src->mem && dst->reg == src->reg) {
+        return;
+    }
+
+    if (dst->mem && src->mem) {
+        emitrm(c, 1, 0x8b, RAX, src);
+        emitrm(c, 1, 0x89, RAX, dst);
+        return;
+    }
+
+    if (dst->mem) {
+        emitrm(c, 1, 0x89, src->reg, dst);
+        return;
+    }
+
+    emitrm(c, 1, 0x8b, dst->reg, src);
+}
+
+
+static void
+emitimm(Compiler *c, Reg r, u64 v, u8 w)
+{
+    if (!w || v <= 0xffffffff) {
+        /* mov r32, imm32 zero-extends */
+        if (r >= R8) {
+            emit(c, 0x41);
+        }
+
+        emit(c, 0xb8 + (r & 7));
+        emit32(c, (u32) v);
+        return;
+    }
+
+    if ((i64) v >= INT32_MIN && (i64) v <= INT32_MAX) {
+        emitrm(c, 1, 0xc7, 0, &(Operand) {.reg = r});
+        emit32(c, (u32) v);
+        return;
+    }
+
+    emit(c, 0x48 | ((r & 8) >> 3));
+    emit(c, 0xb8 + (r & 7));
+    emit64(c, v);
+}
+
+
+/*
+ * Emits a forward jump and links its rel32 field into `chain`.
+ */
+static u32
+emitjump(Compiler *c, Cond cc, u32 *chain)
+{
+    u32  pos;
+
+    if (cc == CcAlways) {
+        emit(c, 0xe9);
+
+    } else {
+        emit(c, 0x0f);
+        emit(c, 0x80 | cc);
+    }
+
+    pos = c->len;
+    emit32(c, *chain);
+    *chain = pos;
+
+    return pos;
+}
+
+
+static void
+emitjumpto(Compiler *c, Cond cc, u32 target)
+{
+    if (cc == CcAlways) {
+        emit(c, 0xe9);
+
+    } else {
+        emit(c, 0x0f);
+        emit(c, 0x80 | cc);
+    }
+
+    emit32(c, target - (c->len + 4));
+}
+
+
+static void
+resolve(Compiler *c, u32 chain, u32 target)
+{
+    u32  next;
+
+    if (slow(c->code == NULL)) {
+        return;
+    }
+
+    while (chain != NOFIX) {
+        memcpy(&next, c->code + chain, 4);
+        patch32(c, chain, target - (chain + 4));
+        chain = next;
+    }
+}
+
+
+static void
+patch32(Compiler *c, u32 pos, u32 v)
+{
+    if (fast(c->code != NULL)) {
+        memcpy(c->code + pos, &v, 4);
+    }
+}
+
+
+#else
+
+
+Error *
+jitmodule(Jit *jit, Module * unused(m), JitMode unused(mode))
+{
+    memset(jit, 0, sizeof(Jit));
+    return newerror("jit not supported on this platform");
+}
+
+
+Error *
+jitcall(Jit * unused(jit), u32 unused(index), u64 * unused(args),
+    u64 * unused(ret))
+{
+    return newerror("jit not supported on this platform");
+}
+
+
+void
+jitclose(Jit * unused(jit))
+{
+}
+
+
+#endif
+
+
+/*
+ * The lowest stack pointer guest frames may reach from here: JIT_STACK_MAX
+ * below the caller, but never within JIT_STACK_RESERVE of the end of the
+ * thread's stack.  Looking up the stack of the main thread reads
+ * /proc/self/maps, so the end is cached per thread.
+ */
+
+u8 *
+jitstacklimit(void)
+{
+    ptr                    sp, limit;
+    static __thread ptr    end;
+#if defined(__linux__)
+    void                   *addr;
+    size_t                 size;
+    pthread_attr_t         attr;
+
+    if (end == 0 && pthread_getattr_np(pthread_self(), &attr) == 0) {
+        if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+            end = (ptr) addr + JIT_STACK_RESERVE;
+        }
+
+        pthread_attr_destroy(&attr);
+    }
+#endif
+
+    sp = (ptr) __builtin_frame_address(0);
+    limit = (sp > JIT_STACK_MAX) ? sp - JIT_STACK_MAX : 0;
+
+    if (limit < end) {
+        limit = end;
+    }
+
+    return (u8 *) limit;
+}
+
+
+const char *
+trapstr(Trap trap)
+{
+    switch (trap) {
+    case TrapNone:
+        return "none";
+
+    case TrapUnreachable:
+        return "unreachable executed";
+
+    case TrapDivZero:
+        return "integer divide by zero";
+
+    case TrapOverflow:
+        return "integer overflow";
+
+    case TrapCallStack:
+        return "call stack exhausted";
+
+    case TrapOutOfBounds:
+        return "out of bounds memory access";
+
+    case TrapFuel:
+        return "all fuel consumed";
+
+    case TrapEpoch:
+        return "epoch deadline reached";
+
+    case TrapPrepare:
+        return "function preparation failed";
+    }
+
+    return "(unknown)";
+}
@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/jit.h>
+#include "test.h"
+
+
+typedef struct {
+    const char  *func;
+    u64         args[4];
+    u64         want;
+    const char  *err;
+} Testcase;
+
+
+typedef struct {
+    const char  *filename;
+    const char  *err;
+} Rejectcase;
+
+
+static Error *test_kernels(JitMode mode);
+static Error *test_lazy();
+static Error *test_memory();
+static Error *test_rejects();
+static Error *callexport(Jit *jit, const Testcase *tc);
+
+
+#define I32MIN  0x80000000
+#define I64MIN  0x8000000000000000
+#define NEG32   0xffffffff      /* -1 as i32 */
+#define NEG64   0xffffffffffffffff
+
+
+static const Testcase  kernels[] = {
+    {"i32.add", {1, 2}, 3, NULL},
+    {"i32.add", {NEG32, 1}, 0, NULL},
+    {"i32.sub", {1, 2}, NEG32, NULL},
+    {"i32.mul", {0x10000, 0x10000}, 0, NULL},
+    {"i32.mul", {NEG32, 7}, 0xfffffff9, NULL},
+    {"i32.div_s", {NEG32 - 9, 3}, NEG32 - 2, NULL},
+    {"i32.div_s", {7, 0}, 0, "trap: integer divide by zero"},
+    {"i32.div_s", {I32MIN, NEG32}, 0, "trap: integer overflow"},
+    {"i32.div_u", {NEG32, 2}, 0x7fffffff, NULL},
+    {"i32.div_u", {7, 0}, 0, "trap: integer divide by zero"},
+    {"i32.rem_s", {NEG32 - 9, 3}, NEG32, NULL},
+    {"i32.rem_s", {I32MIN, NEG32}, 0, NULL},
+    {"i32.rem_u", {10, 3}, 1, NULL},
+    {"i32.and", {0xff00, 0x0ff0}, 0x0f00, NULL},
+    {"i32.or", {0xff00, 0x0ff0}, 0xfff0, NULL},
+    {"i32.xor", {0xff00, 0x0ff0}, 0xf0f0, NULL},
+    {"i32.shl", {1, 33}, 2, NULL},
+    {"i32.shr_s", {I32MIN, 31}, NEG32, NULL},
+    {"i32.shr_u", {I32MIN, 31}, 1, NULL},
+    {"i32.rotl", {I32MIN | 1, 1}, 3, NULL},
+    {"i32.rotr", {3, 1}, I32MIN | 1, NULL},
+    {"i32.eq", {5, 5}, 1, NULL},
+    {"i32.ne", {5, 5}, 0, NULL},
+    {"i32.lt_s", {NEG32, 0}, 1, NULL},
+    {"i32.lt_u", {NEG32, 0}, 0, NULL},
+    {"i32.gt_s", {NEG32, 0}, 0, NULL},
+    {"i32.gt_u", {NEG32, 0}, 1, NULL},
+    {"i32.le_s", {3, 3}, 1, NULL},
+    {"i32.le_u", {4, 3}, 0, NULL},
+    {"i32.ge_s", {3, 4}, 0, NULL},
+    {"i32.ge_u", {4, 3}, 1, NULL},
+
+    {"i64.add", {NEG64, 2}, 1, NULL},
+    {"i64.sub", {0, 1}, NEG64, NULL},
+    {"i64.mul", {0x100000000, 0x10}, 0x1000000000, NULL},
+    {"i64.div_s", {NEG64 - 9, 3}, NEG64 - 2, NULL},
+    {"i64.div_s", {I64MIN, NEG64}, 0, "trap: integer overflow"},
+    {"i64.div_u", {NEG64, 2}, 0x7fffffffffffffff, NULL},
+    {"i64.div_u", {1, 0}, 0, "trap: integer divide by zero"},
+    {"i64.rem_s", {I64MIN, NEG64}, 0, NULL},
+    {"i64.rem_u", {0x100000001, 0x100000000}, 1, NULL},
+    {"i64.and", {0xff00000000, 0x0ff0000000}, 0x0f00000000, NULL},
+    {"i64.or", {0xff00000000, 1}, 0xff00000001, NULL},
+    {"i64.xor", {NEG64, 1}, NEG64 - 1, NULL},
+    {"i64.shl", {1, 63}, I64MIN, NULL},
+    {"i64.shr_s", {I64MIN, 63}, NEG64, NULL},
+    {"i64.shr_u", {I64MIN, 63}, 1, NULL},
+    {"i64.rotl", {I64MIN, 1}, 1, NULL},
+    {"i64.rotr", {1, 1}, I64MIN, NULL},
+    {"i64.eq", {I64MIN, I64MIN}, 1, NULL},
+    {"i64.ne", {1, 0x100000001}, 1, NULL},
+    {"i64.lt_s", {NEG64, 0}, 1, NULL},
+    {"i64.lt_u", {NEG64, 0}, 0, NULL},
+    {"i64.gt_s", {1, NEG64}, 1, NULL},
+    {"i64.gt_u", {1, NEG64}, 0, NULL},
+    {"i64.le_s", {NEG64, NEG64}, 1, NULL},
+    {"i64.le_u", {NEG64, 1}, 0, NULL},
+    {"i64.ge_s", {0, NEG64}, 1, NULL},
+    {"i64.ge_u", {0, NEG64}, 0, NULL},
+
+    {"i32.eqz", {0}, 1, NULL},
+    {"i32.eqz", {I32MIN}, 0, NULL},
+    {"i64.eqz", {0x100000000}, 0, NULL},
+    {"i32.wrap", {0x1ffffffff}, NEG32, NULL},
+    {"i64.extend_s", {NEG32}, NEG64, NULL},
+    {"i64.extend_u", {NEG32}, NEG32, NULL},
+    {"select", {1, 2, 0}, 2, NULL},
+    {"select", {1, 2, 7}, 1, NULL},
+
+    {"fac", {20}, 2432902008176640000, NULL},
+    {"fibrec", {20}, 6765, NULL},
+    {"fib", {40}, 102334155, NULL},
+    {"sum", {100000}, 4999950000, NULL},
+    {"brif", {1}, 7, NULL},
+    {"brif", {0}, 9, NULL},
+    {"abs", {NEG32 - 4}, 5, NULL},
+    {"abs", {5}, 5, NULL},
+    {"deep", {1}, 137, NULL},
+    {"spill", {3}, 42, NULL},
+    {"dead", {0}, 3, NULL},
+    {"zero", {0}, 0, NULL},
+    {"unreachable", {0}, 0, "trap: unreachable executed"},
+    {"recurse", {0}, 0, "trap: call stack exhausted"},
+    {"bigrecurse", {0}, 0, "trap: call stack exhausted"},
+};
+
+
+/* run in order against the same memory */
+static const Testcase  memcases[] = {
+    {"size", {0}, 1, NULL},
+    {"load", {0}, 0, NULL},
+    {"rw32", {65532, 0xdeadbeef}, 0xdeadbeef, NULL},
+    {"rw8", {7, 0x180}, NEG32 - 127, NULL},
+    {"rw16", {9, 0x12345}, 0x2345, NULL},
+    {"rw64", {16, NEG64 - 1}, NEG64 - 1, NULL},
+    {"rw32s", {24, 0x80000000}, 0xffffffff80000000, NULL},
+    {"spill", {32, 42}, 42, NULL},
+    {"load", {65533}, 0, "trap: out of bounds memory access"},
+    {"rw32", {65536, 1}, 0, "trap: out of bounds memory access"},
+    {"offset", {0}, 0, "trap: out of bounds memory access"},
+    {"load", {65532}, 0xdeadbeef, NULL},
+    {"grow", {1}, 36, NULL},
+    {"size", {0}, 2, NULL},
+    {"load", {65533}, 0xdeadbe, NULL},
+    {"rw32", {131068, 5}, 5, NULL},
+    {"grow", {1}, 34, NULL},
+    {"load", {131069}, 0, "trap: out of bounds memory access"},
+};
+
+
+static const Rejectcase  rejects[] = {
+    {
+        "testdata/ok/floats.wasm",
+        "opcode 0x43 not supported",
+    },
+};
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_kernels(JitEager);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_kernels(JitLazy);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_kernels(JitLazy | JitMetered);
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_lazy();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_memory();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_rejects();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+test_kernels(JitMode mode)
+{
+    u32     i;
+    Jit     jit;
+    Error   *err;
+    Module  *m;
+
+    err = loadmodule(&m, "testdata/ok/kernels.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = jitmodule(&jit, m, mode);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        return error(err, "compiling kernels.wasm");
+    }
+
+    jit.fuel = 0xffffffffffffffff;
+
+    for (i = 0; i < nitems(kernels); i++) {
+        err = callexport(&jit, &kernels[i]);
+        if (slow(err != NULL)) {
+            break;
+        }
+    }
+
+    jitclose(&jit);
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+callexport(Jit *jit, const Testcase *tc)
+{
+    u64         args[4], got;
+    Error       *err;
+    String      field;
+    ExportDecl  *export;
+
+    cstr(&field, (u8 *) tc->func);
+
+    export = findexport(jit->module, &field);
+    if (slow(export == NULL)) {
+        return newerror("export %s not found", tc->func);
+    }
+
+    memcpy(args, tc->args, sizeof(args));
+
+    got = 0;
+
+    err = jitcall(jit, export->index, args, &got);
+    if (err != NULL) {
+        if (tc->err == NULL) {
+            return error(err, "%s must not fail", tc->func);
+        }
+
+        if (slow(!iserror(err, tc->err))) {
+            return error(err, "%s: expected error \"%s\"", tc->func, tc->err);
+        }
+
+        errorfree(err);
+        return NULL;
+    }
+
+    if (slow(tc->err != NULL)) {
+        return newerror("%s: expected error \"%s\"", tc->func, tc->err);
+    }
+
+    if (slow(got != tc->want)) {
+        return newerror("%s: result mismatch (%x(u64) != %x(u64))", tc->func,
+                        got, tc->want);
+    }
+
+    return NULL;
+}
+
+
+static Error *
+test_lazy()
+{
+    u32        nprepared;
+    Jit        jit;
+    Error      *err;
+    Module     *m;
+    Testcase   fibrec = {"fibrec", {10}, 55, NULL};
+    Testcase   spill = {"spill", {3}, 42, NULL};
+    Testcase   trunc = {"trunc", {0}, 0, "opcode 0x43 not supported"};
+
+    err = loadmodule(&m, "testdata/ok/kernels.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = jitmodule(&jit, m, JitLazy);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        return err;
+    }
+
+    if (slow(jit.nprepared != 0)) {
+        err = newerror("lazy setup prepared %d functions", jit.nprepared);
+        goto done;
+    }
+
+    err = callexport(&jit, &fibrec);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    if (slow(jit.nprepared != 1)) {
+        err = newerror("fibrec prepared %d functions", jit.nprepared);
+        goto done;
+    }
+
+    err = callexport(&jit, &fibrec);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    nprepared = jit.nprepared;
+
+    /* spill calls i32.add, which is prepared from inside the guest */
+
+    err = callexport(&jit, &spill);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    if (slow(jit.nprepared != nprepared + 2)) {
+        err = newerror("spill prepared %d functions",
+                       jit.nprepared - nprepared);
+        goto done;
+    }
+
+done:
+
+    jitclose(&jit);
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    /* unsupported code only fails once it's called */
+
+    err = loadmodule(&m, "testdata/ok/floats.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = jitmodule(&jit, m, JitLazy);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        return error(err, "lazy setup must not fail");
+    }
+
+    err = callexport(&jit, &trunc);
+
+    jitclose(&jit);
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+test_memory()
+{
+    u32           i;
+    Jit           jit;
+    Error         *err;
+    Module        *m;
+    MemoryDecl    *decl;
+    LinearMemory  mem;
+
+    err = loadmodule(&m, "testdata/ok/memory.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = jitmodule(&jit, m, JitEager);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        return error(err, "compiling memory.wasm");
+    }
+
+    err = callexport(&jit, &memcases[0]);
+    if (slow(err == NULL || !iserror(err, "module has no linear memory"))) {
+        err = error(err, "jitcall must require a memory");
+        goto done;
+    }
+
+    errorfree(err);
+
+    decl = arrayget(m->memories, 0);
+
+    err = newmemory(&mem, &decl->limit);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    jit.memory = &mem;
+
+    for (i = 0; i < nitems(memcases); i++) {
+        err = callexport(&jit, &memcases[i]);
+        if (slow(err != NULL)) {
+            break;
+        }
+    }
+
+    closememory(&mem);
+
+done:
+
+    jitclose(&jit);
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+test_rejects()
+{
+    u32               i;
+    Jit               jit;
+    Error             *err;
+    Module            *m;
+    const Rejectcase  *tc;
+
+    for (i = 0; i < nitems(rejects); i++) {
+        tc = &rejects[i];
+
+        err = loadmodule(&m, tc->filename);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        err = jitmodule(&jit, m, JitEager);
+        closemodule(m);
+
+        if (slow(err == NULL)) {
+            jitclose(&jit);
+            return newerror("%s: jit must fail", tc->filename);
+        }
+
+        if (slow(!iserror(err, tc->err))) {
+            return error(err, "%s: expected error \"%s\"", tc->filename,
+                         tc->err);
+        }
+
+        errorfree(err);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/memory.h>
+
+#include <signal.h>
+#include <pthread.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+
+static void faulthandler(int signo, siginfo_t *info, void *uctx);
+static MemoryGuard *findguard(const u8 *addr);
+
+
+static __thread MemoryGuard  *guards;
+
+static u8                installed;
+static struct sigaction  oldaction;
+static pthread_mutex_t   installlock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*
+ * Reserves the whole guarded range with no access and commits the initial
+ * pages read/write.
+ */
+Error *
+newmemory(LinearMemory *mem, const ResizableLimit *limit)
+{
+    Error  *err;
+
+    memset(mem, 0, sizeof(LinearMemory));
+
+    mem->base = mmap(NULL, MEMORY_RESERVE, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (slow(mem->base == MAP_FAILED)) {
+        mem->base = NULL;
+        return newerror("failed to reserve linear memory: %s",
+                        strerror(errno));
+    }
+
+    mem->reserved = MEMORY_RESERVE;
+
+    err = limitmemory(mem, limit);
+    if (slow(err != NULL)) {
+        closememory(mem);
+        return err;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Applies `limit` to a zeroed memory, committing exactly its initial pages.
+ * Memories being reused may already have pages committed, in which case
+ * only the difference is protected or unprotected.
+ */
+Error *
+limitmemory(LinearMemory *mem, const ResizableLimit *limit)
+{
+    u32  maximum;
+
+    maximum = (limit->flags & 1) ? limit->maximum : WASM_MAX_PAGES;
+
+    if (slow(maximum > WASM_MAX_PAGES || limit->initial > maximum)) {
+        return newerror("invalid memory limits (initial %d, maximum %d)",
+                        limit->initial, maximum);
+    }
+
+    mem->maximum = maximum;
+
+    if (mem->pages > limit->initial) {
+        if (slow(mprotect(mem->base + (u64) limit->initial * WASM_PAGE_SIZE,
+                          (u64) (mem->pages - limit->initial)
+                          * WASM_PAGE_SIZE, PROT_NONE) != 0))
+        {
+            return newerror("failed to decommit pages: %s", strerror(errno));
+        }
+
+        mem->pages = limit->initial;
+        return NULL;
+    }
+
+    if (slow(growmemory(mem, limit->initial - mem->pages) == 0xffffffff)) {
+        return newerror("failed to commit %d pages: %s", limit->initial,
+                        strerror(errno));
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Commits `delta` more pages.  Returns the previous size in pages, or
+ * 0xffffffff (-1 as i32) if the memory can't grow, as grow_memory does.
+ */
+u32
+growmemory(LinearMemory *mem, u32 delta)
+{
+    u32  old;
+
+    old = mem->pages;
+
+    if (delta == 0) {
+        return old;
+    }
+
+    if (slow(delta > mem->maximum - old)) {
+        return 0xffffffff;
+    }
+
+    if (slow(mprotect(mem->base + (u64) old * WASM_PAGE_SIZE,
+                      (u64) delta * WASM_PAGE_SIZE,
+                      PROT_READ | PROT_WRITE) != 0))
+    {
+        return 0xffffffff;
+    }
+
+    mem->pages = old + delta;
+
+    return old;
+}
+
+
+/*
+ * Maps the first `pages` pages of `fd` copy-on-write at the start of the
+ * memory, which then has exactly that many committed pages.
+ */
+Error *
+mapmemory(LinearMemory *mem, int fd, u32 pages)
+{
+    u64  size;
+
+    size = (u64) pages * WASM_PAGE_SIZE;
+
+    if (slow(pages > mem->maximum)) {
+        return newerror("%d pages exceed maximum of %d", pages, mem->maximum);
+    }
+
+    if (size > 0
+        && slow(mmap(mem->base, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED))
+    {
+        return newerror("failed to map memory image: %s", strerror(errno));
+    }
+
+    if (mem->pages > pages
+        && slow(mprotect(mem->base + size,
+                         (u64) (mem->pages - pages) * WASM_PAGE_SIZE,
+                         PROT_NONE) != 0))
+    {
+        return newerror("failed to decommit pages: %s", strerror(errno));
+    }
+
+    mem->pages = pages;
+    mem->mapped = (pages > 0);
+
+    return NULL;
+}
+
+
+/*
+ * Zeroes every committed page, keeping them committed for reuse.  Anonymous
+ * pages are released with MADV_DONTNEED and read back as zeroes; ranges with
+ * file pages get a fresh anonymous mapping instead, as MADV_DONTNEED would
+ * bring the file contents back.
+ */
+Error *
+resetmemory(LinearMemory *mem)
+{
+    u64  size;
+
+    size = (u64) mem->pages * WASM_PAGE_SIZE;
+
+    if (size == 0) {
+        mem->mapped = 0;
+        return NULL;
+    }
+
+    if (mem->mapped) {
+        if (slow(mmap(mem->base, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                      -1, 0) == MAP_FAILED))
+        {
+            return newerror("failed to remap memory: %s", strerror(errno));
+        }
+
+        mem->mapped = 0;
+        return NULL;
+    }
+
+    if (slow(madvise(mem->base, size, MADV_DONTNEED) != 0)) {
+        return newerror("failed to reset memory: %s", strerror(errno));
+    }
+
+    return NULL;
+}
+
+
+void
+closememory(LinearMemory *mem)
+{
+    if (mem->base != NULL) {
+        munmap(mem->base, mem->reserved);
+        mem->base = NULL;
+    }
+
+    mem->pages = 0;
+}
+
+
+/*
+ * Installs the process-wide SIGSEGV handler.  Faults that don't belong to a
+ * guarded memory are handed back to the previous disposition.  Serialized,
+ * as installing twice would save our own handler as the previous one.
+ */
+Error *
+memorysignals(void)
+{
+    Error             *err;
+    struct sigaction  sa;
+
+    if (__atomic_load_n(&installed, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    err = NULL;
+
+    pthread_mutex_lock(&installlock);
+
+    if (__atomic_load_n(&installed, __ATOMIC_RELAXED)) {
+        goto done;
+    }
+
+    memset(&sa, 0, sizeof(struct sigaction));
+
+    /*
+     * SA_NODEFER because traps leave the handler with a longjmp, which
+     * would otherwise keep the signal blocked.
+     */
+    sa.sa_sigaction = faulthandler;
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+
+    if (slow(sigaction(SIGSEGV, &sa, &oldaction) != 0)) {
+        err = newerror("failed to install SIGSEGV handler: %s",
+                       strerror(errno));
+        goto done;
+    }
+
+    __atomic_store_n(&installed, 1, __ATOMIC_RELEASE);
+
+done:
+
+    pthread_mutex_unlock(&installlock);
+
+    return err;
+}
+
+
+void
+guardmemory(MemoryGuard *guard)
+{
+    guard->prev = guards;
+    guards = guard;
+}
+
+
+void
+unguardmemory(MemoryGuard *guard)
+{
+    guards = guard->prev;
+}
+
+
+static void
+faulthandler(int signo, siginfo_t *info, void *uctx)
+{
+    MemoryGuard   *guard;
+
+    guard = findguard(info->si_addr);
+    if (guard != NULL) {
+        guard->trap(guard->data);
+    }
+
+    if (oldaction.sa_flags & SA_SIGINFO) {
+        oldaction.sa_sigaction(signo, info, uctx);
+        return;
+    }
+
+    /* returning re-executes the faulting access under the old action */
+    sigaction(SIGSEGV, &oldaction, NULL);
+    __atomic_store_n(&installed, 0, __ATOMIC_RELEASE);
+}
+
+
+static MemoryGuard *
+findguard(const u8 *addr)
+{
+    LinearMemory  *mem;
+    MemoryGuard   *guard;
+
+    for (guard = guards; guard != NULL; guard = guard->prev) {
+        mem = guard->mem;
+
+        if (addr >= mem->base && addr < mem->base + mem->reserved) {
+            return guard;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <setjmp.h>
+#include <stdlib.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/memory.h>
+#include "test.h"
+
+
+static Error *test_limits();
+static Error *test_grow();
+static Error *test_guard();
+static u8 touch(LinearMemory *mem, u64 off);
+static void trap(void *data) __attribute__((noreturn));
+
+
+static jmp_buf  env;
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_limits();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_grow();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_guard();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+test_limits()
+{
+    Error           *err;
+    LinearMemory    mem;
+    ResizableLimit  limit;
+
+    limit.flags = 1;
+    limit.initial = 3;
+    limit.maximum = 2;
+
+    err = newmemory(&mem, &limit);
+    if (slow(err == NULL)) {
+        closememory(&mem);
+        return newerror("initial above maximum must fail");
+    }
+
+    errorfree(err);
+
+    limit.initial = 0;
+    limit.maximum = WASM_MAX_PAGES + 1;
+
+    err = newmemory(&mem, &limit);
+    if (slow(err == NULL)) {
+        closememory(&mem);
+        return newerror("maximum above 4GiB must fail");
+    }
+
+    errorfree(err);
+
+    limit.flags = 0;
+
+    err = newmemory(&mem, &limit);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    if (slow(mem.pages != 0 || mem.maximum != WASM_MAX_PAGES)) {
+        closememory(&mem);
+        return newerror("unbounded memory: %d pages, maximum %d", mem.pages,
+                        mem.maximum);
+    }
+
+    closememory(&mem);
+
+    return NULL;
+}
+
+
+static Error *
+test_grow()
+{
+    u32             old;
+    Error           *err;
+    LinearMemory    mem;
+    ResizableLimit  limit;
+
+    limit.flags = 1;
+    limit.initial = 1;
+    limit.maximum = 3;
+
+    err = newmemory(&mem, &limit);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    mem.base[WASM_PAGE_SIZE - 1] = 1;
+
+    old = growmemory(&mem, 2);
+    if (slow(old != 1 || mem.pages != 3)) {
+        err = newerror("grow by 2 returned %d (%d pages)", old, mem.pages);
+        goto done;
+    }
+
+    mem.base[3 * WASM_PAGE_SIZE - 1] = 1;
+
+    old = growmemory(&mem, 1);
+    if (slow(old != 0xffffffff || mem.pages != 3)) {
+        err = newerror("grow past maximum returned %d", old);
+        goto done;
+    }
+
+    old = growmemory(&mem, 0);
+    if (slow(old != 3)) {
+        err = newerror("grow by 0 returned %d", old);
+    }
+
+done:
+
+    closememory(&mem);
+
+    return err;
+}
+
+
+static Error *
+test_guard()
+{
+    Error           *err;
+    LinearMemory    mem;
+    ResizableLimit  limit;
+
+    err = memorysignals();
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    limit.flags = 0;
+    limit.initial = 1;
+
+    err = newmemory(&mem, &limit);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    if (slow(touch(&mem, WASM_PAGE_SIZE - 1))) {
+        err = newerror("last committed byte must not trap");
+        goto done;
+    }
+
+    if (slow(!touch(&mem, WASM_PAGE_SIZE))) {
+        err = newerror("first uncommitted byte must trap");
+        goto done;
+    }
+
+    if (slow(!touch(&mem, MEMORY_RESERVE - 1))) {
+        err = newerror("end of guard region must trap");
+        goto done;
+    }
+
+    growmemory(&mem, 1);
+
+    if (slow(touch(&mem, WASM_PAGE_SIZE))) {
+        err = newerror("grown page must not trap");
+    }
+
+done:
+
+    closememory(&mem);
+
+    return err;
+}
+
+
+/*
+ * Writes to `off` and reports if it trapped.
+ */
+static u8
+touch(LinearMemory *mem, u64 off)
+{
+    volatile u8   trapped;
+    MemoryGuard   guard;
+
+    guard.mem = mem;
+    guard.trap = trap;
+    guard.data = NULL;
+
+    guardmemory(&guard);
+
+    trapped = 1;
+
+    if (setjmp(env) == 0) {
+        mem->base[off] = 42;
+        trapped = 0;
+    }
+
+    unguardmemory(&guard);
+
+    return trapped;
+}
+
+
+static void
+trap(void * unused(data))
+{
+    longjmp(env, 1);
+}
@@ -11,6 +11,7 @@
 #include <acorn/array.h>
 #include <oak/file.h>
 #include <oak/module.h>
+#include <oak/validate.h>
 #include "bin.h"
 #include "opcodes.h"
 
@@ -18,6 +19,8 @@
 typedef Error *(*Parser)(Module *m, u8 *begin, const u8 *end);
 
 
+static Error *parsemodule(Module *mod, const char *filename);
+
 /* section parsers */
 static Error *parsesects(Module *m, u8 *begin, const u8 *end);
 static Error *parsesect(u8 **begin, const u8 *end, Section *s);
@@ -35,7 +38,10 @@ static Error *parsecodes(Module *m, u8 *begin, const u8 *end);
 static Error *parsedatas(Module *m, u8 *begin, const u8 *end);
 
 /* helpers */
+static Error *evalconst(Module *m, u8 **begin, const u8 *end,
+    GlobalDecl *expr);
 static Error *parselimits(u8 **begin, const u8 *end, ResizableLimit *limit);
+static void freemodule(Module *m);
 
 
 static const Parser  parsers[] = {
@@ -80,8 +86,8 @@ static const char  *codesect     = "code";
 static const char  *datasect     = "data";
 
 
-Error *
-loadmodule(Module *mod, const char *filename)
+static Error *
+parsemodule(Module *mod, const char *filename)
 {
     u8      *begin, *end;
     File    file;
@@ -109,6 +115,7 @@ loadmodule(Module *mod, const char *filename)
 
     memset(mod, 0, sizeof(Module));
 
+    mod->refs = 1;
     mod->file = file;
 
     mod->sects = newarray(16, sizeof(Section));
@@ -125,11 +132,18 @@ loadmodule(Module *mod, const char *filename)
         goto free;
     }
 
+    err = validatemodule(mod, 0);
+    if (slow(err != NULL)) {
+        err = error(err, "loading module");
+        goto free;
+    }
+
     return NULL;
 
 free:
 
-    free(mod);
+    freemodule(mod);
+    return err;
 
 fail:
 
@@ -266,7 +280,7 @@ parsetypes(Module *m, u8 *begin, const u8 *end)
 
             value = -i8val;
 
-            if (slow(arrayadd(type.params, &value) != OK)) {
+            if (slow(arrayadd(type.rets, &value) != OK)) {
                 return earrayadd();
             }
         }
@@ -291,6 +305,7 @@ parsetypes(Module *m, u8 *begin, const u8 *end)
 static Error *
 parseimports(Module *m, u8 *begin, const u8 *end)
 {
+    i8          i8val;
     u8          u8val;
     u32         i, u32val, nimports;
     TypeDecl    *type;
@@ -344,18 +359,58 @@ parseimports(Module *m, u8 *begin, const u8 *end)
 
         import.kind = u8val;
 
-        if (slow(u8vdecode(&begin, end, &u8val) != OK)) {
-            return ecorruptsect(importsect);
-        }
-
         switch (import.kind) {
         case Function:
+            if (slow(u8vdecode(&begin, end, &u8val) != OK)) {
+                return ecorruptsect(importsect);
+            }
+
             type = arrayget(m->types, u8val);
             if (slow(type == NULL)) {
                 return newerror("import section references unknown function");
             }
 
             import.u.type = *type;
+
+            /* for functype(), as for globaltype() below */
+
+            if (m->importfuncs == NULL) {
+                m->importfuncs = newarray(nimports, sizeof(TypeDecl));
+                if (slow(m->importfuncs == NULL)) {
+                    return earrayalloc();
+                }
+            }
+
+            if (slow(arrayadd(m->importfuncs, type) != OK)) {
+                return earrayadd();
+            }
+
+            m->nimportfuncs++;
+            break;
+
+        case Global:
+            if (slow(s8vdecode(&begin, end, &i8val) != OK
+                     || u8vdecode(&begin, end, &import.u.global.mut) != OK))
+            {
+                return ecorruptsect(importsect);
+            }
+
+            import.u.global.type = (Type) -i8val;
+
+            /* for globaltype(), as imports of other kinds sit in between */
+
+            if (m->importglobals == NULL) {
+                m->importglobals = newarray(nimports, sizeof(GlobalType));
+                if (slow(m->importglobals == NULL)) {
+                    return earrayalloc();
+                }
+            }
+
+            if (slow(arrayadd(m->importglobals, &import.u.global) != OK)) {
+                return earrayadd();
+            }
+
+            m->nimportglobals++;
             break;
 
         default:
@@ -509,8 +564,8 @@ static Error *
 parseglobals(Module *m, u8 *begin, const u8 *end)
 {
     i8          i8val;
-    u8          opcode;
     u32         count;
+    Error       *err;
     GlobalDecl  global;
 
     if (slow(m->globals != NULL)) {
@@ -539,46 +594,9 @@ parseglobals(Module *m, u8 *begin, const u8 *end)
             return emalformed("mutability", globalsect);
         }
 
-        opcode = *begin++;
-
-        switch (opcode) {
-        case OpgetGlobal:
-            if (slow(u32vdecode(&begin, end, &global.u.globalindex) != OK)) {
-                return emalformed("get_global", globalsect);
-            }
-
-            break;
-
-        case Opi32const:
-            if (slow(s32vdecode(&begin, end, &global.u.i32val) != OK)) {
-                return emalformed("i32.const", globalsect);
-            }
-
-            break;
-
-        case Opi64const:
-            if (slow(s64vdecode(&begin, end, &global.u.i64val) != OK)) {
-                return emalformed("i64.const", globalsect);
-            }
-
-            break;
-
-        case Opf32const:
-            if (slow(u32decode(&begin, end, &global.u.f32val) != OK)) {
-                return emalformed("f32.const", globalsect);
-            }
-
-            break;
-
-        case Opf64const:
-            if (slow(u32decode(&begin, end, &global.u.f32val) != OK)) {
-                emalformed("f64.const", globalsect);
-            }
-
-            break;
-
-        default:
-            return newerror("unsupported global expression");
+        err = evalconst(m, &begin, end, &global);
+        if (slow(err != NULL)) {
+            return error(err, "global %d", m->nimportglobals + len(m->globals));
         }
 
         if (slow(arrayadd(m->globals, &global) != OK)) {
@@ -637,18 +655,27 @@ parseexports(Module *m, u8 *begin, const u8 *end)
             return emalformed("index", exportsect);
         }
 
+        export.index = uval;
+
         switch (export.kind) {
         case Function:
-            type = arrayget(m->types, uval);
+            type = functype(m, uval);
             if (slow(type == NULL)) {
-                return newerror("export type %d not found", uval);
+                return newerror("export function %d not found", uval);
             }
 
             export.u.type = *type;
             break;
 
         case Global:
-            global = arrayget(m->globals, uval);
+            if (uval < m->nimportglobals) {
+                export.u.global.type = *globaltype(m, uval);
+                export.u.global.init = OpgetGlobal;
+                export.u.global.u.globalindex = uval;
+                break;
+            }
+
+            global = arrayget(m->globals, uval - m->nimportglobals);
             if (slow(global == NULL)) {
                 return newerror("export global %d not found", uval);
             }
@@ -688,7 +715,7 @@ static Error *
 parsecodes(Module *m, u8 *begin, const u8 *end)
 {
     i8          i8val;
-    u8          *bodybegin, *bodyend;
+    u8          *bodyend;
     u32         count, bodysize, localcount;
     CodeDecl    code;
     LocalEntry  local;
@@ -709,13 +736,16 @@ parsecodes(Module *m, u8 *begin, const u8 *end)
     bodyend = 0;
 
     while (len(m->codes) < count && begin < end) {
-        bodybegin = begin;
-
         if (slow(u32vdecode(&begin, end, &bodysize) != OK)) {
             return emalformed("function body size", codesect);
         }
 
-        bodyend = (bodybegin + bodysize);
+        /* bodyend points to the final 0x0b */
+        bodyend = (begin + bodysize - 1);
+
+        if (slow(bodysize == 0 || bodyend >= end)) {
+            return emalformed("function body size", codesect);
+        }
 
         if (slow(*bodyend != 0x0b)) {
             return newerror("malformed body: missing 0x0b in the end");
@@ -760,6 +790,8 @@ parsecodes(Module *m, u8 *begin, const u8 *end)
         if (slow(arrayadd(m->codes, &code) != OK)) {
             return earrayadd();
         }
+
+        begin = bodyend + 1;
     }
 
     if (slow(len(m->codes) < count)) {
@@ -774,6 +806,110 @@ parsecodes(Module *m, u8 *begin, const u8 *end)
 }
 
 
+/*
+ * Evaluates the init expression at *begin into `expr`, whose type.type is
+ * the type it must have.  get_global may read any immutable global defined
+ * or imported before; a defined one already holds its folded value, so it
+ * is copied and chains resolve in a single step.
+ */
+static Error *
+evalconst(Module *m, u8 **begin, const u8 *end, GlobalDecl *expr)
+{
+    u8          op;
+    u32         index;
+    GlobalType  *type;
+    GlobalDecl  *global;
+
+    if (slow(*begin >= end)) {
+        return newerror("missing init expression");
+    }
+
+    op = *(*begin)++;
+
+    switch (op) {
+    case OpgetGlobal:
+        if (slow(u32vdecode(begin, end, &index) != OK)) {
+            return newerror("malformed get_global");
+        }
+
+        type = globaltype(m, index);
+        if (slow(type == NULL)) {
+            return newerror("unknown global %d", index);
+        }
+
+        if (slow(type->mut)) {
+            return newerror("global %d is mutable", index);
+        }
+
+        if (slow(type->type != expr->type.type)) {
+            return newerror("type mismatch: global %d", index);
+        }
+
+        if (index < m->nimportglobals) {
+            expr->u.globalindex = index;
+            break;
+        }
+
+        global = arrayget(m->globals, index - m->nimportglobals);
+
+        expr->init = global->init;
+        expr->u = global->u;
+        goto done;
+
+    case Opi32const:
+        if (slow(s32vdecode(begin, end, &expr->u.i32val) != OK)) {
+            return newerror("malformed i32.const");
+        }
+
+        break;
+
+    case Opi64const:
+        if (slow(s64vdecode(begin, end, &expr->u.i64val) != OK)) {
+            return newerror("malformed i64.const");
+        }
+
+        break;
+
+    case Opf32const:
+        if (slow(u32decode(begin, end, &expr->u.f32val) != OK)) {
+            return newerror("malformed f32.const");
+        }
+
+        break;
+
+    case Opf64const:
+        if (slow(end - *begin < 8)) {
+            return newerror("malformed f64.const");
+        }
+
+        memcpy(&expr->u.f64val, *begin, 8);
+        *begin += 8;
+        break;
+
+    default:
+        return newerror("unsupported init expression");
+    }
+
+    /* the constant opcodes follow the type order */
+
+    if (slow(op != OpgetGlobal
+             && op - Opi32const != (u8) expr->type.type - I32))
+    {
+        return newerror("type mismatch: init expression");
+    }
+
+    expr->init = op;
+
+done:
+
+    if (slow(*begin >= end || *(*begin)++ != OpEnd)) {
+        return newerror("malformed init expression end");
+    }
+
+    return NULL;
+}
+
+
 static Error *
 parselimits(u8 **begin, const u8 *end, ResizableLimit *limit)
 {
@@ -802,9 +938,10 @@ parselimits(u8 **begin, const u8 *end, ResizableLimit *limit)
 static Error *
 parsedatas(Module *m, u8 *begin, const u8 *end)
 {
-    u8        opcode;
-    u32       count;
-    DataDecl  data;
+    u32         count;
+    Error       *err;
+    DataDecl    data;
+    GlobalDecl  offset;
 
     if (slow(m->datas != NULL)) {
         return edupsect(datasect);
@@ -826,25 +963,27 @@ parsedatas(Module *m, u8 *begin, const u8 *end)
             return emalformed("index", datasect);
         }
 
-        opcode = *begin++;
+        memset(&offset, 0, sizeof(GlobalDecl));
 
-        switch (opcode) {
-        case Opi32const:
-            if (slow(s32vdecode(&begin, end, &data.offset) != OK)) {
-                return emalformed("i32.const", datasect);
-            }
-
-            break;
+        offset.type.type = I32;
 
-        default:
-            return newerror("unsupported data init expression");
+        err = evalconst(m, &begin, end, &offset);
+        if (slow(err != NULL)) {
+            return error(err, "data segment %d offset", len(m->datas));
         }
 
-        if (slow(u32vdecode(&begin, end, &data.size) != OK)) {
+        data.init = offset.init;
+        data.offset = offset.u.i32val;
+        data.globalindex = offset.u.globalindex;
+
+        if (slow(u32vdecode(&begin, end, &data.size) != OK
+                 || data.size > (u64) (end - begin)))
+        {
             return emalformed("size", datasect);
         }
 
         data.data = begin;
+        begin += data.size;
 
         if (slow(arrayadd(m->datas, &data) != OK)) {
             return earrayadd();
@@ -879,8 +1018,120 @@ parseelements(__attribute__ ((unused)) Module *m,
 }
 
 
+/*
+ * Returns the type of the global `index` of the global index space, where
+ * imported globals come first.
+ */
+GlobalType *
+globaltype(const Module *m, u32 index)
+{
+    GlobalDecl  *g;
+
+    if (index < m->nimportglobals) {
+        return arrayget(m->importglobals, index);
+    }
+
+    if (m->globals == NULL) {
+        return NULL;
+    }
+
+    g = arrayget(m->globals, index - m->nimportglobals);
+    return (g != NULL) ? &g->type : NULL;
+}
+
+
+/*
+ * Returns the type of the function `index` of the function index space, where
+ * imported functions come first.
+ */
+TypeDecl *
+functype(const Module *m, u32 index)
+{
+    FuncDecl  *f;
+
+    if (index < m->nimportfuncs) {
+        return arrayget(m->importfuncs, index);
+    }
+
+    if (m->funcs == NULL) {
+        return NULL;
+    }
+
+    f = arrayget(m->funcs, index - m->nimportfuncs);
+    return (f != NULL) ? &f->type : NULL;
+}
+
+
+ExportDecl *
+findexport(const Module *m, const String *field)
+{
+    u32         i;
+    ExportDecl  *export;
+
+    for (i = 0; i < len(m->exports); i++) {
+        export = arrayget(m->exports, i);
+        if (stringcmp(export->field, field)) {
+            return export;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Modules live on the heap only, so that the references held by instances,
+ * jits and snapshots never outlive the memory of the module.
+ */
+Error *
+loadmodule(Module **m, const char *filename)
+{
+    Error   *err;
+    Module  *mod;
+
+    mod = memalloc(sizeof(Module));
+    if (slow(mod == NULL)) {
+        return newerror("failed to allocate module: %s", strerror(errno));
+    }
+
+    err = parsemodule(mod, filename);
+    if (slow(err != NULL)) {
+        memfree(mod);
+        return err;
+    }
+
+    *m = mod;
+
+    return NULL;
+}
+
+
+Module *
+acquiremodule(Module *m)
+{
+    __atomic_add_fetch(&m->refs, 1, __ATOMIC_RELAXED);
+    return m;
+}
+
+
+/*
+ * Drops a reference.  The release ordering makes every use of the module by
+ * this thread happen before the free done by whoever drops the last one.
+ */
 void
 closemodule(Module *m)
+{
+    if (__atomic_sub_fetch(&m->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+
+    freemodule(m);
+    memfree(m);
+}
+
+
+static void
+freemodule(Module *m)
 {
     u32         i;
     CodeDecl    *code;
@@ -893,7 +1144,10 @@ closemodule(Module *m)
      */
 
     closefile(&m->file);
-    freearray(m->sects);
+
+    if (m->sects) {
+        freearray(m->sects);
+    }
 
     if (m->types) {
         for (i = 0; i < len(m->types); i++) {
@@ -918,14 +1172,22 @@ closemodule(Module *m)
         for (i = 0; i < len(m->imports); i++) {
             import = arrayget(m->imports, i);
             if (fast(import != NULL)) {
-                free(import->module);
-                free(import->field);
+                memfree(import->module);
+                memfree(import->field);
             }
         }
 
         freearray(m->imports);
     }
 
+    if (m->importfuncs) {
+        freearray(m->importfuncs);
+    }
+
+    if (m->importglobals) {
+        freearray(m->importglobals);
+    }
+
     if (m->tables) {
         freearray(m->tables);
     }
@@ -938,11 +1200,15 @@ closemodule(Module *m)
         freearray(m->globals);
     }
 
+    if (m->datas) {
+        freearray(m->datas);
+    }
+
     if (m->exports) {
         for (i = 0; i < len(m->exports); i++) {
             export = arrayget(m->exports, i);
             if (fast(export != NULL)) {
-                free(export->field);
+                memfree(export->field);
             }
         }
 
@@ -953,7 +1219,7 @@ closemodule(Module *m)
         for (i = 0; i < len(m->codes); i++) {
             code = arrayget(m->codes, i);
             if (fast(code != NULL)) {
-                free(code->locals);
+                memfree(code->locals);
             }
         }
 
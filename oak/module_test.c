@@ -48,6 +48,21 @@ static const Testcase  invalid_cases[] = {
         "WASM must have at least 8 bytes",
         NULL,
     },
+    {
+        "testdata/invalid/constmut.wasm",
+        "global 0 is mutable",
+        NULL,
+    },
+    {
+        "testdata/invalid/consttype.wasm",
+        "type mismatch: init expression",
+        NULL,
+    },
+    {
+        "testdata/invalid/constforward.wasm",
+        "unknown global 1",
+        NULL,
+    },
     {
         "testdata/ok/empty.wasm",
         NULL,
@@ -90,7 +105,7 @@ static Error *
 test_module(const Testcase *tc)
 {
     Error   *err;
-    Module  m;
+    Module  *m;
 
     err = loadmodule(&m, tc->filename);
     if (err != NULL) {
@@ -107,8 +122,8 @@ test_module(const Testcase *tc)
         return NULL;
     }
 
-    err = assertmodule(&m, tc->module);
-    closemodule(&m);
+    err = assertmodule(m, tc->module);
+    closemodule(m);
     return err;
 }
 
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <acorn/array.h>
+
+#include <string.h>
+#include <sys/types.h>
+
+#include "bin.h"
+#include "opcodes.h"
+
+
+static const char  *Eunsupported = "opcode 0x%x not supported";
+
+
+const OpInfo  opinfo[256] = {
+#define OP(name, code, mnemonic, imm, in1, in2, out)                          \
+    [code] = {mnemonic, imm, in1, in2, out},
+
+    OPCODES(OP)
+
+#undef OP
+};
+
+
+/*
+ * Moves `*p` past the immediates of `op`, whose opcode byte was already
+ * consumed.
+ */
+Error *
+skipimm(u8 **p, const u8 *end, u8 op)
+{
+    Imm  imm;
+
+    return decodeimm(p, end, op, &imm);
+}
+
+
+/*
+ * Decodes the immediates of `op` into `imm` and moves `*p` past them.  Only
+ * their encoding is checked: whether indexes exist or reserved bytes are 0
+ * is left to the caller.
+ */
+Error *
+decodeimm(u8 **p, const u8 *end, u8 op, Imm *imm)
+{
+    u32  i, idx, n;
+    i32  i32val;
+
+    switch (opinfo[op].imm) {
+    case ImmNone:
+        if (slow(opinfo[op].name == NULL)) {
+            return newerror(Eunsupported, op);
+        }
+
+        return NULL;
+
+    case ImmBlock:
+    case ImmReserved:
+        if (slow(*p >= end)) {
+            return newerror("malformed immediate");
+        }
+
+        imm->block = *(*p)++;
+        imm->index = imm->block;
+        return NULL;
+
+    case ImmIndex:
+        if (slow(u32vdecode(p, end, &imm->index) != OK)) {
+            return newerror("malformed immediate");
+        }
+
+        return NULL;
+
+    case ImmTable:
+        if (slow(u32vdecode(p, end, &n) != OK)) {
+            return newerror("malformed br_table");
+        }
+
+        imm->ntargets = n;
+        imm->targets = *p;
+
+        for (i = 0; i <= n; i++) {
+            if (slow(u32vdecode(p, end, &idx) != OK)) {
+                return newerror("malformed br_table");
+            }
+        }
+
+        imm->index = idx;
+        return NULL;
+
+    case ImmIndirect:
+        if (slow(u32vdecode(p, end, &imm->index) != OK || *p >= end)) {
+            return newerror("malformed call_indirect");
+        }
+
+        (*p)++;
+        return NULL;
+
+    case ImmMem8:
+    case ImmMem16:
+    case ImmMem32:
+    case ImmMem64:
+        if (slow(u32vdecode(p, end, &imm->align) != OK
+                 || u32vdecode(p, end, &imm->offset) != OK))
+        {
+            return newerror("malformed memory immediate");
+        }
+
+        return NULL;
+
+    case ImmI32:
+        if (slow(s32vdecode(p, end, &i32val) != OK)) {
+            return newerror("malformed i32.const");
+        }
+
+        imm->value = (i64) i32val;
+        return NULL;
+
+    case ImmI64:
+        if (slow(s64vdecode(p, end, (i64 *) &imm->value) != OK)) {
+            return newerror("malformed i64.const");
+        }
+
+        return NULL;
+
+    default:
+        n = (opinfo[op].imm == ImmF32) ? 4 : 8;
+
+        if (slow((u64) (end - *p) < n)) {
+            return newerror("malformed float constant");
+        }
+
+        imm->value = 0;
+        memcpy(&imm->value, *p, n);
+
+        *p += n;
+        return NULL;
+    }
+}
+
+
+/*
+ * Instructions that may transfer control elsewhere, and those that may be
+ * where control is transferred to.
+ */
+u8
+isbranch(u8 op)
+{
+    switch (op) {
+    case OpUnreachable:
+    case OpIf:
+    case OpBr:
+    case OpBrIf:
+    case OpBrTable:
+    case OpReturn:
+        return 1;
+
+    default:
+        return 0;
+    }
+}
+
+
+u8
+istarget(u8 op)
+{
+    return op == OpLoop || op == OpElse || op == OpEnd;
+}
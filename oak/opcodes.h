@@ -6,14 +6,218 @@
 #define _OAK_OPCODES_H_
 
 
+#include <oak/insn.h>
+
+
+/*
+ * The MVP instruction set, once.  Each row has the name of the op in the
+ * Opcode enum, its encoding, its mnemonic in the text format, the kind of
+ * its immediates and its fixed stack effect: the types of up to two
+ * operands, the second one on top, and of the result.  A 0 is no value, and
+ * the ops whose effect depends on their immediates or on the stack (blocks,
+ * branches, calls, locals, globals, drop and select) only list what does
+ * not.
+ */
+#define OPCODES(OP)                                                           \
+    OP(Unreachable,       0x00, "unreachable",       ImmNone,  0, 0, 0)        \
+    OP(Nop,               0x01, "nop",               ImmNone,  0, 0, 0)        \
+    OP(Block,             0x02, "block",             ImmBlock, 0, 0, 0)        \
+    OP(Loop,              0x03, "loop",              ImmBlock, 0, 0, 0)        \
+    OP(If,                0x04, "if",                ImmBlock, I32, 0, 0)      \
+    OP(Else,              0x05, "else",              ImmNone,  0, 0, 0)        \
+    OP(End,               0x0b, "end",               ImmNone,  0, 0, 0)        \
+    OP(Br,                0x0c, "br",                ImmIndex, 0, 0, 0)        \
+    OP(BrIf,              0x0d, "br_if",             ImmIndex, I32, 0, 0)      \
+    OP(BrTable,           0x0e, "br_table",          ImmTable, I32, 0, 0)      \
+    OP(Return,            0x0f, "return",            ImmNone,  0, 0, 0)        \
+    OP(Call,              0x10, "call",              ImmIndex, 0, 0, 0)        \
+    OP(CallIndirect,      0x11, "call_indirect",     ImmIndirect, I32, 0, 0)   \
+    OP(Drop,              0x1a, "drop",              ImmNone,  0, 0, 0)        \
+    OP(Select,            0x1b, "select",            ImmNone,  0, 0, 0)        \
+    OP(GetLocal,          0x20, "get_local",         ImmIndex, 0, 0, 0)        \
+    OP(SetLocal,          0x21, "set_local",         ImmIndex, 0, 0, 0)        \
+    OP(TeeLocal,          0x22, "tee_local",         ImmIndex, 0, 0, 0)        \
+    OP(getGlobal,         0x23, "get_global",        ImmIndex, 0, 0, 0)        \
+    OP(SetGlobal,         0x24, "set_global",        ImmIndex, 0, 0, 0)        \
+    OP(Loadi32,           0x28, "i32.load",          ImmMem32, I32, 0, I32)    \
+    OP(Loadi64,           0x29, "i64.load",          ImmMem64, I32, 0, I64)    \
+    OP(Loadf32,           0x2a, "f32.load",          ImmMem32, I32, 0, F32)    \
+    OP(Loadf64,           0x2b, "f64.load",          ImmMem64, I32, 0, F64)    \
+    OP(Loadi32x8s,        0x2c, "i32.load8_s",       ImmMem8,  I32, 0, I32)    \
+    OP(Loadi32x8u,        0x2d, "i32.load8_u",       ImmMem8,  I32, 0, I32)    \
+    OP(Loadi32x16s,       0x2e, "i32.load16_s",      ImmMem16, I32, 0, I32)    \
+    OP(Loadi32x16u,       0x2f, "i32.load16_u",      ImmMem16, I32, 0, I32)    \
+    OP(Loadi64x8s,        0x30, "i64.load8_s",       ImmMem8,  I32, 0, I64)    \
+    OP(Loadi64x8u,        0x31, "i64.load8_u",       ImmMem8,  I32, 0, I64)    \
+    OP(Loadi64x16s,       0x32, "i64.load16_s",      ImmMem16, I32, 0, I64)    \
+    OP(Loadi64x16u,       0x33, "i64.load16_u",      ImmMem16, I32, 0, I64)    \
+    OP(Loadi64x32s,       0x34, "i64.load32_s",      ImmMem32, I32, 0, I64)    \
+    OP(Loadi64x32u,       0x35, "i64.load32_u",      ImmMem32, I32, 0, I64)    \
+    OP(Storei32,          0x36, "i32.store",         ImmMem32, I32, I32, 0)    \
+    OP(Storei64,          0x37, "i64.store",         ImmMem64, I32, I64, 0)    \
+    OP(Storef32,          0x38, "f32.store",         ImmMem32, I32, F32, 0)    \
+    OP(Storef64,          0x39, "f64.store",         ImmMem64, I32, F64, 0)    \
+    OP(Storei32x8,        0x3a, "i32.store8",        ImmMem8,  I32, I32, 0)    \
+    OP(Storei32x16,       0x3b, "i32.store16",       ImmMem16, I32, I32, 0)    \
+    OP(Storei64x8,        0x3c, "i64.store8",        ImmMem8,  I32, I64, 0)    \
+    OP(Storei64x16,       0x3d, "i64.store16",       ImmMem16, I32, I64, 0)    \
+    OP(Storei64x32,       0x3e, "i64.store32",       ImmMem32, I32, I64, 0)    \
+    OP(CurrentMemory,     0x3f, "current_memory",    ImmReserved, 0, 0, I32)   \
+    OP(GrowMemory,        0x40, "grow_memory",       ImmReserved, I32, 0, I32) \
+    OP(i32const,          0x41, "i32.const",         ImmI32,   0, 0, I32)      \
+    OP(i64const,          0x42, "i64.const",         ImmI64,   0, 0, I64)      \
+    OP(f32const,          0x43, "f32.const",         ImmF32,   0, 0, F32)      \
+    OP(f64const,          0x44, "f64.const",         ImmF64,   0, 0, F64)      \
+    OP(i32eqz,            0x45, "i32.eqz",           ImmNone,  I32, 0, I32)    \
+    OP(i32eq,             0x46, "i32.eq",            ImmNone,  I32, I32, I32)  \
+    OP(i32ne,             0x47, "i32.ne",            ImmNone,  I32, I32, I32)  \
+    OP(i32lts,            0x48, "i32.lt_s",          ImmNone,  I32, I32, I32)  \
+    OP(i32ltu,            0x49, "i32.lt_u",          ImmNone,  I32, I32, I32)  \
+    OP(i32gts,            0x4a, "i32.gt_s",          ImmNone,  I32, I32, I32)  \
+    OP(i32gtu,            0x4b, "i32.gt_u",          ImmNone,  I32, I32, I32)  \
+    OP(i32les,            0x4c, "i32.le_s",          ImmNone,  I32, I32, I32)  \
+    OP(i32leu,            0x4d, "i32.le_u",          ImmNone,  I32, I32, I32)  \
+    OP(i32ges,            0x4e, "i32.ge_s",          ImmNone,  I32, I32, I32)  \
+    OP(i32geu,            0x4f, "i32.ge_u",          ImmNone,  I32, I32, I32)  \
+    OP(i64eqz,            0x50, "i64.eqz",           ImmNone,  I64, 0, I32)    \
+    OP(i64eq,             0x51, "i64.eq",            ImmNone,  I64, I64, I32)  \
+    OP(i64ne,             0x52, "i64.ne",            ImmNone,  I64, I64, I32)  \
+    OP(i64lts,            0x53, "i64.lt_s",          ImmNone,  I64, I64, I32)  \
+    OP(i64ltu,            0x54, "i64.lt_u",          ImmNone,  I64, I64, I32)  \
+    OP(i64gts,            0x55, "i64.gt_s",          ImmNone,  I64, I64, I32)  \
+    OP(i64gtu,            0x56, "i64.gt_u",          ImmNone,  I64, I64, I32)  \
+    OP(i64les,            0x57, "i64.le_s",          ImmNone,  I64, I64, I32)  \
+    OP(i64leu,            0x58, "i64.le_u",          ImmNone,  I64, I64, I32)  \
+    OP(i64ges,            0x59, "i64.ge_s",          ImmNone,  I64, I64, I32)  \
+    OP(i64geu,            0x5a, "i64.ge_u",          ImmNone,  I64, I64, I32)  \
+    OP(f32eq,             0x5b, "f32.eq",            ImmNone,  F32, F32, I32)  \
+    OP(f32ne,             0x5c, "f32.ne",            ImmNone,  F32, F32, I32)  \
+    OP(f32lt,             0x5d, "f32.lt",            ImmNone,  F32, F32, I32)  \
+    OP(f32gt,             0x5e, "f32.gt",            ImmNone,  F32, F32, I32)  \
+    OP(f32le,             0x5f, "f32.le",            ImmNone,  F32, F32, I32)  \
+    OP(f32ge,             0x60, "f32.ge",            ImmNone,  F32, F32, I32)  \
+    OP(f64eq,             0x61, "f64.eq",            ImmNone,  F64, F64, I32)  \
+    OP(f64ne,             0x62, "f64.ne",            ImmNone,  F64, F64, I32)  \
+    OP(f64lt,             0x63, "f64.lt",            ImmNone,  F64, F64, I32)  \
+    OP(f64gt,             0x64, "f64.gt",            ImmNone,  F64, F64, I32)  \
+    OP(f64le,             0x65, "f64.le",            ImmNone,  F64, F64, I32)  \
+    OP(f64ge,             0x66, "f64.ge",            ImmNone,  F64, F64, I32)  \
+    OP(i32clz,            0x67, "i32.clz",           ImmNone,  I32, 0, I32)    \
+    OP(i32ctz,            0x68, "i32.ctz",           ImmNone,  I32, 0, I32)    \
+    OP(i32popcnt,         0x69, "i32.popcnt",        ImmNone,  I32, 0, I32)    \
+    OP(i32add,            0x6a, "i32.add",           ImmNone,  I32, I32, I32)  \
+    OP(i32sub,            0x6b, "i32.sub",           ImmNone,  I32, I32, I32)  \
+    OP(i32mul,            0x6c, "i32.mul",           ImmNone,  I32, I32, I32)  \
+    OP(i32divs,           0x6d, "i32.div_s",         ImmNone,  I32, I32, I32)  \
+    OP(i32divu,           0x6e, "i32.div_u",         ImmNone,  I32, I32, I32)  \
+    OP(i32rems,           0x6f, "i32.rem_s",         ImmNone,  I32, I32, I32)  \
+    OP(i32remu,           0x70, "i32.rem_u",         ImmNone,  I32, I32, I32)  \
+    OP(i32and,            0x71, "i32.and",           ImmNone,  I32, I32, I32)  \
+    OP(i32or,             0x72, "i32.or",            ImmNone,  I32, I32, I32)  \
+    OP(i32xor,            0x73, "i32.xor",           ImmNone,  I32, I32, I32)  \
+    OP(i32shl,            0x74, "i32.shl",           ImmNone,  I32, I32, I32)  \
+    OP(i32shrs,           0x75, "i32.shr_s",         ImmNone,  I32, I32, I32)  \
+    OP(i32shru,           0x76, "i32.shr_u",         ImmNone,  I32, I32, I32)  \
+    OP(i32rotl,           0x77, "i32.rotl",          ImmNone,  I32, I32, I32)  \
+    OP(i32rotr,           0x78, "i32.rotr",          ImmNone,  I32, I32, I32)  \
+    OP(i64clz,            0x79, "i64.clz",           ImmNone,  I64, 0, I64)    \
+    OP(i64ctz,            0x7a, "i64.ctz",           ImmNone,  I64, 0, I64)    \
+    OP(i64popcnt,         0x7b, "i64.popcnt",        ImmNone,  I64, 0, I64)    \
+    OP(i64add,            0x7c, "i64.add",           ImmNone,  I64, I64, I64)  \
+    OP(i64sub,            0x7d, "i64.sub",           ImmNone,  I64, I64, I64)  \
+    OP(i64mul,            0x7e, "i64.mul",           ImmNone,  I64, I64, I64)  \
+    OP(i64divs,           0x7f, "i64.div_s",         ImmNone,  I64, I64, I64)  \
+    OP(i64divu,           0x80, "i64.div_u",         ImmNone,  I64, I64, I64)  \
+    OP(i64rems,           0x81, "i64.rem_s",         ImmNone,  I64, I64, I64)  \
+    OP(i64remu,           0x82, "i64.rem_u",         ImmNone,  I64, I64, I64)  \
+    OP(i64and,            0x83, "i64.and",           ImmNone,  I64, I64, I64)  \
+    OP(i64or,             0x84, "i64.or",            ImmNone,  I64, I64, I64)  \
+    OP(i64xor,            0x85, "i64.xor",           ImmNone,  I64, I64, I64)  \
+    OP(i64shl,            0x86, "i64.shl",           ImmNone,  I64, I64, I64)  \
+    OP(i64shrs,           0x87, "i64.shr_s",         ImmNone,  I64, I64, I64)  \
+    OP(i64shru,           0x88, "i64.shr_u",         ImmNone,  I64, I64, I64)  \
+    OP(i64rotl,           0x89, "i64.rotl",          ImmNone,  I64, I64, I64)  \
+    OP(i64rotr,           0x8a, "i64.rotr",          ImmNone,  I64, I64, I64)  \
+    OP(f32abs,            0x8b, "f32.abs",           ImmNone,  F32, 0, F32)    \
+    OP(f32neg,            0x8c, "f32.neg",           ImmNone,  F32, 0, F32)    \
+    OP(f32ceil,           0x8d, "f32.ceil",          ImmNone,  F32, 0, F32)    \
+    OP(f32floor,          0x8e, "f32.floor",         ImmNone,  F32, 0, F32)    \
+    OP(f32trunc,          0x8f, "f32.trunc",         ImmNone,  F32, 0, F32)    \
+    OP(f32nearest,        0x90, "f32.nearest",       ImmNone,  F32, 0, F32)    \
+    OP(f32sqrt,           0x91, "f32.sqrt",          ImmNone,  F32, 0, F32)    \
+    OP(f32add,            0x92, "f32.add",           ImmNone,  F32, F32, F32)  \
+    OP(f32sub,            0x93, "f32.sub",           ImmNone,  F32, F32, F32)  \
+    OP(f32mul,            0x94, "f32.mul",           ImmNone,  F32, F32, F32)  \
+    OP(f32div,            0x95, "f32.div",           ImmNone,  F32, F32, F32)  \
+    OP(f32min,            0x96, "f32.min",           ImmNone,  F32, F32, F32)  \
+    OP(f32max,            0x97, "f32.max",           ImmNone,  F32, F32, F32)  \
+    OP(f32copysign,       0x98, "f32.copysign",      ImmNone,  F32, F32, F32)  \
+    OP(f64abs,            0x99, "f64.abs",           ImmNone,  F64, 0, F64)    \
+    OP(f64neg,            0x9a, "f64.neg",           ImmNone,  F64, 0, F64)    \
+    OP(f64ceil,           0x9b, "f64.ceil",          ImmNone,  F64, 0, F64)    \
+    OP(f64floor,          0x9c, "f64.floor",         ImmNone,  F64, 0, F64)    \
+    OP(f64trunc,          0x9d, "f64.trunc",         ImmNone,  F64, 0, F64)    \
+    OP(f64nearest,        0x9e, "f64.nearest",       ImmNone,  F64, 0, F64)    \
+    OP(f64sqrt,           0x9f, "f64.sqrt",          ImmNone,  F64, 0, F64)    \
+    OP(f64add,            0xa0, "f64.add",           ImmNone,  F64, F64, F64)  \
+    OP(f64sub,            0xa1, "f64.sub",           ImmNone,  F64, F64, F64)  \
+    OP(f64mul,            0xa2, "f64.mul",           ImmNone,  F64, F64, F64)  \
+    OP(f64div,            0xa3, "f64.div",           ImmNone,  F64, F64, F64)  \
+    OP(f64min,            0xa4, "f64.min",           ImmNone,  F64, F64, F64)  \
+    OP(f64max,            0xa5, "f64.max",           ImmNone,  F64, F64, F64)  \
+    OP(f64copysign,       0xa6, "f64.copysign",      ImmNone,  F64, F64, F64)  \
+    OP(i32wrapi64,        0xa7, "i32.wrap/i64",      ImmNone,  I64, 0, I32)    \
+    OP(i32truncsf32,      0xa8, "i32.trunc_s/f32",   ImmNone,  F32, 0, I32)    \
+    OP(i32truncuf32,      0xa9, "i32.trunc_u/f32",   ImmNone,  F32, 0, I32)    \
+    OP(i32truncsf64,      0xaa, "i32.trunc_s/f64",   ImmNone,  F64, 0, I32)    \
+    OP(i32truncuf64,      0xab, "i32.trunc_u/f64",   ImmNone,  F64, 0, I32)    \
+    OP(i64extendsi32,     0xac, "i64.extend_s/i32",  ImmNone,  I32, 0, I64)    \
+    OP(i64extendui32,     0xad, "i64.extend_u/i32",  ImmNone,  I32, 0, I64)    \
+    OP(i64truncsf32,      0xae, "i64.trunc_s/f32",   ImmNone,  F32, 0, I64)    \
+    OP(i64truncuf32,      0xaf, "i64.trunc_u/f32",   ImmNone,  F32, 0, I64)    \
+    OP(i64truncsf64,      0xb0, "i64.trunc_s/f64",   ImmNone,  F64, 0, I64)    \
+    OP(i64truncuf64,      0xb1, "i64.trunc_u/f64",   ImmNone,  F64, 0, I64)    \
+    OP(f32convertsi32,    0xb2, "f32.convert_s/i32", ImmNone,  I32, 0, F32)    \
+    OP(f32convertui32,    0xb3, "f32.convert_u/i32", ImmNone,  I32, 0, F32)    \
+    OP(f32convertsi64,    0xb4, "f32.convert_s/i64", ImmNone,  I64, 0, F32)    \
+    OP(f32convertui64,    0xb5, "f32.convert_u/i64", ImmNone,  I64, 0, F32)    \
+    OP(f32demotef64,      0xb6, "f32.demote/f64",    ImmNone,  F64, 0, F32)    \
+    OP(f64convertsi32,    0xb7, "f64.convert_s/i32", ImmNone,  I32, 0, F64)    \
+    OP(f64convertui32,    0xb8, "f64.convert_u/i32", ImmNone,  I32, 0, F64)    \
+    OP(f64convertsi64,    0xb9, "f64.convert_s/i64", ImmNone,  I64, 0, F64)    \
+    OP(f64convertui64,    0xba, "f64.convert_u/i64", ImmNone,  I64, 0, F64)    \
+    OP(f64promotef32,     0xbb, "f64.promote/f32",   ImmNone,  F32, 0, F64)    \
+    OP(i32reinterpretf32, 0xbc, "i32.reinterpret/f32", ImmNone,  F32, 0, I32)  \
+    OP(i64reinterpretf64, 0xbd, "i64.reinterpret/f64", ImmNone,  F64, 0, I64)  \
+    OP(f32reinterpreti32, 0xbe, "f32.reinterpret/i32", ImmNone,  I32, 0, F32)  \
+    OP(f64reinterpreti64, 0xbf, "f64.reinterpret/i64", ImmNone,  I64, 0, F64)
+
+
 typedef enum {
-    OpgetGlobal     = 0x23,
+#define OP(name, code, mnemonic, imm, in1, in2, out)                          \
+    Op##name = code,
 
-    Opi32const      = 0x41,
-    Opi64const,
-    Opf32const,
-    Opf64const,
+    OPCODES(OP)
+
+#undef OP
 } Opcode;
 
 
+typedef struct {
+    const char      *name;      /* NULL for unassigned opcodes */
+    u8              imm;
+    u8              in1;
+    u8              in2;
+    u8              out;
+} OpInfo;
+
+
+extern const OpInfo  opinfo[256];
+
+
+Error *skipimm(u8 **p, const u8 *end, u8 op);
+Error *decodeimm(u8 **p, const u8 *end, u8 op, Imm *imm);
+u8 isbranch(u8 op);
+u8 istarget(u8 op);
+
 #endif
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include "opcodes.h"
+#include "test.h"
+
+
+typedef struct {
+    u8          code[16];
+    u8          size;       /* of code, opcode included */
+    Imm         want;
+} Testcase;
+
+
+static Error *test_table(void);
+static Error *test_decodeimm(const Testcase *tc);
+static Error *test_malformed(void);
+
+
+static const Testcase  cases[] = {
+    {{OpNop}, 1, {0}},
+    {{OpBlock, 0x7f}, 2, {.index = 0x7f, .block = 0x7f}},
+    {{OpCall, 0xe5, 0x8e, 0x26}, 4, {.index = 624485}},
+    {{OpBrTable, 0x02, 0x00, 0x01, 0x03}, 5,
+     {.index = 3, .ntargets = 2}},
+    {{OpCallIndirect, 0x02, 0x00}, 3, {.index = 2}},
+    {{OpLoadi64, 0x03, 0x80, 0x01}, 4, {.align = 3, .offset = 128}},
+    {{OpGrowMemory, 0x00}, 2, {0}},
+    {{Opi32const, 0x7f}, 2, {.value = (u64) -1}},
+    {{Opi64const, 0x80, 0x7f}, 3, {.value = (u64) -128}},
+    {{Opf32const, 0x00, 0x00, 0x80, 0x3f}, 5, {.value = 0x3f800000}},
+    {{Opf64const, 0, 0, 0, 0, 0, 0, 0xf0, 0x3f}, 9,
+     {.value = 0x3ff0000000000000}},
+    {{Opf64reinterpreti64}, 1, {0}},
+};
+
+
+int
+main()
+{
+    u32    i;
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_table();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    for (i = 0; i < nitems(cases); i++) {
+        err = test_decodeimm(&cases[i]);
+        if (slow(err != NULL)) {
+            goto fail;
+        }
+    }
+
+    err = test_malformed();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+/*
+ * The MVP has 172 opcodes, and the rows of the table carry the fixed stack
+ * effects the validator relies on.
+ */
+static Error *
+test_table(void)
+{
+    u32  op, n;
+
+    n = 0;
+
+    for (op = 0; op < 256; op++) {
+        n += (opinfo[op].name != NULL);
+    }
+
+    if (slow(n != 172)) {
+        return newerror("%d opcodes in the table, expected 172", n);
+    }
+
+    if (slow(strcmp(opinfo[Opi64extendui32].name, "i64.extend_u/i32") != 0
+             || opinfo[Opi64extendui32].in1 != I32
+             || opinfo[Opi64extendui32].out != I64))
+    {
+        return newerror("wrong row for i64.extend_u/i32");
+    }
+
+    if (slow(opinfo[OpStorei64x16].imm != ImmMem16
+             || opinfo[OpStorei64x16].in1 != I32
+             || opinfo[OpStorei64x16].in2 != I64
+             || opinfo[OpStorei64x16].out != 0))
+    {
+        return newerror("wrong row for i64.store16");
+    }
+
+    if (slow(opinfo[0x06].name != NULL || opinfo[0xc0].name != NULL)) {
+        return newerror("unassigned opcodes in the table");
+    }
+
+    return NULL;
+}
+
+
+static Error *
+test_decodeimm(const Testcase *tc)
+{
+    u8     *p;
+    Imm    imm;
+    Error  *err;
+
+    memset(&imm, 0, sizeof(Imm));
+
+    p = (u8 *) tc->code + 1;
+
+    err = decodeimm(&p, tc->code + tc->size, tc->code[0], &imm);
+    if (slow(err != NULL)) {
+        return error(err, "decoding %s", opinfo[tc->code[0]].name);
+    }
+
+    if (slow(p != tc->code + tc->size)) {
+        return newerror("%s: %d bytes consumed, expected %d",
+                        opinfo[tc->code[0]].name, p - tc->code, tc->size);
+    }
+
+    if (slow(imm.index != tc->want.index || imm.align != tc->want.align
+             || imm.offset != tc->want.offset
+             || imm.ntargets != tc->want.ntargets
+             || imm.value != tc->want.value || imm.block != tc->want.block))
+    {
+        return newerror("%s: wrong immediates", opinfo[tc->code[0]].name);
+    }
+
+    if (slow(imm.ntargets > 0 && imm.targets != tc->code + 2)) {
+        return newerror("br_table targets not pointing past the count");
+    }
+
+    return NULL;
+}
+
+
+static Error *
+test_malformed(void)
+{
+    u8     *p;
+    Imm    imm;
+    Error  *err;
+
+    static const u8  truncated[] = {Opf64const, 0x00, 0x00, 0x00};
+    static const u8  unassigned[] = {0xc0};
+
+    p = (u8 *) truncated + 1;
+
+    err = decodeimm(&p, truncated + sizeof(truncated), truncated[0], &imm);
+    if (slow(err == NULL || !iserror(err, "malformed float constant"))) {
+        return error(err, "expected a malformed float constant");
+    }
+
+    errorfree(err);
+
+    p = (u8 *) unassigned + 1;
+
+    err = decodeimm(&p, unassigned + 1, unassigned[0], &imm);
+    if (slow(err == NULL || !iserror(err, "opcode 0xc0 not supported"))) {
+        return error(err, "expected opcode 0xc0 to be unsupported");
+    }
+
+    errorfree(err);
+
+    return NULL;
+}
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/memory.h>
+#include <oak/instance.h>
+#include <oak/pool.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+static Error *acquire(Pool *pool, Instance *inst, Module *m);
+static Error *checklimits(Pool *pool, Module *m);
+
+
+Error *
+newpool(Pool *pool, u32 nslots, u32 maxtable, u32 maxglobals)
+{
+    u32             i;
+    u64             pagesize;
+    Error           *err;
+    ResizableLimit  empty;
+
+    memset(pool, 0, sizeof(Pool));
+
+    pagesize = getpagesize();
+
+    pool->nslots = nslots;
+    pool->maxtable = maxtable;
+    pool->maxglobals = maxglobals;
+    pool->stride = ((((u64) maxtable * sizeof(u32) + 7) & ~7)
+                    + (u64) maxglobals * sizeof(u64) + pagesize - 1)
+                   & ~(pagesize - 1);
+
+    pool->memories = zmalloc(sizeof(LinearMemory) * nslots);
+    pool->free = memalloc(sizeof(u32) * nslots);
+
+    if (slow(pool->memories == NULL || pool->free == NULL)) {
+        err = newerror("failed to allocate pool: %s", strerror(errno));
+        goto fail;
+    }
+
+    if (pool->stride > 0) {
+        pool->state = mmap(NULL, pool->stride * nslots,
+                           PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (slow(pool->state == MAP_FAILED)) {
+            pool->state = NULL;
+            err = newerror("failed to reserve pool state: %s",
+                           strerror(errno));
+            goto fail;
+        }
+    }
+
+    empty.flags = 0;
+    empty.initial = 0;
+
+    for (i = 0; i < nslots; i++) {
+        err = newmemory(&pool->memories[i], &empty);
+        if (slow(err != NULL)) {
+            err = error(err, "reserving pool slot %d", i);
+            goto fail;
+        }
+    }
+
+    /* hand out low slots first */
+
+    for (i = 0; i < nslots; i++) {
+        pool->free[i] = nslots - i - 1;
+    }
+
+    pool->nfree = nslots;
+
+    return NULL;
+
+fail:
+
+    closepool(pool);
+    return err;
+}
+
+
+Error *
+poolinstantiate(Pool *pool, Instance *inst, Module *m)
+{
+    Error       *err;
+    TableDecl   *table;
+    MemoryDecl  *decl;
+
+    err = acquire(pool, inst, m);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    if (m->tables != NULL && len(m->tables) > 0) {
+        table = arrayget(m->tables, 0);
+        inst->tablesize = table->limit.initial;
+    }
+
+    inst->nglobals = len(m->globals);
+
+    if (m->memories != NULL && len(m->memories) > 0) {
+        decl = arrayget(m->memories, 0);
+
+        inst->hasmemory = 1;
+
+        err = limitmemory(&inst->memory, &decl->limit);
+        if (slow(err != NULL)) {
+            poolrelease(pool, inst);
+            return error(err, "instantiating memory");
+        }
+    }
+
+    err = initinstance(inst);
+    if (slow(err != NULL)) {
+        poolrelease(pool, inst);
+        return err;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Like clonesnapshot(), but into a pool slot.
+ */
+Error *
+poolclone(Pool *pool, Instance *inst, const Snapshot *snap)
+{
+    Error  *err;
+
+    err = acquire(pool, inst, snap->module);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    inst->tablesize = snap->tablesize;
+    inst->nglobals = snap->nglobals;
+
+    if (snap->tablesize > 0) {
+        memcpy(inst->table, snap->table, sizeof(u32) * snap->tablesize);
+    }
+
+    if (snap->nglobals > 0) {
+        memcpy(inst->globals, snap->globals, sizeof(u64) * snap->nglobals);
+    }
+
+    if (snap->fd >= 0) {
+        inst->hasmemory = 1;
+        inst->memory.maximum = snap->maximum;
+
+        err = mapmemory(&inst->memory, snap->fd, snap->pages);
+        if (slow(err != NULL)) {
+            poolrelease(pool, inst);
+            return error(err, "cloning snapshot");
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Returns the slot of `inst` to the pool, zeroing everything it touched.
+ * Committed memory pages stay committed, so an instance of the same module
+ * gets its slot back without changing any protection.  Table and globals
+ * are cleared with memset when they fit in a page.  A slot whose memory
+ * can't be reset gets a new reservation, and without one it is dropped,
+ * as counted in ndropped.
+ */
+void
+poolrelease(Pool *pool, Instance *inst)
+{
+    u8              *state;
+    u64             used;
+    Error           *err;
+    ResizableLimit  empty;
+
+    expect(inst->pool == pool);
+
+    inst->pool = NULL;
+
+    closemodule(inst->module);
+    inst->module = NULL;
+
+    err = resetmemory(&inst->memory);
+    if (slow(err != NULL)) {
+        errorfree(err);
+
+        closememory(&inst->memory);
+
+        empty.flags = 0;
+        empty.initial = 0;
+
+        err = newmemory(&inst->memory, &empty);
+        if (slow(err != NULL)) {
+            errorfree(err);
+
+            pool->memories[inst->slot] = inst->memory;
+            pool->ndropped++;
+
+            inst->hasmemory = 0;
+            inst->table = NULL;
+            inst->globals = NULL;
+            return;
+        }
+    }
+
+    pool->memories[inst->slot] = inst->memory;
+
+    if (pool->stride > 0) {
+        state = pool->state + inst->slot * pool->stride;
+        used = (u8 *) (inst->globals + inst->nglobals) - state;
+
+        if (used > (u64) getpagesize()) {
+            madvise(state, pool->stride, MADV_DONTNEED);
+
+        } else {
+            memset(inst->table, 0, sizeof(u32) * inst->tablesize);
+            memset(inst->globals, 0, sizeof(u64) * inst->nglobals);
+        }
+    }
+
+    pool->free[pool->nfree++] = inst->slot;
+
+    inst->hasmemory = 0;
+    inst->table = NULL;
+    inst->globals = NULL;
+}
+
+
+void
+closepool(Pool *pool)
+{
+    u32  i;
+
+    if (pool->memories != NULL) {
+        for (i = 0; i < pool->nslots; i++) {
+            closememory(&pool->memories[i]);
+        }
+    }
+
+    if (pool->state != NULL) {
+        munmap(pool->state, pool->stride * pool->nslots);
+    }
+
+    memfree(pool->memories);
+    memfree(pool->free);
+
+    pool->memories = NULL;
+    pool->free = NULL;
+    pool->state = NULL;
+    pool->nslots = 0;
+    pool->nfree = 0;
+    pool->ndropped = 0;
+}
+
+
+/*
+ * Takes a free slot for an instance of `m`, with zeroed table and globals.
+ */
+static Error *
+acquire(Pool *pool, Instance *inst, Module *m)
+{
+    u32    slot;
+    u8     *state;
+    Error  *err;
+
+    err = checklimits(pool, m);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    if (slow(pool->nfree == 0)) {
+        return newerror("pool exhausted (%d slots)", pool->nslots);
+    }
+
+    slot = pool->free[--pool->nfree];
+    state = pool->state + slot * pool->stride;
+
+    memset(inst, 0, sizeof(Instance));
+
+    inst->module = acquiremodule(m);
+    inst->pool = pool;
+    inst->slot = slot;
+    inst->memory = pool->memories[slot];
+
+    inst->table = (u32 *) state;
+    inst->globals = (u64 *) (state + (((u64) pool->maxtable * sizeof(u32)
+                                       + 7) & ~7));
+
+    return NULL;
+}
+
+
+static Error *
+checklimits(Pool *pool, Module *m)
+{
+    TableDecl  *table;
+
+    if (m->tables != NULL && len(m->tables) > 0) {
+        table = arrayget(m->tables, 0);
+
+        if (slow(table->limit.initial > pool->maxtable)) {
+            return newerror("table of %d entries exceeds pool limit of %d",
+                            table->limit.initial, pool->maxtable);
+        }
+    }
+
+    if (slow(m->nimportglobals > 0)) {
+        return newerror("pools do not take imported globals");
+    }
+
+    if (slow(len(m->globals) > pool->maxglobals)) {
+        return newerror("%d globals exceed pool limit of %d",
+                        len(m->globals), pool->maxglobals);
+    }
+
+    return NULL;
+}
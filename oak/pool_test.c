@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/memory.h>
+#include <oak/instance.h>
+#include <oak/pool.h>
+#include "test.h"
+
+
+static Error *test_recycle();
+static Error *test_mapped();
+static Error *test_limits();
+static Error *checksmall(Instance *inst);
+
+
+int
+main()
+{
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    err = test_recycle();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_mapped();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_limits();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+test_recycle()
+{
+    u32       slot;
+    Pool      pool;
+    Error     *err;
+    Module    *m;
+    Instance  a, b, c;
+
+    err = loadmodule(&m, "testdata/ok/small.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = newpool(&pool, 2, 16, 8);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        return err;
+    }
+
+    err = poolinstantiate(&pool, &a, m);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    err = checksmall(&a);
+    if (slow(err != NULL)) {
+        closeinstance(&a);
+        goto done;
+    }
+
+    a.memory.base[100] = 1;
+    a.table[0] = 5;
+    a.globals[0] = 7;
+    growmemory(&a.memory, 1);
+
+    slot = a.slot;
+
+    err = poolinstantiate(&pool, &b, m);
+    if (slow(err != NULL)) {
+        closeinstance(&a);
+        goto done;
+    }
+
+    err = poolinstantiate(&pool, &c, m);
+    if (slow(err == NULL || !iserror(err, "pool exhausted (2 slots)"))) {
+        err = error(err, "third instance must exhaust the pool");
+        goto release;
+    }
+
+    errorfree(err);
+
+    closeinstance(&a);
+
+    err = poolinstantiate(&pool, &a, m);
+    if (slow(err != NULL)) {
+        goto release;
+    }
+
+    if (slow(a.slot != slot)) {
+        err = newerror("released slot %d not reused (got %d)", slot, a.slot);
+        goto release;
+    }
+
+    err = checksmall(&a);
+    if (slow(err != NULL)) {
+        goto release;
+    }
+
+    if (slow(a.memory.base[100] != 0 || a.memory.pages != 1)) {
+        err = newerror("recycled memory not reset");
+    }
+
+release:
+
+    closeinstance(&a);
+    closeinstance(&b);
+
+done:
+
+    closepool(&pool);
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+checksmall(Instance *inst)
+{
+    u32  i;
+
+    if (slow(!inst->hasmemory || inst->memory.pages != 1
+             || inst->memory.maximum != 4))
+    {
+        return newerror("bad memory (%d pages, maximum %d)",
+                        inst->memory.pages, inst->memory.maximum);
+    }
+
+    if (slow(memcmp(inst->memory.base + 16, "hello", 5) != 0)) {
+        return newerror("data segment not applied");
+    }
+
+    if (slow(inst->tablesize != 4)) {
+        return newerror("table size %d != 4", inst->tablesize);
+    }
+
+    for (i = 0; i < inst->tablesize; i++) {
+        if (slow(inst->table[i] != 0)) {
+            return newerror("table entry %d not null", i);
+        }
+    }
+
+    if (slow(inst->nglobals != 3
+             || inst->globals[0] != 42
+             || inst->globals[1] != 0xffffffffffffffff
+             || inst->globals[2] != 0x3ff8000000000000))
+    {
+        return newerror("bad globals");
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Pages mapped from the module file must not come back with the previous
+ * instance's writes, nor with file contents where there was none.
+ */
+static Error *
+test_mapped()
+{
+    u32       i;
+    Pool      pool;
+    Error     *err;
+    Module    *m;
+    Instance  inst;
+
+    err = loadmodule(&m, "testdata/ok/datas.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = newpool(&pool, 1, 0, 0);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        return err;
+    }
+
+    for (i = 0; i < 2; i++) {
+        err = poolinstantiate(&pool, &inst, m);
+        if (slow(err != NULL)) {
+            break;
+        }
+
+        if (slow(inst.memory.base[8192 + 4096] != 4096 % 251)) {
+            err = newerror("round %d: mapped page has %d", i,
+                           inst.memory.base[8192 + 4096]);
+            closeinstance(&inst);
+            break;
+        }
+
+        inst.memory.base[8192 + 4096] = 0xff;
+
+        closeinstance(&inst);
+    }
+
+    closepool(&pool);
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+test_limits()
+{
+    Pool      pool;
+    Error     *err;
+    Module    *m;
+    Instance  inst;
+
+    err = loadmodule(&m, "testdata/ok/small.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = newpool(&pool, 1, 16, 2);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        return err;
+    }
+
+    err = poolinstantiate(&pool, &inst, m);
+    if (slow(err == NULL)) {
+        closeinstance(&inst);
+        err = newerror("module above pool limits must fail");
+        goto done;
+    }
+
+    if (slow(!iserror(err, "3 globals exceed pool limit of 2"))) {
+        err = error(err, "unexpected error");
+        goto done;
+    }
+
+    errorfree(err);
+    err = NULL;
+
+done:
+
+    closepool(&pool);
+    closemodule(m);
+
+    return err;
+}
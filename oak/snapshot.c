@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#define _GNU_SOURCE     /* memfd_create */
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/memory.h>
+#include <oak/instance.h>
+#include <oak/snapshot.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+static Error *writeimage(int fd, const u8 *base, u64 size);
+static u8 iszero(const u8 *p, u64 size);
+
+
+Error *
+takesnapshot(Snapshot *snap, const Instance *inst)
+{
+    Error  *err;
+
+    memset(snap, 0, sizeof(Snapshot));
+
+    snap->module = acquiremodule(inst->module);
+    snap->fd = -1;
+    snap->tablesize = inst->tablesize;
+    snap->nglobals = inst->nglobals;
+
+    if (inst->hasmemory) {
+        snap->pages = inst->memory.pages;
+        snap->maximum = inst->memory.maximum;
+
+        snap->fd = memfd_create("oak-snapshot", MFD_CLOEXEC);
+        if (slow(snap->fd < 0)) {
+            err = newerror("failed to create memfd: %s", strerror(errno));
+            closesnapshot(snap);
+            return err;
+        }
+
+        err = writeimage(snap->fd, inst->memory.base,
+                         (u64) snap->pages * WASM_PAGE_SIZE);
+        if (slow(err != NULL)) {
+            closesnapshot(snap);
+            return err;
+        }
+    }
+
+    if (snap->tablesize > 0) {
+        snap->table = memalloc(sizeof(u32) * snap->tablesize);
+        if (slow(snap->table == NULL)) {
+            closesnapshot(snap);
+            return newerror("failed to allocate table: %s", strerror(errno));
+        }
+
+        memcpy(snap->table, inst->table, sizeof(u32) * snap->tablesize);
+    }
+
+    if (snap->nglobals > 0) {
+        snap->globals = memalloc(sizeof(u64) * snap->nglobals);
+        if (slow(snap->globals == NULL)) {
+            closesnapshot(snap);
+            return newerror("failed to allocate globals: %s",
+                            strerror(errno));
+        }
+
+        memcpy(snap->globals, inst->globals, sizeof(u64) * snap->nglobals);
+    }
+
+    return NULL;
+}
+
+
+Error *
+clonesnapshot(const Snapshot *snap, Instance *inst)
+{
+    Error           *err;
+    ResizableLimit  limit;
+
+    memset(inst, 0, sizeof(Instance));
+
+    inst->module = acquiremodule(snap->module);
+    inst->tablesize = snap->tablesize;
+    inst->nglobals = snap->nglobals;
+
+    if (snap->fd >= 0) {
+        limit.flags = 1;
+        limit.initial = 0;
+        limit.maximum = snap->maximum;
+
+        err = newmemory(&inst->memory, &limit);
+        if (slow(err != NULL)) {
+            err = error(err, "cloning snapshot");
+            goto fail;
+        }
+
+        inst->hasmemory = 1;
+
+        err = mapmemory(&inst->memory, snap->fd, snap->pages);
+        if (slow(err != NULL)) {
+            err = error(err, "cloning snapshot");
+            goto fail;
+        }
+    }
+
+    if (inst->tablesize > 0) {
+        inst->table = memalloc(sizeof(u32) * inst->tablesize);
+        if (slow(inst->table == NULL)) {
+            err = newerror("failed to allocate table: %s", strerror(errno));
+            goto fail;
+        }
+
+        memcpy(inst->table, snap->table, sizeof(u32) * inst->tablesize);
+    }
+
+    if (inst->nglobals > 0) {
+        inst->globals = memalloc(sizeof(u64) * inst->nglobals);
+        if (slow(inst->globals == NULL)) {
+            err = newerror("failed to allocate globals: %s", strerror(errno));
+            goto fail;
+        }
+
+        memcpy(inst->globals, snap->globals, sizeof(u64) * inst->nglobals);
+    }
+
+    return NULL;
+
+fail:
+
+    closeinstance(inst);
+    return err;
+}
+
+
+void
+closesnapshot(Snapshot *snap)
+{
+    if (snap->fd >= 0) {
+        close(snap->fd);
+        snap->fd = -1;
+    }
+
+    memfree(snap->table);
+    memfree(snap->globals);
+
+    snap->table = NULL;
+    snap->globals = NULL;
+
+    if (snap->module != NULL) {
+        closemodule(snap->module);
+        snap->module = NULL;
+    }
+}
+
+
+/*
+ * Writes only the non-zero pages, so untouched memory stays a hole in the
+ * memfd and costs nothing.
+ */
+static Error *
+writeimage(int fd, const u8 *base, u64 size)
+{
+    u64      off, n, pagesize;
+    ssize_t  ret;
+
+    if (slow(ftruncate(fd, size) != 0)) {
+        return newerror("failed to size memfd: %s", strerror(errno));
+    }
+
+    pagesize = getpagesize();
+
+    for (off = 0; off < size; off += pagesize) {
+        if (iszero(base + off, pagesize)) {
+            continue;
+        }
+
+        for (n = 0; n < pagesize; n += ret) {
+            ret = pwrite(fd, base + off + n, pagesize - n, off + n);
+            if (slow(ret <= 0)) {
+                return newerror("failed to write memfd: %s", strerror(errno));
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+static u8
+iszero(const u8 *p, u64 size)
+{
+    u64        i;
+    const u64  *w;
+
+    w = (const u64 *) p;
+
+    for (i = 0; i < size / sizeof(u64); i++) {
+        if (w[i] != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/memory.h>
+#include <oak/instance.h>
+#include <oak/snapshot.h>
+#include <oak/pool.h>
+#include "test.h"
+
+
+static Error *test_clone(Snapshot *snap);
+static Error *test_poolclone(Snapshot *snap);
+static Error *checkclone(Instance *inst);
+
+
+int
+main()
+{
+    Error     *err;
+    Module    *m;
+    Instance  inst;
+    Snapshot  snap;
+
+    fmtadd('e', errorfmt);
+
+    err = loadmodule(&m, "testdata/ok/small.wasm");
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = instantiate(&inst, m);
+    if (slow(err != NULL)) {
+        closemodule(m);
+        goto fail;
+    }
+
+    /* state set up after instantiation must be part of the snapshot */
+
+    inst.memory.base[1000] = 9;
+    inst.table[1] = 3;
+    inst.globals[0] = 99;
+
+    err = takesnapshot(&snap, &inst);
+
+    closeinstance(&inst);
+
+    if (slow(err != NULL)) {
+        closemodule(m);
+        goto fail;
+    }
+
+    err = test_clone(&snap);
+    if (slow(err == NULL)) {
+        err = test_poolclone(&snap);
+    }
+
+    closesnapshot(&snap);
+    closemodule(m);
+
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+test_clone(Snapshot *snap)
+{
+    Error     *err;
+    Instance  a, b;
+
+    err = clonesnapshot(snap, &a);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = clonesnapshot(snap, &b);
+    if (slow(err != NULL)) {
+        closeinstance(&a);
+        return err;
+    }
+
+    err = checkclone(&a);
+    if (slow(err != NULL)) {
+        goto done;
+    }
+
+    /* writes are private to each clone */
+
+    a.memory.base[1000] = 10;
+    a.memory.base[16] = 'j';
+    a.globals[0] = 100;
+
+    err = checkclone(&b);
+    if (slow(err != NULL)) {
+        err = error(err, "clone saw a write of another clone");
+        goto done;
+    }
+
+    if (slow(growmemory(&b.memory, 1) != 1 || b.memory.base[65536] != 0)) {
+        err = newerror("clone memory must grow with zeroed pages");
+        goto done;
+    }
+
+    b.memory.base[65536] = 1;
+
+done:
+
+    closeinstance(&a);
+    closeinstance(&b);
+
+    return err;
+}
+
+
+static Error *
+test_poolclone(Snapshot *snap)
+{
+    u32       i;
+    Pool      pool;
+    Error     *err;
+    Instance  inst;
+
+    err = newpool(&pool, 1, 16, 8);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    for (i = 0; i < 2; i++) {
+        err = poolclone(&pool, &inst, snap);
+        if (slow(err != NULL)) {
+            break;
+        }
+
+        err = checkclone(&inst);
+
+        inst.memory.base[1000] = 10;
+        inst.globals[0] = 100;
+
+        closeinstance(&inst);
+
+        if (slow(err != NULL)) {
+            err = error(err, "round %d", i);
+            break;
+        }
+    }
+
+    closepool(&pool);
+
+    return err;
+}
+
+
+static Error *
+checkclone(Instance *inst)
+{
+    if (slow(!inst->hasmemory || inst->memory.pages != 1
+             || inst->memory.maximum != 4))
+    {
+        return newerror("bad memory (%d pages, maximum %d)",
+                        inst->memory.pages, inst->memory.maximum);
+    }
+
+    if (slow(memcmp(inst->memory.base + 16, "hello", 5) != 0
+             || inst->memory.base[1000] != 9))
+    {
+        return newerror("memory image not restored");
+    }
+
+    if (slow(inst->tablesize != 4 || inst->table[1] != 3)) {
+        return newerror("table not restored");
+    }
+
+    if (slow(inst->nglobals != 3 || inst->globals[0] != 99
+             || inst->globals[1] != 0xffffffffffffffff))
+    {
+        return newerror("globals not restored");
+    }
+
+    return NULL;
+}
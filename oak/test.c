@@ -3,6 +3,7 @@
  */
 
 #include <acorn.h>
+#include <dirent.h>
 #include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
@@ -12,6 +13,12 @@
 #include "test.h"
 
 
+#define TESTDATA    "testdata/ok"
+
+
+static int byname(const void *a, const void *b);
+
+
 /*
  * These functions must be used in tests.
  */
@@ -30,3 +37,80 @@ mustalloc(size_t size)
 
     return ptr;
 }
+
+
+/*
+ * The modules of testdata/ok, by name for the same order on every run, for
+ * the benches to run on.  The names and the list are freed with free().
+ */
+Error *
+testdata(char ***names, u32 *n)
+{
+    u32            i, max;
+    char           **list, **p;
+    DIR            *dir;
+    size_t         size;
+    struct dirent  *entry;
+
+    dir = opendir(TESTDATA);
+    if (slow(dir == NULL)) {
+        return newerror("failed to open " TESTDATA);
+    }
+
+    i = 0;
+    max = 16;
+
+    list = malloc(sizeof(char *) * max);
+
+    while (list != NULL && (entry = readdir(dir)) != NULL) {
+        size = strlen(entry->d_name);
+
+        if (size < 5 || strcmp(entry->d_name + size - 5, ".wasm") != 0) {
+            continue;
+        }
+
+        if (i == max) {
+            max *= 2;
+
+            p = realloc(list, sizeof(char *) * max);
+            if (slow(p == NULL)) {
+                break;
+            }
+
+            list = p;
+        }
+
+        list[i] = malloc(sizeof(TESTDATA) + size + 1);
+        if (slow(list[i] == NULL)) {
+            break;
+        }
+
+        snprintf(list[i++], sizeof(TESTDATA) + size + 1, TESTDATA "/%s",
+                 entry->d_name);
+    }
+
+    closedir(dir);
+
+    if (slow(list == NULL || entry != NULL)) {
+        while (i > 0) {
+            free(list[--i]);
+        }
+
+        free(list);
+        return newerror("failed to list " TESTDATA);
+    }
+
+    qsort(list, i, sizeof(char *), byname);
+
+    *names = list;
+    *n = i;
+
+    return NULL;
+}
+
+
+static int
+byname(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
@@ -10,6 +10,7 @@
 
 
 void *mustalloc(size_t size);
+Error *testdata(char ***names, u32 *n);
 
 
 #endif /* _OAK_TEST_H_ */
@@ -0,0 +1,7 @@
+;; loads an i32 with an alignment of 8 bytes
+(module
+  (memory 1)
+  (func (result i32)
+    i32.const 0
+    i32.load align=8)
+)
@@ -0,0 +1,13 @@
+;; br_table to labels taking different types
+(module
+  (func (param i32) (result i32)
+    block (result i32)
+      block (result i64)
+        i32.const 0
+        get_local 0
+        br_table 0 1
+      end
+      drop
+      i32.const 1
+    end)
+)
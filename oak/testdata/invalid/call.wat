@@ -0,0 +1,5 @@
+;; calls a function not in the index space
+(module
+  (func
+    call 1)
+)
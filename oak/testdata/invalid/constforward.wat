@@ -0,0 +1,5 @@
+;; initializes a global from a later one
+(module
+  (global i32 (get_global 1))
+  (global i32 (i32.const 1))
+)
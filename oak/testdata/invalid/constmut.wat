@@ -0,0 +1,5 @@
+;; initializes a global from a mutable one
+(module
+  (global (mut i32) (i32.const 1))
+  (global i32 (get_global 0))
+)
@@ -0,0 +1,4 @@
+;; initializes an i32 global with an i64
+(module
+  (global i32 (i64.const 1))
+)
@@ -0,0 +1,5 @@
+;; else outside an if
+(module
+  (func
+    else)
+)
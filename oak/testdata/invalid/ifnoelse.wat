@@ -0,0 +1,8 @@
+;; if with a result and no else
+(module
+  (func (param i32) (result i32)
+    get_local 0
+    if (result i32)
+      i32.const 1
+    end)
+)
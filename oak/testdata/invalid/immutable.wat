@@ -0,0 +1,7 @@
+;; sets an immutable global
+(module
+  (global i32 (i32.const 0))
+  (func
+    i32.const 1
+    set_global 0)
+)
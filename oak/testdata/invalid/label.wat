@@ -0,0 +1,7 @@
+;; branches to a label beyond the function block
+(module
+  (func
+    block
+      br 2
+    end)
+)
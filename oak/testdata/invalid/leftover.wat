@@ -0,0 +1,5 @@
+;; leaves a value on the stack of a function without results
+(module
+  (func
+    i32.const 1)
+)
@@ -0,0 +1,6 @@
+;; reads local 3 of a function with 3 locals
+(module
+  (func (param i32) (local i64 i64)
+    get_local 3
+    drop)
+)
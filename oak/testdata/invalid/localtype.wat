@@ -0,0 +1,5 @@
+;; returns an i64 local from a function typed to return an i32
+(module
+  (func (param i32) (result i32) (local i64 i64)
+    get_local 1)
+)
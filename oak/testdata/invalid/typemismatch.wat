@@ -0,0 +1,5 @@
+;; returns an i64 from a function typed to return an i32
+(module
+  (func (result i32)
+    i64.const 1)
+)
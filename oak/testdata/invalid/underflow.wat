@@ -0,0 +1,6 @@
+;; adds with a single operand on the stack
+(module
+  (func (result i32)
+    i32.const 1
+    i32.add)
+)
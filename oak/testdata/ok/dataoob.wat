@@ -0,0 +1,5 @@
+;; data segment crossing the end of memory
+(module
+  (memory 1 1)
+  (data (i32.const 65530) "\01\01\01\01\01\01\01\01")
+)
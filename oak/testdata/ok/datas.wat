@@ -0,0 +1,12 @@
+;; data segments for the instantiation tests.
+;;
+;; The binary has a "pad" custom section before the data section so that
+;; segment 0 starts at file offset 4096, like its memory offset 8192, and
+;; gets its whole pages mapped from the file.  Segment 0 holds 3*4096+10
+;; bytes where byte i is i % 251.
+(module
+  (memory 1 1)
+  (data (i32.const 8192) "\00\01\02...")
+  (data (i32.const 3) "\00\01\02...\63")
+  (data (i32.const 12293) "\aa\aa\aa\aa\aa\aa\aa\aa\aa\aa")
+)
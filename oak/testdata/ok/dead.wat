@@ -0,0 +1,42 @@
+;; code after unreachable, br, br_table and return is type checked against a
+;; polymorphic stack
+(module
+  (func (export "br") (param i32) (result i32)
+    block (result i32)
+      get_local 0
+      br 0
+      i32.add
+    end)
+  (func (export "unreachable") (result i32)
+    unreachable
+    i32.add
+    i32.clz)
+  (func (export "select") (result i64)
+    unreachable
+    i32.const 1
+    select)
+  (func (export "brtable") (param i32) (result i32)
+    block (result i32)
+      i32.const 7
+      get_local 0
+      br_table 0
+      i32.eqz
+    end)
+  (func (export "return") (result f64)
+    f64.const 0
+    return
+    drop
+    drop)
+  (func (export "ifelse") (param i32) (result i32)
+    get_local 0
+    if (result i32)
+      i32.const 1
+    else
+      unreachable
+    end)
+  (func (export "loop") (param i32)
+    loop
+      get_local 0
+      br_if 0
+    end)
+)
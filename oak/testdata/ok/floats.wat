@@ -0,0 +1,6 @@
+;; valid module using floats, which the jit does not support yet
+(module
+  (func (export "trunc") (result i32)
+    f32.const 1.5
+    i32.trunc_s/f32)
+)
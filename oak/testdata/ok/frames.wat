@@ -0,0 +1,24 @@
+;; functions of known frame sizes
+(module
+  ;; 6 locals, 4 values on the stack at most
+  (func (param i32 i64) (local i32 i32 i32) (local f64)
+    i32.const 1
+    i32.const 2
+    i32.const 3
+    block (result i32)
+      i32.const 4
+    end
+    i32.add
+    i32.add
+    i32.add
+    drop)
+  (func
+    nop)
+  ;; 2 values in dead code
+  (func
+    unreachable
+    i32.const 1
+    i32.const 2
+    drop
+    drop)
+)
@@ -0,0 +1,27 @@
+;; imports bound to host functions, for the host tests and benchmark
+(module
+  (import "env" "add" (func $add (param i32 i32) (result i32)))
+  (import "env" "add64" (func $add64 (param i64 i64) (result i64)))
+  (import "env" "nop" (func $nop))
+  (import "env" "mix" (func $mix (param i32 i64 i32) (result i64)))
+  (func (export "add") (param i32 i32) (result i32)
+    i32.const 1000
+    local.get 0 local.get 1 call $add
+    i32.add)
+  (func (export "add64") (param i64 i64) (result i64)
+    local.get 0 local.get 1 call $add64)
+  (func (export "mix") (param i32 i64 i32) (result i64)
+    call $nop
+    local.get 0 local.get 1 local.get 2 call $mix)
+  (func (export "sum") (param $n i32) (result i32)
+    (local $i i32) (local $acc i32)
+    block
+      loop
+        local.get $i local.get $n i32.eq br_if 1
+        local.get $acc local.get $i call $add local.set $acc
+        local.get $i i32.const 1 i32.add local.set $i
+        br 0
+      end
+    end
+    local.get $acc)
+)
@@ -0,0 +1,21 @@
+;; globals and data offsets initialized from imported globals, directly and
+;; through other globals
+(module
+  (import "env" "base" (global i32))
+  (import "env" "big" (global i64))
+  (memory 1)
+  (global i32 (get_global 0))
+  (global i32 (get_global 2))
+  (global i32 (i32.const 5))
+  (global (mut i32) (get_global 4))
+  (global i64 (get_global 1))
+  (func (export "base") (result i32)
+    get_global 3)
+  (func (export "big") (result i64)
+    get_global 6)
+  (func (export "set") (param i32)
+    get_local 0
+    set_global 5)
+  (data (get_global 3) "hi")
+  (data (get_global 4) "!")
+)
@@ -0,0 +1,260 @@
+;; compute kernels for the jit tests and benchmarks
+(module
+  (func (export "i32.add") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.add)
+  (func (export "i32.sub") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.sub)
+  (func (export "i32.mul") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.mul)
+  (func (export "i32.div_s") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.div_s)
+  (func (export "i32.div_u") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.div_u)
+  (func (export "i32.rem_s") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.rem_s)
+  (func (export "i32.rem_u") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.rem_u)
+  (func (export "i32.and") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.and)
+  (func (export "i32.or") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.or)
+  (func (export "i32.xor") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.xor)
+  (func (export "i32.shl") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.shl)
+  (func (export "i32.shr_s") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.shr_s)
+  (func (export "i32.shr_u") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.shr_u)
+  (func (export "i32.rotl") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.rotl)
+  (func (export "i32.rotr") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.rotr)
+  (func (export "i32.eq") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.eq)
+  (func (export "i32.ne") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.ne)
+  (func (export "i32.lt_s") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.lt_s)
+  (func (export "i32.lt_u") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.lt_u)
+  (func (export "i32.gt_s") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.gt_s)
+  (func (export "i32.gt_u") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.gt_u)
+  (func (export "i32.le_s") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.le_s)
+  (func (export "i32.le_u") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.le_u)
+  (func (export "i32.ge_s") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.ge_s)
+  (func (export "i32.ge_u") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.ge_u)
+  (func (export "i64.add") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.add)
+  (func (export "i64.sub") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.sub)
+  (func (export "i64.mul") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.mul)
+  (func (export "i64.div_s") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.div_s)
+  (func (export "i64.div_u") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.div_u)
+  (func (export "i64.rem_s") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.rem_s)
+  (func (export "i64.rem_u") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.rem_u)
+  (func (export "i64.and") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.and)
+  (func (export "i64.or") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.or)
+  (func (export "i64.xor") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.xor)
+  (func (export "i64.shl") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.shl)
+  (func (export "i64.shr_s") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.shr_s)
+  (func (export "i64.shr_u") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.shr_u)
+  (func (export "i64.rotl") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.rotl)
+  (func (export "i64.rotr") (param i64 i64) (result i64)
+    get_local 0 get_local 1 i64.rotr)
+  (func (export "i64.eq") (param i64 i64) (result i32)
+    get_local 0 get_local 1 i64.eq)
+  (func (export "i64.ne") (param i64 i64) (result i32)
+    get_local 0 get_local 1 i64.ne)
+  (func (export "i64.lt_s") (param i64 i64) (result i32)
+    get_local 0 get_local 1 i64.lt_s)
+  (func (export "i64.lt_u") (param i64 i64) (result i32)
+    get_local 0 get_local 1 i64.lt_u)
+  (func (export "i64.gt_s") (param i64 i64) (result i32)
+    get_local 0 get_local 1 i64.gt_s)
+  (func (export "i64.gt_u") (param i64 i64) (result i32)
+    get_local 0 get_local 1 i64.gt_u)
+  (func (export "i64.le_s") (param i64 i64) (result i32)
+    get_local 0 get_local 1 i64.le_s)
+  (func (export "i64.le_u") (param i64 i64) (result i32)
+    get_local 0 get_local 1 i64.le_u)
+  (func (export "i64.ge_s") (param i64 i64) (result i32)
+    get_local 0 get_local 1 i64.ge_s)
+  (func (export "i64.ge_u") (param i64 i64) (result i32)
+    get_local 0 get_local 1 i64.ge_u)
+  (func (export "i32.eqz") (param i32) (result i32)
+    get_local 0 i32.eqz)
+  (func (export "i64.eqz") (param i64) (result i32)
+    get_local 0 i64.eqz)
+  (func (export "i32.wrap") (param i64) (result i32)
+    get_local 0 i32.wrap/i64)
+  (func (export "i64.extend_s") (param i32) (result i64)
+    get_local 0 i64.extend_s/i32)
+  (func (export "i64.extend_u") (param i32) (result i64)
+    get_local 0 i64.extend_u/i32)
+  (func (export "select") (param i32 i32 i32) (result i32)
+    get_local 0 get_local 1 get_local 2 select)
+
+  (func $fac (export "fac") (param i64) (result i64)
+    get_local 0
+    i64.const 2
+    i64.lt_s
+    if (result i64)
+      i64.const 1
+    else
+      get_local 0
+      get_local 0
+      i64.const 1
+      i64.sub
+      call $fac
+      i64.mul
+    end)
+
+  (func $fibrec (export "fibrec") (param i32) (result i32)
+    get_local 0
+    i32.const 2
+    i32.lt_s
+    if
+      get_local 0
+      return
+    end
+    get_local 0
+    i32.const 1
+    i32.sub
+    call $fibrec
+    get_local 0
+    i32.const 2
+    i32.sub
+    call $fibrec
+    i32.add)
+
+  (func (export "fib") (param $n i32) (result i32)
+    (local $a i32) (local $b i32) (local $t i32)
+    i32.const 1
+    set_local $b
+    block
+      loop
+        get_local $n
+        i32.eqz
+        br_if 1
+        get_local $a
+        get_local $b
+        i32.add
+        set_local $t
+        get_local $b
+        set_local $a
+        get_local $t
+        set_local $b
+        get_local $n
+        i32.const 1
+        i32.sub
+        set_local $n
+        br 0
+      end
+    end
+    get_local $a)
+
+  (func (export "sum") (param $n i32) (result i64)
+    (local $i i32) (local $acc i64)
+    block
+      loop
+        get_local $i
+        get_local $n
+        i32.ge_u
+        br_if 1
+        get_local $acc
+        get_local $i
+        i64.extend_u/i32
+        i64.add
+        set_local $acc
+        get_local $i
+        i32.const 1
+        i32.add
+        set_local $i
+        br 0
+      end
+    end
+    get_local $acc)
+
+  (func (export "brif") (param i32) (result i32)
+    block (result i32)
+      i32.const 7
+      get_local 0
+      br_if 0
+      drop
+      i32.const 9
+    end)
+
+  (func (export "abs") (param i32) (result i32)
+    get_local 0
+    i32.const 0
+    i32.lt_s
+    if (result i32)
+      i32.const 0
+      get_local 0
+      i32.sub
+    else
+      get_local 0
+    end)
+
+  ;; x + 1 + 2 + ... + 16, keeping every operand on the stack
+  (func (export "deep") (param i32) (result i32)
+    get_local 0
+    i32.const 1 i32.const 2 i32.const 3 i32.const 4
+    i32.const 5 i32.const 6 i32.const 7 i32.const 8
+    i32.const 9 i32.const 10 i32.const 11 i32.const 12
+    i32.const 13 i32.const 14 i32.const 15 i32.const 16
+    i32.add i32.add i32.add i32.add i32.add i32.add i32.add i32.add
+    i32.add i32.add i32.add i32.add i32.add i32.add i32.add i32.add)
+
+  ;; 12 live values across a call: 12 * x + (x + x)
+  (func (export "spill") (param i32) (result i32)
+    get_local 0 get_local 0 get_local 0 get_local 0
+    get_local 0 get_local 0 get_local 0 get_local 0
+    get_local 0 get_local 0 get_local 0 get_local 0
+    get_local 0 get_local 0 call 0
+    i32.add i32.add i32.add i32.add i32.add i32.add
+    i32.add i32.add i32.add i32.add i32.add i32.add)
+
+  (func (export "dead") (result i32)
+    block (result i32)
+      i32.const 3
+      br 0
+      i32.const 1
+      i32.add
+    end)
+
+  (func (export "unreachable")
+    unreachable)
+
+  (func $recurse (export "recurse")
+    call $recurse)
+
+  ;; 32 KB frames, which a call count alone does not bound
+  (func $bigrecurse (export "bigrecurse")
+    (local i64) ;; x 4096
+    call $bigrecurse)
+
+  (func (export "zero") (result i64)
+    (local i64 i64 i64 i64)
+    nop
+    get_local 3)
+)
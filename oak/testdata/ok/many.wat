@@ -0,0 +1,7 @@
+;; 1000 functions returning their index, to split validation among threads
+(module
+  (func (result i32) i32.const 0)
+  (func (result i32) i32.const 1)
+  ;; ...
+  (func (result i32) i32.const 999)
+)
@@ -0,0 +1,37 @@
+;; linear memory accesses for the jit tests, one page growable to two
+(module
+  (memory 1 2)
+  (func (export "load") (param i32) (result i32)
+    get_local 0 i32.load)
+  (func (export "rw32") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.store
+    get_local 0 i32.load)
+  (func (export "rw8") (param i32 i32) (result i32)
+    i32.const 0 i32.const 0 i32.const 0
+    get_local 0 get_local 1 i32.store8
+    drop drop drop
+    get_local 0 i32.load8_s)
+  (func (export "rw16") (param i32 i32) (result i32)
+    get_local 0 get_local 1 i32.store16
+    get_local 0 i32.load16_u)
+  (func (export "rw64") (param i32 i64) (result i64)
+    get_local 0 get_local 1 i64.store
+    get_local 0 i64.load)
+  (func (export "rw32s") (param i32 i64) (result i64)
+    get_local 0 get_local 1 i64.store32
+    get_local 0 i64.load32_s)
+  (func (export "spill") (param i32 i32) (result i32)
+    i32.const 0 i32.const 0 i32.const 0 i32.const 0 i32.const 0
+    i32.const 0 i32.const 0 i32.const 0 i32.const 0
+    get_local 0 get_local 1 i32.store offset=4
+    drop drop drop drop drop drop drop drop drop
+    get_local 0 i32.load offset=4)
+  (func (export "offset") (param i32) (result i32)
+    get_local 0 i32.load offset=0xfffffff0)
+  (func (export "size") (result i32)
+    current_memory)
+  (func (export "grow") (param i32) (result i32)
+    i32.const 7 i32.const 7 i32.const 7 i32.const 7 i32.const 7
+    get_local 0 grow_memory
+    i32.add i32.add i32.add i32.add i32.add)
+)
@@ -0,0 +1,12 @@
+;; small module with every kind of instance state, for the pool tests and
+;; benchmarks
+(module
+  (memory 1 4)
+  (table 4 anyfunc)
+  (global (mut i32) (i32.const 42))
+  (global i64 (i64.const -1))
+  (global f64 (f64.const 1.5))
+  (func (export "peek") (result i32)
+    i32.const 16 i32.load)
+  (data (i32.const 16) "hello")
+)
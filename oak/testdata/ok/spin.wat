@@ -0,0 +1,9 @@
+;; code that never returns on its own, for the epoch tests
+(module
+  (func (export "spin")
+    loop
+      br 0
+    end)
+  (func (export "leaf") (result i32)
+    i32.const 1)
+)
@@ -0,0 +1,957 @@
+/*
+ * Copyright (C) Madlambda Authors
+ */
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/validate.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "bin.h"
+#include "opcodes.h"
+
+
+/*
+ * Bodies handed to a thread at a time.
+ */
+#define BATCH   16
+
+#define NONE    0xffffffff
+
+
+/* the type of values popped from the polymorphic stack of dead code */
+#define Any     0
+
+
+typedef struct {
+    u8              op;         /* OpBlock, OpLoop, OpIf or OpElse */
+    u8              arity;
+    u8              type;       /* of the result, if arity */
+    u8              unreachable;
+    u32             height;
+} Frame;
+
+
+typedef struct {
+    Module          *m;
+    const u8        *p;
+    const u8        *end;
+
+    u8              *vals;
+    Frame           *ctrls;
+    u32             nvals;
+    u32             nctrls;
+    u32             maxvals;
+
+    /*
+     * Locals as runs of the same type: local i has the type of the first
+     * run j with i < localends[j].  Params are runs of one.
+     */
+    u64             *localends;
+    u8              *localtypes;
+    u32             nruns;
+
+    u32             nfuncs;     /* size of the function index space */
+    u8              retarity;
+    u8              rettype;
+} Validator;
+
+
+typedef struct {
+    Module          *m;
+    u32             maxbody;    /* bytes */
+    u32             maxruns;
+    u32             next;       /* next body to hand out, atomic */
+    u32             failed;     /* lowest failing body so far, atomic */
+} Shared;
+
+
+typedef struct {
+    Shared          *shared;
+    pthread_t       tid;
+    u32             failed;     /* its lowest failing body, or NONE */
+    Error           *err;
+} Worker;
+
+
+static void *work(void *arg);
+static Error *validatebody(Validator *v, u32 i);
+static Error *validateop(Validator *v, u8 op);
+static Error *brtable(Validator *v);
+static Error *call(Validator *v, const TypeDecl *type);
+static Error *memop(Validator *v, u8 op);
+static Error *blocktype(Validator *v, u8 *arity, u8 *type);
+static Error *localtype(Validator *v, u8 *type);
+static Error *pushframe(Validator *v, u8 op, u8 arity, u8 type);
+static Error *popframe(Validator *v, Frame *frame);
+static Error *pop(Validator *v, u8 want, u8 *got);
+static void unreachable(Validator *v);
+static const char *typename(u8 type);
+
+
+Error *
+validatemodule(Module *m, u32 nthreads)
+{
+    u32         i, n, best;
+    u64         total;
+    long        ncpus;
+    Error       *err;
+    Shared      shared;
+    Worker      *workers;
+    CodeDecl    *code;
+    FuncDecl    *func;
+
+    if (slow(len(m->funcs) != len(m->codes))) {
+        return newerror("function and code section sizes differ (%d != %d)",
+                        len(m->funcs), len(m->codes));
+    }
+
+    memset(&shared, 0, sizeof(Shared));
+
+    shared.m = m;
+    shared.failed = NONE;
+
+    total = 0;
+
+    for (i = 0; i < len(m->codes); i++) {
+        code = arrayget(m->codes, i);
+        func = arrayget(m->funcs, i);
+
+        n = code->end - code->start + 1;
+        total += n;
+
+        if (n > shared.maxbody) {
+            shared.maxbody = n;
+        }
+
+        n = len(func->type.params) + len(code->locals);
+
+        if (n > shared.maxruns) {
+            shared.maxruns = n;
+        }
+    }
+
+    if (nthreads == 0) {
+        nthreads = 1;
+
+        if (total >= VALIDATE_PARALLEL_MIN) {
+            ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+            nthreads = (ncpus > VALIDATE_MAX_THREADS) ? VALIDATE_MAX_THREADS
+                                                      : (u32) ncpus;
+        }
+    }
+
+    if (nthreads > (len(m->codes) + BATCH - 1) / BATCH) {
+        nthreads = (len(m->codes) + BATCH - 1) / BATCH;
+    }
+
+    if (nthreads <= 1) {
+        Worker  w = {&shared, 0, NONE, NULL};
+
+        work(&w);
+        return w.err;
+    }
+
+    workers = zmalloc(sizeof(Worker) * nthreads);
+    if (slow(workers == NULL)) {
+        return newerror("failed to allocate workers: %s", strerror(errno));
+    }
+
+    for (n = 0; n < nthreads; n++) {
+        workers[n].shared = &shared;
+        workers[n].failed = NONE;
+
+        errno = pthread_create(&workers[n].tid, NULL, work, &workers[n]);
+        if (slow(errno != 0)) {
+            break;
+        }
+    }
+
+    /* those that started validate everything if some failed to */
+
+    if (slow(n == 0)) {
+        memfree(workers);
+        return newerror("failed to start validation: %s", strerror(errno));
+    }
+
+    best = 0;
+
+    for (i = 0; i < n; i++) {
+        pthread_join(workers[i].tid, NULL);
+
+        if (workers[i].failed < workers[best].failed) {
+            best = i;
+        }
+    }
+
+    err = workers[best].err;
+
+    for (i = 0; i < n; i++) {
+        if (i != best && workers[i].err != NULL) {
+            errorfree(workers[i].err);
+        }
+    }
+
+    memfree(workers);
+
+    return err;
+}
+
+
+/*
+ * Bodies are handed out in increasing order and a worker stops at its first
+ * failure, so every body below the lowest failure gets validated and that
+ * failure is reported no matter how the work was split.
+ */
+static void *
+work(void *arg)
+{
+    u32        i, start, end, failed, ncodes;
+    Error      *err;
+    Shared     *s;
+    Worker     *w;
+    Validator  v;
+
+    w = arg;
+    s = w->shared;
+
+    memset(&v, 0, sizeof(Validator));
+
+    v.m = s->m;
+    v.nfuncs = s->m->nimportfuncs + len(s->m->funcs);
+    v.vals = memalloc(s->maxbody + 1);
+    v.ctrls = memalloc(sizeof(Frame) * (s->maxbody + 1));
+    v.localends = memalloc(sizeof(u64) * (s->maxruns + 1));
+    v.localtypes = memalloc(s->maxruns + 1);
+
+    err = NULL;
+
+    if (slow(v.vals == NULL || v.ctrls == NULL || v.localends == NULL
+             || v.localtypes == NULL))
+    {
+        err = newerror("failed to allocate validator: %s", strerror(errno));
+        i = 0;
+        goto fail;
+    }
+
+    ncodes = len(s->m->codes);
+
+    for ( ;; ) {
+        start = __atomic_fetch_add(&s->next, BATCH, __ATOMIC_RELAXED);
+        if (start >= ncodes) {
+            break;
+        }
+
+        end = (ncodes - start > BATCH) ? start + BATCH : ncodes;
+
+        for (i = start; i < end; i++) {
+            if (i > __atomic_load_n(&s->failed, __ATOMIC_RELAXED)) {
+                goto done;
+            }
+
+            err = validatebody(&v, i);
+            if (slow(err != NULL)) {
+                err = error(err, "function %d", s->m->nimportfuncs + i);
+                goto fail;
+            }
+        }
+    }
+
+    goto done;
+
+fail:
+
+    w->failed = i;
+    w->err = err;
+
+    failed = __atomic_load_n(&s->failed, __ATOMIC_RELAXED);
+
+    while (i < failed
+           && !__atomic_compare_exchange_n(&s->failed, &failed, i, 0,
+                                           __ATOMIC_RELAXED,
+                                           __ATOMIC_RELAXED))
+    {
+        /* failed was reloaded */
+    }
+
+done:
+
+    memfree(v.vals);
+    memfree(v.ctrls);
+    memfree(v.localends);
+    memfree(v.localtypes);
+
+    return NULL;
+}
+
+
+static Error *
+validatebody(Validator *v, u32 i)
+{
+    u8          op;
+    u32         j, at;
+    u64         nlocals;
+    Type        *t;
+    Error       *err;
+    CodeDecl    *code;
+    FuncDecl    *func;
+    LocalEntry  *local;
+
+    code = arrayget(v->m->codes, i);
+    func = arrayget(v->m->funcs, i);
+
+    if (slow(len(func->type.rets) > 1)) {
+        return newerror("invalid result arity");
+    }
+
+    nlocals = 0;
+    v->nruns = 0;
+
+    for (j = 0; j < len(func->type.params); j++) {
+        t = arrayget(func->type.params, j);
+        if (slow(*t < I32 || *t > F64)) {
+            return newerror("invalid param type");
+        }
+
+        v->localends[v->nruns] = ++nlocals;
+        v->localtypes[v->nruns++] = *t;
+    }
+
+    for (j = 0; j < len(code->locals); j++) {
+        local = arrayget(code->locals, j);
+        if (slow(local->type < I32 || local->type > F64)) {
+            return newerror("invalid local type");
+        }
+
+        nlocals += local->count;
+
+        if (slow(nlocals > 0xffffffff)) {
+            return newerror("too many locals");
+        }
+
+        v->localends[v->nruns] = nlocals;
+        v->localtypes[v->nruns++] = local->type;
+    }
+
+    v->retarity = len(func->type.rets);
+    v->rettype = Any;
+
+    if (v->retarity > 0) {
+        v->rettype = *(Type *) arrayget(func->type.rets, 0);
+    }
+
+    v->p = code->start;
+    v->end = code->end + 1;     /* includes the final 0x0b */
+    v->nvals = 0;
+    v->nctrls = 0;
+    v->maxvals = 0;
+
+    pushframe(v, OpBlock, v->retarity, v->rettype);
+
+    while (v->nctrls > 0) {
+        if (slow(v->p >= v->end)) {
+            return newerror("unexpected end of body");
+        }
+
+        at = v->p - code->start;
+        op = *v->p++;
+
+        err = validateop(v, op);
+        if (slow(err != NULL)) {
+            return error(err, "at offset %d", at);
+        }
+
+        /* every op pops before it pushes, so the peak is between ops */
+
+        if (v->nvals > v->maxvals) {
+            v->maxvals = v->nvals;
+        }
+    }
+
+    if (slow(v->p != v->end)) {
+        return newerror("surplus bytes after body end");
+    }
+
+    code->nlocals = nlocals;
+    code->maxstack = v->maxvals;
+
+    return NULL;
+}
+
+
+static Error *
+validateop(Validator *v, u8 op)
+{
+    u8            arity, type, b;
+    u32           idx;
+    Error         *err;
+    Frame         frame;
+    TypeDecl      *ftype;
+    GlobalType    *gtype;
+    const OpInfo  *info;
+
+    switch (op) {
+    case OpUnreachable:
+        unreachable(v);
+        return NULL;
+
+    case OpNop:
+        return NULL;
+
+    case OpBlock:
+    case OpLoop:
+    case OpIf:
+        err = blocktype(v, &arity, &type);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        if (op == OpIf) {
+            err = pop(v, I32, NULL);
+            if (slow(err != NULL)) {
+                return err;
+            }
+        }
+
+        return pushframe(v, op, arity, type);
+
+    case OpElse:
+        if (slow(v->ctrls[v->nctrls - 1].op != OpIf)) {
+            return newerror("else without if");
+        }
+
+        err = popframe(v, &frame);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        return pushframe(v, OpElse, frame.arity, frame.type);
+
+    case OpEnd:
+        err = popframe(v, &frame);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        if (slow(frame.op == OpIf && frame.arity > 0)) {
+            return newerror("type mismatch: if without else has a result");
+        }
+
+        if (frame.arity > 0) {
+            v->vals[v->nvals++] = frame.type;
+        }
+
+        return NULL;
+
+    case OpBr:
+    case OpBrIf:
+        if (slow(u32vdecode((u8 **) &v->p, v->end, &idx) != OK)) {
+            return newerror("malformed branch depth");
+        }
+
+        if (slow(idx >= v->nctrls)) {
+            return newerror("unknown label %d", idx);
+        }
+
+        if (op == OpBrIf) {
+            err = pop(v, I32, NULL);
+            if (slow(err != NULL)) {
+                return err;
+            }
+        }
+
+        frame = v->ctrls[v->nctrls - 1 - idx];
+
+        if (frame.op != OpLoop && frame.arity > 0) {
+            err = pop(v, frame.type, NULL);
+            if (slow(err != NULL)) {
+                return err;
+            }
+
+            if (op == OpBrIf) {
+                v->vals[v->nvals++] = frame.type;
+            }
+        }
+
+        if (op == OpBr) {
+            unreachable(v);
+        }
+
+        return NULL;
+
+    case OpBrTable:
+        return brtable(v);
+
+    case OpReturn:
+        if (v->retarity > 0) {
+            err = pop(v, v->rettype, NULL);
+            if (slow(err != NULL)) {
+                return err;
+            }
+        }
+
+        unreachable(v);
+        return NULL;
+
+    case OpCall:
+        if (slow(u32vdecode((u8 **) &v->p, v->end, &idx) != OK)) {
+            return newerror("malformed call index");
+        }
+
+        ftype = (idx < v->nfuncs) ? functype(v->m, idx) : NULL;
+        if (slow(ftype == NULL)) {
+            return newerror("unknown function %d", idx);
+        }
+
+        return call(v, ftype);
+
+    case OpCallIndirect:
+        if (slow(u32vdecode((u8 **) &v->p, v->end, &idx) != OK
+                 || v->p >= v->end))
+        {
+            return newerror("malformed call_indirect");
+        }
+
+        if (slow(*v->p++ != 0)) {
+            return newerror("zero flag expected");
+        }
+
+        if (slow(len(v->m->tables) == 0)) {
+            return newerror("unknown table 0");
+        }
+
+        ftype = arrayget(v->m->types, idx);
+        if (slow(ftype == NULL)) {
+            return newerror("unknown type %d", idx);
+        }
+
+        err = pop(v, I32, NULL);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        return call(v, ftype);
+
+    case OpDrop:
+        return pop(v, Any, NULL);
+
+    case OpSelect:
+        err = pop(v, I32, NULL);
+        if (err == NULL) {
+            err = pop(v, Any, &type);
+        }
+
+        if (err == NULL) {
+            err = pop(v, type, &b);
+        }
+
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        v->vals[v->nvals++] = (type != Any) ? type : b;
+        return NULL;
+
+    case OpGetLocal:
+    case OpSetLocal:
+    case OpTeeLocal:
+        err = localtype(v, &type);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        if (op != OpGetLocal) {
+            err = pop(v, type, NULL);
+            if (slow(err != NULL)) {
+                return err;
+            }
+        }
+
+        if (op != OpSetLocal) {
+            v->vals[v->nvals++] = type;
+        }
+
+        return NULL;
+
+    case OpgetGlobal:
+    case OpSetGlobal:
+        if (slow(u32vdecode((u8 **) &v->p, v->end, &idx) != OK)) {
+            return newerror("malformed global index");
+        }
+
+        gtype = globaltype(v->m, idx);
+        if (slow(gtype == NULL)) {
+            return newerror("unknown global %d", idx);
+        }
+
+        if (op == OpgetGlobal) {
+            v->vals[v->nvals++] = gtype->type;
+            return NULL;
+        }
+
+        if (slow(!gtype->mut)) {
+            return newerror("global %d is immutable", idx);
+        }
+
+        return pop(v, gtype->type, NULL);
+
+    case OpCurrentMemory:
+    case OpGrowMemory:
+        if (slow(len(v->m->memories) == 0)) {
+            return newerror("unknown memory 0");
+        }
+
+        if (slow(v->p >= v->end || *v->p++ != 0)) {
+            return newerror("zero flag expected");
+        }
+
+        if (op == OpGrowMemory) {
+            err = pop(v, I32, NULL);
+            if (slow(err != NULL)) {
+                return err;
+            }
+        }
+
+        v->vals[v->nvals++] = I32;
+        return NULL;
+
+    case Opi32const:
+    case Opi64const:
+    case Opf32const:
+    case Opf64const:
+        err = skipimm((u8 **) &v->p, v->end, op);
+        if (slow(err != NULL)) {
+            return err;
+        }
+
+        v->vals[v->nvals++] = opinfo[op].out;
+        return NULL;
+    }
+
+    /* what is left has a fixed stack effect */
+
+    info = &opinfo[op];
+
+    if (slow(info->name == NULL)) {
+        return newerror("unknown opcode 0x%x", op);
+    }
+
+    if (info->imm >= ImmMem8 && info->imm <= ImmMem64) {
+        err = memop(v, op);
+        if (slow(err != NULL)) {
+            return err;
+        }
+    }
+
+    if (info->in2 != 0) {
+        err = pop(v, info->in2, NULL);
+        if (slow(err != NULL)) {
+            return err;
+        }
+    }
+
+    err = pop(v, info->in1, NULL);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    if (info->out != 0) {
+        v->vals[v->nvals++] = info->out;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Every target must take the same values as the default one.  They are
+ * compared against the first target while decoding, as the default comes
+ * last.
+ */
+static Error *
+brtable(Validator *v)
+{
+    u32    i, n, idx;
+    Error  *err;
+    Frame  *first, *target;
+
+    if (slow(u32vdecode((u8 **) &v->p, v->end, &n) != OK
+             || n > (u32) (v->end - v->p)))
+    {
+        return newerror("malformed br_table");
+    }
+
+    first = NULL;
+
+    for (i = 0; i <= n; i++) {
+        if (slow(u32vdecode((u8 **) &v->p, v->end, &idx) != OK)) {
+            return newerror("malformed br_table");
+        }
+
+        if (slow(idx >= v->nctrls)) {
+            return newerror("unknown label %d", idx);
+        }
+
+        target = &v->ctrls[v->nctrls - 1 - idx];
+
+        if (first == NULL) {
+            first = target;
+            continue;
+        }
+
+        if (slow((target->op == OpLoop ? 0 : target->arity)
+                     != (first->op == OpLoop ? 0 : first->arity)
+                 || (target->op != OpLoop && target->arity > 0
+                     && target->type != first->type)))
+        {
+            return newerror("type mismatch: br_table targets differ");
+        }
+    }
+
+    err = pop(v, I32, NULL);
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    if (first->op != OpLoop && first->arity > 0) {
+        err = pop(v, first->type, NULL);
+        if (slow(err != NULL)) {
+            return err;
+        }
+    }
+
+    unreachable(v);
+
+    return NULL;
+}
+
+
+static Error *
+call(Validator *v, const TypeDecl *type)
+{
+    u32    i;
+    Error  *err;
+
+    for (i = len(type->params); i > 0; i--) {
+        err = pop(v, *(Type *) arrayget(type->params, i - 1), NULL);
+        if (slow(err != NULL)) {
+            return err;
+        }
+    }
+
+    if (len(type->rets) > 0) {
+        v->vals[v->nvals++] = *(Type *) arrayget(type->rets, 0);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Decodes the immediates of a load or store, whose operands are popped by
+ * the caller.
+ */
+static Error *
+memop(Validator *v, u8 op)
+{
+    u32  align, offset;
+
+    if (slow(len(v->m->memories) == 0)) {
+        return newerror("unknown memory 0");
+    }
+
+    if (slow(u32vdecode((u8 **) &v->p, v->end, &align) != OK
+             || u32vdecode((u8 **) &v->p, v->end, &offset) != OK))
+    {
+        return newerror("malformed memory immediate");
+    }
+
+    /* ImmMem8 to ImmMem64 go by log2 of the natural alignment */
+
+    if (slow(align > (u32) (opinfo[op].imm - ImmMem8))) {
+        return newerror("alignment must not be larger than natural");
+    }
+
+    return NULL;
+}
+
+
+static Error *
+blocktype(Validator *v, u8 *arity, u8 *type)
+{
+    u8  b;
+
+    if (slow(v->p >= v->end)) {
+        return newerror("malformed block type");
+    }
+
+    b = *v->p++;
+
+    if (b == Emptyblock) {
+        *arity = 0;
+        *type = Any;
+        return NULL;
+    }
+
+    /* 0x7f is i32 down to 0x7c for f64, as -I32 to -F64 in a byte */
+
+    if (slow(b < 0x7c || b > 0x7f)) {
+        return newerror("invalid block type 0x%x", b);
+    }
+
+    *arity = 1;
+    *type = 0x80 - b;
+
+    return NULL;
+}
+
+
+static Error *
+localtype(Validator *v, u8 *type)
+{
+    u32  idx, lo, hi, mid;
+
+    if (slow(u32vdecode((u8 **) &v->p, v->end, &idx) != OK)) {
+        return newerror("malformed local index");
+    }
+
+    if (slow(v->nruns == 0 || idx >= v->localends[v->nruns - 1])) {
+        return newerror("unknown local %d", idx);
+    }
+
+    lo = 0;
+    hi = v->nruns - 1;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+
+        if (idx < v->localends[mid]) {
+            hi = mid;
+
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    *type = v->localtypes[lo];
+
+    return NULL;
+}
+
+
+/*
+ * Stacks hold at most one entry per body byte, as every op pushing without
+ * popping has at least that size, so they never overflow.
+ */
+static Error *
+pushframe(Validator *v, u8 op, u8 arity, u8 type)
+{
+    Frame  *frame;
+
+    frame = &v->ctrls[v->nctrls++];
+
+    frame->op = op;
+    frame->arity = arity;
+    frame->type = type;
+    frame->unreachable = 0;
+    frame->height = v->nvals;
+
+    return NULL;
+}
+
+
+static Error *
+popframe(Validator *v, Frame *frame)
+{
+    Error  *err;
+
+    *frame = v->ctrls[v->nctrls - 1];
+
+    if (frame->arity > 0) {
+        err = pop(v, frame->type, NULL);
+        if (slow(err != NULL)) {
+            return err;
+        }
+    }
+
+    if (slow(v->nvals != frame->height)) {
+        return newerror("type mismatch: %d values left in block",
+                        v->nvals - frame->height);
+    }
+
+    v->nctrls--;
+
+    return NULL;
+}
+
+
+static Error *
+pop(Validator *v, u8 want, u8 *got)
+{
+    u8     type;
+    Frame  *frame;
+
+    frame = &v->ctrls[v->nctrls - 1];
+
+    if (v->nvals > frame->height) {
+        type = v->vals[--v->nvals];
+
+    } else if (fast(frame->unreachable)) {
+        type = want;
+
+    } else {
+        return newerror("type mismatch: expected %s, stack is empty",
+                        typename(want));
+    }
+
+    if (slow(want != Any && type != Any && type != want)) {
+        return newerror("type mismatch: expected %s, got %s", typename(want),
+                        typename(type));
+    }
+
+    if (got != NULL) {
+        *got = type;
+    }
+
+    return NULL;
+}
+
+
+static void
+unreachable(Validator *v)
+{
+    Frame  *frame;
+
+    frame = &v->ctrls[v->nctrls - 1];
+
+    v->nvals = frame->height;
+    frame->unreachable = 1;
+}
+
+
+static const char *
+typename(u8 type)
+{
+    switch (type) {
+    case I32:
+        return "i32";
+
+    case I64:
+        return "i64";
+
+    case F32:
+        return "f32";
+
+    case F64:
+        return "f64";
+    }
+
+    return "any";
+}
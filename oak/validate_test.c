@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) Madlambda Authors.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <acorn.h>
+#include <acorn/array.h>
+#include <oak/module.h>
+#include <oak/validate.h>
+#include "test.h"
+
+
+typedef struct {
+    const char  *filename;
+    const char  *err;
+} Testcase;
+
+
+static Error *test_invalid(const Testcase *tc);
+static Error *test_threads(void);
+static Error *test_frames(void);
+static Error *validatebroken(Module *m, const u32 *broken, u32 n, u32 want);
+
+
+static const Testcase  cases[] = {
+    {
+        "testdata/ok/dead.wasm",
+        NULL,
+    },
+    {
+        "testdata/ok/kernels.wasm",
+        NULL,
+    },
+    {
+        "testdata/invalid/typemismatch.wasm",
+        "type mismatch: expected i32, got i64",
+    },
+    {
+        "testdata/invalid/underflow.wasm",
+        "type mismatch: expected i32, stack is empty",
+    },
+    {
+        "testdata/invalid/leftover.wasm",
+        "type mismatch: 1 values left in block",
+    },
+    {
+        "testdata/invalid/label.wasm",
+        "unknown label 2",
+    },
+    {
+        "testdata/invalid/local.wasm",
+        "unknown local 3",
+    },
+    {
+        "testdata/invalid/localtype.wasm",
+        "type mismatch: expected i32, got i64",
+    },
+    {
+        "testdata/invalid/immutable.wasm",
+        "global 0 is immutable",
+    },
+    {
+        "testdata/invalid/ifnoelse.wasm",
+        "type mismatch: if without else has a result",
+    },
+    {
+        "testdata/invalid/brtable.wasm",
+        "type mismatch: br_table targets differ",
+    },
+    {
+        "testdata/invalid/nomemory.wasm",
+        "unknown memory 0",
+    },
+    {
+        "testdata/invalid/align.wasm",
+        "alignment must not be larger than natural",
+    },
+    {
+        "testdata/invalid/call.wasm",
+        "unknown function 1",
+    },
+    {
+        "testdata/invalid/else.wasm",
+        "else without if",
+    },
+};
+
+
+/* i64.const 1 in functions returning i32 */
+static const u8  badbody[] = {0x42, 0x01, 0x0b};
+
+
+int
+main()
+{
+    u32    i;
+    Error  *err;
+
+    fmtadd('e', errorfmt);
+
+    for (i = 0; i < nitems(cases); i++) {
+        err = test_invalid(&cases[i]);
+        if (slow(err != NULL)) {
+            goto fail;
+        }
+    }
+
+    err = test_threads();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    err = test_frames();
+    if (slow(err != NULL)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+
+    cprint("[error] %e\n", err);
+    errorfree(err);
+    return 1;
+}
+
+
+static Error *
+test_invalid(const Testcase *tc)
+{
+    Error   *err;
+    Module  *m;
+
+    err = loadmodule(&m, tc->filename);
+    if (err == NULL) {
+        closemodule(m);
+
+        if (slow(tc->err != NULL)) {
+            return newerror("%s: expected error \"%s\"", tc->filename,
+                            tc->err);
+        }
+
+        return NULL;
+    }
+
+    if (slow(tc->err == NULL)) {
+        return error(err, "%s must load", tc->filename);
+    }
+
+    if (slow(!iserror(err, tc->err))) {
+        return error(err, "%s: expected error \"%s\"", tc->filename, tc->err);
+    }
+
+    errorfree(err);
+
+    return NULL;
+}
+
+
+/*
+ * Whatever the thread count, the lowest broken body is the one reported.
+ * Bodies are broken from the top down, so the last one is the lowest.
+ */
+static Error *
+test_threads(void)
+{
+    u32     i;
+    Error   *err;
+    Module  *m;
+
+    static const u32  broken[] = {998, 517, 101, 100};
+
+    err = loadmodule(&m, "testdata/ok/many.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    err = validatemodule(m, VALIDATE_MAX_THREADS);
+    if (slow(err != NULL)) {
+        err = error(err, "many.wasm must validate on threads");
+        goto done;
+    }
+
+    for (i = 0; i < nitems(broken); i++) {
+        err = validatebroken(m, broken, i + 1, broken[i]);
+        if (slow(err != NULL)) {
+            break;
+        }
+    }
+
+done:
+
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+test_frames(void)
+{
+    u32       i;
+    Error     *err;
+    Module    *m;
+    CodeDecl  *code;
+
+    static const u32  want[][2] = {{6, 4}, {0, 0}, {0, 2}};
+
+    err = loadmodule(&m, "testdata/ok/frames.wasm");
+    if (slow(err != NULL)) {
+        return err;
+    }
+
+    for (i = 0; i < nitems(want); i++) {
+        code = arrayget(m->codes, i);
+
+        if (slow(code->nlocals != want[i][0]
+                 || code->maxstack != want[i][1]))
+        {
+            err = newerror("function %d: frame of %d locals and %d values, "
+                           "expected %d and %d", i, code->nlocals,
+                           code->maxstack, want[i][0], want[i][1]);
+            break;
+        }
+    }
+
+    closemodule(m);
+
+    return err;
+}
+
+
+static Error *
+validatebroken(Module *m, const u32 *broken, u32 n, u32 want)
+{
+    u32          i, run, nthreads;
+    char         msg[32];
+    Error        *err;
+    CodeDecl     *code;
+    CodeDecl     saved[4];
+
+    for (i = 0; i < n; i++) {
+        code = arrayget(m->codes, broken[i]);
+        saved[i] = *code;
+        code->start = badbody;
+        code->end = badbody + sizeof(badbody) - 1;
+    }
+
+    snprintf(msg, sizeof(msg), "function %u", want);
+
+    err = NULL;
+
+    for (run = 0; run < 20 && err == NULL; run++) {
+        for (nthreads = 1; nthreads <= VALIDATE_MAX_THREADS; nthreads++) {
+            err = validatemodule(m, nthreads);
+            if (slow(err == NULL)) {
+                err = newerror("%d threads: broken body %d validated",
+                               nthreads, want);
+                break;
+            }
+
+            if (slow(!iserror(err, msg))) {
+                err = error(err, "%d threads: expected \"%s\"", nthreads,
+                            msg);
+                break;
+            }
+
+            errorfree(err);
+            err = NULL;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        *(CodeDecl *) arrayget(m->codes, broken[i]) = saved[i];
+    }
+
+    return err;
+}